@@ -0,0 +1,10 @@
+@echo off
+rem compile.bat
+rem
+rem Compiles every compute shader to SPIR-V next to its source, which is where the application looks when it's
+rem started from the project directory (see shaderDirectory in src/shader-module.h). Needs glslc from the Vulkan SDK.
+
+cd /d "%~dp0"
+for %%f in (*.comp) do (
+    "%VULKAN_SDK%\Bin\glslc.exe" -O "%%f" -o "%%~nf.spv" || exit /b 1
+)
@@ -0,0 +1,164 @@
+// app-config.cpp
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "app-config.h"
+
+static bool envFlag(const char* name) {
+
+    // Treats any value other than empty or "0" as enabled, so VKTEST_HEADLESS=1 and VKTEST_HEADLESS=yes both work
+    const char* value = std::getenv(name);
+    return value != nullptr && value[0] != '\0' && std::strcmp(value, "0") != 0;
+}
+
+static uint32_t parseCount(const std::string& option, const char* value) {
+
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(value, &end, 10);
+
+    if (end == value || *end != '\0' || parsed == 0) {
+        throw std::runtime_error("invalid value for " + option + ": " + value);
+    }
+    return static_cast<uint32_t>(parsed);
+}
+
+static void parseFrameWindow(const char* value, ValidationSettings& validation) {
+
+    // "<first>-<last>", either end may be left out: "100-", "-50"
+    std::string window = value;
+    size_t dash = window.find('-');
+    if (dash == std::string::npos) {
+        throw std::runtime_error(std::string("invalid frame window: ") + value + " (expected <first>-<last>)");
+    }
+
+    try {
+        std::string first = window.substr(0, dash), last = window.substr(dash + 1);
+        validation.firstFrame = first.empty() ? 0 : std::stoull(first);
+        validation.lastFrame = last.empty() ? UINT64_MAX : std::stoull(last);
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error(std::string("invalid frame window: ") + value + " (expected <first>-<last>)");
+    }
+    if (validation.lastFrame < validation.firstFrame) {
+        throw std::runtime_error(std::string("invalid frame window: ") + value + " (last frame before first)");
+    }
+}
+
+static uint32_t parseFeatures(const char* value) {
+
+    uint32_t features = parseValidationFeatures(value);
+    if (features == 0) {
+        throw std::runtime_error(std::string("invalid validation features: ") + value + " (expected best-practices, sync and/or gpu-assisted)");
+    }
+    return features;
+}
+
+static FramePacing parsePacing(const char* value) {
+
+    for (FramePacing pacing : { FramePacing::Uncapped, FramePacing::FixedRate, FramePacing::EventDriven }) {
+        if (std::strcmp(value, framePacingName(pacing)) == 0) {
+            return pacing;
+        }
+    }
+    throw std::runtime_error(std::string("invalid value for --pacing: ") + value + " (expected uncapped, fixed or idle)");
+}
+
+static PresentPreference parsePresentMode(const char* value) {
+
+    for (PresentPreference mode : { PresentPreference::Mailbox, PresentPreference::Immediate, PresentPreference::FifoRelaxed, PresentPreference::Fifo }) {
+        if (std::strcmp(value, presentPreferenceName(mode)) == 0) {
+            return mode;
+        }
+    }
+    throw std::runtime_error(std::string("invalid value for --present-mode: ") + value + " (expected mailbox, immediate, relaxed or fifo)");
+}
+
+AppConfig parseAppConfig(int argc, char** argv) {
+
+    AppConfig config;
+    config.headless = envFlag("VKTEST_HEADLESS");
+    config.shaderHotReload = envFlag("VKTEST_SHADER_HOT_RELOAD");
+    if (const char* profilePath = std::getenv("VKTEST_PROFILE")) {
+        config.profilePath = profilePath;
+    }
+
+    // Unlike VKTEST_HEADLESS this one can also turn something off, so unset and "0" mean different things
+    if (std::getenv("VKTEST_VALIDATION") != nullptr) {
+        config.validation.enabled = envFlag("VKTEST_VALIDATION");
+    }
+    if (const char* features = std::getenv("VKTEST_VALIDATION_FEATURES")) {
+        config.validation.features = parseFeatures(features);
+        config.validation.enabled = true;
+    }
+    if (const char* window = std::getenv("VKTEST_VALIDATE_FRAMES")) {
+        parseFrameWindow(window, config.validation);
+    }
+    bool pacingGiven = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        // Flags like --headless stand alone, every other option takes a value, so grab it up front and complain if it's missing
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--headless") { config.headless = true; }
+        else if (arg == "--frames") { config.frameCount = parseCount(arg, next()); }
+        else if (arg == "--resize-every") { config.resizeEvery = parseCount(arg, next()); }
+        else if (arg == "--width") { config.width = parseCount(arg, next()); }
+        else if (arg == "--height") { config.height = parseCount(arg, next()); }
+        else if (arg == "--pacing") { config.pacing = parsePacing(next()); pacingGiven = true; }
+        else if (arg == "--fps") { config.targetFps = parseCount(arg, next()); }
+        else if (arg == "--present-mode") { config.swapchain.presentMode = parsePresentMode(next()); }
+        else if (arg == "--buffering") { config.swapchain.imageCount = parseCount(arg, next()); }
+        else if (arg == "--frames-in-flight") { config.swapchain.framesInFlight = parseCount(arg, next()); }
+        else if (arg == "--cold-pipeline-cache") { config.coldPipelineCache = true; }
+        else if (arg == "--default-host-allocator") { config.hostAllocator = false; }
+        else if (arg == "--threads") { config.workerThreads = parseCount(arg, next()); }
+        else if (arg == "--record-benchmark") { config.recordBenchmarkDraws = parseCount(arg, next()); }
+        else if (arg == "--compute-benchmark") { config.computeBenchmarkElements = parseCount(arg, next()); }
+        else if (arg == "--cull-benchmark") { config.cullBenchmarkInstances = parseCount(arg, next()); }
+        else if (arg == "--mesh-benchmark") { config.meshBenchmarkFile = next(); }
+        else if (arg == "--texture-benchmark") { config.textureBenchmarkTextures = parseCount(arg, next()); }
+        else if (arg == "--startup-benchmark") { config.startupBenchmarkRuns = parseCount(arg, next()); }
+        else if (arg == "--benchmark") { config.benchmarkOutput = next(); }
+        else if (arg == "--texture-budget") { config.textureStreaming.budget = VkDeviceSize(parseCount(arg, next())) << 20; }
+        else if (arg == "--texture-loader-threads") { config.textureStreaming.loaderThreads = parseCount(arg, next()); }
+        else if (arg == "--shader-hot-reload") { config.shaderHotReload = true; }
+        else if (arg == "--profile") { config.profilePath = next(); }
+        else if (arg == "--validation") { config.validation.enabled = true; }
+        else if (arg == "--no-validation") { config.validation.enabled = false; }
+        else if (arg == "--validation-features") { config.validation.features = parseFeatures(next()); config.validation.enabled = true; }
+        else if (arg == "--validate-every") { config.validation.every = parseCount(arg, next()); }
+        else if (arg == "--validate-frames") { parseFrameWindow(next(), config.validation); }
+        else if (arg == "--validation-severity") {
+            const char* value = next();
+            config.validation.filter.severities = parseValidationSeverity(value);
+            if (config.validation.filter.severities == 0) {
+                throw std::runtime_error(std::string("invalid value for --validation-severity: ") + value + " (expected verbose, info, warning or error)");
+            }
+        }
+        else if (arg == "--validation-types") {
+            const char* value = next();
+            config.validation.filter.types = parseValidationTypes(value);
+            if (config.validation.filter.types == 0) {
+                throw std::runtime_error(std::string("invalid value for --validation-types: ") + value + " (expected general, validation and/or performance)");
+            }
+        }
+        else {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (config.headless && !pacingGiven) {
+        config.pacing = FramePacing::Uncapped;
+    }
+
+    return config;
+}
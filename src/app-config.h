@@ -0,0 +1,135 @@
+// app-config.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "frame-scheduler.h"
+#include "swapchain.h"
+#include "texture-streamer.h"
+#include "debugger.h"
+
+// Runtime options for the Application. These are filled in from the command line (and, where noted, the
+// environment) by parseAppConfig in app-config.cpp, so the same binary can run on a desktop or on a build box.
+
+struct AppConfig {
+	// Headless mode skips GLFW entirely. Presentation goes through VK_EXT_headless_surface when the loader
+	// offers it, otherwise frames are rendered into a plain offscreen image. Useful with a software ICD such
+	// as lavapipe or SwiftShader (select it with VK_DRIVER_FILES / VK_ICD_FILENAMES).
+	bool headless = false;
+
+	// Number of frames to render before exiting in headless mode. Windowed runs ignore this.
+	uint32_t frameCount = 600;
+
+	// When non-zero, headless runs change the render size every this many frames, the way dragging a window's
+	// corner would, to exercise swap chain recreation. Windowed runs ignore this. See resize.cpp.
+	uint32_t resizeEvery = 0;
+
+	uint32_t width = 800;
+	uint32_t height = 600;
+
+	// See frame-scheduler.h. Headless runs default to Uncapped since they exist to measure raw frame cost.
+	FramePacing pacing = FramePacing::FixedRate;
+	double targetFps = 60.0;
+
+	// Present mode, buffering and frames in flight. See swapchain.h.
+	SwapchainSettings swapchain;
+
+	// Start with an empty pipeline cache even if one is on disk, to measure cold startup. See pipeline-cache.h.
+	bool coldPipelineCache = false;
+
+	// Route driver host allocations through our own VkAllocationCallbacks. See host-allocator.h.
+	bool hostAllocator = true;
+
+	// Upper bound on recording threads, 0 = one per hardware thread. See job-system.h.
+	uint32_t workerThreads = 0;
+
+	// When non-zero, run the command recording benchmark with this many draws instead of the frame loop.
+	// See record-benchmark.cpp.
+	uint32_t recordBenchmarkDraws = 0;
+
+	// When non-zero, run the compute kernels on this many values, on the GPU and the CPU, instead of the frame
+	// loop. See compute-benchmark.cpp.
+	uint32_t computeBenchmarkElements = 0;
+
+	// When non-zero, cull this many instances on the CPU and the GPU, instead of the frame loop. See cull-benchmark.cpp.
+	uint32_t cullBenchmarkInstances = 0;
+
+	// When set, load this .vkmesh file over and over, mapped and read the old way, and report how fast instead of
+	// running the frame loop. "generated" loads a generated test scene. See mesh-benchmark.cpp.
+	std::string meshBenchmarkFile;
+
+	// When non-zero, stream this many generated textures through the texture streamer and report how fast instead of
+	// running the frame loop. See texture-benchmark.cpp.
+	uint32_t textureBenchmarkTextures = 0;
+
+	// When non-zero, start up this many times, each up to the first frame, and report how long it took instead of
+	// running normally. The first run ignores the pipeline cache. See startup-benchmark.cpp.
+	uint32_t startupBenchmarkRuns = 0;
+
+	// When set, run the benchmark suite and write its results here as JSON instead of running normally.
+	// See benchmark-suite.cpp.
+	std::string benchmarkOutput;
+
+	// Texture memory budget and loader threads. See texture-streamer.h.
+	TextureStreamingSettings textureStreaming;
+
+	// Watch loaded shaders and rebuild whatever uses them when they change on disk (Linux only). See shader-library.h.
+	bool shaderHotReload = false;
+
+	// When set, CPU and GPU zones are recorded and written here as a Chrome trace on exit. See profiler.h.
+	std::string profilePath;
+
+	// Layers, extra validation features, which messages to report and on which frames. See debugger.h.
+	ValidationSettings validation;
+};
+
+// Accepts:
+//   --headless            same as setting VKTEST_HEADLESS=1
+//   --frames <n>          frame count for headless runs
+//   --resize-every <n>    headless runs: resize the render target every n frames
+//   --width <n>           window / render target width
+//   --height <n>          window / render target height
+//   --pacing <policy>     uncapped, fixed or idle (see FramePacing)
+//   --fps <n>             target rate for fixed pacing, and the wake-up rate for idle pacing
+//   --present-mode <m>    mailbox, immediate, relaxed or fifo (see PresentPreference)
+//   --buffering <n>       swap chain images, 2 for double buffering or 3 for triple
+//   --frames-in-flight <n>
+//   --cold-pipeline-cache ignore the pipeline cache on disk for this run
+//   --default-host-allocator
+//                         pass nullptr for pAllocator and let the driver use malloc, for comparison
+//   --threads <n>         most threads to record with
+//   --record-benchmark <draws>
+//                         time parallel command recording at 1, 2, 4, ... threads, then exit
+//   --compute-benchmark <elements>
+//                         time reduce, scan, histogram and radix sort on the GPU and the CPU, then exit
+//   --cull-benchmark <instances>
+//                         time frustum culling and draw batching on the CPU and the GPU, then exit
+//   --mesh-benchmark <file.vkmesh>
+//                         time loading a mesh file onto the GPU, mapped and read, then exit ("generated" for a test scene)
+//   --texture-benchmark <textures>
+//                         time streaming generated textures in, all of them and then a moving window, then exit
+//   --startup-benchmark <runs>
+//                         time startup to the first frame, cold and then warm, then exit
+//   --benchmark <results.json>
+//                         run the benchmark suite, write the results as JSON, then exit
+//   --texture-budget <MiB>
+//                         device memory streamed textures may take, default a quarter of the largest device-local heap
+//   --texture-loader-threads <n>
+//                         threads reading texture mips from disk
+//   --shader-hot-reload   same as setting VKTEST_SHADER_HOT_RELOAD=1
+//   --profile <trace.json>
+//                         same as setting VKTEST_PROFILE=<trace.json>
+//   --validation          same as setting VKTEST_VALIDATION=1, on by default in debug builds
+//   --no-validation       same as setting VKTEST_VALIDATION=0
+//   --validation-features <list>
+//                         same as VKTEST_VALIDATION_FEATURES, comma separated: best-practices, sync, gpu-assisted.
+//                         Turns validation on.
+//   --validate-every <n>  only validate every nth frame
+//   --validate-frames <first>-<last>
+//                         same as VKTEST_VALIDATE_FRAMES, only validate frames in this (inclusive) window
+//   --validation-severity <s>
+//                         verbose, info, warning (default) or error, each including the ones after it
+//   --validation-types <list>
+//                         comma separated: general, validation, performance (default all three)
+AppConfig parseAppConfig(int argc, char** argv);
@@ -7,14 +7,75 @@
 #include "include.h"
 #include "application.h"
 #include "debugger.h"
+#include "frame-scheduler.h"
+#include "profiler.h"
+#include "startup-timer.h"
 
 const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 
+Application::Application(const AppConfig& config)
+    : WIDTH(config.width),
+      HEIGHT(config.height),
+      headless(config.headless),
+      frameCount(config.frameCount),
+      resizeEvery(config.resizeEvery),
+      pacing(config.pacing),
+      targetFps(config.targetFps),
+      swapchainSettings(config.swapchain),
+      coldPipelineCache(config.coldPipelineCache),
+      workerThreads(config.workerThreads),
+      recordBenchmarkDraws(config.recordBenchmarkDraws),
+      computeBenchmarkElements(config.computeBenchmarkElements),
+      cullBenchmarkInstances(config.cullBenchmarkInstances),
+      meshBenchmarkFile(config.meshBenchmarkFile),
+      textureBenchmarkTextures(config.textureBenchmarkTextures),
+      textureStreaming(config.textureStreaming),
+      profilePath(config.profilePath),
+      shaderHotReload(config.shaderHotReload),
+      startupBenchmark(config.startupBenchmarkRuns > 0),
+      validation(config.validation),
+      enableValidationLayers(config.validation.enabled),
+      hostAllocator(config.hostAllocator) {}
+
+Application::~Application() {
+
+    // Does nothing after cleanup(). Otherwise something threw on the way, and whatever got created goes, in order.
+    teardown();
+}
+
 void Application::run() {
 
-    initWindow();
+    // First thing, so startup is in the trace too
+    if (!profilePath.empty()) {
+        profiler.enable(profilePath);
+    }
+
+    startupTimer.begin();
+
+    // Headless runs have no window at all, so GLFW is never initialized. See headless.cpp. The window itself is
+    // created in initVulkan, alongside the instance.
+    if (!headless) {
+        initGlfw();
+    }
     Application::initVulkan();
-    mainLoop();
+    if (recordBenchmarkDraws > 0) {
+        runRecordBenchmark();
+    }
+    else if (computeBenchmarkElements > 0) {
+        runComputeBenchmark();
+    }
+    else if (cullBenchmarkInstances > 0) {
+        runCullBenchmark();
+    }
+    else if (!meshBenchmarkFile.empty()) {
+        runMeshBenchmark();
+    }
+    else if (textureBenchmarkTextures > 0) {
+        runTextureBenchmark();
+    }
+    else {
+        mainLoop();
+    }
     cleanup();
 
 }
@@ -24,11 +85,22 @@ std::vector<const char*> Application::getRequiredExtensions() {
     // Setting up a debug messenger to handle debug messages explicitly rather than letting
     // Vulkan implicitly handle them (Vulkan is poopoo at debug messages by default, lump phao)
 
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    std::vector<const char*> extensions;
 
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    if (headless) {
+
+        // Without GLFW there's nobody to tell us which surface extensions are needed. VK_EXT_headless_surface
+        // only needs the base surface extension, and if it isn't available we render offscreen with no surface.
+
+        if (useHeadlessSurface) {
+            extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+            extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+        }
+    }
+    else {
+        // Asked for once in initGlfw, since this runs on the instance thread
+        extensions = windowExtensions;
+    }
 
     // Enables the VK_EXT_debug_utils extension if validation layers are enabled
 
@@ -36,15 +108,36 @@ std::vector<const char*> Application::getRequiredExtensions() {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
+    // Provided by the validation layer itself, and needed for VkValidationFeaturesEXT
+    if (useValidationFeatures) {
+        extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+    }
+
     return extensions;
 }
 
+void Application::initGlfw() {
+
+    STARTUP_STAGE(startupTimer, "glfwInit");
+
+    if (glfwInit() != GLFW_TRUE) {
+        throw std::runtime_error("failed to initialize GLFW!");
+    }
+
+    // Needs glfwInit, and has to be known before the instance can be created. The strings belong to GLFW.
+    uint32_t glfwExtensionCount = 0;
+    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    windowExtensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+}
+
 void Application::initWindow() {
 
-    glfwInit();
+    STARTUP_STAGE(startupTimer, "initWindow");
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);          // Specifies that GLFW will not use an OpenGL context
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+    // Resizes rebuild the swap chain between frames, without waiting for the ones in flight. See resize.cpp
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     window = glfwCreateWindow(WIDTH, HEIGHT,
         "Vulkan",    // Window title
@@ -52,27 +145,137 @@ void Application::initWindow() {
         nullptr      // Relevant only to OpenGL
     );
 
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+
 }
 
 void Application::mainLoop() {
 
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+    if (headless) {
+        headlessLoop();
+        return;
+    }
+
+    // Polling events in a bare loop keeps a core pegged at 100% even when nothing changes on screen. The scheduler
+    // decides how to spend the gap between frames instead, and handles the event pumping as part of that.
+
+    FrameScheduler scheduler(pacing, targetFps, true);
+
+    // The startup benchmark only needs the first frame
+    while (!glfwWindowShouldClose(window) && !(startupBenchmark && startupTimer.hasFirstFrame())) {
+        scheduler.beginFrame();
+        beginValidationFrame();
+        drawFrame();
+        startupTimer.markFirstFrame();
+        validationSink.endFrame();
+        scheduler.endFrame();
     }
+
+    // Frames may still be in flight, and nothing they use can be destroyed until they're done
+    vkDeviceWaitIdle(device);
+
+    scheduler.report(std::cout);
+    swapchain.report(std::cout);
+    reportResizes(std::cout);
+    uploadRing.report(std::cout);
+    allocator.report(std::cout);
 }
 
 void Application::cleanup() {
 
-    vkDestroyDevice(device, nullptr);
+    // Reports first, while everything they read is still there
+    deferred.report(std::cout);
+    renderGraph.report(std::cout);
+    textures.report(std::cout);
+    bindless.report(std::cout);
+    frameDescriptors.report(std::cout, "Frame");
+    culler.report(std::cout);
+    compute.report(std::cout);
+    shaders.report(std::cout);
+
+    // Written back on every clean exit, so whatever got compiled this run is free next time
+    pipelineCache.save();
+    pipelineCache.report(std::cout);
 
-    // All children of an instance must be destroyed before that instance is destroyed
+    teardown();
+
+    // After teardown, since destroying the instance can still raise messages
     if (enableValidationLayers) {
-        Application::DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        validationSink.report(std::cout);
+        if (!validation.validatesEveryFrame()) {
+            std::cout << "    validated " << validatedFrames << " of " << validationFrame << " frames\n";
+        }
+    }
+
+    // After the instance is gone, so anything still live is memory the driver never gave back
+    hostAllocator.report(std::cout);
+
+    if (startupTimer.hasFirstFrame()) {
+        startupTimer.report(std::cout);
+        std::cout << "    " << enumerations.enumerations() << " layer and extension lists enumerated, "
+            << enumerations.hits() << " lookups answered from the cache\n";
     }
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    vkDestroyInstance(instance, nullptr);
-    
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    profiler.report(std::cout);
+    profiler.writeChromeTrace();
+}
+
+void Application::teardown() {
+
+    // Every destroy below does nothing if its create never ran, and nothing the second time, so this works after a
+    // partial startup and again from the destructor
+    if (device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(device);
+    }
+
+    // The device is idle, so everything still waiting goes now, while the allocator and bindless table it goes back
+    // to are still here
+    deferred.destroy();
+
+    swapchain.destroy();
+    destroyOffscreenTarget();
+
+    renderGraph.destroy();
+
+    // Before the bindless table, since it hands back its images' slots
+    textures.destroy();
+    bindless.destroy();
+    frameSetLayout.reset();
+    frameDescriptors.destroy();
+    frameArena.destroy(allocator);
+    culler.destroy();
+
+    // The cache keeps what the kernels' pipelines compiled to after the pipelines themselves are gone
+    kernels.destroy();
+    compute.destroy();
+    shaders.destroy();
+    pipelineCache.destroy();
+
+    uploadRing.destroy();
+
+    // Collects the last frames' timestamps, so it has to come after the wait idle
+    profiler.destroyGpu();
+
+    // Every resource placed by the allocator is gone by now, so this only returns the blocks themselves
+    allocator.destroy();
+
+    device.reset();
+
+    // All children of an instance must be destroyed before that instance is destroyed. The messenger may already
+    // be gone if the last frame was outside the validation schedule, which reset() doesn't mind.
+    debugMessenger.reset();
+    surface.reset();
+    instance.reset();
+
+    // Destroying the instance can still raise messages, so the sink stops after it
+    validationSink.stop();
+
+    if (!headless) {
+        if (window != nullptr) {
+            glfwDestroyWindow(window);
+            window = nullptr;
+        }
+        glfwTerminate();
+    }
 }
\ No newline at end of file
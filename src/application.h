@@ -3,30 +3,167 @@
 #pragma once
 
 #include "queue-family-indices.h"
+#include "app-config.h"
+#include "swapchain.h"
+#include "pipeline-cache.h"
+#include "device-allocator.h"
+#include "host-allocator.h"
+#include "upload-ring.h"
+#include "shader-library.h"
+#include "compute.h"
+#include "bindless-table.h"
+#include "deferred-destruction.h"
+#include "texture-streamer.h"
+#include "frame-descriptor-pools.h"
+#include "render-graph.h"
+#include "compute-kernels.h"
+#include "instance-culling.h"
+#include "validation-sink.h"
+#include "device-capabilities.h"
+#include "enumeration-cache.h"
+#include "startup-timer.h"
+#include "frame-stats.h"
+#include "vulkan-handle.h"
+#include <string>
 #include <vector>
 
+// Device extensions every physical device must support when there's a surface to present to
+extern const std::vector<const char*> deviceExtensions;
+
+class BenchmarkResults;
+
+// One kernel's row in the compute benchmark, see compute-benchmark.cpp. The culling benchmark uses them too.
+struct ComputeKernelTiming {
+	std::string kernel;
+	FrameStats cpu;
+	FrameStats gpu;                         // No samples when the GPU kernels aren't available
+	bool matches;                           // The GPU gave exactly the CPU's result
+};
+
+// One way of loading a mesh file in the mesh loader benchmark, see mesh-benchmark.cpp
+struct MeshLoadTiming {
+	std::string method;
+	FrameStats load;                        // Opening the file to every mesh on the GPU
+	FrameStats firstDraw;                   // Opening the file to the first mesh on the GPU
+};
+
 class Application {
 
 public:
 
+	explicit Application(const AppConfig& config);
+	~Application();                         // Tears down whatever run() got to, if it threw
+
 	void run();
 
+	// Runs the Application config.startupBenchmarkRuns times up to its first frame and reports cold and warm
+	// startup times. See startup-benchmark.cpp.
+	static void runStartupBenchmark(const AppConfig& config);
+
+	const StartupTimer& startup() const { return startupTimer; }
+
+	// What a run handed to the deferred destruction queue, and how many times it rebuilt its render target. Read by
+	// the headless-resize test after run().
+	const DeferredDestruction& deferredDestruction() const { return deferred; }
+	uint64_t resizes() const { return resizesApplied; }
+
+	// Runs every benchmark in benchmark-suite.cpp and writes the results to config.benchmarkOutput as JSON
+	static void runBenchmarkSuite(const AppConfig& config);
+
 private:
 
 	// Declarations for functions should be done best reflecting order of execution
 	// If a member function calls other functions half way through its own execution, 
 	// that function should be declared before the member function using it is.
 
-	const uint32_t WIDTH = 800;
-	const uint32_t HEIGHT = 600;
-	
-	VkDevice device;
-	VkSurfaceKHR surface;
-	GLFWwindow* window;
-	VkInstance instance;
-	VkDebugUtilsMessengerEXT debugMessenger;
+	const uint32_t WIDTH;
+	const uint32_t HEIGHT;
+
+	// Headless runs never touch GLFW. See app-config.h and headless.cpp
+	const bool headless;
+	const uint32_t frameCount;
+	const uint32_t resizeEvery;             // Headless runs only, see simulateResize
+	const FramePacing pacing;
+	const double targetFps;
+	const SwapchainSettings swapchainSettings;
+	const bool coldPipelineCache;
+	const uint32_t workerThreads;
+	const uint32_t recordBenchmarkDraws;
+	const uint32_t computeBenchmarkElements;
+	const uint32_t cullBenchmarkInstances;
+	const std::string meshBenchmarkFile;
+	const uint32_t textureBenchmarkTextures;
+	const TextureStreamingSettings textureStreaming;
+	const std::string profilePath;
+	const bool shaderHotReload;
+	const bool startupBenchmark;            // Stop after the first frame, see runStartupBenchmark
+	const ValidationSettings validation;
+	const bool enableValidationLayers;
+
+	// Declared ahead of every Vulkan handle, since they're all created with its callbacks. See host-allocator.h
+	HostAllocator hostAllocator;
+
+	// Same for the debug messenger, which hands every message to it. See validation-sink.h
+	ValidationSink validationSink;
+
+	// Filled in from several threads during initVulkan. See startup-timer.h and enumeration-cache.h
+	StartupTimer startupTimer;
+	EnumerationCache enumerations;
+	std::vector<const char*> windowExtensions;  // From glfwGetRequiredInstanceExtensions
+	bool useHeadlessSurface = false;
+	bool useValidationFeatures = false;     // The layer has VK_EXT_validation_features, see createInstance
+	uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+	DeviceCapabilities capabilities;        // What the device was created with, see device-capabilities.h
+
+	// In creation order, so they're destroyed children first. The subsystems below hold plain handles and are torn
+	// down by teardown(), which cleanup() ends with and the destructor repeats if startup or a frame threw first.
+	// See vulkan-handle.h
+	UniqueInstance instance;
+	UniqueDebugMessenger debugMessenger;    // Only while validating, see beginValidationFrame
+	UniqueSurface surface;
+	UniqueDevice device;
+
+	GLFWwindow* window = nullptr;
+	uint64_t validationFrame = 0;           // Frames seen by beginValidationFrame
+	uint64_t validatedFrames = 0;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-	VkQueue graphicsQueue;
+	VkQueue graphicsQueue = VK_NULL_HANDLE;
+	VkQueue presentQueue = VK_NULL_HANDLE;
+	VkQueue computeQueue = VK_NULL_HANDLE;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	QueueFamilyIndices queueFamilyIndices;
+	DeviceAllocator allocator;
+	UploadRing uploadRing;
+	ShaderLibrary shaders;
+	ComputeContext compute;                 // On the compute queue, see compute.h
+	ComputeKernels kernels;
+	DrawCuller culler;                      // Also on the compute queue, see instance-culling.h
+	Swapchain swapchain;
+	DeferredDestruction deferred;           // What frames in flight may still use, see deferred-destruction.h
+	BindlessTable bindless;
+	TextureStreamer textures;               // Mip residency under a budget, see texture-streamer.h
+	FrameDescriptorPools frameDescriptors;  // Transient sets, reset per frame slot
+	FrameArena frameArena;                  // Per-frame uniforms, a region per frame slot, see writeFrameUniforms
+	UniqueDescriptorSetLayout frameSetLayout;
+	VkDeviceSize uniformAlignment = 1;      // minUniformBufferOffsetAlignment
+	VkDescriptorSet frameSet = VK_NULL_HANDLE;  // This frame's FrameUniforms, valid until its slot comes round again
+	RenderGraph renderGraph;                // Rebuilt every frame, see recordFrame
+	PipelineCache pipelineCache;
+
+	// Offscreen render target used in place of a window when running headless
+	VkImage offscreenImage = VK_NULL_HANDLE;
+	DeviceAllocation offscreenImageMemory;
+	UniqueCommandPool offscreenCommandPool;
+	VkCommandBuffer offscreenCommandBuffer = VK_NULL_HANDLE;    // Freed with the pool
+	UniqueFence offscreenFence;
+	VkExtent2D offscreenExtent{};
+
+	// The size the swap chain (or the offscreen target) should be, from the framebuffer size callback or from
+	// simulateResize. However many events come in, it's applied once, at the start of the next frame. See resize.cpp
+	VkExtent2D windowExtent{};
+	bool resizePending = false;
+	uint64_t resizeEvents = 0;
+	uint64_t resizesApplied = 0;
 
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, 
@@ -34,25 +171,72 @@ private:
 		const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, 
 		void* pUserData);
 
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+
+	void initGlfw();
 	void initWindow();
 
 	void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 	std::vector<const char*> getRequiredExtensions();
 	bool checkValidationLayerSupport();
+	bool checkValidationFeaturesSupport();
 	void createInstance();
 
 	void setupDebugMessenger();
+	void beginValidationFrame();
 
+	bool checkHeadlessSurfaceSupport();
+	void createHeadlessSurface();
 	void createSurface();
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
+	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 	bool isDeviceSuitable(VkPhysicalDevice device);
 	void pickPhysicalDevice();
 	void createLogicalDevice();
+	void createSwapChain();
+	void createOffscreenImage(VkExtent2D extent);
+	void createOffscreenTarget();
 	void initVulkan();
-	
+
+	void onResize(uint32_t width, uint32_t height);
+	void simulateResize(uint32_t frame);
+	void resizeOffscreenTarget(VkExtent2D extent);
+	bool applyResize();
+	void reportResizes(std::ostream& out) const;
+
+	// What every frame's set 0, binding 0 holds. Nothing reads it yet: it's where passes will find the target size
+	// and frame number once there's a graphics pipeline.
+	struct FrameUniforms {
+		uint32_t width;
+		uint32_t height;
+		uint32_t frame;                     // Counts up from 0 at the first frame
+		uint32_t frameSlot;
+	};
+
+	void createFrameUniforms(uint32_t framesInFlight);
+	void writeFrameUniforms(uint32_t frameIndex, VkExtent2D extent);
+	void applyShaderReloads();
+	void recordFrame(VkCommandBuffer commandBuffer, VkImage target, VkPipelineStageFlags2 readyStage, VkImageLayout finalLayout);
+	void drawFrame();
+	void drawOffscreenFrame();
+	void headlessLoop();
 	void mainLoop();
+	FrameStats measureRecording(uint32_t threads, uint32_t drawCount);
+	uint32_t recordingThreads() const;
+	void runRecordBenchmark();
+	std::vector<ComputeKernelTiming> measureCompute(uint32_t elements);
+	void runComputeBenchmark();
+	std::vector<ComputeKernelTiming> measureCulling(uint32_t instances);
+	void runCullBenchmark();
+	static std::string benchmarkMeshFile();
+	std::vector<MeshLoadTiming> measureMeshLoading(const std::string& path);
+	void runMeshBenchmark();
+	static std::vector<std::string> benchmarkTextureFiles(uint32_t count);
+	void runTextureBenchmark();
+	void benchmarkSubsystems(BenchmarkResults& results);
 
-	void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
+	void destroyOffscreenTarget();
+	void teardown();
 	void cleanup();
 	
 };
\ No newline at end of file
@@ -0,0 +1,32 @@
+// benchmark-main.cpp
+
+#include <iostream>
+#include "include.h"
+#include "application.h"
+#include "app-config.h"
+
+// Entry point of the vulkan-test-bench target in CMakeLists.txt. Same as running vulkan-test with --headless and
+// --benchmark, but with defaults that suit a build box, so it needs no arguments at all. The Visual Studio project
+// doesn't build this file; use --benchmark there.
+
+int main(int argc, char** argv) {
+
+    try {
+        AppConfig config = parseAppConfig(argc, argv);
+
+        // No window, nothing pacing the frames, and somewhere to put the results
+        config.headless = true;
+        config.pacing = FramePacing::Uncapped;
+        if (config.benchmarkOutput.empty()) {
+            config.benchmarkOutput = "benchmark.json";
+        }
+
+        Application::runBenchmarkSuite(config);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+// benchmark-results.cpp
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include "benchmark-results.h"
+#include "include.h"
+
+// Set by the CMake build from git describe, so JSON files from different revisions can be told apart
+#ifndef VKTEST_REVISION
+#define VKTEST_REVISION "unknown"
+#endif
+
+static std::string jsonString(const std::string& text) {
+
+    std::string quoted = "\"";
+    for (char c : text) {
+        switch (c) {
+        case '"': quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            }
+            else {
+                quoted += c;
+            }
+        }
+    }
+    return quoted + "\"";
+}
+
+void BenchmarkResults::setDevice(std::string name, uint32_t driverVersion, uint32_t apiVersion) {
+    device = std::move(name);
+    this->driverVersion = driverVersion;
+    this->apiVersion = apiVersion;
+}
+
+void BenchmarkResults::add(const std::string& name, const FrameStats& samples, std::vector<std::pair<std::string, double>> metrics) {
+    entries.push_back({ name, samples, std::move(metrics) });
+}
+
+void BenchmarkResults::print(std::ostream& out) const {
+
+    out << "\nBenchmarks on " << device << " (revision " << VKTEST_REVISION << "):\n";
+
+    for (const Entry& entry : entries) {
+        out << std::fixed << std::setprecision(3)
+            << "    " << std::left << std::setw(28) << entry.name << std::right
+            << " mean " << std::setw(9) << entry.samples.mean() << " ms"
+            << "   p95 " << std::setw(9) << entry.samples.percentile(95) << " ms";
+        for (const auto& metric : entry.metrics) {
+            out << "   " << metric.first << " " << std::setprecision(2) << metric.second;
+        }
+        out << "\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
+
+void BenchmarkResults::writeJson(const std::string& path) const {
+
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("failed to open " + path + " for the benchmark results!");
+    }
+
+    // Enough digits that nothing is lost going through a double and back
+    file << std::setprecision(9);
+
+    file << "{\n"
+        << "  \"revision\": " << jsonString(VKTEST_REVISION) << ",\n"
+        << "  \"device\": " << jsonString(device) << ",\n"
+        << "  \"driverVersion\": " << driverVersion << ",\n"
+        << "  \"apiVersion\": \"" << VK_API_VERSION_MAJOR(apiVersion) << "." << VK_API_VERSION_MINOR(apiVersion) << "\",\n"
+        << "  \"benchmarks\": [";
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& entry = entries[i];
+        const FrameStats& samples = entry.samples;
+
+        file << (i == 0 ? "\n" : ",\n")
+            << "    { \"name\": " << jsonString(entry.name)
+            << ", \"samples\": " << samples.count()
+            << ", \"mean_ms\": " << samples.mean()
+            << ", \"min_ms\": " << samples.min()
+            << ", \"p50_ms\": " << samples.percentile(50)
+            << ", \"p95_ms\": " << samples.percentile(95)
+            << ", \"p99_ms\": " << samples.percentile(99)
+            << ", \"max_ms\": " << samples.max()
+            << ", \"metrics\": {";
+
+        for (size_t m = 0; m < entry.metrics.size(); m++) {
+            file << (m == 0 ? " " : ", ") << jsonString(entry.metrics[m].first) << ": " << entry.metrics[m].second;
+        }
+        file << (entry.metrics.empty() ? "} }" : " } }");
+    }
+
+    file << "\n  ]\n}\n";
+
+    if (!file) {
+        throw std::runtime_error("failed to write the benchmark results to " + path + "!");
+    }
+}
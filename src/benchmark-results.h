@@ -0,0 +1,44 @@
+// benchmark-results.h
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "frame-stats.h"
+
+// What the benchmark suite measured, printed for people and written as JSON for scripts.
+//
+// Every benchmark is a set of timing samples in milliseconds plus whatever derived numbers make sense for it
+// (GiB/s for uploads, draws/ms for recording, ...). The JSON carries the revision the binary was built from and the
+// device it ran on, so results from different revisions can be lined up and diffed. Its layout:
+//
+//   { "revision": "...", "device": "...", "driverVersion": n, "apiVersion": "1.3",
+//     "benchmarks": [ { "name": "...", "samples": n, "mean_ms": x, "min_ms": x, "p50_ms": x, "p95_ms": x,
+//                       "p99_ms": x, "max_ms": x, "metrics": { "gib_per_s": x, ... } }, ... ] }
+
+class BenchmarkResults {
+
+public:
+
+	void setDevice(std::string name, uint32_t driverVersion, uint32_t apiVersion);
+
+	void add(const std::string& name, const FrameStats& samples, std::vector<std::pair<std::string, double>> metrics = {});
+
+	void print(std::ostream& out) const;
+	void writeJson(const std::string& path) const;
+
+private:
+
+	struct Entry {
+		std::string name;
+		FrameStats samples;
+		std::vector<std::pair<std::string, double>> metrics;
+	};
+
+	std::string device = "unknown";
+	uint32_t driverVersion = 0;
+	uint32_t apiVersion = 0;
+	std::vector<Entry> entries;
+};
@@ -0,0 +1,288 @@
+// benchmark-suite.cpp
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "benchmark-results.h"
+#include "device-ranking.h"
+#include "frame-stats.h"
+#include "mesh-loader.h"
+
+// The benchmark suite: one run over every path that matters for a short render job, with the numbers written as
+// JSON (see benchmark-results.h) so they can be compared across revisions. Made for lavapipe on a build box, but
+// it runs on anything.
+//
+// Startup is measured macro-style: the whole Application is started several times up to its first frame, and the
+// instance, device selection and device creation stages are taken from its startup timer (see startup-timer.h).
+// Everything else is a micro benchmark on one Application that stays up for all of them: selection on its own,
+// device memory allocation, staging upload throughput, command buffer recording, the compute kernels, instance
+// culling, mesh loading, and the submit and frame round trips. Each one warms up before it's measured.
+
+static constexpr uint32_t startupRuns = 5;
+static constexpr uint32_t selectionSamples = 100;
+static constexpr uint32_t allocationSamples = 50;
+static constexpr uint32_t uploadSamples = 10;
+static constexpr uint32_t recordDraws = 10000;
+static constexpr uint32_t computeElements = 1u << 22;
+static constexpr uint32_t cullInstances = 1u << 20;
+static constexpr uint32_t submitSamples = 200;
+static constexpr uint32_t frameSamples = 200;
+static constexpr uint32_t warmupSamples = 3;
+
+void Application::runBenchmarkSuite(const AppConfig& config) {
+
+    BenchmarkResults results;
+
+    // Startup. Only the first frame is drawn, and the pipeline cache is whatever the previous run left, so these
+    // are warm starts; --startup-benchmark has the cold one.
+    FrameStats instanceTime("instance"), selectionTime("selection"), deviceTime("device"), firstFrameTime("first frame");
+    uint32_t runs = config.startupBenchmarkRuns > 0 ? config.startupBenchmarkRuns : startupRuns;
+
+    for (uint32_t run = 0; run < runs; run++) {
+        AppConfig runConfig = config;
+        runConfig.frameCount = 1;
+        runConfig.startupBenchmarkRuns = 1;
+        runConfig.profilePath.clear();
+        runConfig.benchmarkOutput.clear();
+
+        Application app(runConfig);
+        app.run();
+
+        const StartupTimer& timer = app.startup();
+        instanceTime.add(timer.stageMilliseconds("createInstance") + timer.stageMilliseconds("setupDebugMessenger"));
+        selectionTime.add(timer.stageMilliseconds("pickPhysicalDevice"));
+        deviceTime.add(timer.stageMilliseconds("createLogicalDevice"));
+        firstFrameTime.add(timer.timeToFirstFrame());
+    }
+
+    results.add("startup.create_instance", instanceTime);
+    results.add("startup.select_device", selectionTime);
+    results.add("startup.create_device", deviceTime);
+    results.add("startup.time_to_first_frame", firstFrameTime);
+
+    // Everything else shares one device
+    AppConfig suiteConfig = config;
+    suiteConfig.profilePath.clear();
+
+    Application app(suiteConfig);
+    app.benchmarkSubsystems(results);
+
+    results.print(std::cout);
+    results.writeJson(config.benchmarkOutput);
+    std::cout << "\nBenchmark results written to " << config.benchmarkOutput << "\n";
+}
+
+void Application::benchmarkSubsystems(BenchmarkResults& results) {
+
+    startupTimer.begin();
+    if (!headless) {
+        initGlfw();
+    }
+    initVulkan();
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    results.setDevice(deviceProperties.deviceName, deviceProperties.driverVersion, capabilities.apiVersion);
+
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Device);
+
+    // Every measurement here warms up the same way and only differs in how many samples it keeps
+    auto measure = [](const char* label, uint32_t samples, auto body) {
+        return timeRuns(label, [] {}, body, { warmupSamples, samples });
+    };
+
+    // Queue family lookup, suitability and ranking for every device, the way the full selection pass does it. The
+    // extension lists come from the cache, same as they would during startup.
+    {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        FrameStats selection = measure("selection", selectionSamples, [&] {
+            for (VkPhysicalDevice candidate : devices) {
+                findQueueFamilies(candidate);
+                if (isDeviceSuitable(candidate)) {
+                    rankPhysicalDevice(candidate, instanceApiVersion, enumerations.deviceExtensions(candidate));
+                }
+            }
+        });
+        results.add("select.rank_devices", selection, { { "devices", static_cast<double>(deviceCount) } });
+    }
+
+    // Device memory: small buffers come out of the allocator's blocks, large ones take a block of their own.
+    // Everything is created first and then destroyed, so the allocator sees a full block's worth at once.
+    auto allocationBenchmark = [&](const char* name, VkDeviceSize size, uint32_t count) {
+        std::vector<VkBuffer> buffers(count);
+        std::vector<DeviceAllocation> allocations(count);
+
+        FrameStats stats = measure(name, allocationSamples, [&] {
+            for (uint32_t i = 0; i < count; i++) {
+                buffers[i] = allocator.createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocations[i]);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                allocator.destroyBuffer(buffers[i], allocations[i]);
+            }
+        });
+        results.add(name, stats, { { "us_per_buffer", stats.mean() * 1000.0 / count } });
+    };
+    allocationBenchmark("allocate.buffer_64k", 64ull << 10, 256);
+    allocationBenchmark("allocate.buffer_16m", 16ull << 20, 8);
+
+    // Staging uploads: 64 MiB in 1 MiB pieces through the upload ring, timed until the transfer queue is done
+    {
+        const VkDeviceSize chunkSize = 1ull << 20;
+        const uint32_t chunkCount = 64;
+
+        DeviceAllocation destinationMemory;
+        VkBuffer destination = allocator.createBuffer(chunkSize * chunkCount, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, destinationMemory);
+        std::vector<uint8_t> data(chunkSize);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<uint8_t>(i * 31);
+        }
+
+        FrameStats upload = measure("upload", uploadSamples, [&] {
+            for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                uploadRing.uploadBuffer(destination, chunk * chunkSize, data.data(), chunkSize);
+            }
+            uploadRing.wait(uploadRing.flush());
+        });
+
+        double gibPerSecond = upload.mean() > 0.0 ? (chunkSize * chunkCount / double(1ull << 30)) / (upload.mean() / 1000.0) : 0.0;
+        results.add("upload.buffer_64m", upload, { { "gib_per_s", gibPerSecond } });
+
+        allocator.destroyBuffer(destination, destinationMemory);
+    }
+
+    // Command recording, single threaded and on every recording thread. See record-benchmark.cpp. The parallel
+    // run's name doesn't change with the machine's thread count, so results from different machines line up; the
+    // count goes in its metrics instead.
+    {
+        FrameStats single = measureRecording(1, recordDraws);
+        results.add("record.draws_1_thread", single, { { "draws_per_ms", single.mean() > 0.0 ? recordDraws / single.mean() : 0.0 } });
+
+        uint32_t threads = recordingThreads();
+        if (threads > 1) {
+            FrameStats parallel = measureRecording(threads, recordDraws);
+            results.add("record.draws_parallel", parallel, {
+                { "threads", threads },
+                { "draws_per_ms", parallel.mean() > 0.0 ? recordDraws / parallel.mean() : 0.0 },
+                { "speedup", parallel.mean() > 0.0 ? single.mean() / parallel.mean() : 0.0 } });
+        }
+    }
+
+    // Compute kernels against their CPU versions. See compute-benchmark.cpp
+    for (const ComputeKernelTiming& timing : measureCompute(computeElements)) {
+        results.add("compute." + timing.kernel + "_cpu", timing.cpu,
+            { { "melem_per_s", timing.cpu.mean() > 0.0 ? computeElements / timing.cpu.mean() / 1000.0 : 0.0 } });
+        if (timing.gpu.count() > 0) {
+            results.add("compute." + timing.kernel + "_gpu", timing.gpu, {
+                { "melem_per_s", timing.gpu.mean() > 0.0 ? computeElements / timing.gpu.mean() / 1000.0 : 0.0 },
+                { "matches_cpu", timing.matches ? 1.0 : 0.0 } });
+        }
+    }
+
+    // Frustum culling and draw batching, CPU and GPU. See cull-benchmark.cpp
+    for (const ComputeKernelTiming& timing : measureCulling(cullInstances)) {
+        results.add("cull." + timing.kernel + "_cpu", timing.cpu,
+            { { "instances_per_ms", timing.cpu.mean() > 0.0 ? cullInstances / timing.cpu.mean() : 0.0 } });
+        if (timing.gpu.count() > 0) {
+            results.add("cull." + timing.kernel + "_gpu", timing.gpu, {
+                { "instances_per_ms", timing.gpu.mean() > 0.0 ? cullInstances / timing.gpu.mean() : 0.0 },
+                { "matches_cpu", timing.matches ? 1.0 : 0.0 } });
+        }
+    }
+
+    // Loading a generated mesh file onto the GPU, mapped and read. See mesh-benchmark.cpp
+    {
+        std::string path = benchmarkMeshFile();
+        MeshFile file;
+        file.open(path);
+        double mebibytes = file.size() / double(1 << 20);
+        file.close();
+
+        for (const MeshLoadTiming& timing : measureMeshLoading(path)) {
+            results.add("mesh.load_" + timing.method, timing.load,
+                { { "mib_per_s", timing.load.mean() > 0.0 ? mebibytes / (timing.load.mean() / 1000.0) : 0.0 } });
+            results.add("mesh.first_draw_" + timing.method, timing.firstDraw);
+        }
+    }
+
+    // Submit round trip: an empty command buffer in, its fence signalled back out. The floor for any frame.
+    {
+        VkCommandPool pool;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, callbacks, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create benchmark command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate benchmark command buffer!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS || vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record benchmark command buffer!");
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(device, &fenceInfo, callbacks, &fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create benchmark fence!");
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        FrameStats submit = measure("submit", submitSamples, [&] {
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit benchmark command buffer!");
+            }
+            vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(device, 1, &fence);
+        });
+        results.add("submit.empty_round_trip", submit);
+
+        vkDestroyFence(device, fence, callbacks);
+        vkDestroyCommandPool(device, pool, callbacks);
+    }
+
+    // Whole frames as the main loop draws them. With a surface that's acquire, record, submit and present, with
+    // the swap chain's frames in flight overlapping; offscreen it's record, submit and wait.
+    {
+        FrameStats frames = measure("frame", frameSamples, [&] {
+            if (surface != VK_NULL_HANDLE) {
+                drawFrame();
+            }
+            else {
+                drawOffscreenFrame();
+            }
+        });
+        results.add(surface != VK_NULL_HANDLE ? "frame.submit_present" : "frame.submit_offscreen", frames,
+            { { "fps", frames.mean() > 0.0 ? 1000.0 / frames.mean() : 0.0 } });
+    }
+
+    vkDeviceWaitIdle(device);
+    cleanup();
+}
@@ -0,0 +1,260 @@
+// bindless-table.cpp
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include "bindless-table.h"
+
+void SlotFreeList::reset(uint32_t capacity) {
+
+    // Every slot starts out free, linked in order so the first pops hand out 0, 1, 2, ...
+    next.reset(new std::atomic<uint32_t>[capacity]);
+    for (uint32_t slot = 0; slot < capacity; slot++) {
+        next[slot].store(slot + 1 < capacity ? slot + 1 : empty, std::memory_order_relaxed);
+    }
+    head.store(capacity > 0 ? 0 : empty, std::memory_order_release);
+    slotCount = capacity;
+}
+
+uint32_t SlotFreeList::pop() {
+
+    uint64_t current = head.load(std::memory_order_acquire);
+    while (true) {
+        uint32_t slot = static_cast<uint32_t>(current);
+        if (slot == empty) return empty;
+
+        // May be stale if another thread pops this slot first, but then the tag has changed and the exchange fails
+        uint32_t following = next[slot].load(std::memory_order_relaxed);
+        uint64_t replacement = ((current >> 32) + 1) << 32 | following;
+        if (head.compare_exchange_weak(current, replacement, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return slot;
+        }
+    }
+}
+
+void SlotFreeList::push(uint32_t slot) {
+
+    uint64_t current = head.load(std::memory_order_relaxed);
+    uint64_t replacement;
+    do {
+        next[slot].store(static_cast<uint32_t>(current), std::memory_order_relaxed);
+        replacement = ((current >> 32) + 1) << 32 | slot;
+    } while (!head.compare_exchange_weak(current, replacement, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void BindlessTable::create(VkPhysicalDevice physicalDevice, VkDevice device, const DeviceCapabilities& capabilities,
+    uint32_t maxSampledImages, uint32_t maxStorageBuffers, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+
+    if (!capabilities.descriptorIndexing) {
+        std::clog << "Bindless descriptors unavailable (no descriptor indexing)" << std::endl;
+        return;
+    }
+
+    // Update-after-bind descriptors have limits of their own, often far higher than the regular ones
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    uint32_t sampledImages = std::min({ maxSampledImages,
+        indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages });
+    uint32_t storageBuffers = std::min({ maxStorageBuffers,
+        indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+    // Both arrays are visible to every stage, so together they have to fit in one stage's budget too
+    uint32_t perStage = indexingProperties.maxPerStageUpdateAfterBindResources;
+    if (sampledImages + storageBuffers > perStage) {
+        sampledImages = std::min(sampledImages, perStage / 2);
+        storageBuffers = std::min(storageBuffers, perStage - sampledImages);
+    }
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[0].descriptorCount = sampledImages;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = storageBuffers;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+    const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    const VkDescriptorBindingFlags bindingFlags[2] = { flags, flags };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = 2;
+    flagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &flagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, allocationCallbacks, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSizes[2] = {
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, sampledImages },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffers },
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, allocationCallbacks, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+
+    freeLists[static_cast<uint32_t>(BindlessKind::SampledImage)].reset(sampledImages);
+    freeLists[static_cast<uint32_t>(BindlessKind::StorageBuffer)].reset(storageBuffers);
+}
+
+void BindlessTable::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+    // The set goes with its pool
+    if (pool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, pool, allocationCallbacks);
+        vkDestroyDescriptorSetLayout(device, setLayout, allocationCallbacks);
+    }
+    pool = VK_NULL_HANDLE;
+    setLayout = VK_NULL_HANDLE;
+    set = VK_NULL_HANDLE;
+    device = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTable::allocate(BindlessKind kind) {
+
+    uint32_t index = static_cast<uint32_t>(kind);
+    uint32_t slot = freeLists[index].pop();
+    if (slot == invalidSlot) {
+        failedAllocations.fetch_add(1, std::memory_order_relaxed);
+        return invalidSlot;
+    }
+
+    // Only for the report, so relaxed, and the peak may lag a racing allocation by one
+    uint32_t inUse = slotsInUse[index].fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t peak = peakSlots[index].load(std::memory_order_relaxed);
+    while (inUse > peak && !peakSlots[index].compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {}
+    return slot;
+}
+
+void BindlessTable::free(BindlessKind kind, uint32_t slot) {
+
+    uint32_t index = static_cast<uint32_t>(kind);
+    freeLists[index].push(slot);
+    slotsInUse[index].fetch_sub(1, std::memory_order_relaxed);
+}
+
+void BindlessTable::writeSampledImage(uint32_t slot, VkImageView imageView, VkImageLayout imageLayout) {
+
+    PendingWrite write{};
+    write.kind = BindlessKind::SampledImage;
+    write.slot = slot;
+    write.image.imageView = imageView;
+    write.image.imageLayout = imageLayout;
+
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pending.push_back(write);
+}
+
+void BindlessTable::writeStorageBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+
+    PendingWrite write{};
+    write.kind = BindlessKind::StorageBuffer;
+    write.slot = slot;
+    write.buffer.buffer = buffer;
+    write.buffer.offset = offset;
+    write.buffer.range = range;
+
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pending.push_back(write);
+}
+
+void BindlessTable::flush() {
+
+    if (!available()) return;
+
+    // Swapped out under the lock, so writers are only ever held up for the swap
+    flushing.clear();
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        if (pending.empty()) return;
+        flushing.swap(pending);
+    }
+
+    // Point into flushing, which doesn't change size from here on
+    writes.clear();
+    writes.reserve(flushing.size());
+    for (const PendingWrite& pendingWrite : flushing) {
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstArrayElement = pendingWrite.slot;
+        write.descriptorCount = 1;
+        if (pendingWrite.kind == BindlessKind::SampledImage) {
+            write.dstBinding = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            write.pImageInfo = &pendingWrite.image;
+        }
+        else {
+            write.dstBinding = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &pendingWrite.buffer;
+        }
+        writes.push_back(write);
+    }
+
+    // Writes apply in order, so a slot written twice since the last flush ends up with the later one
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    uint32_t count = static_cast<uint32_t>(writes.size());
+    flushes++;
+    totalWrites += count;
+    maxWritesPerFlush = std::max(maxWritesPerFlush, count);
+}
+
+void BindlessTable::report(std::ostream& out) const {
+
+    if (!available()) return;
+
+    const uint32_t images = static_cast<uint32_t>(BindlessKind::SampledImage);
+    const uint32_t buffers = static_cast<uint32_t>(BindlessKind::StorageBuffer);
+
+    out << "\nBindless: " << slotsInUse[images].load() << " / " << capacity(BindlessKind::SampledImage)
+        << " image slots in use (peak " << peakSlots[images].load() << "), " << slotsInUse[buffers].load() << " / "
+        << capacity(BindlessKind::StorageBuffer) << " buffer slots (peak " << peakSlots[buffers].load() << ")";
+    if (failedAllocations.load() > 0) {
+        out << ", " << failedAllocations.load() << " allocations failed (table full)";
+    }
+    out << "\n    " << totalWrites << " descriptor writes in " << flushes << " flushes, up to " << maxWritesPerFlush
+        << " in one frame\n";
+}
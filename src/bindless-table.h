@@ -0,0 +1,122 @@
+// bindless-table.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "include.h"
+#include "device-capabilities.h"
+
+// A lock-free stack of free slot indices (a Treiber stack over an index array).
+//
+// The head carries a tag that changes on every push and pop next to the slot index, so a pop that read a stale
+// "next" can never succeed: by the time it tries, the tag has moved on (the ABA problem). Every slot's link is an
+// atomic of its own, so a pop reading the link of a slot that's being pushed again at the same moment is fine too.
+class SlotFreeList {
+
+public:
+
+	static constexpr uint32_t empty = UINT32_MAX;
+
+	void reset(uint32_t capacity);
+
+	// empty when every slot is taken
+	uint32_t pop();
+	void push(uint32_t slot);
+
+	uint32_t capacity() const { return slotCount; }
+
+private:
+
+	std::unique_ptr<std::atomic<uint32_t>[]> next;
+	std::atomic<uint64_t> head{ empty };        // Tag in the high 32 bits, slot in the low 32
+	uint32_t slotCount = 0;
+};
+
+enum class BindlessKind : uint32_t {
+	SampledImage,       // Binding 0, texture2D textures[]
+	StorageBuffer,      // Binding 1, buffer ... buffers[]
+	Count
+};
+
+// One global descriptor set holding every texture and storage buffer, indexed by slot from shaders
+// (descriptor indexing, core in Vulkan 1.2).
+//
+// Both bindings are UPDATE_AFTER_BIND, PARTIALLY_BOUND and UPDATE_UNUSED_WHILE_PENDING. So the set is bound once
+// per command buffer and stays bound. Slots can be written while frames using the set are in flight, as long as
+// those frames don't use that slot. Slots that were never written can be left as they are.
+//
+// Slots come from a lock-free free list per binding, so any thread can allocate and free them. Writes go into a
+// queue that flush() turns into one vkUpdateDescriptorSets call per frame. That needs a lock, since the set has to
+// be externally synchronized for updates. Freeing a slot doesn't wait for the GPU: only free it once the last frame
+// that used it is done.
+//
+// Without the descriptor indexing features (see DeviceCapabilities) nothing is created and available() is false.
+
+class BindlessTable {
+
+public:
+
+	static constexpr uint32_t invalidSlot = SlotFreeList::empty;
+
+	// Sizes are clamped to what the device allows for update-after-bind descriptors
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, const DeviceCapabilities& capabilities,
+		uint32_t maxSampledImages, uint32_t maxStorageBuffers, const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	bool available() const { return set != VK_NULL_HANDLE; }
+
+	VkDescriptorSetLayout layout() const { return setLayout; }
+	VkDescriptorSet descriptorSet() const { return set; }
+	uint32_t capacity(BindlessKind kind) const { return freeLists[static_cast<uint32_t>(kind)].capacity(); }
+
+	// Thread safe. invalidSlot when the binding is full.
+	uint32_t allocate(BindlessKind kind);
+	void free(BindlessKind kind, uint32_t slot);
+
+	// Thread safe. Take effect at the next flush().
+	void writeSampledImage(uint32_t slot, VkImageView imageView, VkImageLayout imageLayout);
+	void writeStorageBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+	// Once per frame, before submitting anything that reads this frame's writes
+	void flush();
+
+	void report(std::ostream& out) const;
+
+private:
+
+	struct PendingWrite {
+		BindlessKind kind;
+		uint32_t slot;
+		VkDescriptorImageInfo image;
+		VkDescriptorBufferInfo buffer;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+
+	SlotFreeList freeLists[static_cast<uint32_t>(BindlessKind::Count)];
+
+	std::mutex pendingMutex;
+	std::vector<PendingWrite> pending;
+
+	// flush() only, so on one thread
+	std::vector<PendingWrite> flushing;
+	std::vector<VkWriteDescriptorSet> writes;
+
+	// Bookkeeping for the report
+	std::atomic<uint32_t> slotsInUse[static_cast<uint32_t>(BindlessKind::Count)] = {};
+	std::atomic<uint32_t> peakSlots[static_cast<uint32_t>(BindlessKind::Count)] = {};
+	std::atomic<uint32_t> failedAllocations{ 0 };
+	uint64_t flushes = 0;
+	uint64_t totalWrites = 0;
+	uint32_t maxWritesPerFlush = 0;
+};
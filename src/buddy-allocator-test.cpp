@@ -0,0 +1,135 @@
+// buddy-allocator-test.cpp
+
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "buddy-allocator.h"
+#include "test-harness.h"
+
+// The buddy allocator on its own, without a device. Walks one small range through every split and merge by hand,
+// then fills a larger one with random sizes and alignments and checks that nothing overlaps, everything is aligned
+// to its rounded size, and freeing it all in a random order merges back into the whole range.
+
+static uint64_t roundedSize(uint64_t size, uint64_t alignment, uint64_t minBlockSize) {
+
+    uint64_t rounded = minBlockSize;
+    while (rounded < std::max(size, alignment)) {
+        rounded *= 2;
+    }
+    return rounded;
+}
+
+template <typename Body>
+static bool throwsRuntimeError(Body body) {
+
+    try {
+        body();
+    }
+    catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void testBuddyAllocator() {
+
+    // Splits: the first 64 byte block splits the range down, leaving the upper half free on every level
+    {
+        BuddyAllocator buddy(1024, 64);
+        CHECK(buddy.largestFreeBlock() == 1024);
+
+        std::optional<uint64_t> a = buddy.allocate(10, 1);
+        CHECK(a == 0u);
+        CHECK(buddy.bytesAllocated() == 64);
+        CHECK(buddy.bytesRequested() == 10);
+        CHECK(buddy.largestFreeBlock() == 512);
+
+        // Each takes the free half left by the first split at its size
+        std::optional<uint64_t> b = buddy.allocate(64, 1);
+        std::optional<uint64_t> c = buddy.allocate(100, 1);
+        std::optional<uint64_t> d = buddy.allocate(256, 1);
+        CHECK(b == 64u);
+        CHECK(c == 128u);
+        CHECK(d == 256u);
+        CHECK(buddy.largestFreeBlock() == 512);
+
+        // Alignment: 16 bytes aligned to 512 takes a whole 512 byte block
+        std::optional<uint64_t> e = buddy.allocate(16, 512);
+        CHECK(e == 512u);
+        CHECK(buddy.bytesAllocated() == 1024);
+        CHECK(buddy.bytesRequested() == 10 + 64 + 100 + 256 + 16);
+        CHECK(buddy.allocationCount() == 5);
+        CHECK(!buddy.allocate(1, 1).has_value());
+        CHECK(buddy.largestFreeBlock() == 0);
+
+        // Merges: a block only merges once its buddy is free too, and then keeps going up
+        buddy.free(*b);
+        CHECK(buddy.largestFreeBlock() == 64);
+        buddy.free(*a);
+        CHECK(buddy.largestFreeBlock() == 128);
+        buddy.free(*c);
+        CHECK(buddy.largestFreeBlock() == 256);
+        buddy.free(*d);
+        CHECK(buddy.largestFreeBlock() == 512);
+        buddy.free(*e);
+        CHECK(buddy.largestFreeBlock() == 1024);
+        CHECK(buddy.empty());
+        CHECK(buddy.bytesAllocated() == 0);
+        CHECK(buddy.bytesRequested() == 0);
+
+        // Back in one piece, and nothing bigger than the range or aligned beyond it fits
+        CHECK(buddy.allocate(1024, 1) == 0u);
+        buddy.free(0);
+        CHECK(!buddy.allocate(2048, 1).has_value());
+        CHECK(!buddy.allocate(16, 2048).has_value());
+        CHECK(buddy.empty());
+
+        CHECK(throwsRuntimeError([&] { buddy.free(64); }));
+    }
+
+    CHECK(throwsRuntimeError([] { BuddyAllocator buddy(1000, 64); }));
+    CHECK(throwsRuntimeError([] { BuddyAllocator buddy(1024, 48); }));
+    CHECK(throwsRuntimeError([] { BuddyAllocator buddy(64, 1024); }));
+
+    // Random sizes and alignments until the range is full
+    {
+        const uint64_t capacity = 1 << 20;
+        const uint64_t minBlockSize = 256;
+        BuddyAllocator buddy(capacity, minBlockSize);
+
+        std::mt19937 random(11);
+        std::vector<std::pair<uint64_t, uint64_t>> placed;     // Offset and rounded size
+        uint64_t allocated = 0;
+        for (uint32_t attempt = 0; attempt < 4096; attempt++) {
+            uint64_t size = 1 + random() % (24 << 10);
+            uint64_t alignment = uint64_t(1) << (random() % 14);
+            std::optional<uint64_t> offset = buddy.allocate(size, alignment);
+            if (!offset) continue;
+
+            uint64_t rounded = roundedSize(size, alignment, minBlockSize);
+            CHECK(*offset % alignment == 0);
+            CHECK(*offset % rounded == 0);
+            CHECK(*offset + rounded <= capacity);
+            placed.push_back({ *offset, rounded });
+            allocated += rounded;
+        }
+        CHECK(!placed.empty());
+        CHECK(buddy.bytesAllocated() == allocated);
+        CHECK(buddy.allocationCount() == placed.size());
+
+        std::sort(placed.begin(), placed.end());
+        for (size_t i = 1; i < placed.size(); i++) {
+            CHECK(placed[i - 1].first + placed[i - 1].second <= placed[i].first);
+        }
+
+        std::shuffle(placed.begin(), placed.end(), random);
+        for (const std::pair<uint64_t, uint64_t>& allocation : placed) {
+            buddy.free(allocation.first);
+        }
+        CHECK(buddy.empty());
+        CHECK(buddy.largestFreeBlock() == capacity);
+    }
+}
@@ -0,0 +1,101 @@
+// buddy-allocator.cpp
+
+#include <algorithm>
+#include <stdexcept>
+#include "buddy-allocator.h"
+
+static bool isPowerOfTwo(uint64_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static uint64_t nextPowerOfTwo(uint64_t value) {
+
+    uint64_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+static uint32_t log2(uint64_t value) {
+
+    uint32_t result = 0;
+    while (value >>= 1) result++;
+    return result;
+}
+
+BuddyAllocator::BuddyAllocator(uint64_t capacity, uint64_t minBlockSize)
+    : totalSize(capacity),
+      levelCount(log2(capacity) - log2(minBlockSize) + 1) {
+
+    if (!isPowerOfTwo(capacity) || !isPowerOfTwo(minBlockSize) || minBlockSize > capacity) {
+        throw std::runtime_error("buddy allocator sizes must be powers of two!");
+    }
+
+    freeLists.resize(levelCount);
+    freeLists[0].insert(0);
+}
+
+std::optional<uint64_t> BuddyAllocator::allocate(uint64_t size, uint64_t alignment) {
+
+    // Blocks are aligned to their own size, so asking for at least `alignment` bytes covers the alignment too
+    uint64_t needed = nextPowerOfTwo(std::max({ size, alignment, blockSize(levelCount - 1) }));
+    if (needed > totalSize) return std::nullopt;
+
+    uint32_t targetLevel = log2(totalSize) - log2(needed);
+
+    // Find the smallest free block that fits, searching upwards from the exact size
+    int level = static_cast<int>(targetLevel);
+    while (level >= 0 && freeLists[level].empty()) {
+        level--;
+    }
+    if (level < 0) return std::nullopt;
+
+    // Take the lowest offset, which keeps allocations packed towards the start of the range
+    uint64_t offset = *freeLists[level].begin();
+    freeLists[level].erase(freeLists[level].begin());
+
+    // Split down to the target size. Each split leaves the upper half free on the level below.
+    while (static_cast<uint32_t>(level) < targetLevel) {
+        level++;
+        freeLists[level].insert(offset + blockSize(level));
+    }
+
+    allocations[offset] = { targetLevel, size };
+    allocatedSize += needed;
+    requestedSize += size;
+    return offset;
+}
+
+void BuddyAllocator::free(uint64_t offset) {
+
+    auto it = allocations.find(offset);
+    if (it == allocations.end()) {
+        throw std::runtime_error("buddy allocator: freeing an offset that was never allocated!");
+    }
+
+    uint32_t level = it->second.level;
+    allocatedSize -= blockSize(level);
+    requestedSize -= it->second.requested;
+    allocations.erase(it);
+
+    // Merge with the buddy for as long as the buddy is free too. A block's buddy is found by flipping the bit that
+    // corresponds to the block size.
+    while (level > 0) {
+        uint64_t buddy = offset ^ blockSize(level);
+        auto buddyIt = freeLists[level].find(buddy);
+        if (buddyIt == freeLists[level].end()) break;
+
+        freeLists[level].erase(buddyIt);
+        offset = std::min(offset, buddy);
+        level--;
+    }
+
+    freeLists[level].insert(offset);
+}
+
+uint64_t BuddyAllocator::largestFreeBlock() const {
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+        if (!freeLists[level].empty()) return blockSize(level);
+    }
+    return 0;
+}
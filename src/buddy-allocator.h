@@ -0,0 +1,53 @@
+// buddy-allocator.h
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// Binary buddy allocator over an abstract range of [0, capacity). It hands out offsets only and never touches
+// memory, so the same code manages sub-ranges of a VkDeviceMemory block or anything else.
+//
+// Every allocation is rounded up to a power of two (at least minBlockSize) and sits at an offset that is a multiple
+// of its rounded size. That makes any power-of-two alignment up to the rounded size free, which is exactly what
+// Vulkan's memory requirements ask for. Freed blocks merge with their buddy, so the range never fragments into
+// pieces that can't be put back together.
+
+class BuddyAllocator {
+
+public:
+
+	// capacity and minBlockSize must both be powers of two
+	BuddyAllocator(uint64_t capacity, uint64_t minBlockSize);
+
+	std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment);
+	void free(uint64_t offset);
+
+	uint64_t capacity() const { return totalSize; }
+	uint64_t bytesAllocated() const { return allocatedSize; }   // Rounded sizes, what's actually unavailable
+	uint64_t bytesRequested() const { return requestedSize; }   // What callers asked for
+	uint64_t largestFreeBlock() const;
+	size_t allocationCount() const { return allocations.size(); }
+	bool empty() const { return allocations.empty(); }
+
+private:
+
+	struct Allocation {
+		uint32_t level;
+		uint64_t requested;
+	};
+
+	uint64_t blockSize(uint32_t level) const { return totalSize >> level; }
+
+	const uint64_t totalSize;
+	const uint32_t levelCount;      // Level 0 is the whole range, the last level is minBlockSize
+
+	std::vector<std::set<uint64_t>> freeLists;              // Free block offsets, per level
+	std::unordered_map<uint64_t, Allocation> allocations;   // Keyed by offset
+
+	uint64_t allocatedSize = 0;
+	uint64_t requestedSize = 0;
+};
@@ -0,0 +1,86 @@
+// cache-directory.cpp
+
+#include <cstdlib>
+#include <fstream>
+#include <system_error>
+#include "cache-directory.h"
+
+namespace fs = std::filesystem;
+
+static fs::path defaultCacheRoot() {
+
+    if (const char* dir = std::getenv("VKTEST_CACHE_DIR")) {
+        return dir;
+    }
+#ifdef _WIN32
+    if (const char* localAppData = std::getenv("LOCALAPPDATA")) {
+        return fs::path(localAppData) / "vulkan-test";
+    }
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        return fs::path(xdg) / "vulkan-test";
+    }
+    if (const char* home = std::getenv("HOME")) {
+        return fs::path(home) / ".cache" / "vulkan-test";
+    }
+#endif
+    return {};
+}
+
+fs::path cacheDirectory() {
+
+    // Resolved once. Nothing here changes while the program runs.
+    static const fs::path directory = []() -> fs::path {
+        fs::path root = defaultCacheRoot();
+        if (root.empty()) return {};
+
+        std::error_code error;
+        fs::create_directories(root, error);
+        return error ? fs::path() : root;
+    }();
+
+    return directory;
+}
+
+std::optional<std::vector<char>> readCacheFile(const fs::path& path) {
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return std::nullopt;
+
+    std::streamsize size = file.tellg();
+    if (size < 0) return std::nullopt;
+
+    std::vector<char> data(static_cast<size_t>(size));
+    file.seekg(0);
+    if (!file.read(data.data(), size)) return std::nullopt;
+
+    return data;
+}
+
+bool writeCacheFileAtomically(const fs::path& path, const void* data, size_t size) {
+
+    fs::path temporary = path;
+    temporary += ".tmp";
+
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!file.flush()) {
+            file.close();
+            std::error_code ignored;
+            fs::remove(temporary, ignored);
+            return false;
+        }
+    }
+
+    // rename() replaces the destination in one step on both POSIX and Windows (MoveFileEx with REPLACE_EXISTING)
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+// cache-directory.h
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Where things that make the next startup faster get stored (chosen device, pipeline cache, ...).
+//
+// VKTEST_CACHE_DIR wins if set. Otherwise it's %LOCALAPPDATA%\vulkan-test on Windows and
+// $XDG_CACHE_HOME/vulkan-test (or ~/.cache/vulkan-test) elsewhere. The directory is created on first use.
+// An empty path means no usable location was found, in which case callers just skip caching.
+std::filesystem::path cacheDirectory();
+
+// Reads a whole file. Returns nothing if it doesn't exist or can't be read.
+std::optional<std::vector<char>> readCacheFile(const std::filesystem::path& path);
+
+// Writes to a temporary file next to the target and renames it over the top, so a crash or a second instance
+// writing at the same time can never leave a half-written file behind. Returns false on failure.
+bool writeCacheFileAtomically(const std::filesystem::path& path, const void* data, size_t size);
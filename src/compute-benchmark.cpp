@@ -0,0 +1,93 @@
+// compute-benchmark.cpp
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "frame-stats.h"
+#include "simd-kernels.h"
+
+// The compute kernels against their CPU versions on the same random input. Every GPU result is checked against the
+// CPU one, so a mismatch shows up in the table instead of as a wrong number somewhere later.
+//
+// GPU times are for the host-vector calls, so they include writing the input into mapped memory and reading the
+// result back. That's the cost a caller of ComputeKernels actually pays for a one-off; kernels chained through the
+// record* calls without leaving the GPU don't pay it.
+
+std::vector<ComputeKernelTiming> Application::measureCompute(uint32_t elements) {
+
+    std::mt19937 random(elements);
+    std::vector<uint32_t> values(elements);
+    for (uint32_t& value : values) value = random();
+
+    std::vector<ComputeKernelTiming> timings;
+    auto nothing = [] {};
+    bool gpu = kernels.available();
+
+    // Sum
+    {
+        uint32_t cpuResult = 0, gpuResult = 0;
+        FrameStats cpu = timeRuns("cpu", nothing, [&] { cpuResult = cpuReduce(values.data(), values.size()); });
+        FrameStats gpuStats("gpu");
+        if (gpu) gpuStats = timeRuns("gpu", nothing, [&] { gpuResult = kernels.reduce(values); });
+        timings.push_back({ "reduce", cpu, gpuStats, !gpu || gpuResult == cpuResult });
+    }
+
+    // Prefix sum
+    {
+        std::vector<uint32_t> cpuResult(elements), gpuResult;
+        FrameStats cpu = timeRuns("cpu", nothing, [&] { cpuExclusiveScan(values.data(), cpuResult.data(), values.size()); });
+        FrameStats gpuStats("gpu");
+        if (gpu) gpuStats = timeRuns("gpu", nothing, [&] { gpuResult = kernels.exclusiveScan(values); });
+        timings.push_back({ "exclusive_scan", cpu, gpuStats, !gpu || gpuResult == cpuResult });
+    }
+
+    // Histogram of the second byte, so the low bits the generator sets least carefully don't matter
+    {
+        std::vector<uint32_t> cpuResult(256), gpuResult;
+        FrameStats cpu = timeRuns("cpu", nothing, [&] { cpuHistogram(values.data(), values.size(), 8, cpuResult.data()); });
+        FrameStats gpuStats("gpu");
+        if (gpu) gpuStats = timeRuns("gpu", nothing, [&] { gpuResult = kernels.histogram(values, 8); });
+        timings.push_back({ "histogram", cpu, gpuStats, !gpu || gpuResult == cpuResult });
+    }
+
+    // Sorting is in place, so every run starts again from a copy of the unsorted values
+    {
+        std::vector<uint32_t> cpuKeys, gpuKeys;
+        FrameStats cpu = timeRuns("cpu", [&] { cpuKeys = values; }, [&] { cpuRadixSort(cpuKeys); });
+        FrameStats gpuStats("gpu");
+        if (gpu) gpuStats = timeRuns("gpu", [&] { gpuKeys = values; }, [&] { kernels.radixSort(gpuKeys); });
+        timings.push_back({ "radix_sort", cpu, gpuStats, !gpu || gpuKeys == cpuKeys });
+    }
+
+    return timings;
+}
+
+void Application::runComputeBenchmark() {
+
+    const uint32_t elements = computeBenchmarkElements;
+
+    std::cout << "\nCompute benchmark: " << elements << " uints, " << BenchmarkRuns{}.measured << " runs per kernel, CPU "
+        << simdInstructionSet() << (kernels.available() ? "" : ", no GPU kernels (shaders not found)") << "\n"
+        << "    kernel             cpu ms     gpu ms   cpu Melem/s   gpu Melem/s   speedup   result\n";
+
+    for (const ComputeKernelTiming& timing : measureCompute(elements)) {
+        double cpu = timing.cpu.mean();
+        double gpu = timing.gpu.count() > 0 ? timing.gpu.mean() : 0.0;
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "    " << std::left << std::setw(15) << timing.kernel << std::right
+            << std::setw(10) << cpu << std::setw(11) << gpu
+            << std::setprecision(1)
+            << std::setw(14) << (cpu > 0.0 ? elements / cpu / 1000.0 : 0.0)
+            << std::setw(14) << (gpu > 0.0 ? elements / gpu / 1000.0 : 0.0)
+            << std::setw(9) << std::setprecision(2) << (gpu > 0.0 ? cpu / gpu : 0.0) << "x"
+            << "   " << (timing.gpu.count() == 0 ? "cpu only" : timing.matches ? "match" : "MISMATCH") << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    compute.report(std::cout);
+    kernels.report(std::cout);
+}
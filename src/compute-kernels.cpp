@@ -0,0 +1,267 @@
+// compute-kernels.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include "compute-kernels.h"
+#include "simd-kernels.h"
+
+const ComputeKernels::KernelInfo ComputeKernels::kernelInfo[KernelCount] = {
+    { "reduce.spv", 2 },
+    { "scan.spv", 3 },
+    { "add-offsets.spv", 2 },
+    { "histogram.spv", 2 },
+    { "radix-count.spv", 2 },
+    { "radix-scatter.spv", 3 },
+};
+
+void ComputeKernels::create(ComputeContext& compute, ShaderLibrary& shaders, const std::string& shaderDir) {
+
+    this->compute = &compute;
+    this->shaders = &shaders;
+
+    try {
+        for (uint32_t kernel = 0; kernel < KernelCount; kernel++) {
+            shaderHandles[kernel] = shaders.load(shaderDir + "/" + kernelInfo[kernel].file);
+        }
+    }
+    catch (const std::runtime_error& error) {
+        // Not fatal: nothing in the frame depends on these, and the CPU versions give the same results
+        std::clog << "Compute kernels unavailable (" << error.what() << "), using the CPU versions ("
+            << simdInstructionSet() << ")" << std::endl;
+        return;
+    }
+
+    for (uint32_t kernel = 0; kernel < KernelCount; kernel++) {
+        pipelines[kernel] = compute.createPipeline(shaders.module(shaderHandles[kernel]), kernelInfo[kernel].bindingCount,
+            sizeof(PushConstants));
+    }
+    created = true;
+}
+
+void ComputeKernels::destroy() {
+
+    if (!created) return;
+
+    for (ComputePipeline& pipeline : pipelines) {
+        compute->destroyPipeline(pipeline);
+    }
+    created = false;
+}
+
+void ComputeKernels::reload(const std::vector<ShaderHandle>& changed) {
+
+    if (!created) return;
+
+    // Every submit waits for itself, so no pipeline is in use between calls and the old one can go right away
+    for (uint32_t kernel = 0; kernel < KernelCount; kernel++) {
+        if (std::find(changed.begin(), changed.end(), shaderHandles[kernel]) == changed.end()) continue;
+
+        ComputePipeline rebuilt;
+        try {
+            rebuilt = compute->createPipeline(shaders->module(shaderHandles[kernel]), kernelInfo[kernel].bindingCount,
+                sizeof(PushConstants));
+        }
+        catch (const std::runtime_error& error) {
+            std::clog << "Keeping the old " << kernelInfo[kernel].file << " pipeline: " << error.what() << std::endl;
+            continue;
+        }
+        compute->destroyPipeline(pipelines[kernel]);
+        pipelines[kernel] = rebuilt;
+        rebuilds++;
+    }
+}
+
+void ComputeKernels::checkCount(size_t count) {
+
+    if (count > 0xffffff00u) {
+        throw std::runtime_error("too many values for a compute kernel!");
+    }
+}
+
+void ComputeKernels::recordReduce(const ComputeBuffer& values, uint32_t count, const ComputeBuffer& result) {
+
+    PushConstants params{ count, 0, (count + blockSize - 1) / blockSize };
+
+    compute->fill(result, 0);
+    compute->dispatch(pipelines[Reduce], { &values, &result }, &params, params.blockCount);
+}
+
+void ComputeKernels::recordExclusiveScan(const ComputeBuffer& values, const ComputeBuffer& output, uint32_t count) {
+
+    if (count == 0) return;
+
+    PushConstants params{ count, 0, (count + blockSize - 1) / blockSize };
+
+    ComputeBuffer blockSums = compute->scratchBuffer(params.blockCount * sizeof(uint32_t));
+    compute->dispatch(pipelines[Scan], { &values, &output, &blockSums }, &params, params.blockCount);
+
+    // Each block was scanned on its own, so every block still needs the total of all the blocks before it
+    if (params.blockCount > 1) {
+        ComputeBuffer blockOffsets = compute->scratchBuffer(params.blockCount * sizeof(uint32_t));
+        recordExclusiveScan(blockSums, blockOffsets, params.blockCount);
+        compute->dispatch(pipelines[AddOffsets], { &output, &blockOffsets }, &params, params.blockCount);
+    }
+}
+
+void ComputeKernels::recordHistogram(const ComputeBuffer& values, uint32_t count, uint32_t shift, const ComputeBuffer& bins) {
+
+    if (shift >= 32) {
+        throw std::runtime_error("histogram shift out of range!");
+    }
+
+    PushConstants params{ count, shift, (count + blockSize - 1) / blockSize };
+
+    compute->fill(bins, 0);
+    compute->dispatch(pipelines[Histogram], { &values, &bins }, &params, params.blockCount);
+}
+
+void ComputeKernels::recordRadixPass(const ComputeBuffer& keysIn, const ComputeBuffer& keysOut, uint32_t count, uint32_t shift) {
+
+    if (count == 0) return;
+
+    PushConstants params{ count, shift, (count + radixBlockSize - 1) / radixBlockSize };
+    uint32_t countCount = params.blockCount * 256;
+
+    // Digit-major counts, scanned into where each block's keys of each digit start
+    ComputeBuffer counts = compute->scratchBuffer(static_cast<VkDeviceSize>(countCount) * sizeof(uint32_t));
+    ComputeBuffer offsets = compute->scratchBuffer(static_cast<VkDeviceSize>(countCount) * sizeof(uint32_t));
+
+    compute->dispatch(pipelines[RadixCount], { &keysIn, &counts }, &params, params.blockCount);
+    recordExclusiveScan(counts, offsets, countCount);
+    compute->dispatch(pipelines[RadixScatter], { &keysIn, &keysOut, &offsets }, &params, params.blockCount);
+}
+
+uint32_t ComputeKernels::reduce(const std::vector<uint32_t>& values) {
+
+    checkCount(values.size());
+    if (!created) {
+        cpuCalls++;
+        return cpuReduce(values.data(), values.size());
+    }
+    gpuCalls++;
+
+    uint32_t count = static_cast<uint32_t>(values.size());
+    ComputeBuffer input = compute->createBuffer(static_cast<VkDeviceSize>(count) * sizeof(uint32_t));
+    ComputeBuffer result = compute->createBuffer(sizeof(uint32_t));
+    std::memcpy(input.mapped(), values.data(), values.size() * sizeof(uint32_t));
+
+    compute->begin();
+    recordReduce(input, count, result);
+    compute->submitAndWait();
+
+    uint32_t total;
+    std::memcpy(&total, result.mapped(), sizeof(total));
+
+    compute->destroyBuffer(input);
+    compute->destroyBuffer(result);
+    return total;
+}
+
+std::vector<uint32_t> ComputeKernels::exclusiveScan(const std::vector<uint32_t>& values) {
+
+    checkCount(values.size());
+    std::vector<uint32_t> scanned(values.size());
+    if (!created) {
+        cpuCalls++;
+        cpuExclusiveScan(values.data(), scanned.data(), values.size());
+        return scanned;
+    }
+    gpuCalls++;
+
+    uint32_t count = static_cast<uint32_t>(values.size());
+    VkDeviceSize size = static_cast<VkDeviceSize>(count) * sizeof(uint32_t);
+    ComputeBuffer input = compute->createBuffer(size);
+    ComputeBuffer output = compute->createBuffer(size);
+    std::memcpy(input.mapped(), values.data(), values.size() * sizeof(uint32_t));
+
+    compute->begin();
+    recordExclusiveScan(input, output, count);
+    compute->submitAndWait();
+
+    std::memcpy(scanned.data(), output.mapped(), scanned.size() * sizeof(uint32_t));
+
+    compute->destroyBuffer(input);
+    compute->destroyBuffer(output);
+    return scanned;
+}
+
+std::vector<uint32_t> ComputeKernels::histogram(const std::vector<uint32_t>& values, uint32_t shift) {
+
+    checkCount(values.size());
+    std::vector<uint32_t> bins(256);
+    if (!created) {
+        if (shift >= 32) {
+            throw std::runtime_error("histogram shift out of range!");
+        }
+        cpuCalls++;
+        cpuHistogram(values.data(), values.size(), shift, bins.data());
+        return bins;
+    }
+    gpuCalls++;
+
+    uint32_t count = static_cast<uint32_t>(values.size());
+    ComputeBuffer input = compute->createBuffer(static_cast<VkDeviceSize>(count) * sizeof(uint32_t));
+    ComputeBuffer output = compute->createBuffer(bins.size() * sizeof(uint32_t));
+    std::memcpy(input.mapped(), values.data(), values.size() * sizeof(uint32_t));
+
+    compute->begin();
+    recordHistogram(input, count, shift, output);
+    compute->submitAndWait();
+
+    std::memcpy(bins.data(), output.mapped(), bins.size() * sizeof(uint32_t));
+
+    compute->destroyBuffer(input);
+    compute->destroyBuffer(output);
+    return bins;
+}
+
+void ComputeKernels::radixSort(std::vector<uint32_t>& keys) {
+
+    checkCount(keys.size());
+    if (!created) {
+        cpuCalls++;
+        cpuRadixSort(keys);
+        return;
+    }
+    if (keys.size() < 2) return;
+    gpuCalls++;
+
+    // Same shortcut as the CPU version: a digit that's the same in every key doesn't need a pass. One cheap read of
+    // the keys on the host saves up to three full count/scan/scatter rounds on the GPU.
+    uint32_t differing = 0;
+    for (uint32_t key : keys) differing |= key ^ keys[0];
+
+    uint32_t count = static_cast<uint32_t>(keys.size());
+    VkDeviceSize size = static_cast<VkDeviceSize>(count) * sizeof(uint32_t);
+    ComputeBuffer buffers[2] = { compute->createBuffer(size), compute->createBuffer(size) };
+    std::memcpy(buffers[0].mapped(), keys.data(), keys.size() * sizeof(uint32_t));
+
+    // Ping-pong between the two buffers, all passes in one submit
+    uint32_t source = 0;
+    compute->begin();
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        if (((differing >> shift) & 255) == 0) continue;
+        recordRadixPass(buffers[source], buffers[1 - source], count, shift);
+        source = 1 - source;
+    }
+    compute->submitAndWait();
+
+    std::memcpy(keys.data(), buffers[source].mapped(), keys.size() * sizeof(uint32_t));
+
+    compute->destroyBuffer(buffers[0]);
+    compute->destroyBuffer(buffers[1]);
+}
+
+void ComputeKernels::report(std::ostream& out) const {
+
+    if (gpuCalls == 0 && cpuCalls == 0) return;
+
+    out << "Compute kernels: " << gpuCalls << " calls on the GPU, " << cpuCalls << " on the CPU ("
+        << simdInstructionSet() << ")";
+    if (rebuilds > 0) {
+        out << ", " << rebuilds << " pipelines rebuilt after shader reloads";
+    }
+    out << "\n";
+}
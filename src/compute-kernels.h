@@ -0,0 +1,86 @@
+// compute-kernels.h
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "compute.h"
+#include "shader-library.h"
+
+// Reduce, exclusive scan, histogram and radix sort on 32-bit unsigned values, built on ComputeContext.
+//
+// The shaders come precompiled from the shader directory (see shaderDirectory()), through the shader library. When
+// they're missing the kernels aren't available and every call runs the CPU version from simd-kernels.h instead, so
+// callers never have to care. With hot reload on, reload() rebuilds the pipelines of whichever shaders changed.
+//
+// Two levels: the host-vector calls upload, record, submit, wait and read back in one go, and are what you want for
+// a one-off. The record* calls only record into the context's current command buffer, so several steps (or several
+// kernels) can share a single submit and their intermediate results never leave the GPU.
+
+class ComputeKernels {
+
+public:
+
+	void create(ComputeContext& compute, ShaderLibrary& shaders, const std::string& shaderDir);
+	void destroy();
+
+	// changed is what ShaderLibrary::applyReloads returned
+	void reload(const std::vector<ShaderHandle>& changed);
+
+	bool available() const { return created; }
+
+	uint32_t reduce(const std::vector<uint32_t>& values);
+	std::vector<uint32_t> exclusiveScan(const std::vector<uint32_t>& values);
+	std::vector<uint32_t> histogram(const std::vector<uint32_t>& values, uint32_t shift);
+	void radixSort(std::vector<uint32_t>& keys);
+
+	// result (4 bytes) is zeroed and then receives the sum of the first count values
+	void recordReduce(const ComputeBuffer& values, uint32_t count, const ComputeBuffer& result);
+	// output may not be values. Recursive for more than 1024 values; block totals go into scratch buffers.
+	void recordExclusiveScan(const ComputeBuffer& values, const ComputeBuffer& output, uint32_t count);
+	// bins (256 * 4 bytes) are zeroed first
+	void recordHistogram(const ComputeBuffer& values, uint32_t count, uint32_t shift, const ComputeBuffer& bins);
+	// One 8-bit pass from keysIn to keysOut
+	void recordRadixPass(const ComputeBuffer& keysIn, const ComputeBuffer& keysOut, uint32_t count, uint32_t shift);
+
+	void report(std::ostream& out) const;
+
+private:
+
+	// Matches Params in every shader
+	struct PushConstants {
+		uint32_t count;
+		uint32_t shift;
+		uint32_t blockCount;
+	};
+
+	// Elements per workgroup
+	static constexpr uint32_t blockSize = 1024;
+	static constexpr uint32_t radixBlockSize = 256;
+
+	// Counts are uint32_t on the GPU, and that includes radix sort's 256 digit counts per block of 256 keys
+	static void checkCount(size_t count);
+
+	ComputeContext* compute = nullptr;
+	bool created = false;
+
+	enum Kernel { Reduce, Scan, AddOffsets, Histogram, RadixCount, RadixScatter, KernelCount };
+
+	// Shader file name and storage buffer count of each kernel
+	struct KernelInfo {
+		const char* file;
+		uint32_t bindingCount;
+	};
+	static const KernelInfo kernelInfo[KernelCount];
+
+	ShaderLibrary* shaders = nullptr;
+	ShaderHandle shaderHandles[KernelCount] = {};
+	ComputePipeline pipelines[KernelCount];
+
+	// Calls that went to the GPU and to the CPU fallback, and pipelines rebuilt after a reload
+	uint64_t gpuCalls = 0;
+	uint64_t cpuCalls = 0;
+	uint32_t rebuilds = 0;
+};
@@ -0,0 +1,295 @@
+// compute.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#include "compute.h"
+#include "frame-stats.h"
+
+void ComputeContext::create(VkPhysicalDevice physicalDevice, VkDevice device, DeviceAllocator& allocator, PipelineCache& pipelineCache,
+    VkQueue queue, uint32_t queueFamily, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocator = &allocator;
+    this->pipelineCache = &pipelineCache;
+    this->queue = queue;
+    this->allocationCallbacks = allocationCallbacks;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    maxGroupCountX = properties.limits.maxComputeWorkGroupCount[0];
+    maxGroupCountY = properties.limits.maxComputeWorkGroupCount[1];
+
+    // One command buffer, re-recorded for every submit
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate compute command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(device, &fenceInfo, allocationCallbacks, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute fence!");
+    }
+
+    descriptorPools.create(device, 1, setsPerPool, { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setsPerPool * maxBindings } },
+        allocationCallbacks);
+    descriptorPools.beginFrame(0);
+}
+
+void ComputeContext::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+    for (ComputeBuffer& buffer : scratch) {
+        destroyBuffer(buffer);
+    }
+    scratch.clear();
+
+    descriptorPools.destroy();
+
+    vkDestroyFence(device, fence, allocationCallbacks);
+    vkDestroyCommandPool(device, commandPool, allocationCallbacks);
+    device = VK_NULL_HANDLE;
+}
+
+ComputePipeline ComputeContext::createPipeline(VkShaderModule shaderModule, uint32_t bindingCount, uint32_t pushConstantSize) {
+
+    if (bindingCount > maxBindings) {
+        throw std::runtime_error("too many bindings for a compute pipeline!");
+    }
+
+    ComputePipeline pipeline;
+    pipeline.bindingCount = bindingCount;
+    pipeline.pushConstantSize = pushConstantSize;
+
+    VkDescriptorSetLayoutBinding bindings[maxBindings]{};
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = bindingCount;
+    setLayoutInfo.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, allocationCallbacks, &pipeline.setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &pipeline.setLayout;
+    layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &layoutInfo, allocationCallbacks, &pipeline.layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipeline.layout;
+
+    if (pipelineCache->createComputePipeline(pipelineInfo, &pipeline.pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+    return pipeline;
+}
+
+void ComputeContext::destroyPipeline(ComputePipeline& pipeline) {
+
+    vkDestroyPipeline(device, pipeline.pipeline, allocationCallbacks);
+    vkDestroyPipelineLayout(device, pipeline.layout, allocationCallbacks);
+    vkDestroyDescriptorSetLayout(device, pipeline.setLayout, allocationCallbacks);
+    pipeline = {};
+}
+
+ComputeBuffer ComputeContext::createBuffer(VkDeviceSize size) {
+
+    // Zero-sized buffers aren't allowed, and empty inputs still get bound
+    ComputeBuffer buffer;
+    buffer.size = std::max<VkDeviceSize>(size, 4);
+    buffer.buffer = allocator->createBuffer(buffer.size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffer.allocation);
+    return buffer;
+}
+
+void ComputeContext::destroyBuffer(ComputeBuffer& buffer) {
+
+    if (buffer.buffer == VK_NULL_HANDLE) return;
+    allocator->destroyBuffer(buffer.buffer, buffer.allocation);
+    buffer = {};
+}
+
+ComputeBuffer ComputeContext::scratchBuffer(VkDeviceSize size) {
+
+    scratch.push_back(createBuffer(size));
+    return scratch.back();
+}
+
+void ComputeContext::begin() {
+
+    if (recording) {
+        throw std::runtime_error("compute work is already being recorded!");
+    }
+
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording compute command buffer!");
+    }
+    recording = true;
+}
+
+void ComputeContext::barrier(VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = srcAccess;
+    memoryBarrier.dstAccessMask = dstAccess;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void ComputeContext::fill(const ComputeBuffer& buffer, uint32_t value) {
+
+    vkCmdFillBuffer(commandBuffer, buffer.buffer, 0, VK_WHOLE_SIZE, value);
+    barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void ComputeContext::dispatch(const ComputePipeline& pipeline, std::initializer_list<const ComputeBuffer*> buffers,
+    const void* pushConstants, uint32_t groupCount) {
+
+    if (!recording) {
+        throw std::runtime_error("compute dispatch outside of begin() and submitAndWait()!");
+    }
+    if (buffers.size() != pipeline.bindingCount) {
+        throw std::runtime_error("compute dispatch with the wrong number of buffers!");
+    }
+    if (groupCount == 0) return;
+
+    VkDescriptorSet set = descriptorPools.allocate(pipeline.setLayout);
+
+    VkDescriptorBufferInfo bufferInfos[maxBindings]{};
+    VkWriteDescriptorSet writes[maxBindings]{};
+    uint32_t binding = 0;
+    for (const ComputeBuffer* buffer : buffers) {
+        bufferInfos[binding].buffer = buffer->buffer;
+        bufferInfos[binding].range = VK_WHOLE_SIZE;
+
+        writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[binding].dstSet = set;
+        writes[binding].dstBinding = binding;
+        writes[binding].descriptorCount = 1;
+        writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[binding].pBufferInfo = &bufferInfos[binding];
+        binding++;
+    }
+    descriptorPools.update(writes, binding);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1, &set, 0, nullptr);
+    if (pipeline.pushConstantSize > 0) {
+        vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pipeline.pushConstantSize, pushConstants);
+    }
+
+    // Wider than one row allows: a grid of full rows, and the shader skips the groups past the end
+    uint32_t x = std::min(groupCount, maxGroupCountX);
+    uint32_t y = (groupCount + x - 1) / x;
+    if (y > maxGroupCountY) {
+        throw std::runtime_error("compute dispatch too large!");
+    }
+    vkCmdDispatch(commandBuffer, x, y, 1);
+
+    // Whatever comes next can read what this wrote, or overwrite what it read
+    barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    dispatches++;
+    groups += static_cast<uint64_t>(x) * y;
+}
+
+void ComputeContext::submitAndWait() {
+
+    if (!recording) return;
+    recording = false;
+
+    // Results are read through the mapping, so shader writes have to be made visible to the host
+    barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record compute command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    auto start = std::chrono::steady_clock::now();
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit compute work!");
+    }
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &fence);
+    waitMilliseconds += elapsedMilliseconds(start, std::chrono::steady_clock::now());
+    submits++;
+
+    // The GPU is done with everything this submit used
+    for (ComputeBuffer& buffer : scratch) {
+        destroyBuffer(buffer);
+    }
+    scratch.clear();
+
+    descriptorPools.beginFrame(0);
+}
+
+void ComputeContext::report(std::ostream& out) const {
+
+    if (submits == 0) return;
+
+    out << std::fixed << std::setprecision(2)
+        << "\nCompute: " << dispatches << " dispatches (" << groups << " workgroups) in " << submits << " submits, "
+        << waitMilliseconds << " ms submit to completion\n";
+    out.unsetf(std::ios::floatfield);
+    descriptorPools.report(out, "    Compute");
+}
@@ -0,0 +1,106 @@
+// compute.h
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <ostream>
+#include <vector>
+#include "include.h"
+#include "device-allocator.h"
+#include "pipeline-cache.h"
+#include "frame-descriptor-pools.h"
+
+// Data-parallel work on the compute queue (a dedicated family when the device has one, see QueueFamilyIndices).
+//
+// Pipelines are built from shader modules through the application's pipeline cache. They all share one shape: a single
+// descriptor set of storage buffers, and up to 16 bytes of push constants. Buffers are host visible and coherent,
+// preferring device-local memory where the device has it (all of it on integrated GPUs and lavapipe), so inputs
+// are written and results read through the mapping without any staging.
+//
+// Work is recorded between begin() and submitAndWait() into one command buffer. Every dispatch is followed by a
+// barrier that makes its writes visible to whatever comes next, so dispatches can feed each other without any
+// extra bookkeeping. Descriptor sets and scratch buffers live until the submit is done.
+
+struct ComputeBuffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	DeviceAllocation allocation;
+	VkDeviceSize size = 0;
+
+	void* mapped() const { return allocation.mapped; }
+};
+
+struct ComputePipeline {
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	uint32_t bindingCount = 0;
+	uint32_t pushConstantSize = 0;
+};
+
+class ComputeContext {
+
+public:
+
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, DeviceAllocator& allocator, PipelineCache& pipelineCache,
+		VkQueue queue, uint32_t queueFamily, const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// bindingCount storage buffers at bindings 0 to bindingCount - 1, and pushConstantSize bytes of push constants.
+	// The module can go as soon as this returns, see shader-library.h.
+	ComputePipeline createPipeline(VkShaderModule shaderModule, uint32_t bindingCount, uint32_t pushConstantSize);
+	void destroyPipeline(ComputePipeline& pipeline);
+
+	ComputeBuffer createBuffer(VkDeviceSize size);
+	void destroyBuffer(ComputeBuffer& buffer);
+
+	// A buffer that's destroyed after the next submitAndWait, for intermediate results
+	ComputeBuffer scratchBuffer(VkDeviceSize size);
+
+	void begin();
+
+	void fill(const ComputeBuffer& buffer, uint32_t value);
+
+	// groupCount workgroups of pipeline, with buffers bound in order. Counts above maxComputeWorkGroupCount[0] are
+	// split into rows, so shaders have to work out their group as gl_WorkGroupID.y * gl_NumWorkGroups.x +
+	// gl_WorkGroupID.x and skip anything past the count they were given.
+	void dispatch(const ComputePipeline& pipeline, std::initializer_list<const ComputeBuffer*> buffers,
+		const void* pushConstants, uint32_t groupCount);
+
+	void submitAndWait();
+
+	bool isCreated() const { return device != VK_NULL_HANDLE; }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	void barrier(VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	static constexpr uint32_t setsPerPool = 256;
+	static constexpr uint32_t maxBindings = 6;
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	DeviceAllocator* allocator = nullptr;
+	PipelineCache* pipelineCache = nullptr;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t maxGroupCountX = 65535;
+	uint32_t maxGroupCountY = 65535;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	bool recording = false;
+
+	// One "frame" per submit, reset as soon as it's done
+	FrameDescriptorPools descriptorPools;
+
+	std::vector<ComputeBuffer> scratch;
+
+	// Bookkeeping for the report
+	uint64_t dispatches = 0;
+	uint64_t groups = 0;
+	uint64_t submits = 0;
+	double waitMilliseconds = 0.0;
+};
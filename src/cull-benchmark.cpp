@@ -0,0 +1,140 @@
+// cull-benchmark.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "frame-stats.h"
+#include "simd-kernels.h"
+
+// Frustum culling and draw batching on the CPU and the GPU, over a random scene: instances of a few dozen meshes
+// scattered through a cube around a camera looking down -z. Each GPU row's visible instances are compared with the
+// CPU's mesh by mesh (see drawnInstances), and the result column says whether culling on the GPU dropped or added any.
+//
+// GPU times are submit to completion plus reading the draws back, which is what DrawCuller::cullGpu costs its caller.
+// The moving row changes every instance before each run, so the GPU also pays for uploading the bounds again.
+
+static constexpr uint32_t sceneMeshes = 64;
+static constexpr float sceneExtent = 200.0f;
+
+// Every mesh's drawn instances in ascending order, keyed by the mesh's first index (unique in this scene). The two
+// paths order their draws and the instances within a draw differently, but these come out the same.
+static std::map<uint32_t, std::vector<uint32_t>> drawnInstances(const DrawCuller& culler) {
+
+    std::map<uint32_t, std::vector<uint32_t>> drawn;
+    const VkDrawIndexedIndirectCommand* draws = culler.draws(0);
+    const uint32_t* visible = culler.visibleInstanceIndices(0);
+    for (uint32_t draw = 0; draw < culler.drawCount(0); draw++) {
+        std::vector<uint32_t>& instances = drawn[draws[draw].firstIndex];
+        instances.assign(visible + draws[draw].firstInstance, visible + draws[draw].firstInstance + draws[draw].instanceCount);
+        std::sort(instances.begin(), instances.end());
+    }
+    return drawn;
+}
+
+std::vector<ComputeKernelTiming> Application::measureCulling(uint32_t instances) {
+
+    // A 60 degree perspective camera at the origin, with Vulkan's 0..1 depth and flipped y
+    const float nearPlane = 0.1f, farPlane = 300.0f;
+    const float focal = 1.0f / std::tan(0.5f * 60.0f * 3.14159265f / 180.0f);
+    const float aspect = float(WIDTH) / float(HEIGHT);
+    float projection[16] = {};
+    projection[0] = focal / aspect;
+    projection[5] = -focal;
+    projection[10] = farPlane / (nearPlane - farPlane);
+    projection[11] = -1.0f;
+    projection[14] = nearPlane * farPlane / (nearPlane - farPlane);
+    Frustum frustum = Frustum::fromMatrix(projection);
+
+    // A cube's worth of indices per mesh, each mesh in its own place
+    InstanceStore store;
+    for (uint32_t mesh = 0; mesh < sceneMeshes; mesh++) {
+        store.addMesh({ 36, mesh * 36, static_cast<int32_t>(mesh * 24) });
+    }
+
+    std::mt19937 random(instances);
+    std::uniform_real_distribution<float> position(-sceneExtent, sceneExtent);
+    std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+    for (uint32_t i = 0; i < instances; i++) {
+        store.add(random() % sceneMeshes, position(random), position(random), position(random), radius(random));
+    }
+
+    std::vector<ComputeKernelTiming> timings;
+    auto nothing = [] {};
+    bool gpu = culler.gpuAvailable();
+
+    // The sphere tests on their own, with nothing to compare against on the GPU
+    {
+        std::vector<uint32_t> visible(instances);
+        FrameStats cpu = timeRuns("cpu", nothing, [&] {
+            cpuFrustumCull(frustum.planes, store.x(), store.y(), store.z(), store.radius(), instances, visible.data());
+        });
+        timings.push_back({ "frustum_test", cpu, FrameStats("gpu"), true });
+    }
+
+    // Culling and batching into draws, a static scene
+    {
+        FrameStats cpu = timeRuns("cpu", nothing, [&] { culler.cullCpu(store, frustum, 0); });
+        std::map<uint32_t, std::vector<uint32_t>> cpuDrawn = drawnInstances(culler);
+        FrameStats gpuStats("gpu");
+        bool matches = true;
+        if (gpu) {
+            gpuStats = timeRuns("gpu", nothing, [&] { culler.cullGpu(store, frustum, 0); });
+            matches = drawnInstances(culler) == cpuDrawn;
+        }
+        timings.push_back({ "cull_and_batch", cpu, gpuStats, matches });
+    }
+
+    // The same with every instance moved before each run
+    {
+        auto move = [&] {
+            for (uint32_t i = 0; i < instances; i++) {
+                store.move(i, store.x()[i] + 0.25f, store.y()[i], store.z()[i], store.radius()[i]);
+            }
+        };
+        FrameStats cpu = timeRuns("cpu", move, [&] { culler.cullCpu(store, frustum, 0); });
+        FrameStats gpuStats("gpu");
+        bool matches = true;
+        if (gpu) {
+            gpuStats = timeRuns("gpu", move, [&] { culler.cullGpu(store, frustum, 0); });
+            std::map<uint32_t, std::vector<uint32_t>> gpuDrawn = drawnInstances(culler);
+            culler.cullCpu(store, frustum, 0);
+            matches = drawnInstances(culler) == gpuDrawn;
+        }
+        timings.push_back({ "cull_and_batch_moving", cpu, gpuStats, matches });
+    }
+
+    return timings;
+}
+
+void Application::runCullBenchmark() {
+
+    const uint32_t instances = cullBenchmarkInstances;
+
+    std::cout << "\nCulling benchmark: " << instances << " instances of " << sceneMeshes << " meshes, " << BenchmarkRuns{}.measured
+        << " runs per step, CPU " << simdInstructionSet() << (culler.gpuAvailable() ? "" : ", no GPU culling") << "\n"
+        << "    step                  cpu ms     gpu ms   cpu inst/ms   gpu inst/ms   speedup   result\n";
+
+    for (const ComputeKernelTiming& timing : measureCulling(instances)) {
+        double cpu = timing.cpu.mean();
+        double gpu = timing.gpu.count() > 0 ? timing.gpu.mean() : 0.0;
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "    " << std::left << std::setw(22) << timing.kernel << std::right
+            << std::setw(10) << cpu << std::setw(11) << gpu
+            << std::setprecision(0)
+            << std::setw(14) << (cpu > 0.0 ? instances / cpu : 0.0)
+            << std::setw(14) << (gpu > 0.0 ? instances / gpu : 0.0)
+            << std::setw(9) << std::setprecision(2) << (gpu > 0.0 ? cpu / gpu : 0.0) << "x"
+            << "   " << (timing.gpu.count() == 0 ? "cpu only" : timing.matches ? "match" : "MISMATCH") << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    culler.report(std::cout);
+    compute.report(std::cout);
+}
@@ -3,8 +3,11 @@
 #include "include.h"
 #include "application.h"
 #include "debugger.h"
+#include "startup-timer.h"
 #include <stdexcept>
 #include <iostream>
+#include <cstring>
+#include <string>
 
 VkResult CreateDebugUtilsMessengerEXT(
     VkInstance instance,
@@ -28,29 +31,43 @@ bool Application::checkValidationLayerSupport() {
 
     // Essentially, explicit error declaration support ensuring that validationLayers - if enabled - are working as intended
 
-    uint32_t layerCount;
-    vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+    for (const char* layerName : validationLayers) {
+        if (!enumerations.hasInstanceLayer(layerName)) {
+            return false;
+        }
+    }
 
-    std::vector<VkLayerProperties> availableLayers(layerCount);
+    return true;
+}
 
-    vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+uint32_t parseValidationFeatures(const char* list) {
 
-    for (const char* layerName : validationLayers) {
-        bool layerFound = false;
+    uint32_t features = 0;
+    std::string remaining = list;
 
-        for (const auto& layerProperties : availableLayers) {
-            if (strcmp(layerName, layerProperties.layerName) == 0) {
-                layerFound = true;
-                break;
-            }
-        }
+    while (!remaining.empty()) {
+        size_t comma = remaining.find(',');
+        std::string name = remaining.substr(0, comma);
+        remaining = comma == std::string::npos ? "" : remaining.substr(comma + 1);
 
-        if (!layerFound) {
-            return false;
-        }
+        if (name == "best-practices") features |= ValidationBestPractices;
+        else if (name == "sync") features |= ValidationSynchronization;
+        else if (name == "gpu-assisted") features |= ValidationGpuAssisted;
+        else return 0;
     }
+    return features;
+}
 
-    return true;
+bool Application::checkValidationFeaturesSupport() {
+
+    // VK_EXT_validation_features isn't something the loader or driver offers, the layer does. So it's looked up in
+    // the layer's own extension list rather than the instance's.
+    if (enumerations.hasInstanceExtension(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME, validationLayers[0])) {
+        return true;
+    }
+
+    std::clog << "The validation layer doesn't support VK_EXT_validation_features, ignoring --validation-features\n";
+    return false;
 }
 
 void Application::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
@@ -61,32 +78,64 @@ void Application::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateIn
 
     createInfo = {};
 
-    // The message severity parameter has VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT left out (disabled) to 
-    // avoid recieving general, annoying, and mostly useless debug info
+    // Only what the filter lets through is registered, so the layer doesn't spend time building messages that would
+    // be thrown away. That used to include VERBOSE, which floods the callback with general, annoying, and mostly
+    // useless debug info; it's now opt-in with --validation-severity verbose.
 
-    createInfo.messageSeverity = (
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT
-
-        );
+    createInfo.messageSeverity = validation.filter.severities;
 
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    createInfo.messageType = validation.filter.types;
     createInfo.pfnUserCallback = debugCallback;
-    createInfo.pUserData = nullptr; // Optional
+    createInfo.pUserData = &validationSink;
 }
 
 void Application::setupDebugMessenger() {
 
+    STARTUP_STAGE(startupTimer, "setupDebugMessenger");
+
     if (!enableValidationLayers) return;
 
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     populateDebugMessengerCreateInfo(createInfo);
 
-    if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Instance);
+    VkDebugUtilsMessengerEXT messenger;
+    if (CreateDebugUtilsMessengerEXT(instance, &createInfo, callbacks, &messenger) != VK_SUCCESS) {
         throw std::runtime_error("failed to set up debug messenger!");
     }
+
+    // An extension function, so the loader doesn't export it. It's there, since creating through it just worked.
+    auto destroy = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    debugMessenger = UniqueDebugMessenger(instance, messenger, destroy, callbacks);
+}
+
+void Application::beginValidationFrame() {
+
+    if (!enableValidationLayers) return;
+
+    bool validate = validation.validatesFrame(validationFrame++);
+    if (validate) {
+        validatedFrames++;
+    }
+
+    // Only changes when the frame enters or leaves the schedule, not every frame
+    if (validate == (debugMessenger != VK_NULL_HANDLE)) return;
+
+    if (validate) {
+        setupDebugMessenger();
+        validationSink.setFilter(validation.filter);
+    }
+    else {
+        // The layer stays loaded (it can't be removed from a live instance) but has no messenger to report to. The
+        // sink filters everything too, in case something still comes in through the instance's own messenger.
+        debugMessenger.reset();
+
+        ValidationFilter none;
+        none.severities = 0;
+        none.types = 0;
+        validationSink.setFilter(none);
+    }
 }
 
 VKAPI_ATTR VkBool32 VKAPI_CALL Application::debugCallback(
@@ -120,30 +169,13 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Application::debugCallback(
     void* pUserData
 
     // The pUserData parameter contains a pointer that was specified during the setup of the callback, with which custom information can be passed
+    // (here, the ValidationSink)
 
 ) {
 
-    std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+    // This runs inside the Vulkan call that raised the message. Writing to cerr with endl here used to make every
+    // such call wait on the console, so the message is only queued and the sink's own thread prints it.
+    static_cast<ValidationSink*>(pUserData)->capture(messageSeverity, messageType, pCallbackData);
 
     return VK_FALSE;
-}
-
-void Application::DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
-
-    // This is a great example of the utility of the "auto" keyword.
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-
-    /*
-    could instead be:
-
-
-    PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-
-    But that would be incredibly redundant. In essence, use auto if the variable's declaration is casted explicitly anyways, so you don't have to
-    explicitly declare it's type multiple times when it's type is obvious.
-    */
-
-    if (func != nullptr) {
-        func(instance, debugMessenger, pAllocator);
-    }
 }
\ No newline at end of file
@@ -2,21 +2,53 @@
 
 #pragma once
 
+#include <cstdint>
+#include <vector>
 #include "include.h"
+#include "validation-sink.h"
 
-// Enables validation layers if debug mode is enabled. Otherwise, (i.e., release, build, etc), validation
-// will be disabled and unstable or random behavior might propogate given errors in the build code relating
-// to Vulkan functions. Validation layers are Vulkan debug messages that help decipher errors in the code
-// that still compile. Some validation layer errors will only happen on deconstruction, so make sure to check
-// the console after closing the application window.
+// Validation layers are Vulkan debug messages that help decipher errors in the code that still compile. Without
+// them, unstable or random behavior might propogate given errors in the build code relating to Vulkan functions.
+// Some validation layer errors will only happen on deconstruction, so make sure to check the console after closing
+// the application window.
+//
+// Whether they're on used to be fixed at compile time from NDEBUG, so checking a release build meant building a
+// different binary. It's a runtime setting now (see app-config.h). NDEBUG only picks the default.
 
 extern const std::vector<const char*> validationLayers;
+
+// Extra checks from VkValidationFeaturesEXT. All of them cost noticeably more than core validation.
+enum ValidationFeature : uint32_t {
+	ValidationBestPractices = 1 << 0,   // Warnings about legal but slow or unusual API use
+	ValidationSynchronization = 1 << 1, // Hazards between commands, barriers and submits
+	ValidationGpuAssisted = 1 << 2      // Instruments shaders to catch out-of-bounds descriptor and buffer access
+};
+
+// Comma separated list of "best-practices", "sync" and "gpu-assisted". Returns 0 if any of them is unknown.
+uint32_t parseValidationFeatures(const char* list);
+
+struct ValidationSettings {
 #ifdef NDEBUG
-const bool enableValidationLayers = false;
+	bool enabled = false;
 #else
-const bool enableValidationLayers = true;
+	bool enabled = true;
 #endif
 
+	uint32_t features = 0;              // ValidationFeature bits
+	ValidationFilter filter;
+
+	// Frames outside the schedule run with the debug messenger destroyed and the sink filtering everything, so
+	// nothing is reported and the layer has nobody to format messages for. Startup is always validated.
+	uint32_t every = 1;                 // Only every Nth frame
+	uint64_t firstFrame = 0;            // Inclusive window
+	uint64_t lastFrame = UINT64_MAX;
+
+	bool validatesFrame(uint64_t frame) const {
+		return frame >= firstFrame && frame <= lastFrame && (frame - firstFrame) % every == 0;
+	}
+	bool validatesEveryFrame() const { return every == 1 && firstFrame == 0 && lastFrame == UINT64_MAX; }
+};
+
 VkResult CreateDebugUtilsMessengerEXT(
 	VkInstance instance,
 	const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
@@ -0,0 +1,122 @@
+// deferred-destruction-test.cpp
+
+#include <cstring>
+#include <vector>
+#include "include.h"
+#include "deferred-destruction.h"
+#include "test-harness.h"
+
+// Plays frames against the queue without a device: what's deferred during a frame has to outlive the frames in
+// flight after it and go at the first beginFrame() past them, upload ring tickets go once collect() reaches them,
+// and a UniqueHandle handed over is destroyed exactly once, by the queue. Needs no Vulkan device, so never skips.
+
+static uint32_t fencesDestroyed = 0;
+
+static void VKAPI_PTR destroyFence(VkDevice device, VkFence fence, const VkAllocationCallbacks* allocationCallbacks) {
+
+    fencesDestroyed++;
+}
+
+// Any non-null value will do, since nothing is ever called with it. Non-dispatchable handles are pointers on 64-bit
+// builds and uint64_t on 32-bit ones, both 8 bytes.
+static VkFence fakeFence(uint64_t value) {
+
+    VkFence fence;
+    static_assert(sizeof(fence) == sizeof(value), "non-dispatchable handles are 64 bits");
+    std::memcpy(&fence, &value, sizeof(fence));
+    return fence;
+}
+
+void testDeferredDestruction() {
+
+    const uint32_t framesInFlight = 2;
+    std::vector<int> destroyed;
+
+    // By frame: deferred before the first frame and during the second, so each goes framesInFlight frames later
+    {
+        DeferredDestruction deferred;
+        deferred.create(framesInFlight);
+
+        deferred.defer([&]() { destroyed.push_back(0); });
+        deferred.beginFrame();
+        deferred.beginFrame();
+        CHECK(destroyed.empty());
+
+        deferred.defer([&]() { destroyed.push_back(1); });
+        CHECK(deferred.pending() == 2);
+
+        // The third frame's slot fence covered the first frame, which is all the first one was waiting for
+        deferred.beginFrame();
+        CHECK(destroyed == std::vector<int>({ 0 }));
+        CHECK(deferred.pending() == 1);
+
+        deferred.beginFrame();
+        CHECK(destroyed == std::vector<int>({ 0, 1 }));
+        CHECK(deferred.pending() == 0);
+        deferred.destroy();
+    }
+
+    // By ticket: deferred out of order, each goes at the first collect() that reaches it
+    destroyed.clear();
+    {
+        DeferredDestruction deferred;
+        deferred.create(framesInFlight);
+
+        deferred.deferUntil(5, [&]() { destroyed.push_back(5); });
+        deferred.deferUntil(3, [&]() { destroyed.push_back(3); });
+        deferred.collect(2);
+        CHECK(destroyed.empty());
+        deferred.collect(4);
+        CHECK(destroyed == std::vector<int>({ 3 }));
+        deferred.collect(4);
+        CHECK(destroyed == std::vector<int>({ 3 }));
+        deferred.collect(5);
+        CHECK(destroyed == std::vector<int>({ 3, 5 }));
+
+        // Both, the way the mesh streamer retires a buffer: the frames first, then the ticket of the last copy
+        deferred.defer([&]() { deferred.deferUntil(7, [&]() { destroyed.push_back(7); }); });
+        for (uint32_t frame = 0; frame <= framesInFlight; frame++) {
+            deferred.beginFrame();
+            deferred.collect(6);
+        }
+        CHECK(destroyed.size() == 2);
+        CHECK(deferred.pending() == 1);
+        deferred.collect(7);
+        CHECK(destroyed == std::vector<int>({ 3, 5, 7 }));
+        deferred.destroy();
+    }
+
+    // Whatever is left at destroy() goes, including what a frame entry defers by ticket on its way out
+    destroyed.clear();
+    {
+        DeferredDestruction deferred;
+        deferred.create(framesInFlight);
+        deferred.deferUntil(9, [&]() { destroyed.push_back(9); });
+        deferred.defer([&]() { deferred.deferUntil(8, [&]() { destroyed.push_back(8); }); });
+        deferred.destroy();
+        CHECK(destroyed.size() == 2);
+        CHECK(deferred.pending() == 0);
+    }
+
+    // Handles: ownership moves to the queue, and a null one isn't queued at all
+    {
+        DeferredDestruction deferred;
+        deferred.create(framesInFlight);
+
+        UniqueFence fence(VK_NULL_HANDLE, fakeFence(1), destroyFence, nullptr);
+        deferred.defer(std::move(fence));
+        CHECK(fence.get() == VK_NULL_HANDLE);
+        deferred.defer(UniqueFence());
+        CHECK(deferred.pending() == 1);
+
+        fence.reset();
+        for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+            deferred.beginFrame();
+        }
+        CHECK(fencesDestroyed == 0);
+        deferred.beginFrame();
+        CHECK(fencesDestroyed == 1);
+        deferred.destroy();
+        CHECK(fencesDestroyed == 1);
+    }
+}
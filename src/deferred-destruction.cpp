@@ -0,0 +1,79 @@
+// deferred-destruction.cpp
+
+#include <algorithm>
+#include <utility>
+#include "deferred-destruction.h"
+
+void DeferredDestruction::create(uint32_t framesInFlight) {
+
+    this->framesInFlight = std::max(framesInFlight, 1u);
+    frames = 0;
+}
+
+void DeferredDestruction::destroy() {
+
+    // The device is idle, so nothing is in use any more
+    while (!byFrame.empty()) {
+        std::function<void()> destroy = std::move(byFrame.front().destroy);
+        byFrame.pop_front();
+        destroy();
+    }
+
+    // After the frames, since those may have deferred until a value
+    std::vector<Entry> remaining = std::move(byValue);
+    byValue.clear();
+    for (Entry& entry : remaining) {
+        entry.destroy();
+    }
+}
+
+void DeferredDestruction::beginFrame() {
+
+    frames++;
+    if (frames <= framesInFlight) return;
+
+    // This slot's fence was the frame framesInFlight back, and it's signaled, so every frame up to that one is done
+    uint64_t finished = frames - framesInFlight;
+    while (!byFrame.empty() && byFrame.front().key <= finished) {
+        std::function<void()> destroy = std::move(byFrame.front().destroy);
+        byFrame.pop_front();
+        destroy();
+        destroyedMidRun++;
+    }
+}
+
+void DeferredDestruction::defer(std::function<void()> destroy) {
+
+    // Frames up to this one may use it: the one being recorded if it's between beginFrame and the submit, the last
+    // one submitted otherwise
+    byFrame.push_back({ frames, std::move(destroy) });
+    deferred++;
+    peakPending = std::max(peakPending, pending());
+}
+
+void DeferredDestruction::deferUntil(uint64_t value, std::function<void()> destroy) {
+
+    byValue.push_back({ value, std::move(destroy) });
+    deferred++;
+    peakPending = std::max(peakPending, pending());
+}
+
+void DeferredDestruction::collect(uint64_t reached) {
+
+    // Pulled out first, since a destruction may defer something else
+    auto done = std::partition(byValue.begin(), byValue.end(), [&](const Entry& entry) { return entry.key > reached; });
+    std::vector<Entry> ready(std::make_move_iterator(done), std::make_move_iterator(byValue.end()));
+    byValue.erase(done, byValue.end());
+    for (Entry& entry : ready) {
+        entry.destroy();
+        destroyedMidRun++;
+    }
+}
+
+void DeferredDestruction::report(std::ostream& out) const {
+
+    if (deferred == 0) return;
+
+    out << "\nDeferred destruction: " << deferred << " deferred, " << destroyedMidRun << " destroyed mid-run without waiting, "
+        << "at most " << peakPending << " waiting at once\n";
+}
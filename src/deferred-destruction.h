@@ -0,0 +1,77 @@
+// deferred-destruction.h
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <vector>
+#include "vulkan-handle.h"
+
+// Destroys resources once the GPU is done with them, without waiting for it.
+//
+// Anything a frame may have recorded can't be destroyed until that frame has finished, and the frames in flight
+// can be up to framesInFlight behind the CPU. Rather than vkDeviceWaitIdle, releasing something mid-run hands its
+// destruction to defer(), which runs it once every frame recorded so far is done: beginFrame() is called right after
+// the frame slot's fence wait, which proves the frame framesInFlight back finished, so everything deferred up to
+// then can go.
+//
+// Work that isn't on the frame's fence has its own completion value. That's the upload ring's ticket, which the
+// frame passes to collect() after beginFrame(): deferUntil(ticket) runs once collect() has been told it's reached.
+// The mesh streamer's replaced buffers go through both, the frames first and then the last copy into them.
+//
+// Main thread only. destroy() runs whatever is left, so it goes after the device is idle and before anything the
+// deferred destructions use (the allocator, the bindless table) is destroyed.
+
+class DeferredDestruction {
+
+public:
+
+	void create(uint32_t framesInFlight);
+	void destroy();
+
+	// Once per frame, right after the wait on the frame slot's fence
+	void beginFrame();
+	uint64_t frame() const { return frames; }
+
+	// Runs once every frame recorded so far has finished
+	void defer(std::function<void()> destroy);
+
+	template <typename Handle, typename Parent>
+	void defer(UniqueHandle<Handle, Parent>&& handle) {
+		if (handle.get() == VK_NULL_HANDLE) return;
+		Parent parent = handle.parent();
+		typename UniqueHandle<Handle, Parent>::Destroy destroyer = handle.destroyer();
+		const VkAllocationCallbacks* callbacks = handle.allocationCallbacks();
+		Handle raw = handle.release();
+		defer([=]() { destroyer(parent, raw, callbacks); });
+	}
+
+	// Runs once collect() is called with value or higher
+	void deferUntil(uint64_t value, std::function<void()> destroy);
+	void collect(uint64_t reached);
+
+	size_t pending() const { return byFrame.size() + byValue.size(); }
+	uint64_t totalDeferred() const { return deferred; }
+	uint64_t totalDestroyedMidRun() const { return destroyedMidRun; }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	struct Entry {
+		uint64_t key;
+		std::function<void()> destroy;
+	};
+
+	uint32_t framesInFlight = 1;
+	uint64_t frames = 0;
+	std::deque<Entry> byFrame;              // Keys only grow, so oldest first
+	std::vector<Entry> byValue;             // Upload ring tickets, in the order they were deferred rather than by value
+
+	// Bookkeeping for the report
+	uint64_t deferred = 0;
+	uint64_t destroyedMidRun = 0;
+	size_t peakPending = 0;
+};
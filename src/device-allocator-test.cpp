@@ -0,0 +1,192 @@
+// device-allocator-test.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "include.h"
+#include "device-allocator.h"
+#include "device-capabilities.h"
+#include "enumeration-cache.h"
+#include "test-harness.h"
+
+// Sub-allocates from lavapipe's host-visible memory type and writes a different byte into each allocation, so any
+// two that overlap show up as a wrong byte. Also checks the ways out of sub-allocation: resources too big for a
+// block, and an alignment no block can satisfy, which must fall back to a dedicated allocation without leaving an
+// empty block behind. Then the frame arena on top of it. The buddy allocator itself is tested on its own, without a
+// device, in buddy-allocator-test.cpp.
+
+static constexpr VkDeviceSize blockSize = 4ull << 20;
+
+static uint32_t totalCount(const std::vector<DeviceAllocator::HeapStats>& heaps, uint32_t DeviceAllocator::HeapStats::* count) {
+
+    uint32_t total = 0;
+    for (const DeviceAllocator::HeapStats& heap : heaps) {
+        total += heap.*count;
+    }
+    return total;
+}
+
+void testDeviceAllocator() {
+
+    UniqueInstance instance;
+    VkPhysicalDevice physicalDevice;
+    uint32_t apiVersion = VK_API_VERSION_1_3;
+    if (!createTestInstance(apiVersion, instance, physicalDevice)) {
+        apiVersion = VK_API_VERSION_1_0;
+        createTestInstance(apiVersion, instance, physicalDevice);
+    }
+
+    EnumerationCache enumeration;
+    DeviceFeatureChain chain;
+    chain.negotiate(physicalDevice, apiVersion, enumeration.deviceExtensions(physicalDevice));
+
+    VkQueue queue;
+    UniqueDevice device = createTestDevice(physicalDevice, chain, queue);
+
+    DeviceAllocator allocator;
+    allocator.create(physicalDevice, device, nullptr, blockSize);
+
+    const VkPhysicalDeviceMemoryProperties& memory = allocator.memoryProperties();
+    uint32_t allTypes = memory.memoryTypeCount >= 32 ? ~0u : (1u << memory.memoryTypeCount) - 1;
+    const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    // Small allocations are placed in blocks, at their alignment, and never overlap
+    std::mt19937 random(7);
+    std::vector<DeviceAllocation> allocations;
+    for (uint32_t i = 0; i < 200; i++) {
+        VkMemoryRequirements requirements{};
+        requirements.size = 256 + random() % (64 << 10);
+        requirements.alignment = VkDeviceSize(256) << (random() % 5);
+        requirements.memoryTypeBits = allTypes;
+
+        DeviceAllocation allocation = allocator.allocate(requirements, hostVisible, 0, ResourceKind::Linear);
+        CHECK(allocation.block != nullptr);
+        CHECK(allocation.offset % requirements.alignment == 0);
+        CHECK(allocation.mapped != nullptr);
+        if (allocation.mapped != nullptr) {
+            std::memset(allocation.mapped, static_cast<int>(i & 0xff), requirements.size);
+        }
+        allocations.push_back(allocation);
+    }
+
+    for (size_t i = 0; i < allocations.size(); i++) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(allocations[i].mapped);
+        if (bytes == nullptr) continue;
+        CHECK(std::all_of(bytes, bytes + allocations[i].size, [&](unsigned char byte) { return byte == (i & 0xff); }));
+    }
+
+    // Too big to share a block
+    {
+        VkMemoryRequirements requirements{};
+        requirements.size = blockSize;
+        requirements.alignment = 256;
+        requirements.memoryTypeBits = allTypes;
+
+        DeviceAllocation allocation = allocator.allocate(requirements, hostVisible, 0, ResourceKind::Linear);
+        CHECK(allocation.memory != VK_NULL_HANDLE);
+        CHECK(allocation.block == nullptr);
+        allocations.push_back(allocation);
+    }
+
+    // Small, but aligned beyond any block. Even a fresh block can't take it.
+    {
+        uint32_t blocksBefore = totalCount(allocator.stats(), &DeviceAllocator::HeapStats::blockCount);
+
+        VkMemoryRequirements requirements{};
+        requirements.size = 4096;
+        requirements.alignment = blockSize * 4;
+        requirements.memoryTypeBits = allTypes;
+
+        DeviceAllocation allocation = allocator.allocate(requirements, hostVisible, 0, ResourceKind::Linear);
+        CHECK(allocation.memory != VK_NULL_HANDLE);
+        CHECK(allocation.block == nullptr);
+        CHECK(allocation.offset == 0);
+        CHECK(totalCount(allocator.stats(), &DeviceAllocator::HeapStats::blockCount) == blocksBefore);
+        allocations.push_back(allocation);
+    }
+
+    CHECK(totalCount(allocator.stats(), &DeviceAllocator::HeapStats::allocationCount) == allocations.size());
+    CHECK(totalCount(allocator.stats(), &DeviceAllocator::HeapStats::dedicatedCount) == 2);
+
+    for (DeviceAllocation& allocation : allocations) {
+        allocator.free(allocation);
+        CHECK(allocation.memory == VK_NULL_HANDLE);
+    }
+    CHECK(totalCount(allocator.stats(), &DeviceAllocator::HeapStats::allocationCount) == 0);
+
+    // A buffer and an optimal image through the real binding calls, which lavapipe checks against the requirements
+    DeviceAllocation bufferMemory, imageMemory;
+    VkBuffer buffer = allocator.createBuffer(1 << 16, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, bufferMemory);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = { 256, 256, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImage image = allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageMemory);
+
+    CHECK(bufferMemory.memory != VK_NULL_HANDLE);
+    CHECK(imageMemory.memory != VK_NULL_HANDLE);
+
+    allocator.destroyImage(image, imageMemory);
+    allocator.destroyBuffer(buffer, bufferMemory);
+
+    // The frame arena bumps through its frame's region, refuses what doesn't fit rather than spilling into the next
+    // region, and starts a region over when its frame slot comes round again
+    {
+        const VkDeviceSize regionSize = 4096;
+        const uint32_t framesInFlight = 3;
+        FrameArena arena;
+        arena.create(allocator, regionSize, framesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+        std::vector<unsigned char*> regionStarts(framesInFlight, nullptr);
+        for (uint32_t frame = 0; frame < framesInFlight * 2; frame++) {
+            uint32_t frameIndex = frame % framesInFlight;
+            arena.beginFrame(frameIndex);
+            CHECK(arena.bytesUsedThisFrame() == 0);
+
+            FrameArena::Slice first, second, rest, none;
+            CHECK(arena.allocate(100, 1, first));
+            CHECK(first.offset == frameIndex * regionSize);
+            CHECK(arena.allocate(100, 256, second));
+            CHECK(second.buffer == first.buffer);
+            CHECK(second.offset == frameIndex * regionSize + 256);
+            CHECK(static_cast<char*>(second.mapped) - static_cast<char*>(first.mapped) == 256);
+
+            // Exactly the rest of the region, after which nothing more fits
+            CHECK(arena.allocate(regionSize - 356, 1, rest));
+            CHECK(!arena.allocate(1, 1, none));
+            CHECK(arena.bytesUsedThisFrame() == regionSize);
+
+            // The second time round each slot gets its region back from the start
+            unsigned char* start = static_cast<unsigned char*>(first.mapped);
+            if (frame >= framesInFlight) {
+                CHECK(start == regionStarts[frameIndex]);
+            }
+            regionStarts[frameIndex] = start;
+            if (start != nullptr) {
+                std::memset(start, static_cast<int>(frame), static_cast<size_t>(regionSize));
+            }
+        }
+
+        // Each region holds what its own frame wrote last, untouched by its neighbours
+        for (uint32_t frameIndex = 0; frameIndex < framesInFlight; frameIndex++) {
+            const unsigned char* start = regionStarts[frameIndex];
+            if (start == nullptr) continue;
+            unsigned char written = static_cast<unsigned char>(framesInFlight + frameIndex);
+            CHECK(std::all_of(start, start + regionSize, [&](unsigned char byte) { return byte == written; }));
+        }
+        CHECK(arena.peakBytesPerFrame() == regionSize);
+        arena.destroy(allocator);
+    }
+
+    allocator.destroy();
+}
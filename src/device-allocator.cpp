@@ -0,0 +1,362 @@
+// device-allocator.cpp
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+#include "device-allocator.h"
+
+static constexpr VkDeviceSize minimumBlockSize = 1ull << 20;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+double DeviceAllocator::HeapStats::internalFragmentation() const {
+    return allocated == 0 ? 0.0 : 1.0 - static_cast<double>(used) / static_cast<double>(allocated);
+}
+
+double DeviceAllocator::HeapStats::externalFragmentation() const {
+    return free == 0 ? 0.0 : 1.0 - static_cast<double>(largestFree) / static_cast<double>(free);
+}
+
+void DeviceAllocator::create(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* allocationCallbacks,
+    VkDeviceSize preferredBlockSize) {
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    bufferImageGranularity = deviceProperties.limits.bufferImageGranularity;
+
+    // The buddy allocator wants a power of two, so round down rather than reserve more than asked for
+    this->preferredBlockSize = minimumBlockSize;
+    while (this->preferredBlockSize * 2 <= preferredBlockSize) {
+        this->preferredBlockSize *= 2;
+    }
+}
+
+void DeviceAllocator::destroy() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Anything still allocated at this point is a leak, but the memory goes back to the driver either way.
+    // Freeing memory also unmaps it.
+    for (auto& block : blocks) {
+        vkFreeMemory(device, block->memory, allocationCallbacks);
+    }
+    for (auto& allocation : dedicated) {
+        vkFreeMemory(device, allocation.memory, allocationCallbacks);
+    }
+    blocks.clear();
+    dedicated.clear();
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const {
+
+    // Memory types are ordered by the driver from "best" to "worst" for their flags, so the first type with every
+    // preferred flag wins, and failing that the first type with just the required ones
+    uint32_t fallback = UINT32_MAX;
+
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+        if (!(typeBits & (1u << i))) continue;
+
+        VkMemoryPropertyFlags flags = properties.memoryTypes[i].propertyFlags;
+        if ((flags & required) != required) continue;
+
+        if ((flags & preferred) == preferred) return i;
+        if (fallback == UINT32_MAX) fallback = i;
+    }
+
+    if (fallback == UINT32_MAX) {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    return fallback;
+}
+
+VkDeviceSize DeviceAllocator::blockSizeFor(uint32_t memoryType) const {
+
+    // Small heaps (the 256 MiB host-visible device-local window on discrete cards, for example) get smaller blocks
+    // so a handful of them can't take the whole heap
+    VkDeviceSize heapSize = properties.memoryHeaps[properties.memoryTypes[memoryType].heapIndex].size;
+
+    VkDeviceSize size = preferredBlockSize;
+    while (size > minimumBlockSize && size > heapSize / 8) {
+        size /= 2;
+    }
+    return size;
+}
+
+VkDeviceMemory DeviceAllocator::allocateMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, allocationCallbacks, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    // Mapping once and keeping it mapped is allowed and saves a map/unmap pair on every upload
+    *mapped = nullptr;
+    if (properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(device, memory, allocationCallbacks);
+            throw std::runtime_error("failed to map device memory!");
+        }
+    }
+    return memory;
+}
+
+DeviceAllocation DeviceAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred, ResourceKind kind) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    DeviceAllocation allocation;
+    allocation.memoryType = findMemoryType(requirements.memoryTypeBits, required, preferred);
+    allocation.size = requirements.size;
+
+    VkDeviceSize blockSize = blockSizeFor(allocation.memoryType);
+
+    auto allocateDedicated = [&] {
+        allocation.memory = allocateMemory(requirements.size, allocation.memoryType, &allocation.mapped);
+        dedicated.push_back({ allocation.memory, requirements.size, allocation.memoryType });
+        return allocation;
+    };
+
+    // Big resources would waste up to half of a block to rounding, so they get memory of their own
+    if (requirements.size > blockSize / 2) {
+        return allocateDedicated();
+    }
+
+    // With a granularity of 1 there's nothing to keep apart
+    if (bufferImageGranularity <= 1) {
+        kind = ResourceKind::Linear;
+    }
+
+    Block* target = nullptr;
+    std::optional<uint64_t> offset;
+
+    for (auto& block : blocks) {
+        if (block->memoryType != allocation.memoryType || block->kind != kind) continue;
+
+        offset = block->allocator.allocate(requirements.size, requirements.alignment);
+        if (offset) {
+            target = block.get();
+            break;
+        }
+    }
+
+    if (target == nullptr) {
+        auto block = std::make_unique<Block>(blockSize);
+        block->memoryType = allocation.memoryType;
+        block->kind = kind;
+
+        // Placed before the block has any memory, so nothing is wasted when even an empty block can't take it (an
+        // alignment larger than the block)
+        offset = block->allocator.allocate(requirements.size, requirements.alignment);
+        if (!offset) {
+            return allocateDedicated();
+        }
+
+        block->memory = allocateMemory(blockSize, allocation.memoryType, &block->mapped);
+        target = block.get();
+        blocks.push_back(std::move(block));
+    }
+
+    allocation.memory = target->memory;
+    allocation.offset = *offset;
+    allocation.block = target;
+    if (target->mapped != nullptr) {
+        allocation.mapped = static_cast<char*>(target->mapped) + allocation.offset;
+    }
+    return allocation;
+}
+
+void DeviceAllocator::free(DeviceAllocation& allocation) {
+
+    if (allocation.memory == VK_NULL_HANDLE) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (allocation.block == nullptr) {
+        vkFreeMemory(device, allocation.memory, allocationCallbacks);
+        dedicated.erase(std::remove_if(dedicated.begin(), dedicated.end(),
+            [&](const Dedicated& d) { return d.memory == allocation.memory; }), dedicated.end());
+        allocation = {};
+        return;
+    }
+
+    Block* block = static_cast<Block*>(allocation.block);
+    block->allocator.free(allocation.offset);
+
+    // Give empty blocks back to the driver, except the last one of its kind. Keeping one around stops a
+    // create/destroy pattern from allocating and freeing a whole block every frame.
+    if (block->allocator.empty()) {
+        bool hasSibling = std::any_of(blocks.begin(), blocks.end(), [&](const std::unique_ptr<Block>& other) {
+            return other.get() != block && other->memoryType == block->memoryType && other->kind == block->kind;
+        });
+
+        if (hasSibling) {
+            vkFreeMemory(device, block->memory, allocationCallbacks);
+            blocks.erase(std::find_if(blocks.begin(), blocks.end(),
+                [&](const std::unique_ptr<Block>& other) { return other.get() == block; }));
+        }
+    }
+
+    allocation = {};
+}
+
+VkBuffer DeviceAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred, DeviceAllocation& allocation, const std::vector<uint32_t>& queueFamilies) {
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // The families have to be distinct, and a single one is the same as exclusive
+    if (queueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &bufferInfo, allocationCallbacks, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    allocation = allocate(memRequirements, required, preferred, ResourceKind::Linear);
+    vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+    return buffer;
+}
+
+void DeviceAllocator::destroyBuffer(VkBuffer buffer, DeviceAllocation& allocation) {
+
+    vkDestroyBuffer(device, buffer, allocationCallbacks);
+    free(allocation);
+}
+
+VkImage DeviceAllocator::createImage(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags required, DeviceAllocation& allocation) {
+
+    VkImage image;
+    if (vkCreateImage(device, &createInfo, allocationCallbacks, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    ResourceKind kind = createInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+    allocation = allocate(memRequirements, required, 0, kind);
+    vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+    return image;
+}
+
+void DeviceAllocator::destroyImage(VkImage image, DeviceAllocation& allocation) {
+
+    vkDestroyImage(device, image, allocationCallbacks);
+    free(allocation);
+}
+
+std::vector<DeviceAllocator::HeapStats> DeviceAllocator::stats() const {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<HeapStats> heaps(properties.memoryHeapCount);
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        heaps[i].heapSize = properties.memoryHeaps[i].size;
+    }
+
+    for (const auto& block : blocks) {
+        HeapStats& heap = heaps[properties.memoryTypes[block->memoryType].heapIndex];
+        const BuddyAllocator& buddy = block->allocator;
+
+        heap.blockCount++;
+        heap.reserved += buddy.capacity();
+        heap.allocated += buddy.bytesAllocated();
+        heap.used += buddy.bytesRequested();
+        heap.free += buddy.capacity() - buddy.bytesAllocated();
+        heap.largestFree = std::max<VkDeviceSize>(heap.largestFree, buddy.largestFreeBlock());
+        heap.allocationCount += static_cast<uint32_t>(buddy.allocationCount());
+    }
+
+    for (const auto& allocation : dedicated) {
+        HeapStats& heap = heaps[properties.memoryTypes[allocation.memoryType].heapIndex];
+
+        heap.dedicatedCount++;
+        heap.allocationCount++;
+        heap.reserved += allocation.size;
+        heap.allocated += allocation.size;
+        heap.used += allocation.size;
+    }
+
+    return heaps;
+}
+
+void DeviceAllocator::report(std::ostream& out) const {
+
+    auto mib = [](VkDeviceSize bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+
+    out << std::fixed << std::setprecision(2) << "\nDevice memory:\n";
+
+    std::vector<HeapStats> heaps = stats();
+    for (size_t i = 0; i < heaps.size(); i++) {
+        const HeapStats& heap = heaps[i];
+
+        out << "    heap " << i << ((properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "")
+            << ": " << mib(heap.used) << " MiB used, " << mib(heap.reserved) << " / " << mib(heap.heapSize) << " MiB reserved, "
+            << heap.allocationCount << " allocations in " << heap.blockCount << " blocks + " << heap.dedicatedCount << " dedicated, "
+            << "fragmentation " << heap.internalFragmentation() * 100.0 << "% internal / "
+            << heap.externalFragmentation() * 100.0 << "% external\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
+
+void FrameArena::create(DeviceAllocator& allocator, VkDeviceSize bytesPerFrame, uint32_t framesInFlight, VkBufferUsageFlags usage) {
+
+    // Coherent so nothing has to be flushed before submitting
+    regionSize = bytesPerFrame;
+    buffer = allocator.createBuffer(bytesPerFrame * framesInFlight, usage,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, allocation);
+    regionStart = 0;
+    head = 0;
+}
+
+void FrameArena::destroy(DeviceAllocator& allocator) {
+
+    if (buffer == VK_NULL_HANDLE) return;
+
+    allocator.destroyBuffer(buffer, allocation);
+    buffer = VK_NULL_HANDLE;
+}
+
+void FrameArena::beginFrame(uint32_t frameIndex) {
+
+    regionStart = frameIndex * regionSize;
+    head = regionStart;
+}
+
+bool FrameArena::allocate(VkDeviceSize size, VkDeviceSize alignment, Slice& slice) {
+
+    // Vulkan alignments (minUniformBufferOffsetAlignment and friends) are always powers of two
+    VkDeviceSize offset = alignUp(head, std::max<VkDeviceSize>(alignment, 1));
+    if (offset + size > regionStart + regionSize) return false;
+
+    slice.buffer = buffer;
+    slice.offset = offset;
+    slice.mapped = static_cast<char*>(allocation.mapped) + offset;
+
+    head = offset + size;
+    peak = std::max(peak, head - regionStart);
+    return true;
+}
@@ -0,0 +1,151 @@
+// device-allocator.h
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "include.h"
+#include "buddy-allocator.h"
+
+// Device memory sub-allocation.
+//
+// vkAllocateMemory is slow, and drivers only guarantee maxMemoryAllocationCount allocations in total (4096 on many
+// desktop drivers). So instead of one allocation per resource, memory is reserved in large blocks per memory type
+// and buffers and images are placed inside them with a buddy allocator. Anything larger than half a block gets a
+// dedicated allocation of its own.
+//
+// bufferImageGranularity: linear resources (buffers, linear images) and optimal-tiling images must not share a
+// granularity-sized page. Rather than tracking neighbours, each kind gets its own blocks whenever the device's
+// granularity is larger than 1, so the two can never end up next to each other.
+
+enum class ResourceKind {
+	Linear,     // Buffers and VK_IMAGE_TILING_LINEAR images
+	Optimal     // VK_IMAGE_TILING_OPTIMAL images
+};
+
+struct DeviceAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;         // Host-visible memory is persistently mapped. Already offset to this allocation.
+	uint32_t memoryType = 0;
+
+	void* block = nullptr;          // Owning block, opaque to callers. Null for dedicated allocations.
+};
+
+class DeviceAllocator {
+
+public:
+
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* allocationCallbacks,
+		VkDeviceSize preferredBlockSize = 64ull << 20);
+	void destroy();
+
+	// required flags must be present, preferred flags break ties (e.g. HOST_CACHED for readback)
+	DeviceAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred, ResourceKind kind);
+	void free(DeviceAllocation& allocation);
+
+	// Convenience wrappers that create the resource, allocate and bind in one go. A buffer used from more than one
+	// queue family without ownership transfers lists them in queueFamilies, and is made concurrent.
+	VkBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred, DeviceAllocation& allocation, const std::vector<uint32_t>& queueFamilies = {});
+	void destroyBuffer(VkBuffer buffer, DeviceAllocation& allocation);
+
+	VkImage createImage(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags required, DeviceAllocation& allocation);
+	void destroyImage(VkImage image, DeviceAllocation& allocation);
+
+	uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const;
+	const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return properties; }
+
+	struct HeapStats {
+		VkDeviceSize heapSize = 0;
+		VkDeviceSize reserved = 0;      // Total size of blocks and dedicated allocations
+		VkDeviceSize allocated = 0;     // Rounded up to the buddy sizes, i.e. what's no longer available
+		VkDeviceSize used = 0;          // What resources actually asked for
+		VkDeviceSize free = 0;          // Unallocated bytes inside blocks
+		VkDeviceSize largestFree = 0;   // Largest single free range in any block
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+		uint32_t dedicatedCount = 0;
+
+		// Share of allocated bytes lost to power-of-two rounding
+		double internalFragmentation() const;
+		// 0 when all free space is one contiguous range, approaching 1 as it's split into ever smaller pieces
+		double externalFragmentation() const;
+	};
+
+	// Live snapshot, one entry per memory heap
+	std::vector<HeapStats> stats() const;
+	void report(std::ostream& out) const;
+
+private:
+
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		uint32_t memoryType = 0;
+		ResourceKind kind = ResourceKind::Linear;
+		BuddyAllocator allocator;
+
+		Block(VkDeviceSize size) : allocator(size, 256) {}
+	};
+
+	VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+	VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkPhysicalDeviceMemoryProperties properties{};
+	VkDeviceSize bufferImageGranularity = 1;
+	VkDeviceSize preferredBlockSize = 0;
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<Block>> blocks;
+
+	// Dedicated allocations are only tracked for the stats
+	struct Dedicated {
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memoryType;
+	};
+	std::vector<Dedicated> dedicated;
+};
+
+// Linear allocator for data that only lives for one frame (uniforms, dynamic vertices, ...). One host-visible buffer
+// is split into a region per frame in flight. Allocating is a pointer bump, and a region is recycled wholesale
+// when its frame comes around again, by which point the frame's fence guarantees the GPU is done with it.
+
+class FrameArena {
+
+public:
+
+	struct Slice {
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		void* mapped;
+	};
+
+	void create(DeviceAllocator& allocator, VkDeviceSize bytesPerFrame, uint32_t framesInFlight, VkBufferUsageFlags usage);
+	void destroy(DeviceAllocator& allocator);
+
+	// Call once per frame, after waiting on that frame's fence
+	void beginFrame(uint32_t frameIndex);
+
+	// Returns false when the frame's region is full. Nothing is ever freed individually.
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, Slice& slice);
+
+	VkDeviceSize bytesUsedThisFrame() const { return head - regionStart; }
+	VkDeviceSize peakBytesPerFrame() const { return peak; }
+
+private:
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	DeviceAllocation allocation;
+	VkDeviceSize regionSize = 0;
+	VkDeviceSize regionStart = 0;
+	VkDeviceSize head = 0;
+	VkDeviceSize peak = 0;
+};
@@ -0,0 +1,158 @@
+// device-capabilities-test.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "include.h"
+#include "device-capabilities.h"
+#include "enumeration-cache.h"
+#include "test-harness.h"
+
+// Negotiates at every instance version from 1.0 to 1.3. Lavapipe is a 1.3 device, so each lower version is one of
+// the fallbacks: a flag must only be set when the version (or an extension) provides it, must match what the device
+// reports when asked separately, and must be enabled in the chain. Then the device has to accept the chain.
+
+// A struct in a pNext chain, by its sType
+template <typename Struct>
+static const Struct* findInChain(const void* next, VkStructureType type) {
+
+    for (auto link = static_cast<const VkBaseInStructure*>(next); link != nullptr; link = link->pNext) {
+        if (link->sType == type) return reinterpret_cast<const Struct*>(link);
+    }
+    return nullptr;
+}
+
+static bool hasName(const std::vector<const char*>& names, const char* name) {
+
+    return std::any_of(names.begin(), names.end(), [&](const char* other) { return std::strcmp(other, name) == 0; });
+}
+
+static void checkNegotiation(uint32_t apiVersion) {
+
+    UniqueInstance instance;
+    VkPhysicalDevice physicalDevice;
+    if (!createTestInstance(apiVersion, instance, physicalDevice)) return;
+
+    EnumerationCache enumeration;
+    const std::vector<VkExtensionProperties>& extensions = enumeration.deviceExtensions(physicalDevice);
+
+    DeviceFeatureChain chain;
+    DeviceCapabilities capabilities = chain.negotiate(physicalDevice, apiVersion, extensions);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint32_t version = std::min(apiVersion, properties.apiVersion);
+    CHECK(capabilities.apiVersion == VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version), 0));
+
+    bool vulkan11 = capabilities.apiVersion >= VK_API_VERSION_1_1;
+    bool vulkan12 = capabilities.apiVersion >= VK_API_VERSION_1_2;
+    bool vulkan13 = capabilities.apiVersion >= VK_API_VERSION_1_3;
+
+    VkPhysicalDeviceFeatures core;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &core);
+    CHECK(capabilities.multiDrawIndirect == (core.multiDrawIndirect == VK_TRUE));
+    CHECK(capabilities.drawIndirectFirstInstance == (core.drawIndirectFirstInstance == VK_TRUE));
+    CHECK(chain.coreFeatures().multiDrawIndirect == core.multiDrawIndirect);
+
+    const auto* enabled12 = findInChain<VkPhysicalDeviceVulkan12Features>(chain.next(), VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+    const auto* enabled13 = findInChain<VkPhysicalDeviceVulkan13Features>(chain.next(), VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES);
+    CHECK((enabled12 != nullptr) == vulkan12);
+    CHECK((enabled13 != nullptr) == vulkan13);
+
+    // Before 1.2 there's no struct to ask for these with, so they all fall back to off
+    if (!vulkan12) {
+        CHECK(!capabilities.timelineSemaphores);
+        CHECK(!capabilities.hostQueryReset);
+        CHECK(!capabilities.drawIndirectCount);
+        CHECK(!capabilities.descriptorIndexing);
+        CHECK(!capabilities.bufferDeviceAddress);
+    }
+    else if (enabled12 != nullptr) {
+        VkPhysicalDeviceVulkan12Features supported12{};
+        supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supported{};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported.pNext = &supported12;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+        CHECK(capabilities.timelineSemaphores == (supported12.timelineSemaphore == VK_TRUE));
+        CHECK(capabilities.hostQueryReset == (supported12.hostQueryReset == VK_TRUE));
+        CHECK(capabilities.drawIndirectCount == (supported12.drawIndirectCount == VK_TRUE));
+        CHECK(capabilities.bufferDeviceAddress == (supported12.bufferDeviceAddress == VK_TRUE));
+
+        CHECK(capabilities.timelineSemaphores == (enabled12->timelineSemaphore == VK_TRUE));
+        CHECK(capabilities.hostQueryReset == (enabled12->hostQueryReset == VK_TRUE));
+        CHECK(capabilities.drawIndirectCount == (enabled12->drawIndirectCount == VK_TRUE));
+        CHECK(capabilities.descriptorIndexing == (enabled12->descriptorIndexing == VK_TRUE));
+        CHECK(capabilities.descriptorIndexing == (enabled12->runtimeDescriptorArray == VK_TRUE));
+        CHECK(capabilities.bufferDeviceAddress == (enabled12->bufferDeviceAddress == VK_TRUE));
+    }
+
+    // synchronization2 and dynamic rendering are in the 1.3 struct, come from their KHR extensions on 1.1 and 1.2, and
+    // aren't there on 1.0
+    bool synchronization2Extension = hasName(chain.extensions(), VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    bool dynamicRenderingExtension = hasName(chain.extensions(), VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    if (vulkan13) {
+        CHECK(!synchronization2Extension);
+        CHECK(!dynamicRenderingExtension);
+        if (enabled13 != nullptr) {
+            VkPhysicalDeviceVulkan13Features supported13{};
+            supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+            VkPhysicalDeviceFeatures2 supported{};
+            supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            supported.pNext = &supported13;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+            CHECK(capabilities.synchronization2 == (supported13.synchronization2 == VK_TRUE));
+            CHECK(capabilities.dynamicRendering == (supported13.dynamicRendering == VK_TRUE));
+            CHECK(capabilities.synchronization2 == (enabled13->synchronization2 == VK_TRUE));
+            CHECK(capabilities.dynamicRendering == (enabled13->dynamicRendering == VK_TRUE));
+        }
+    }
+    else if (vulkan11) {
+        CHECK(synchronization2Extension == containsExtension(extensions, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME));
+        CHECK(dynamicRenderingExtension == containsExtension(extensions, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME));
+        CHECK(!capabilities.synchronization2 || synchronization2Extension);
+        CHECK(!capabilities.dynamicRendering || dynamicRenderingExtension);
+
+        const auto* enabledDynamicRendering = findInChain<VkPhysicalDeviceDynamicRenderingFeaturesKHR>(chain.next(),
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR);
+        CHECK((enabledDynamicRendering != nullptr) == dynamicRenderingExtension);
+        if (enabledDynamicRendering != nullptr) {
+            VkPhysicalDeviceDynamicRenderingFeaturesKHR supportedDynamicRendering{};
+            supportedDynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+            VkPhysicalDeviceFeatures2 supported{};
+            supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            supported.pNext = &supportedDynamicRendering;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+            CHECK(capabilities.dynamicRendering == (supportedDynamicRendering.dynamicRendering == VK_TRUE));
+            CHECK(capabilities.dynamicRendering == (enabledDynamicRendering->dynamicRendering == VK_TRUE));
+        }
+    }
+    else {
+        CHECK(!synchronization2Extension);
+        CHECK(!dynamicRenderingExtension);
+        CHECK(!capabilities.synchronization2);
+        CHECK(!capabilities.dynamicRendering);
+    }
+
+    CHECK(capabilities.pipelineCreationFeedback ==
+        (vulkan13 || containsExtension(extensions, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)));
+
+    for (const char* name : chain.extensions()) {
+        CHECK(containsExtension(extensions, name));
+    }
+
+    // Invalid chains (a struct without its extension, a feature the device doesn't have) fail here
+    VkQueue queue;
+    UniqueDevice device = createTestDevice(physicalDevice, chain, queue);
+    CHECK(device != VK_NULL_HANDLE);
+}
+
+void testDeviceCapabilities() {
+
+    for (uint32_t apiVersion : { VK_API_VERSION_1_0, VK_API_VERSION_1_1, VK_API_VERSION_1_2, VK_API_VERSION_1_3 }) {
+        checkNegotiation(apiVersion);
+    }
+}
@@ -0,0 +1,166 @@
+// device-capabilities.cpp
+
+#include <algorithm>
+#include "device-capabilities.h"
+#include "enumeration-cache.h"
+
+void DeviceCapabilities::print(std::ostream& out) const {
+
+    auto flag = [&](const char* name, bool value) {
+        out << ", " << name << (value ? " yes" : " no");
+    };
+
+    out << "Device capabilities: Vulkan " << VK_API_VERSION_MAJOR(apiVersion) << "." << VK_API_VERSION_MINOR(apiVersion);
+    flag("timeline semaphores", timelineSemaphores);
+    flag("synchronization2", synchronization2);
+    flag("dynamic rendering", dynamicRendering);
+    flag("descriptor indexing", descriptorIndexing);
+    flag("buffer device address", bufferDeviceAddress);
+    flag("host query reset", hostQueryReset);
+    flag("draw indirect count", drawIndirectCount);
+    flag("multi draw indirect", multiDrawIndirect);
+    flag("pipeline creation feedback", pipelineCreationFeedback);
+    out << "\n";
+}
+
+DeviceCapabilities DeviceFeatureChain::negotiate(VkPhysicalDevice physicalDevice, uint32_t instanceApiVersion,
+    const std::vector<VkExtensionProperties>& availableExtensions) {
+
+    DeviceCapabilities capabilities;
+
+    // A 1.3 device behind a 1.1 instance can only be used as 1.1. Patch versions don't matter for features.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint32_t version = std::min(instanceApiVersion, properties.apiVersion);
+    capabilities.apiVersion = VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version), 0);
+
+    bool vulkan11 = capabilities.apiVersion >= VK_API_VERSION_1_1;
+    bool vulkan12 = capabilities.apiVersion >= VK_API_VERSION_1_2;
+    bool vulkan13 = capabilities.apiVersion >= VK_API_VERSION_1_3;
+
+    auto hasExtension = [&](const char* name) { return containsExtension(availableExtensions, name); };
+
+    // The query chain and the enable chain have the same shape: every struct the device can answer for gets linked
+    // into both. The Vulkan11/12 structs only exist from 1.2 on; before 1.3, synchronization2 and dynamic rendering
+    // come from their KHR extensions instead.
+    supported = {};
+    enabled = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    enabled.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    requiredExtensions.clear();
+
+    void** supportedTail = &supported.pNext;
+    void** enabledTail = &enabled.pNext;
+
+    auto link = [&](auto& supportedStruct, auto& enabledStruct, VkStructureType type) {
+        supportedStruct = {};
+        enabledStruct = {};
+        supportedStruct.sType = type;
+        enabledStruct.sType = type;
+        *supportedTail = &supportedStruct;
+        *enabledTail = &enabledStruct;
+        supportedTail = &supportedStruct.pNext;
+        enabledTail = &enabledStruct.pNext;
+    };
+
+    if (vulkan12) {
+        link(supported11, enabled11, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES);
+        link(supported12, enabled12, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+    }
+    if (vulkan13) {
+        link(supported13, enabled13, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES);
+    }
+
+    // The extension structs can be chained on any device with vkGetPhysicalDeviceFeatures2
+    bool synchronization2Extension = vulkan11 && !vulkan13 && hasExtension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    bool dynamicRenderingExtension = vulkan11 && !vulkan13 && hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+
+    // An extension's struct may only be passed to vkCreateDevice with that extension enabled, so linking one means
+    // enabling its extension too, even if the feature itself turns out to be unsupported
+    if (synchronization2Extension) {
+        link(supportedSynchronization2, enabledSynchronization2, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR);
+        requiredExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    }
+    if (dynamicRenderingExtension) {
+        link(supportedDynamicRendering, enabledDynamicRendering, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR);
+        requiredExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    }
+
+    if (vulkan11) {
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+    }
+    else {
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supported.features);
+    }
+
+    // Turn on what we use out of what's there
+    enabled.features.multiDrawIndirect = supported.features.multiDrawIndirect;
+    enabled.features.drawIndirectFirstInstance = supported.features.drawIndirectFirstInstance;
+    capabilities.multiDrawIndirect = supported.features.multiDrawIndirect;
+    capabilities.drawIndirectFirstInstance = supported.features.drawIndirectFirstInstance;
+
+    if (vulkan12) {
+        enabled12.timelineSemaphore = supported12.timelineSemaphore;
+        capabilities.timelineSemaphores = supported12.timelineSemaphore;
+
+        enabled12.bufferDeviceAddress = supported12.bufferDeviceAddress;
+        capabilities.bufferDeviceAddress = supported12.bufferDeviceAddress;
+
+        enabled12.hostQueryReset = supported12.hostQueryReset;
+        capabilities.hostQueryReset = supported12.hostQueryReset;
+
+        enabled12.drawIndirectCount = supported12.drawIndirectCount;
+        capabilities.drawIndirectCount = supported12.drawIndirectCount;
+
+        // Bindless needs all of these together, so it's all or nothing
+        bool bindless = supported12.descriptorIndexing &&
+            supported12.runtimeDescriptorArray &&
+            supported12.descriptorBindingPartiallyBound &&
+            supported12.descriptorBindingVariableDescriptorCount &&
+            supported12.descriptorBindingUpdateUnusedWhilePending &&
+            supported12.shaderSampledImageArrayNonUniformIndexing &&
+            supported12.shaderStorageBufferArrayNonUniformIndexing &&
+            supported12.descriptorBindingSampledImageUpdateAfterBind &&
+            supported12.descriptorBindingStorageBufferUpdateAfterBind;
+
+        if (bindless) {
+            enabled12.descriptorIndexing = VK_TRUE;
+            enabled12.runtimeDescriptorArray = VK_TRUE;
+            enabled12.descriptorBindingPartiallyBound = VK_TRUE;
+            enabled12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+            enabled12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+            enabled12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            enabled12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+            enabled12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            enabled12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        }
+        capabilities.descriptorIndexing = bindless;
+    }
+
+    if (vulkan13) {
+        enabled13.synchronization2 = supported13.synchronization2;
+        enabled13.dynamicRendering = supported13.dynamicRendering;
+        capabilities.synchronization2 = supported13.synchronization2;
+        capabilities.dynamicRendering = supported13.dynamicRendering;
+    }
+
+    if (synchronization2Extension) {
+        enabledSynchronization2.synchronization2 = supportedSynchronization2.synchronization2;
+        capabilities.synchronization2 = supportedSynchronization2.synchronization2;
+    }
+    if (dynamicRenderingExtension) {
+        enabledDynamicRendering.dynamicRendering = supportedDynamicRendering.dynamicRendering;
+        capabilities.dynamicRendering = supportedDynamicRendering.dynamicRendering;
+    }
+
+    // No feature bit, only a struct to chain onto pipeline creation, so having the extension is enough
+    if (vulkan13) {
+        capabilities.pipelineCreationFeedback = true;
+    }
+    else if (hasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+        requiredExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        capabilities.pipelineCreationFeedback = true;
+    }
+
+    return capabilities;
+}
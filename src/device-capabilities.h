@@ -0,0 +1,87 @@
+// device-capabilities.h
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "include.h"
+
+// What the logical device was actually created with. Subsystems check this to pick their fast path, and fall back
+// to the plain Vulkan 1.0 way of doing things when a flag is false. Every flag that's true has been enabled on the
+// device, not just found to be supported. The comment on each flag names what reads it.
+//
+// Dynamic rendering and buffer device address have no reader yet. They're turned on whenever the device has them, so
+// a pass without a VkRenderPass or a shader reading buffers by address can rely on the flag rather than renegotiate.
+struct DeviceCapabilities {
+	uint32_t apiVersion = VK_API_VERSION_1_0;   // The lower of the instance's and the device's
+
+	bool timelineSemaphores = false;            // Vulkan 1.2, upload ring tickets
+	bool synchronization2 = false;              // Vulkan 1.3 or VK_KHR_synchronization2, render graph barriers
+	bool dynamicRendering = false;              // Vulkan 1.3 or VK_KHR_dynamic_rendering
+	bool bufferDeviceAddress = false;           // Vulkan 1.2
+
+	// Vulkan 1.2, the bindless table. Only set when the whole bindless set is there: runtime sized, partially bound,
+	// variable count, non-uniformly indexed arrays of sampled images and storage buffers that can be updated after
+	// binding.
+	bool descriptorIndexing = false;
+
+	bool hostQueryReset = false;                // Vulkan 1.2, vkResetQueryPool from the host, profiler queries
+
+	// How the culler issues its draws
+	bool drawIndirectCount = false;             // Vulkan 1.2, vkCmdDrawIndexedIndirectCount
+	bool multiDrawIndirect = false;             // Vulkan 1.0 feature, drawCount > 1 in vkCmdDrawIndexedIndirect
+	bool drawIndirectFirstInstance = false;     // Vulkan 1.0 feature, non-zero firstInstance in indirect draws
+
+	bool pipelineCreationFeedback = false;      // Vulkan 1.3 or VK_EXT_pipeline_creation_feedback, cache hits
+	bool calibratedTimestamps = false;          // VK_EXT_calibrated_timestamps, only asked for when profiling
+
+	void print(std::ostream& out) const;
+};
+
+// Builds the feature chain for vkCreateDevice.
+//
+// negotiate() queries VkPhysicalDeviceVulkan11/12/13Features (as far as the device's version goes, plus the KHR
+// extension structs for synchronization2 and dynamic rendering on 1.1 and 1.2 devices) and then turns on only the features we use out of
+// what's supported. Nothing is ever required; anything missing just stays off.
+//
+// The chain points into this object, so it mustn't move between negotiate() and vkCreateDevice.
+
+class DeviceFeatureChain {
+
+public:
+
+	DeviceFeatureChain() = default;
+	DeviceFeatureChain(const DeviceFeatureChain&) = delete;
+	DeviceFeatureChain& operator=(const DeviceFeatureChain&) = delete;
+
+	// availableExtensions is the device's extension list, see enumeration-cache.h
+	DeviceCapabilities negotiate(VkPhysicalDevice physicalDevice, uint32_t instanceApiVersion,
+		const std::vector<VkExtensionProperties>& availableExtensions);
+
+	// Vulkan 1.0 features go in here too, since pEnabledFeatures has to be null once there's a chain
+	VkPhysicalDeviceFeatures& coreFeatures() { return enabled.features; }
+	const VkPhysicalDeviceFeatures& supportedCoreFeatures() const { return supported.features; }
+
+	// pNext for VkDeviceCreateInfo, and the extensions the chain needs on top of the caller's own
+	const void* next() const { return &enabled; }
+	const std::vector<const char*>& extensions() const { return requiredExtensions; }
+
+private:
+
+	VkPhysicalDeviceFeatures2 supported{};
+	VkPhysicalDeviceVulkan11Features supported11{};
+	VkPhysicalDeviceVulkan12Features supported12{};
+	VkPhysicalDeviceVulkan13Features supported13{};
+	VkPhysicalDeviceSynchronization2FeaturesKHR supportedSynchronization2{};
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR supportedDynamicRendering{};
+
+	VkPhysicalDeviceFeatures2 enabled{};
+	VkPhysicalDeviceVulkan11Features enabled11{};
+	VkPhysicalDeviceVulkan12Features enabled12{};
+	VkPhysicalDeviceVulkan13Features enabled13{};
+	VkPhysicalDeviceSynchronization2FeaturesKHR enabledSynchronization2{};
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR enabledDynamicRendering{};
+
+	std::vector<const char*> requiredExtensions;
+};
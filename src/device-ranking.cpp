@@ -0,0 +1,181 @@
+// device-ranking.cpp
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "device-ranking.h"
+#include "cache-directory.h"
+
+// Optional device extensions that later subsystems can take advantage of. Each one found adds to the score.
+static const char* const rankedExtensions[] = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+    VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+    "VK_KHR_timeline_semaphore",
+    "VK_KHR_synchronization2",
+    "VK_KHR_dynamic_rendering",
+    "VK_EXT_descriptor_indexing",
+    "VK_KHR_buffer_device_address",
+};
+
+static int64_t scoreDeviceType(VkPhysicalDeviceType type) {
+
+    switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return 100000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 50000;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return 30000;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:            return 10000;
+    default:                                     return 0;
+    }
+}
+
+std::optional<DeviceUuid> queryDeviceUuid(VkPhysicalDevice device, uint32_t instanceApiVersion) {
+
+    // VkPhysicalDeviceIDProperties and vkGetPhysicalDeviceProperties2 are core in 1.1, and it's the lower of the
+    // instance and device versions that counts: a 1.1 device behind a 1.0 instance can't be asked either. We don't
+    // enable VK_KHR_get_physical_device_properties2, so without both there's simply no UUID.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (std::min(instanceApiVersion, properties.apiVersion) < VK_API_VERSION_1_1) {
+        return std::nullopt;
+    }
+
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+
+    DeviceUuid uuid;
+    std::memcpy(uuid.data(), idProperties.deviceUUID, VK_UUID_SIZE);
+    return uuid;
+}
+
+DeviceRanking rankPhysicalDevice(VkPhysicalDevice device, uint32_t instanceApiVersion,
+    const std::vector<VkExtensionProperties>& extensions) {
+
+    DeviceRanking ranking;
+    ranking.device = device;
+    ranking.uuid = queryDeviceUuid(device, instanceApiVersion);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    ranking.name = properties.deviceName;
+    ranking.typeScore = scoreDeviceType(properties.deviceType);
+
+    // Only heaps flagged DEVICE_LOCAL count. On integrated GPUs that's system RAM, but the type score has
+    // already put those below any discrete card. One point per 16 MiB, capped so it can't overtake the type.
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            ranking.deviceLocalBytes += memoryProperties.memoryHeaps[i].size;
+        }
+    }
+    ranking.memoryScore = std::min<int64_t>(ranking.deviceLocalBytes / (16ull << 20), 8000);
+
+    // Limits that bound what we can render or dispatch in one go
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+    ranking.limitsScore =
+        limits.maxImageDimension2D / 1024 +
+        limits.maxComputeSharedMemorySize / 1024 +
+        limits.maxBoundDescriptorSets +
+        limits.maxPushConstantsSize / 32 +
+        std::min<int64_t>(limits.maxDrawIndirectCount, 1u << 20) / 65536;
+
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(device, &features);
+
+    const VkBool32 rankedFeatures[] = {
+        features.samplerAnisotropy, features.multiDrawIndirect, features.drawIndirectFirstInstance,
+        features.shaderInt64, features.fillModeNonSolid, features.pipelineStatisticsQuery,
+    };
+    for (VkBool32 supported : rankedFeatures) {
+        if (supported) ranking.featureScore += 50;
+    }
+
+    for (const char* wanted : rankedExtensions) {
+        for (const auto& extension : extensions) {
+            if (std::strcmp(extension.extensionName, wanted) == 0) {
+                ranking.featureScore += 100;
+                break;
+            }
+        }
+    }
+
+    return ranking;
+}
+
+std::string formatUuid(const DeviceUuid& uuid) {
+
+    // Same 8-4-4-4-12 grouping vulkaninfo prints, so values can be pasted straight into VKTEST_DEVICE
+    std::string text;
+    char byte[3];
+    for (size_t i = 0; i < uuid.size(); i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) text += '-';
+        std::snprintf(byte, sizeof(byte), "%02x", uuid[i]);
+        text += byte;
+    }
+    return text;
+}
+
+std::optional<DeviceUuid> parseUuid(const std::string& text) {
+
+    std::string hex;
+    for (char c : text) {
+        if (c == '-') continue;
+        if (!std::isxdigit(static_cast<unsigned char>(c))) return std::nullopt;
+        hex += c;
+    }
+    if (hex.size() != VK_UUID_SIZE * 2) return std::nullopt;
+
+    DeviceUuid uuid;
+    for (size_t i = 0; i < uuid.size(); i++) {
+        uuid[i] = static_cast<uint8_t>(std::stoul(hex.substr(i * 2, 2), nullptr, 16));
+    }
+    return uuid;
+}
+
+bool matchesDeviceOverride(const std::string& override, const std::string& name, const std::optional<DeviceUuid>& uuid) {
+
+    if (auto wanted = parseUuid(override)) {
+        return uuid.has_value() && *uuid == *wanted;
+    }
+
+    auto lower = [](std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    };
+    return lower(name).find(lower(override)) != std::string::npos;
+}
+
+static std::filesystem::path deviceCachePath() {
+
+    std::filesystem::path directory = cacheDirectory();
+    return directory.empty() ? directory : directory / "physical-device.txt";
+}
+
+std::optional<DeviceUuid> loadCachedDeviceUuid() {
+
+    std::filesystem::path path = deviceCachePath();
+    if (path.empty()) return std::nullopt;
+
+    auto data = readCacheFile(path);
+    if (!data) return std::nullopt;
+
+    std::string text(data->begin(), data->end());
+    return parseUuid(text.substr(0, text.find_first_of("\r\n")));
+}
+
+void storeCachedDeviceUuid(const DeviceUuid& uuid) {
+
+    std::filesystem::path path = deviceCachePath();
+    if (path.empty()) return;
+
+    std::string text = formatUuid(uuid) + "\n";
+    writeCacheFileAtomically(path, text.data(), text.size());
+}
@@ -0,0 +1,50 @@
+// device-ranking.h
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "include.h"
+
+using DeviceUuid = std::array<uint8_t, VK_UUID_SIZE>;
+
+// How attractive a physical device is, broken down so the startup log can show why one device beat another.
+// Device type dominates on purpose: no amount of memory should make a software rasterizer beat a real GPU.
+
+struct DeviceRanking {
+	VkPhysicalDevice device = VK_NULL_HANDLE;
+	std::string name;
+	std::optional<DeviceUuid> uuid;     // Needs a Vulkan 1.1 instance and device
+
+	int64_t typeScore = 0;
+	int64_t memoryScore = 0;
+	int64_t limitsScore = 0;
+	int64_t featureScore = 0;
+
+	VkDeviceSize deviceLocalBytes = 0;
+
+	int64_t total() const { return typeScore + memoryScore + limitsScore + featureScore; }
+};
+
+// Cheap identity lookup, used on the cached fast path where nothing else about the device needs querying. Empty
+// unless both the instance (instanceApiVersion, as created) and the device are Vulkan 1.1.
+std::optional<DeviceUuid> queryDeviceUuid(VkPhysicalDevice device, uint32_t instanceApiVersion);
+
+// Full scoring pass: properties, memory heaps, limits, features and extensions. The extension list is the device's,
+// passed in since the caller has it already (see enumeration-cache.h).
+DeviceRanking rankPhysicalDevice(VkPhysicalDevice device, uint32_t instanceApiVersion,
+	const std::vector<VkExtensionProperties>& extensions);
+
+std::string formatUuid(const DeviceUuid& uuid);
+std::optional<DeviceUuid> parseUuid(const std::string& text);
+
+// VKTEST_DEVICE picks a device by UUID, or by a case-insensitive substring of its name. Returns true if the
+// given device is the one asked for.
+bool matchesDeviceOverride(const std::string& override, const std::string& name, const std::optional<DeviceUuid>& uuid);
+
+// The UUID of the device chosen on a previous run, and storing it for the next one. See cache-directory.h.
+std::optional<DeviceUuid> loadCachedDeviceUuid();
+void storeCachedDeviceUuid(const DeviceUuid& uuid);
@@ -0,0 +1,154 @@
+// draw-frame.cpp
+
+#include <cstring>
+#include <stdexcept>
+#include "include.h"
+#include "application.h"
+#include "profiler.h"
+
+// Per-frame rendering. There's no graphics pipeline yet, so every frame is a clear, but it goes through the full
+// acquire -> record -> submit -> present path with all the synchronization a real frame needs. What's recorded is
+// described to the render graph (see render-graph.h), which places the barriers.
+
+void Application::createFrameUniforms(uint32_t framesInFlight) {
+
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Device);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
+
+    // Far more than one FrameUniforms a frame, so per-pass uniforms can come from the same regions later
+    frameArena.create(allocator, 64 << 10, framesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_ALL;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, callbacks, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create frame descriptor set layout!");
+    }
+    frameSetLayout = UniqueDescriptorSetLayout(device, layout, vkDestroyDescriptorSetLayout, callbacks);
+}
+
+void Application::writeFrameUniforms(uint32_t frameIndex, VkExtent2D extent) {
+
+    // The slot's fence has been waited on, so its region is free to overwrite, same as its descriptor pools
+    frameArena.beginFrame(frameIndex);
+
+    FrameUniforms uniforms{ extent.width, extent.height, static_cast<uint32_t>(deferred.frame() - 1), frameIndex };
+    FrameArena::Slice slice;
+    if (!frameArena.allocate(sizeof(uniforms), uniformAlignment, slice)) {
+        throw std::runtime_error("frame arena is full!");
+    }
+    std::memcpy(slice.mapped, &uniforms, sizeof(uniforms));
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = slice.buffer;
+    bufferInfo.offset = slice.offset;
+    bufferInfo.range = sizeof(uniforms);
+
+    frameSet = frameDescriptors.allocate(frameSetLayout);
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = frameSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    frameDescriptors.update(&write, 1);
+}
+
+void Application::applyShaderReloads() {
+
+    // Whatever the shader watcher rebuilt since the last frame. Doesn't wait on it, see ShaderLibrary::applyReloads.
+    if (!shaders.hotReloading()) return;
+
+    PROFILE_ZONE("applyShaderReloads");
+    std::vector<ShaderHandle> changed = shaders.applyReloads();
+    if (!changed.empty()) {
+        kernels.reload(changed);
+        culler.reload(changed);
+    }
+}
+
+void Application::recordFrame(VkCommandBuffer commandBuffer, VkImage target, VkPipelineStageFlags2 readyStage,
+    VkImageLayout finalLayout) {
+
+    // The previous contents are never needed, so the target comes in as UNDEFINED every frame. The graph works out
+    // the barriers around the clear and leaves the image in whatever layout its next user expects (PRESENT_SRC for
+    // swap chain images).
+    renderGraph.begin();
+    GraphImage output = renderGraph.importImage(target, VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, readyStage, finalLayout);
+
+    renderGraph.addPass("clear", [output](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.levelCount = 1;
+        range.layerCount = 1;
+
+        VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+        vkCmdClearColorImage(commandBuffer, graph.image(output), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
+    }).write(output, GraphAccess::TransferWrite);
+
+    renderGraph.execute(commandBuffer);
+}
+
+void Application::drawFrame() {
+
+    PROFILE_ZONE("drawFrame");
+
+    // Minimized, so there's nothing to draw into
+    if (!applyResize()) return;
+
+    applyShaderReloads();
+
+    // Swaps in finished textures and queues the next reads and uploads, ahead of the flush that sends them
+    {
+        PROFILE_ZONE("textures.update");
+        textures.update();
+    }
+
+    // Whatever was uploaded since the last frame goes out as one batch on the transfer queue
+    {
+        PROFILE_ZONE("uploadRing.flush");
+        uploadRing.flush();
+    }
+
+    VkCommandBuffer commandBuffer;
+    {
+        PROFILE_ZONE("swapchain.beginFrame");
+        commandBuffer = swapchain.beginFrame();
+    }
+
+    // Out of date, so this frame is skipped and the next one starts with a new swap chain
+    if (commandBuffer == VK_NULL_HANDLE) return;
+
+    // The slot's fence has been waited on by now, so last time's timestamps for it are ready to read, its transient
+    // descriptor sets are free to go, and so is whatever was released before the frame it fenced or waited on an
+    // upload that has finished since
+    deferred.beginFrame();
+    deferred.collect(uploadRing.completed());
+    frameDescriptors.beginFrame(swapchain.frameIndex());
+    writeFrameUniforms(swapchain.frameIndex(), swapchain.getExtent());
+    profiler.beginGpuFrame(commandBuffer, swapchain.frameIndex());
+
+    // The acquire semaphore is waited on at the transfer stage, see Swapchain::endFrame
+    recordFrame(commandBuffer, swapchain.currentImage(), VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    // Slots written this frame, before the submit that may read them
+    bindless.flush();
+
+    PROFILE_ZONE("swapchain.endFrame");
+    swapchain.endFrame(graphicsQueue, presentQueue);
+}
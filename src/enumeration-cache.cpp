@@ -0,0 +1,99 @@
+// enumeration-cache.cpp
+
+#include <algorithm>
+#include <cstring>
+#include "enumeration-cache.h"
+
+bool containsExtension(const std::vector<VkExtensionProperties>& extensions, const char* name) {
+    return std::any_of(extensions.begin(), extensions.end(),
+        [&](const VkExtensionProperties& extension) { return std::strcmp(extension.extensionName, name) == 0; });
+}
+
+const std::vector<VkLayerProperties>& EnumerationCache::instanceLayers() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (layersLoaded) {
+        hitCount++;
+        return layers;
+    }
+
+    uint32_t layerCount = 0;
+    vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+    layers.resize(layerCount);
+    vkEnumerateInstanceLayerProperties(&layerCount, layers.data());
+    layers.resize(layerCount);
+
+    layersLoaded = true;
+    enumerationCount++;
+    return layers;
+}
+
+const std::vector<VkExtensionProperties>& EnumerationCache::instanceExtensions(const char* layerName) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = instanceExtensionLists.find(layerName != nullptr ? layerName : "");
+    if (found != instanceExtensionLists.end()) {
+        hitCount++;
+        return found->second;
+    }
+
+    std::vector<VkExtensionProperties>& extensions = instanceExtensionLists[layerName != nullptr ? layerName : ""];
+
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, nullptr);
+    extensions.resize(extensionCount);
+    vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, extensions.data());
+    extensions.resize(extensionCount);
+
+    enumerationCount++;
+    return extensions;
+}
+
+const std::vector<VkExtensionProperties>& EnumerationCache::deviceExtensions(VkPhysicalDevice device) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = deviceExtensionLists.find(device);
+    if (found != deviceExtensionLists.end()) {
+        hitCount++;
+        return found->second;
+    }
+
+    std::vector<VkExtensionProperties>& extensions = deviceExtensionLists[device];
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    extensions.resize(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+    extensions.resize(extensionCount);
+
+    enumerationCount++;
+    return extensions;
+}
+
+bool EnumerationCache::hasInstanceLayer(const char* name) {
+
+    const std::vector<VkLayerProperties>& available = instanceLayers();
+    return std::any_of(available.begin(), available.end(),
+        [&](const VkLayerProperties& layer) { return std::strcmp(layer.layerName, name) == 0; });
+}
+
+bool EnumerationCache::hasInstanceExtension(const char* name, const char* layerName) {
+    return containsExtension(instanceExtensions(layerName), name);
+}
+
+bool EnumerationCache::hasDeviceExtension(VkPhysicalDevice device, const char* name) {
+    return containsExtension(deviceExtensions(device), name);
+}
+
+uint32_t EnumerationCache::enumerations() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return enumerationCount;
+}
+
+uint32_t EnumerationCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
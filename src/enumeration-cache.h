@@ -0,0 +1,52 @@
+// enumeration-cache.h
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "include.h"
+
+// Layer and extension lists, each asked for once.
+//
+// Startup used to enumerate the same things several times over: instance extensions for the headless surface
+// check, layer extensions for the validation features check, and device extensions once for ranking, once for
+// suitability, once for the feature chain and once more for calibrated timestamps. Each of those is a trip through
+// the loader (and for device extensions, every implicit layer too), so the lists are kept here instead.
+//
+// None of them can change while the instance is alive, so nothing is ever invalidated. Safe to use from any thread,
+// and the returned references stay valid for the cache's lifetime.
+
+class EnumerationCache {
+
+public:
+
+	const std::vector<VkLayerProperties>& instanceLayers();
+
+	// layerName null means the loader's and the drivers' own extensions, same as vkEnumerateInstanceExtensionProperties
+	const std::vector<VkExtensionProperties>& instanceExtensions(const char* layerName = nullptr);
+	const std::vector<VkExtensionProperties>& deviceExtensions(VkPhysicalDevice device);
+
+	bool hasInstanceLayer(const char* name);
+	bool hasInstanceExtension(const char* name, const char* layerName = nullptr);
+	bool hasDeviceExtension(VkPhysicalDevice device, const char* name);
+
+	// How many lists were enumerated, and how many lookups were answered without enumerating
+	uint32_t enumerations() const;
+	uint32_t hits() const;
+
+private:
+
+	mutable std::mutex mutex;
+	bool layersLoaded = false;
+	std::vector<VkLayerProperties> layers;
+	std::map<std::string, std::vector<VkExtensionProperties>> instanceExtensionLists;   // Keyed by layer, "" for none
+	std::map<VkPhysicalDevice, std::vector<VkExtensionProperties>> deviceExtensionLists;
+	uint32_t enumerationCount = 0;
+	uint32_t hitCount = 0;
+};
+
+// Whether a list has an extension of this name
+bool containsExtension(const std::vector<VkExtensionProperties>& extensions, const char* name);
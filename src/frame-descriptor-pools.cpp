@@ -0,0 +1,140 @@
+// frame-descriptor-pools.cpp
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+#include "frame-descriptor-pools.h"
+
+void FrameDescriptorPools::create(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool,
+    std::vector<VkDescriptorPoolSize> poolSizes, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->setsPerPool = setsPerPool;
+    this->poolSizes = std::move(poolSizes);
+    this->allocationCallbacks = allocationCallbacks;
+
+    frames.assign(framesInFlight, Frame{});
+    frameIndex = 0;
+}
+
+void FrameDescriptorPools::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+    countFrame();
+    for (Frame& frame : frames) {
+        for (VkDescriptorPool pool : frame.pools) {
+            vkDestroyDescriptorPool(device, pool, allocationCallbacks);
+        }
+    }
+    frames.clear();
+    device = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool FrameDescriptorPools::createPool() {
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = setsPerPool;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(device, &poolInfo, allocationCallbacks, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+    poolsCreated++;
+    return pool;
+}
+
+void FrameDescriptorPools::countFrame() {
+
+    if (!frameBegun) return;
+
+    countedFrames++;
+    totalSets += frameSets;
+    totalWrites += frameWrites;
+    maxSets = std::max(maxSets, frameSets);
+    maxWrites = std::max(maxWrites, frameWrites);
+    frameSets = 0;
+    frameWrites = 0;
+}
+
+void FrameDescriptorPools::beginFrame(uint32_t frameIndex) {
+
+    countFrame();
+    this->frameIndex = frameIndex;
+    frameBegun = true;
+
+    // Only the pools that were actually used last time round need resetting
+    Frame& frame = frames[frameIndex];
+    uint32_t used = std::min(frame.current + 1, static_cast<uint32_t>(frame.pools.size()));
+    for (uint32_t pool = 0; pool < used; pool++) {
+        vkResetDescriptorPool(device, frame.pools[pool], 0);
+    }
+    frame.current = 0;
+    frame.currentSets = 0;
+}
+
+VkDescriptorSet FrameDescriptorPools::allocate(VkDescriptorSetLayout setLayout) {
+
+    Frame& frame = frames[frameIndex];
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    // Try the current pool, and move on to the next one (creating it if needed) once that's full
+    while (true) {
+        if (frame.current == frame.pools.size()) {
+            frame.pools.push_back(createPool());
+        }
+        allocInfo.descriptorPool = frame.pools[frame.current];
+
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+        if (result == VK_SUCCESS) {
+            frame.currentSets++;
+            frameSets++;
+            return set;
+        }
+        if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+            throw std::runtime_error("failed to allocate descriptor set!");
+        }
+
+        // A set that doesn't fit in an empty pool never will
+        if (frame.currentSets == 0) {
+            throw std::runtime_error("descriptor set layout too large for the frame descriptor pools!");
+        }
+        frame.current++;
+        frame.currentSets = 0;
+    }
+}
+
+void FrameDescriptorPools::update(const VkWriteDescriptorSet* writes, uint32_t writeCount) {
+
+    vkUpdateDescriptorSets(device, writeCount, writes, 0, nullptr);
+    frameWrites += writeCount;
+}
+
+uint32_t FrameDescriptorPools::poolCount() const {
+
+    uint32_t count = 0;
+    for (const Frame& frame : frames) {
+        count += static_cast<uint32_t>(frame.pools.size());
+    }
+    return count;
+}
+
+void FrameDescriptorPools::report(std::ostream& out, const char* name) const {
+
+    if (totalSets == 0 && totalWrites == 0) return;
+
+    out << std::fixed << std::setprecision(1)
+        << name << " descriptors: " << static_cast<double>(totalSets) / countedFrames << " sets and "
+        << static_cast<double>(totalWrites) / countedFrames << " writes per frame on average (max " << maxSets
+        << " and " << maxWrites << "), " << poolsCreated << " pools\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,71 @@
+// frame-descriptor-pools.h
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "include.h"
+
+// Descriptor sets that only live for one frame, allocated linearly and thrown away in bulk.
+//
+// Every frame in flight has its own list of pools. Sets come from the frame's current pool until it's full, then
+// the next one, creating more as needed. None is ever freed on its own. beginFrame() resets all of the frame's
+// pools with one vkResetDescriptorPool each, which is far cheaper than freeing sets one by one. The pools are
+// created without FREE_DESCRIPTOR_SET_BIT for that reason, which lets drivers use a plain bump allocator. Pools
+// are never destroyed before destroy(), so after the first few frames nothing is allocated from the driver any more.
+//
+// Descriptor pools are externally synchronized, so one instance belongs to one thread. Threads recording in
+// parallel each need their own.
+
+class FrameDescriptorPools {
+
+public:
+
+	// poolSizes is what one pool holds, for setsPerPool sets
+	void create(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool, std::vector<VkDescriptorPoolSize> poolSizes,
+		const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Once the GPU is done with this frame slot's previous use. Invalidates every set allocated for it back then.
+	void beginFrame(uint32_t frameIndex);
+
+	VkDescriptorSet allocate(VkDescriptorSetLayout setLayout);
+
+	// vkUpdateDescriptorSets, counted
+	void update(const VkWriteDescriptorSet* writes, uint32_t writeCount);
+
+	uint32_t poolCount() const;
+
+	void report(std::ostream& out, const char* name) const;
+
+private:
+
+	struct Frame {
+		std::vector<VkDescriptorPool> pools;
+		uint32_t current = 0;
+		uint32_t currentSets = 0;           // Allocated from pools[current]
+	};
+
+	VkDescriptorPool createPool();
+	void countFrame();
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	uint32_t setsPerPool = 0;
+	std::vector<VkDescriptorPoolSize> poolSizes;
+
+	std::vector<Frame> frames;
+	uint32_t frameIndex = 0;
+
+	// This frame's counts, and totals over every frame that's been counted (in beginFrame and destroy)
+	bool frameBegun = false;
+	uint32_t frameSets = 0;
+	uint32_t frameWrites = 0;
+	uint64_t countedFrames = 0;
+	uint64_t totalSets = 0;
+	uint64_t totalWrites = 0;
+	uint32_t maxSets = 0;
+	uint32_t maxWrites = 0;
+	uint32_t poolsCreated = 0;
+};
@@ -0,0 +1,120 @@
+// frame-scheduler.cpp
+
+#include <cmath>
+#include <iomanip>
+#include <thread>
+#include "include.h"
+#include "frame-scheduler.h"
+
+const char* framePacingName(FramePacing pacing) {
+
+    switch (pacing) {
+    case FramePacing::Uncapped:    return "uncapped";
+    case FramePacing::FixedRate:   return "fixed";
+    case FramePacing::EventDriven: return "idle";
+    }
+    return "unknown";
+}
+
+FrameScheduler::FrameScheduler(FramePacing pacing, double targetFps, bool pumpWindowEvents)
+    : pacing(pacing),
+      period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps))),
+      pumpWindowEvents(pumpWindowEvents) {}
+
+void FrameScheduler::beginFrame() {
+
+    frameStart = Clock::now();
+
+    if (firstFrame) {
+        nextDeadline = frameStart + period;
+        firstFrame = false;
+    }
+    else {
+        double interval = elapsedMilliseconds(previousFrameStart, frameStart);
+        frameInterval.add(interval);
+
+        // With a target rate, jitter is how far each frame landed from where it should have. Without one there's
+        // no "should", so it's the change from the previous frame instead.
+        if (pacing == FramePacing::FixedRate) {
+            jitter.add(std::abs(interval - std::chrono::duration<double, std::milli>(period).count()));
+        }
+        else if (previousInterval > 0.0) {
+            jitter.add(std::abs(interval - previousInterval));
+        }
+        previousInterval = interval;
+    }
+
+    previousFrameStart = frameStart;
+}
+
+void FrameScheduler::endFrame() {
+
+    Clock::time_point cpuEnd = Clock::now();
+    cpuTime.add(elapsedMilliseconds(frameStart, cpuEnd));
+
+    switch (pacing) {
+
+    case FramePacing::Uncapped:
+        if (pumpWindowEvents) glfwPollEvents();
+        break;
+
+    case FramePacing::FixedRate:
+        if (pumpWindowEvents) glfwPollEvents();
+        waitUntil(nextDeadline);
+
+        // Deadlines advance by exactly one period so small overshoots don't accumulate. If a frame ran long enough
+        // to miss its slot entirely, start over from now rather than rushing out a burst of frames to catch up.
+        nextDeadline += period;
+        if (nextDeadline < Clock::now()) {
+            nextDeadline = Clock::now() + period;
+        }
+        break;
+
+    case FramePacing::EventDriven:
+        if (pumpWindowEvents) {
+            glfwWaitEventsTimeout(std::chrono::duration<double>(period).count());
+        }
+        else {
+            std::this_thread::sleep_for(period);
+        }
+        break;
+    }
+
+    idleTime.add(elapsedMilliseconds(cpuEnd, Clock::now()));
+}
+
+void FrameScheduler::waitUntil(Clock::time_point deadline) {
+
+    // Sleep through the bulk of the wait, then spin through the last stretch for accuracy. yield() keeps the
+    // spin polite towards other threads on the same core.
+
+    auto remaining = deadline - Clock::now();
+    if (remaining > spinThreshold) {
+        std::this_thread::sleep_for(remaining - spinThreshold);
+    }
+    while (Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+void FrameScheduler::report(std::ostream& out) const {
+
+    double busy = cpuTime.total();
+    double wall = busy + idleTime.total();
+
+    out << "\nFrame pacing: " << framePacingName(pacing);
+    if (pacing != FramePacing::Uncapped) {
+        out << " (" << std::fixed << std::setprecision(1) << 1.0 / std::chrono::duration<double>(period).count() << " fps target)";
+        out.unsetf(std::ios::floatfield);
+    }
+    out << "\n";
+
+    frameInterval.print(out);
+    cpuTime.printLine(out);
+    idleTime.printLine(out);
+    jitter.printLine(out);
+
+    out << std::fixed << std::setprecision(1)
+        << "    main thread busy " << (wall > 0.0 ? 100.0 * busy / wall : 0.0) << "% of the time\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,61 @@
+// frame-scheduler.h
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include "frame-stats.h"
+
+// How the main loop spends the time between frames.
+//
+// Uncapped      Poll events and start the next frame immediately. Burns a full core, only useful for benchmarks.
+// FixedRate     Aim for a target frame rate. Sleeps for most of the remaining time and spins for the last
+//               stretch, because OS sleeps are only accurate to a millisecond or so.
+// EventDriven   Block in glfwWaitEventsTimeout until input arrives or one frame period passes. Uses next to no
+//               CPU while nothing is happening.
+
+enum class FramePacing {
+	Uncapped,
+	FixedRate,
+	EventDriven
+};
+
+const char* framePacingName(FramePacing pacing);
+
+class FrameScheduler {
+
+public:
+
+	// pumpWindowEvents is false for headless runs, where GLFW was never initialized
+	FrameScheduler(FramePacing pacing, double targetFps, bool pumpWindowEvents);
+
+	// Call around the CPU side of each frame. endFrame() handles events and waits out the rest of the frame.
+	void beginFrame();
+	void endFrame();
+
+	void report(std::ostream& out) const;
+
+private:
+
+	using Clock = std::chrono::steady_clock;
+
+	// Below this much remaining time we stop sleeping and spin instead
+	static constexpr std::chrono::microseconds spinThreshold{ 1500 };
+
+	void waitUntil(Clock::time_point deadline);
+
+	const FramePacing pacing;
+	const Clock::duration period;
+	const bool pumpWindowEvents;
+
+	Clock::time_point frameStart;
+	Clock::time_point previousFrameStart;
+	Clock::time_point nextDeadline;
+	bool firstFrame = true;
+	double previousInterval = 0.0;
+
+	FrameStats frameInterval{ "frame interval" };
+	FrameStats cpuTime{ "cpu time" };
+	FrameStats idleTime{ "idle time" };
+	FrameStats jitter{ "jitter" };
+};
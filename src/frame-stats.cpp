@@ -0,0 +1,66 @@
+// frame-stats.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include "frame-stats.h"
+
+double FrameStats::total() const {
+    return std::accumulate(samples.begin(), samples.end(), 0.0);
+}
+
+double FrameStats::mean() const {
+    return samples.empty() ? 0.0 : total() / samples.size();
+}
+
+double FrameStats::min() const {
+    return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+}
+
+double FrameStats::max() const {
+    return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+}
+
+double FrameStats::percentile(double p) const {
+
+    if (samples.empty()) return 0.0;
+
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest-rank: the smallest sample such that at least p percent of all samples are <= it
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    rank = std::clamp<size_t>(rank, 1, sorted.size());
+    return sorted[rank - 1];
+}
+
+void FrameStats::print(std::ostream& out) const {
+
+    double seconds = total() / 1000.0;
+
+    out << std::fixed << std::setprecision(3)
+        << label << " (" << count() << " frames, " << seconds << " s, "
+        << (seconds > 0.0 ? count() / seconds : 0.0) << " fps)\n"
+        << "    mean " << mean() << " ms"
+        << "   min " << min() << " ms"
+        << "   max " << max() << " ms\n"
+        << "    p50 " << percentile(50) << " ms"
+        << "   p95 " << percentile(95) << " ms"
+        << "   p99 " << percentile(99) << " ms\n";
+
+    out.unsetf(std::ios::floatfield);
+}
+
+void FrameStats::printLine(std::ostream& out) const {
+
+    out << std::fixed << std::setprecision(3)
+        << "    " << std::left << std::setw(14) << label << std::right
+        << " mean " << mean() << " ms"
+        << "   p50 " << percentile(50) << " ms"
+        << "   p95 " << percentile(95) << " ms"
+        << "   p99 " << percentile(99) << " ms"
+        << "   max " << max() << " ms\n";
+
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,79 @@
+// frame-stats.h
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Collects per-frame timings (in milliseconds) and prints a summary with percentiles at the end of a run.
+// Samples are stored rather than folded into running totals so that exact percentiles can be reported.
+
+class FrameStats {
+
+public:
+
+	explicit FrameStats(std::string label) : label(std::move(label)) {}
+
+	void reserve(size_t frames) { samples.reserve(frames); }
+	void add(double milliseconds) { samples.push_back(milliseconds); }
+
+	size_t count() const { return samples.size(); }
+	double total() const;
+	double mean() const;
+	double min() const;
+	double max() const;
+
+	// p is in the range [0, 100]. Uses nearest-rank on a sorted copy, so it's meant for end-of-run reporting.
+	double percentile(double p) const;
+
+	// print() is the full multi-line report. printLine() is a one-line summary for secondary measurements
+	// (idle time, jitter, ...) where a frame rate makes no sense.
+	void print(std::ostream& out) const;
+	void printLine(std::ostream& out) const;
+
+private:
+
+	std::string label;
+	std::vector<double> samples;
+};
+
+// Milliseconds between two steady_clock time points, the unit every report in this project uses
+inline double elapsedMilliseconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// How often a benchmark repeats what it times. The warmup runs pay for cold caches, first touches of new memory and
+// whatever the driver does lazily on first use, and are thrown away.
+struct BenchmarkRuns {
+	uint32_t warmup = 2;
+	uint32_t measured = 10;
+};
+
+// Calls run(measured) warmup + measured times, with measured false for the warmup runs. For benchmarks that take
+// more than one timing per run; timeRuns below covers the rest.
+template <typename Run>
+void repeatRuns(const BenchmarkRuns& runs, Run run) {
+	for (uint32_t i = 0; i < runs.warmup + runs.measured; i++) {
+		run(i >= runs.warmup);
+	}
+}
+
+// Times body() on every run and keeps the measured ones. prepare() runs before each body() outside the timing, for
+// work that has to be redone every run, like refilling what body() sorts in place.
+template <typename Prepare, typename Body>
+FrameStats timeRuns(const char* label, Prepare prepare, Body body, const BenchmarkRuns& runs = {}) {
+	FrameStats stats(label);
+	stats.reserve(runs.measured);
+	repeatRuns(runs, [&](bool measured) {
+		prepare();
+		auto start = std::chrono::steady_clock::now();
+		body();
+		if (measured) {
+			stats.add(elapsedMilliseconds(start, std::chrono::steady_clock::now()));
+		}
+	});
+	return stats;
+}
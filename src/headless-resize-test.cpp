@@ -0,0 +1,50 @@
+// headless-resize-test.cpp
+
+#include <string>
+#include <vector>
+#include "include.h"
+#include "app-config.h"
+#include "application.h"
+#include "test-harness.h"
+
+// The application itself, headless with --resize-every, on whatever device the tests were pointed at (lavapipe under
+// ctest). Each rebuild replaces the render target: the swap chain, with its views and semaphores, when the loader has
+// VK_EXT_headless_surface, otherwise the offscreen image. What it replaced has to go through the deferred destruction
+// queue, and be gone mid-run, retired by beginFrame() without waiting on the device.
+
+static constexpr uint32_t frames = 40;
+static constexpr uint32_t resizeEvery = 5;
+
+void testHeadlessResize() {
+
+    // Skipped like the other tests when there's no device at all
+    {
+        UniqueInstance instance;
+        VkPhysicalDevice physicalDevice;
+        createTestInstance(VK_API_VERSION_1_0, instance, physicalDevice);
+    }
+
+    // Through the command line parser, so it's the same run as typing the options. Validation is left out: the tests
+    // don't assume the layers are installed.
+    std::vector<std::string> arguments = { "vulkan-test", "--headless", "--no-validation",
+        "--frames", std::to_string(frames), "--resize-every", std::to_string(resizeEvery) };
+    std::vector<char*> argv;
+    for (std::string& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    AppConfig config = parseAppConfig(static_cast<int>(argv.size()), argv.data());
+
+    Application app(config);
+    app.run();
+
+    // Frames 5, 10, ... 35, each to a different size than the one before
+    const uint64_t expectedResizes = (frames - 1) / resizeEvery;
+    CHECK(app.resizes() == expectedResizes);
+
+    // At least one deferral per rebuild. The last rebuild is 5 frames before the end, more than the frames in flight,
+    // so every one of them is destroyed between frames rather than by cleanup(), which leaves nothing behind.
+    const DeferredDestruction& deferred = app.deferredDestruction();
+    CHECK(deferred.totalDeferred() >= expectedResizes);
+    CHECK(deferred.totalDestroyedMidRun() == deferred.totalDeferred());
+    CHECK(deferred.pending() == 0);
+}
@@ -0,0 +1,221 @@
+// headless.cpp
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cstring>
+#include "include.h"
+#include "application.h"
+#include "frame-scheduler.h"
+#include "profiler.h"
+#include "startup-timer.h"
+
+// Everything the Application needs to run without a window: a surface from VK_EXT_headless_surface (when the
+// loader has it), an offscreen image to render into, and a loop that draws a fixed number of frames and reports
+// how long they took. This is what the build and regression boxes run, usually against lavapipe or SwiftShader.
+
+bool Application::checkHeadlessSurfaceSupport() {
+
+    return enumerations.hasInstanceExtension(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+}
+
+void Application::createHeadlessSurface() {
+
+    // Not every loader/ICD combination has VK_EXT_headless_surface. Without it we simply don't have a surface,
+    // and the offscreen target is all there is.
+
+    if (!useHeadlessSurface) {
+        std::clog << "VK_EXT_headless_surface not available, rendering offscreen only\n";
+        return;
+    }
+
+    // Extension functions aren't exported by the loader, so look it up the same way as the debug messenger functions
+    auto func = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+
+    VkHeadlessSurfaceCreateInfoEXT createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Instance);
+    VkSurfaceKHR created;
+    if (func == nullptr || func(instance, &createInfo, callbacks, &created) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create headless surface!");
+    }
+    surface = UniqueSurface(instance, created, vkDestroySurfaceKHR, callbacks);
+}
+
+void Application::createOffscreenImage(VkExtent2D extent) {
+
+    // The render target itself. TRANSFER_SRC is there so frames can be read back later for image comparisons.
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = { extent.width, extent.height, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    // Sub-allocated like everything else, see device-allocator.h
+    offscreenImage = allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenImageMemory);
+    offscreenExtent = extent;
+}
+
+void Application::createOffscreenTarget() {
+
+    STARTUP_STAGE(startupTimer, "createOffscreenTarget");
+
+    windowExtent = { WIDTH, HEIGHT };
+    createOffscreenImage(windowExtent);
+
+    // The command buffer is re-recorded every frame, so the pool lets individual buffers be reset
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Device);
+    VkCommandPool pool;
+    if (vkCreateCommandPool(device, &poolInfo, callbacks, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create offscreen command pool!");
+    }
+    offscreenCommandPool = UniqueCommandPool(device, pool, vkDestroyCommandPool, callbacks);
+
+    VkCommandBufferAllocateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    bufferInfo.commandPool = offscreenCommandPool;
+    bufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    bufferInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &bufferInfo, &offscreenCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate offscreen command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device, &fenceInfo, callbacks, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create offscreen fence!");
+    }
+    offscreenFence = UniqueFence(device, fence, vkDestroyFence, callbacks);
+}
+
+void Application::resizeOffscreenTarget(VkExtent2D extent) {
+
+    // Same as the swap chain: the old image waits in the deferred queue rather than for the device. With the one
+    // frame slot's fence waited on at the end of every frame, it goes as soon as this frame begins.
+    deferred.defer([this, image = offscreenImage, memory = offscreenImageMemory]() mutable {
+        allocator.destroyImage(image, memory);
+    });
+    createOffscreenImage(extent);
+}
+
+void Application::drawOffscreenFrame() {
+
+    // There's no pipeline yet, so a "frame" is a layout transition plus a clear. That's still a full
+    // record -> submit -> wait round trip through the driver, which is exactly what we want to time.
+
+    PROFILE_ZONE("drawOffscreenFrame");
+
+    applyResize();
+    applyShaderReloads();
+
+    {
+        PROFILE_ZONE("textures.update");
+        textures.update();
+    }
+    {
+        PROFILE_ZONE("uploadRing.flush");
+        uploadRing.flush();
+    }
+    vkResetCommandBuffer(offscreenCommandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(offscreenCommandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording offscreen command buffer!");
+    }
+
+    // One frame slot, since the fence below is waited on before the next frame is recorded
+    deferred.beginFrame();
+    deferred.collect(uploadRing.completed());
+    frameDescriptors.beginFrame(0);
+    writeFrameUniforms(0, offscreenExtent);
+    profiler.beginGpuFrame(offscreenCommandBuffer, 0);
+
+    // Nothing to wait for: last frame's fence was waited on before this one started
+    recordFrame(offscreenCommandBuffer, offscreenImage, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    if (vkEndCommandBuffer(offscreenCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record offscreen command buffer!");
+    }
+
+    bindless.flush();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &offscreenCommandBuffer;
+
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, offscreenFence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit offscreen frame!");
+    }
+
+    PROFILE_ZONE("fence wait");
+    VkFence fence = offscreenFence;
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &fence);
+}
+
+void Application::headlessLoop() {
+
+    // Same scheduler as the windowed loop, minus the event pumping since GLFW isn't running
+    FrameScheduler scheduler(pacing, targetFps, false);
+
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        scheduler.beginFrame();
+        simulateResize(frame);
+        beginValidationFrame();
+        if (surface != VK_NULL_HANDLE) {
+            drawFrame();
+        }
+        else {
+            drawOffscreenFrame();
+        }
+        startupTimer.markFirstFrame();
+        validationSink.endFrame();
+        scheduler.endFrame();
+    }
+
+    vkDeviceWaitIdle(device);
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    std::cout << "\nDevice: " << deviceProperties.deviceName << " (" << WIDTH << "x" << HEIGHT << ", "
+        << (surface != VK_NULL_HANDLE ? "headless surface" : "offscreen only") << ")\n";
+    scheduler.report(std::cout);
+    if (surface != VK_NULL_HANDLE) {
+        swapchain.report(std::cout);
+    }
+    reportResizes(std::cout);
+    uploadRing.report(std::cout);
+    allocator.report(std::cout);
+}
+
+void Application::destroyOffscreenTarget() {
+
+    // Freeing the pool frees the command buffer allocated from it
+    offscreenFence.reset();
+    offscreenCommandPool.reset();
+    if (offscreenImage != VK_NULL_HANDLE) {
+        allocator.destroyImage(offscreenImage, offscreenImageMemory);
+        offscreenImage = VK_NULL_HANDLE;
+    }
+}
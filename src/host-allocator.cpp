@@ -0,0 +1,354 @@
+// host-allocator.cpp
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include "host-allocator.h"
+
+static constexpr size_t smallestSizeClass = 64;
+static constexpr size_t sizeClassCount = 7;                 // 64, 128, ... 4096
+static constexpr size_t slabSize = 64 * 1024;
+static constexpr size_t refillBatch = 32;
+static constexpr uint32_t threadCacheLimit = 512;           // Per size class, beyond that frees go back to the depot
+static constexpr size_t commandArenaSize = 64 * 1024;
+
+enum class Origin : uint8_t { Pool, Arena, Heap };
+
+// Sits directly in front of every pointer handed to the driver. alignas keeps the pointer after it 16-byte aligned,
+// which is what malloc guarantees and what drivers assume for the default alignment.
+struct alignas(16) AllocationHeader {
+    void* tracker;
+    void* arena;            // Command arena the allocation came from, if any
+    uint64_t size;          // As requested, for the counters and for realloc
+    uint32_t offset;        // From the start of the underlying block to the user pointer
+    Origin origin;
+    uint8_t scope;
+    uint8_t sizeClass;
+};
+
+struct FreeNode {
+    FreeNode* next;
+};
+
+// Where thread caches get blocks from when they run dry, and where they leave them when a thread exits. Slabs are
+// never given back to the system: driver host allocations peak during startup and stay flat after that, so holding on
+// to them costs little and means freeing never has to figure out which slab a block belongs to.
+struct Depot {
+    std::mutex mutex;
+    std::array<FreeNode*, sizeClassCount> lists{};
+};
+
+static Depot& depot() {
+    static Depot instance;
+    return instance;
+}
+
+// Counted globally rather than per tracker since the pools are shared by all subsystems. Relaxed atomics, they're
+// only read for the report.
+static std::atomic<uint64_t> threadCacheHits{ 0 };
+static std::atomic<uint64_t> depotRefills{ 0 };
+static std::atomic<uint64_t> slabsCarved{ 0 };
+static std::atomic<uint64_t> arenaAllocations{ 0 };
+static std::atomic<uint64_t> heapAllocations{ 0 };
+
+struct ThreadCache {
+    std::array<FreeNode*, sizeClassCount> lists{};
+    std::array<uint32_t, sizeClassCount> counts{};
+
+    ~ThreadCache() {
+
+        // Hand everything to the depot so blocks freed on this thread aren't lost when it exits
+        std::lock_guard<std::mutex> lock(depot().mutex);
+        for (size_t c = 0; c < sizeClassCount; c++) {
+            while (lists[c] != nullptr) {
+                FreeNode* node = lists[c];
+                lists[c] = node->next;
+                node->next = depot().lists[c];
+                depot().lists[c] = node;
+            }
+        }
+    }
+};
+
+struct CommandArena {
+    char* base = nullptr;
+    size_t head = 0;
+    std::atomic<uint32_t> live{ 0 };
+
+    ~CommandArena() { std::free(base); }
+};
+
+static thread_local ThreadCache threadCache;
+static thread_local CommandArena commandArena;
+
+static size_t sizeClassBytes(size_t sizeClass) {
+    return smallestSizeClass << sizeClass;
+}
+
+static char* alignPointer(char* pointer, size_t alignment) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(pointer);
+    return reinterpret_cast<char*>((value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1));
+}
+
+static FreeNode* takeFromPool(size_t sizeClass) {
+
+    FreeNode*& list = threadCache.lists[sizeClass];
+
+    if (list == nullptr) {
+        std::lock_guard<std::mutex> lock(depot().mutex);
+        FreeNode*& shared = depot().lists[sizeClass];
+
+        // Move a batch over rather than one block, so the lock is taken once per refillBatch allocations
+        for (size_t i = 0; i < refillBatch && shared != nullptr; i++) {
+            FreeNode* node = shared;
+            shared = node->next;
+            node->next = list;
+            list = node;
+            threadCache.counts[sizeClass]++;
+        }
+
+        if (list == nullptr) {
+            char* slab = static_cast<char*>(std::malloc(slabSize));
+            if (slab == nullptr) return nullptr;
+
+            size_t blockSize = sizeClassBytes(sizeClass);
+            for (size_t offset = 0; offset + blockSize <= slabSize; offset += blockSize) {
+                FreeNode* node = reinterpret_cast<FreeNode*>(slab + offset);
+                node->next = list;
+                list = node;
+                threadCache.counts[sizeClass]++;
+            }
+            slabsCarved.fetch_add(1, std::memory_order_relaxed);
+        }
+        depotRefills.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        threadCacheHits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    FreeNode* node = list;
+    list = node->next;
+    threadCache.counts[sizeClass]--;
+    return node;
+}
+
+static void returnToPool(void* block, size_t sizeClass) {
+
+    FreeNode* node = static_cast<FreeNode*>(block);
+
+    // Threads that free much more than they allocate would otherwise hoard blocks nobody else can reach
+    if (threadCache.counts[sizeClass] >= threadCacheLimit) {
+        std::lock_guard<std::mutex> lock(depot().mutex);
+        node->next = depot().lists[sizeClass];
+        depot().lists[sizeClass] = node;
+        return;
+    }
+
+    node->next = threadCache.lists[sizeClass];
+    threadCache.lists[sizeClass] = node;
+    threadCache.counts[sizeClass]++;
+}
+
+// Places the header and user pointer inside a block that starts at raw. Returns the user pointer.
+static void* placeAllocation(char* raw, size_t size, size_t alignment, void* tracker, VkSystemAllocationScope scope,
+    Origin origin, uint8_t sizeClass, void* arena) {
+
+    char* user = alignPointer(raw + sizeof(AllocationHeader), alignment);
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(user) - 1;
+
+    header->tracker = tracker;
+    header->arena = arena;
+    header->size = size;
+    header->offset = static_cast<uint32_t>(user - raw);
+    header->origin = origin;
+    header->scope = static_cast<uint8_t>(scope);
+    header->sizeClass = sizeClass;
+    return user;
+}
+
+const char* hostSubsystemName(HostSubsystem subsystem) {
+
+    switch (subsystem) {
+    case HostSubsystem::Instance: return "instance";
+    case HostSubsystem::Device: return "device";
+    case HostSubsystem::Swapchain: return "swapchain";
+    }
+    return "unknown";
+}
+
+void HostAllocator::Counters::add(uint64_t size) {
+
+    uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+void HostAllocator::Counters::remove(uint64_t size) {
+    liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+HostAllocator::HostAllocator(bool enabled) : enabled(enabled) {
+
+    for (Tracker& tracker : trackers) {
+        tracker.callbacks.pUserData = &tracker;
+        tracker.callbacks.pfnAllocation = allocation;
+        tracker.callbacks.pfnReallocation = reallocation;
+        tracker.callbacks.pfnFree = free;
+        tracker.callbacks.pfnInternalAllocation = internalAllocation;
+        tracker.callbacks.pfnInternalFree = internalFree;
+    }
+}
+
+const VkAllocationCallbacks* HostAllocator::callbacks(HostSubsystem subsystem) const {
+    return enabled ? &trackers[static_cast<size_t>(subsystem)].callbacks : nullptr;
+}
+
+void* VKAPI_PTR HostAllocator::allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+
+    if (size == 0) return nullptr;
+
+    Tracker* tracker = static_cast<Tracker*>(userData);
+    alignment = alignment < alignof(AllocationHeader) ? alignof(AllocationHeader) : alignment;
+
+    // Worst case: header, then padding up to the requested alignment, then the data
+    size_t needed = size + sizeof(AllocationHeader) + (alignment - alignof(AllocationHeader));
+    void* user = nullptr;
+
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+        CommandArena& arena = commandArena;
+
+        // Only this thread moves the head. Other threads can only ever decrement live, so once it's zero
+        // nothing in the arena is in use and it can start over.
+        if (arena.live.load(std::memory_order_acquire) == 0) {
+            arena.head = 0;
+        }
+        if (arena.base == nullptr) {
+            arena.base = static_cast<char*>(std::malloc(commandArenaSize));
+        }
+
+        if (arena.base != nullptr && arena.head + needed <= commandArenaSize) {
+            char* raw = arena.base + arena.head;
+            user = placeAllocation(raw, size, alignment, tracker, scope, Origin::Arena, 0, &arena);
+            // Keep the head 16-byte aligned so the padding accounted for in needed is always enough
+            arena.head = alignPointer(static_cast<char*>(user) + size, alignof(AllocationHeader)) - arena.base;
+            arena.live.fetch_add(1, std::memory_order_relaxed);
+            arenaAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (user == nullptr && needed <= sizeClassBytes(sizeClassCount - 1)) {
+        uint8_t sizeClass = 0;
+        while (sizeClassBytes(sizeClass) < needed) sizeClass++;
+
+        char* raw = reinterpret_cast<char*>(takeFromPool(sizeClass));
+        if (raw == nullptr) return nullptr;
+        user = placeAllocation(raw, size, alignment, tracker, scope, Origin::Pool, sizeClass, nullptr);
+    }
+
+    if (user == nullptr) {
+        char* raw = static_cast<char*>(std::malloc(needed));
+        if (raw == nullptr) return nullptr;
+        user = placeAllocation(raw, size, alignment, tracker, scope, Origin::Heap, 0, nullptr);
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    tracker->total.add(size);
+    tracker->scopes[scope].add(size);
+    return user;
+}
+
+void* VKAPI_PTR HostAllocator::reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+
+    // The spec spells out these two cases
+    if (original == nullptr) return allocation(userData, size, alignment, scope);
+    if (size == 0) {
+        free(userData, original);
+        return nullptr;
+    }
+
+    const AllocationHeader* header = static_cast<const AllocationHeader*>(original) - 1;
+
+    // On failure the original has to stay valid, so allocate first
+    void* replacement = allocation(userData, size, alignment, scope);
+    if (replacement == nullptr) return nullptr;
+
+    std::memcpy(replacement, original, header->size < size ? header->size : size);
+    free(userData, original);
+    return replacement;
+}
+
+void VKAPI_PTR HostAllocator::free(void* userData, void* memory) {
+
+    if (memory == nullptr) return;
+
+    AllocationHeader* header = static_cast<AllocationHeader*>(memory) - 1;
+    char* raw = static_cast<char*>(memory) - header->offset;
+
+    // Counted against the tracker that allocated it, whichever callbacks the free came through
+    Tracker* tracker = static_cast<Tracker*>(header->tracker);
+    tracker->total.remove(header->size);
+    tracker->scopes[header->scope].remove(header->size);
+
+    switch (header->origin) {
+    case Origin::Arena:
+        static_cast<CommandArena*>(header->arena)->live.fetch_sub(1, std::memory_order_release);
+        break;
+    case Origin::Pool:
+        returnToPool(raw, header->sizeClass);
+        break;
+    case Origin::Heap:
+        std::free(raw);
+        break;
+    }
+}
+
+void VKAPI_PTR HostAllocator::internalAllocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    static_cast<Tracker*>(userData)->internal.add(size);
+}
+
+void VKAPI_PTR HostAllocator::internalFree(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    static_cast<Tracker*>(userData)->internal.remove(size);
+}
+
+void HostAllocator::report(std::ostream& out) const {
+
+    if (!enabled) {
+        out << "\nHost allocations: driver default allocator\n";
+        return;
+    }
+
+    static const char* scopeNames[scopeCount] = { "command", "object", "cache", "device", "instance" };
+    auto kib = [](uint64_t bytes) { return static_cast<double>(bytes) / 1024.0; };
+
+    out << std::fixed << std::setprecision(1) << "\nHost allocations:\n";
+
+    for (size_t s = 0; s < subsystemCount; s++) {
+        const Tracker& tracker = trackers[s];
+
+        // Anything still live here was never freed by the driver, or belongs to an object we never destroyed
+        out << "    " << std::left << std::setw(10) << hostSubsystemName(static_cast<HostSubsystem>(s)) << std::right
+            << tracker.total.allocations.load() << " allocations, peak " << kib(tracker.total.peakBytes.load())
+            << " KiB, live " << kib(tracker.total.liveBytes.load()) << " KiB";
+        if (tracker.internal.allocations.load() > 0) {
+            out << ", internal peak " << kib(tracker.internal.peakBytes.load()) << " KiB";
+        }
+        out << "\n";
+
+        for (size_t scope = 0; scope < scopeCount; scope++) {
+            const Counters& counters = tracker.scopes[scope];
+            if (counters.allocations.load() == 0) continue;
+
+            out << "        " << std::left << std::setw(10) << scopeNames[scope] << std::right
+                << counters.allocations.load() << " allocations, peak " << kib(counters.peakBytes.load()) << " KiB\n";
+        }
+    }
+
+    uint64_t hits = threadCacheHits.load();
+    uint64_t refills = depotRefills.load();
+    out << "    pools: " << hits << " thread cache hits, " << refills << " refills (" << slabsCarved.load() << " new slabs), "
+        << arenaAllocations.load() << " command arena, " << heapAllocations.load() << " malloc\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,80 @@
+// host-allocator.h
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include "include.h"
+
+// VkAllocationCallbacks for the driver's and loader's own host (CPU) memory.
+//
+// Passing nullptr as pAllocator sends every one of those allocations through global malloc, where they're invisible
+// and all threads fight over the same heap lock. Here they're counted per subsystem and per VkSystemAllocationScope,
+// and served from:
+//
+//   - A per-thread command arena for VK_SYSTEM_ALLOCATION_SCOPE_COMMAND. Those only live until the Vulkan call that
+//     made them returns, so a bump pointer that rewinds whenever nothing is live covers them.
+//   - Per-thread free lists in power-of-two size classes (64 B to 4 KiB) for everything else that's small. Freeing
+//     and re-allocating on the same thread never takes a lock. Empty lists refill in batches from a shared depot,
+//     and the depot refills by carving up 64 KiB slabs.
+//   - Plain malloc for anything larger.
+//
+// Every allocation carries a small header that records where it came from, since vkFree gets neither a size nor a
+// scope.
+
+enum class HostSubsystem {
+	Instance,   // Instance, surface, debug messenger
+	Device,     // Device and everything created from it that isn't listed below
+	Swapchain   // Swap chain, its image views and per-frame sync objects
+};
+
+const char* hostSubsystemName(HostSubsystem subsystem);
+
+class HostAllocator {
+
+public:
+
+	// Disabled = callbacks() always returns nullptr and the driver's default allocator is used, for comparison
+	explicit HostAllocator(bool enabled);
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	// Pass as pAllocator. Objects must be destroyed with callbacks from the same subsystem they were created with.
+	const VkAllocationCallbacks* callbacks(HostSubsystem subsystem) const;
+
+	void report(std::ostream& out) const;
+
+private:
+
+	static constexpr size_t scopeCount = 5;         // VK_SYSTEM_ALLOCATION_SCOPE_COMMAND through _INSTANCE
+	static constexpr size_t subsystemCount = 3;
+
+	struct Counters {
+		std::atomic<uint64_t> liveBytes{ 0 };
+		std::atomic<uint64_t> peakBytes{ 0 };
+		std::atomic<uint64_t> allocations{ 0 };
+
+		void add(uint64_t size);
+		void remove(uint64_t size);
+	};
+
+	// pUserData of each subsystem's callbacks
+	struct Tracker {
+		VkAllocationCallbacks callbacks{};
+		Counters total;
+		std::array<Counters, scopeCount> scopes;
+		Counters internal;                          // Driver allocations we only hear about (e.g. executable memory)
+	};
+
+	static void* VKAPI_PTR allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void* VKAPI_PTR reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void VKAPI_PTR free(void* userData, void* memory);
+	static void VKAPI_PTR internalAllocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static void VKAPI_PTR internalFree(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	const bool enabled;
+	std::array<Tracker, subsystemCount> trackers;
+};
@@ -5,7 +5,7 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
-// Where did I leave off?       https://vulkan-tutorial.com/en/Drawing_a_triangle/Presentation/Swap_chain
+// Where did I leave off?       https://vulkan-tutorial.com/en/Drawing_a_triangle/Graphics_pipeline_basics/Introduction
 
 /*
 
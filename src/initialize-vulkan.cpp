@@ -6,42 +6,175 @@
 #include <vector>
 #include <cstring>
 #include <set>
+#include <optional>
+#include <algorithm>
+#include <future>
 #include "include.h"
 #include "application.h"
 #include "debugger.h"
+#include "device-ranking.h"
+#include "profiler.h"
+#include "shader-module.h"
+#include "startup-timer.h"
+
+const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+// Bindless table sizes, before clamping to the device's update-after-bind limits
+static constexpr uint32_t bindlessSampledImages = 16384;
+static constexpr uint32_t bindlessStorageBuffers = 16384;
 
 void Application::initVulkan() {
     
-    Application::createInstance();
-    Application::setupDebugMessenger();
+    // Every stage is timed on its own (the Application ones inside the functions), see startup-timer.h
+    PROFILE_ZONE("initVulkan");
+
+    // The window and the instance don't need each other until createSurface. So in windowed runs the instance (and
+    // the layer loading that makes up most of it with validation on) is created on a second thread while this one
+    // makes the window. It's that way around because GLFW windows have to be created on the main thread.
+    if (headless) {
+        Application::createInstance();
+        Application::setupDebugMessenger();
+    }
+    else {
+        std::future<void> instanceCreated = std::async(std::launch::async, [this] {
+            Application::createInstance();
+            Application::setupDebugMessenger();
+        });
+        Application::initWindow();
+
+        // Rethrows anything createInstance threw
+        instanceCreated.get();
+    }
     Application::createSurface();
     Application::pickPhysicalDevice();
     Application::createLogicalDevice();
+    {
+        STARTUP_STAGE(startupTimer, "allocator.create");
+        allocator.create(physicalDevice, device, hostAllocator.callbacks(HostSubsystem::Device));
+    }
+    {
+        STARTUP_STAGE(startupTimer, "pipelineCache.create");
+        pipelineCache.setCreationFeedbackSupported(capabilities.pipelineCreationFeedback);
+        pipelineCache.create(physicalDevice, device, coldPipelineCache, hostAllocator.callbacks(HostSubsystem::Device));
+    }
+    {
+        // Staging goes out on the transfer queue, which is a separate copy engine when the device has one
+        STARTUP_STAGE(startupTimer, "uploadRing.create");
+        uploadRing.create(physicalDevice, device, allocator, transferQueue, queueFamilyIndices.transferFamily.value(),
+            16ull << 20, capabilities.timelineSemaphores, hostAllocator.callbacks(HostSubsystem::Device));
+    }
+    {
+        STARTUP_STAGE(startupTimer, "shaders.create");
+        shaders.create(device, shaderHotReload, hostAllocator.callbacks(HostSubsystem::Device));
+    }
+    {
+        // On the compute queue, a separate family from graphics when the device has one. Loading the kernels only
+        // fails softly: without their shaders every call runs on the CPU instead.
+        STARTUP_STAGE(startupTimer, "compute.create");
+        compute.create(physicalDevice, device, allocator, pipelineCache, computeQueue, queueFamilyIndices.computeFamily.value(),
+            hostAllocator.callbacks(HostSubsystem::Device));
+        kernels.create(compute, shaders, shaderDirectory());
+    }
+
+    // Headless runs without VK_EXT_headless_surface have nothing to present to, so frames are drawn into an image of our own
+    if (surface != VK_NULL_HANDLE) {
+        Application::createSwapChain();
+    }
+    else {
+        Application::createOffscreenTarget();
+    }
+
+    // Timestamps are written from the graphics queue's frame command buffers, one query range per frame in flight.
+    // Does nothing unless profiling was turned on.
+    {
+        STARTUP_STAGE(startupTimer, "profiler.createGpu");
+        profiler.createGpu(instance, physicalDevice, device, graphicsQueue, queueFamilyIndices.graphicsFamily.value(),
+            surface != VK_NULL_HANDLE ? swapchain.framesInFlight() : 1, capabilities.calibratedTimestamps,
+            capabilities.hostQueryReset, hostAllocator.callbacks(HostSubsystem::Device));
+    }
+
+    // Descriptors: the global bindless table, and per-frame pools for sets that only live for one frame, both
+    // sized for the frames in flight. See bindless-table.h and frame-descriptor-pools.h
+    {
+        STARTUP_STAGE(startupTimer, "descriptors.create");
+        bindless.create(physicalDevice, device, capabilities, bindlessSampledImages, bindlessStorageBuffers,
+            hostAllocator.callbacks(HostSubsystem::Device));
+        frameDescriptors.create(device, surface != VK_NULL_HANDLE ? swapchain.framesInFlight() : 1, 256, {
+                { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 256 * 2 },
+                { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 256 * 4 },
+                { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 256 * 2 } },
+            hostAllocator.callbacks(HostSubsystem::Device));
+        createFrameUniforms(surface != VK_NULL_HANDLE ? swapchain.framesInFlight() : 1);
+    }
+
+    // What's released mid-run waits here for the frames in flight that may still use it. See deferred-destruction.h
+    deferred.create(surface != VK_NULL_HANDLE ? swapchain.framesInFlight() : 1);
+
+    // Textures stream in through the upload ring into bindless slots, and hand the images they replace to the
+    // deferred destruction queue. See texture-streamer.h
+    {
+        STARTUP_STAGE(startupTimer, "textures.create");
+        textures.create(device, allocator, uploadRing, bindless, queueFamilyIndices, deferred, textureStreaming,
+            hostAllocator.callbacks(HostSubsystem::Device));
+    }
+
+    // Transient images are shared by every frame in flight, see render-graph.h
+    {
+        STARTUP_STAGE(startupTimer, "renderGraph.create");
+        renderGraph.create(device, allocator, capabilities, deferred, hostAllocator.callbacks(HostSubsystem::Device));
+    }
+
+    // Culls on the compute queue into draw buffers per frame in flight, or on the CPU without its shaders. See
+    // instance-culling.h
+    {
+        STARTUP_STAGE(startupTimer, "culler.create");
+        culler.create(device, allocator, compute, shaders, shaderDirectory(), capabilities, queueFamilyIndices,
+            surface != VK_NULL_HANDLE ? swapchain.framesInFlight() : 1);
+    }
 
 }
 
 void Application::createInstance() {
 
+    STARTUP_STAGE(startupTimer, "createInstance");
+
     if (enableValidationLayers && !checkValidationLayerSupport()) {
         throw std::runtime_error("validation layers requested, but not available!");
     }
 
+    // Running before vkCreateInstance, since the messenger chained into it below already reports to the sink
+    if (enableValidationLayers) {
+        validationSink.start(validation.filter);
+    }
+
+    // Has to be known before getRequiredExtensions is called, same as useHeadlessSurface below
+    useValidationFeatures = enableValidationLayers && validation.features != 0 && checkValidationFeaturesSupport();
+
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     appInfo.pApplicationName = "Hello Triangle";
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    // Ask for the newest version up to 1.3 that the loader knows. A 1.0 loader doesn't have vkEnumerateInstanceVersion
+    // at all, and rejects anything above 1.0. Device ranking needs 1.1 for vkGetPhysicalDeviceProperties2.
+    instanceApiVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion =
+        (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    if (enumerateInstanceVersion != nullptr) {
+        uint32_t loaderVersion = VK_API_VERSION_1_0;
+        enumerateInstanceVersion(&loaderVersion);
+        instanceApiVersion = std::min(loaderVersion, VK_API_VERSION_1_3);
+    }
+    appInfo.apiVersion = instanceApiVersion;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
 
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    // Has to be known before getRequiredExtensions is called, since it decides which surface extensions to ask for
+    useHeadlessSurface = headless && checkHeadlessSurfaceSupport();
 
     // The following if-else statement not only describes validation layers if enabled, but simaltaneously
     // allows the existance of validation debug in this createInstance function.
@@ -53,6 +186,9 @@ void Application::createInstance() {
     // https://vulkan-tutorial.com/Drawing_a_triangle/Setup/Validation_layers
 
     VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+    VkValidationFeaturesEXT validationFeatures{};
+    std::vector<VkValidationFeatureEnableEXT> enabledFeatures;
+
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
         createInfo.ppEnabledLayerNames = validationLayers.data();
@@ -60,6 +196,25 @@ void Application::createInstance() {
         populateDebugMessengerCreateInfo(debugCreateInfo);
         createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
 
+        // The extra checks are chosen once, for the instance's whole lifetime
+        if (useValidationFeatures) {
+            if (validation.features & ValidationBestPractices) {
+                enabledFeatures.push_back(VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT);
+            }
+            if (validation.features & ValidationSynchronization) {
+                enabledFeatures.push_back(VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT);
+            }
+            if (validation.features & ValidationGpuAssisted) {
+                // The layer needs a descriptor set binding of its own for the instrumentation
+                enabledFeatures.push_back(VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT);
+                enabledFeatures.push_back(VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT);
+            }
+
+            validationFeatures.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+            validationFeatures.enabledValidationFeatureCount = static_cast<uint32_t>(enabledFeatures.size());
+            validationFeatures.pEnabledValidationFeatures = enabledFeatures.data();
+            debugCreateInfo.pNext = &validationFeatures;
+        }
     }
     else {
         createInfo.enabledLayerCount = 0;
@@ -77,13 +232,23 @@ void Application::createInstance() {
     // Almost all Vulkan functions return a VkResult of either VK_SUCCESS or an error code, which can be taken
     // advantage of like so:
 
-    if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Instance);
+    VkInstance created;
+    if (vkCreateInstance(&createInfo, callbacks, &created) != VK_SUCCESS) {
         throw std::runtime_error("failed to create instance!");
     }
+    instance = UniqueInstance(created, vkDestroyInstance, callbacks);
 }
 
 void Application::createSurface() {
 
+    STARTUP_STAGE(startupTimer, "createSurface");
+
+    if (headless) {
+        createHeadlessSurface();
+        return;
+    }
+
     /* You could do this with platform specific notation, but GLFW has a special function anyways. It would look like this:
     VkWin32SurfaceCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
@@ -96,16 +261,18 @@ void Application::createSurface() {
     */
 
     // Creates a "VkSurfaceKHR," or an "object that represents an abstract type of surface to present rendered images to."
-    if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Instance);
+    VkSurfaceKHR created;
+    if (glfwCreateWindowSurface(instance, window, callbacks, &created) != VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface!");
     }
+    surface = UniqueSurface(instance, created, vkDestroySurfaceKHR, callbacks);
 
 }
 
 QueueFamilyIndices Application::findQueueFamilies(VkPhysicalDevice device) {
 
     QueueFamilyIndices indices;
-    int i = 0;
 
     // Retrieving the list of queue families
     uint32_t queueFamilyCount = 0;
@@ -114,23 +281,59 @@ QueueFamilyIndices Application::findQueueFamilies(VkPhysicalDevice device) {
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-    // Checking for surface presentation support is slightly different than checking for Vulkan graphics support
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+    // Every family is scored for each role and the best one wins. Ties go to the lowest index, which is
+    // usually the family the driver considers primary.
+    int bestGraphics = -1, bestCompute = -1, bestTransfer = -1;
 
-    // Find a queue family that supports Vulkan graphics drawing and a queue family that supports presentation to a surface
-    // It's very likely these two queue families will be the same, and I should probably add logic that prefers those over two seperate ones for performance
-    for (const auto& queueFamily : queueFamilies) {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) { indices.graphicsFamily = i; }
-        if (presentSupport) { indices.presentFamily = i; }
-        if (indices.isComplete()) { break; }
-        i++;
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        bool graphics = flags & VK_QUEUE_GRAPHICS_BIT;
+        bool compute = flags & VK_QUEUE_COMPUTE_BIT;
+
+        // Checking for surface presentation support is slightly different than checking for Vulkan graphics support,
+        // and has to be asked for each family separately. Headless runs without VK_EXT_headless_surface have no
+        // surface, and therefore no present family either.
+        VkBool32 presentSupport = false;
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        }
+
+        // A family that can both draw and present saves handing every swap chain image over between two queues
+        if (graphics) {
+            int score = 1 + (presentSupport ? 2 : 0);
+            if (score > bestGraphics) { indices.graphicsFamily = i; bestGraphics = score; }
+        }
+        if (presentSupport && !indices.presentFamily.has_value()) {
+            indices.presentFamily = i;
+        }
+
+        // Async compute wants a family without graphics so it runs alongside rendering instead of queueing behind it
+        if (compute) {
+            int score = graphics ? 0 : 2;
+            if (score > bestCompute) { indices.computeFamily = i; bestCompute = score; }
+        }
+
+        // Graphics and compute families can always do transfers, even if they don't advertise TRANSFER_BIT. The best
+        // is a transfer-only family, usually backed by a copy engine that DMAs while the rest of the GPU keeps working.
+        if (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
+            int score = graphics ? 0 : (compute ? 1 : 2);
+            if (score > bestTransfer) { indices.transferFamily = i; bestTransfer = score; }
+        }
+    }
+
+    // Prefer presenting from the graphics family if it can
+    if (bestGraphics >= 3) {
+        indices.presentFamily = indices.graphicsFamily;
     }
+
     return indices;
 }
 
 void Application::pickPhysicalDevice() {
 
+    STARTUP_STAGE(startupTimer, "pickPhysicalDevice");
+
     // The graphics card that we'll end up selecting will be stored in a VkPhysicalDevice handle that is added as a new class member. 
     // This object will be implicitly destroyed when the VkInstance is destroyed, so we won't need to do anything new in the cleanup function.
 
@@ -147,39 +350,81 @@ void Application::pickPhysicalDevice() {
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    // List all physical devices found to the console. Should I even include it?
-    // Only looks clean with validation layers off, will fix somehow soon?
-
     VkPhysicalDeviceProperties deviceProperties;
+
+    // 1. An explicit choice always wins. It's not remembered, so unsetting it goes back to normal selection.
+    if (const char* override = std::getenv("VKTEST_DEVICE")) {
+        for (const auto& device : devices) {
+            vkGetPhysicalDeviceProperties(device, &deviceProperties);
+            if (matchesDeviceOverride(override, deviceProperties.deviceName, queryDeviceUuid(device, instanceApiVersion)) && isDeviceSuitable(device)) {
+                std::cout << "\nDevice Chosen by VKTEST_DEVICE: " << deviceProperties.deviceName << "\n\n";
+                physicalDevice = device;
+                return;
+            }
+        }
+        throw std::runtime_error(std::string("VKTEST_DEVICE=") + override + " does not match any suitable GPU!");
+    }
+
+    // 2. The device picked last time. Only its UUID is looked up for each device, which skips the full scoring
+    // pass below. If it's gone or no longer suitable, fall through and rank everything again.
+    const char* cacheSetting = std::getenv("VKTEST_DEVICE_CACHE");
+    bool useCache = !(cacheSetting != nullptr && std::strcmp(cacheSetting, "0") == 0);
+
+    if (useCache) {
+        if (auto cachedUuid = loadCachedDeviceUuid()) {
+            for (const auto& device : devices) {
+                if (queryDeviceUuid(device, instanceApiVersion) == cachedUuid && isDeviceSuitable(device)) {
+                    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+                    std::cout << "\nCached Device Chosen: " << deviceProperties.deviceName << "\n\n";
+                    physicalDevice = device;
+                    return;
+                }
+            }
+        }
+    }
+
+    // 3. Score every suitable device and take the best. Taking the first suitable one, like we used to, can
+    // easily land on an integrated or software GPU when there's a discrete card in the same machine.
+    std::optional<DeviceRanking> best;
     int i = 1;
 
     for (const auto& device : devices) {
+        DeviceRanking ranking = rankPhysicalDevice(device, instanceApiVersion, enumerations.deviceExtensions(device));
+        bool suitable = isDeviceSuitable(device);
+
         vkGetPhysicalDeviceProperties(device, &deviceProperties);
         std::clog << "\nPHYSICAL DEVICE " << i << "\n"
         << "Device Name:      " << deviceProperties.deviceName << "\n"
+        << "Device UUID:      " << (ranking.uuid ? formatUuid(*ranking.uuid) : "n/a") << "\n"
         << "API Version:      " << deviceProperties.apiVersion << "\n"
         << "Driver Version:   " << deviceProperties.driverVersion << "\n"
-        << "Vendor ID:        " << deviceProperties.vendorID << "\n"
-        << "Device ID:        " << deviceProperties.deviceID << "\n";
+        << "Device Local:     " << (ranking.deviceLocalBytes >> 20) << " MiB\n"
+        << "Score:            " << ranking.total() << " (type " << ranking.typeScore << ", memory " << ranking.memoryScore
+        << ", limits " << ranking.limitsScore << ", features " << ranking.featureScore << ")"
+        << (suitable ? "" : " - not suitable") << "\n";
         i++;
-    }
 
-    // Choose suitable device
-    for (const auto& device : devices) {
-        if (isDeviceSuitable(device)) {
-            vkGetPhysicalDeviceProperties(device, &deviceProperties);
-            std::cout << "\nSuitable Device Chosen: " << deviceProperties.deviceName << "\n\n";
-            physicalDevice = device;
-            break;
+        if (suitable && (!best || ranking.total() > best->total())) {
+            best = ranking;
         }
     }
-    if (physicalDevice == VK_NULL_HANDLE) {
+
+    if (!best) {
         throw std::runtime_error("failed to find a suitable GPU!");
     }
+
+    std::cout << "\nSuitable Device Chosen: " << best->name << "\n\n";
+    physicalDevice = best->device;
+
+    if (useCache && best->uuid) {
+        storeCachedDeviceUuid(*best->uuid);
+    }
 }
 
 void Application::createLogicalDevice() {
 
+    STARTUP_STAGE(startupTimer, "createLogicalDevice");
+
     /* 
     The creation of a logical device involves specifying a bunch of details in structs again,
     of which the first one will be VkDeviceQueueCreateInfo. This structure describes the number 
@@ -191,13 +436,18 @@ void Application::createLogicalDevice() {
     and then submit them all at once on the main thread with a single low-overhead call.
     */
 
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-    VkQueue presentQueue;
+    // Selected once here and kept, since the swap chain and every other subsystem needs the same answer
+    queueFamilyIndices = findQueueFamilies(physicalDevice);
+    const QueueFamilyIndices& indices = queueFamilyIndices;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 
     // If there are multiple queue families, a VkDeviceQueueCreateInfo struct must be created for them all.
-    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+    // Compute and transfer always have a family (at worst the graphics one), so they're always in the set.
+    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.computeFamily.value(), indices.transferFamily.value() };
+    if (indices.presentFamily.has_value()) {
+        uniqueQueueFamilies.insert(indices.presentFamily.value());
+    }
 
     // Vulkan lets you assign priorities to queues to influence the scheduling of command buffer execution using floating 
     // point numbers between 0.0 and 1.0. This is required even if there is only a single queue.
@@ -212,17 +462,40 @@ void Application::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
-    VkPhysicalDeviceFeatures deviceFeatures{};
+    // Works out which of the 1.1/1.2/1.3 features we use are there and turns those on. See device-capabilities.h.
+    DeviceFeatureChain featureChain;
+    capabilities = featureChain.negotiate(physicalDevice, instanceApiVersion, enumerations.deviceExtensions(physicalDevice));
+
+    // GPU-assisted validation writes its findings from inside our shaders, which needs stores from every stage
+    if (useValidationFeatures && (validation.features & ValidationGpuAssisted)) {
+        const VkPhysicalDeviceFeatures& supportedFeatures = featureChain.supportedCoreFeatures();
+        featureChain.coreFeatures().fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics;
+        featureChain.coreFeatures().vertexPipelineStoresAndAtomics = supportedFeatures.vertexPipelineStoresAndAtomics;
+    }
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = featureChain.next();
 
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
-    createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = 0;
+    createInfo.pEnabledFeatures = nullptr;      // The 1.0 features are in the chain instead
 
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    // Swap chains come from an extension, so it has to be enabled explicitly whenever we'll be presenting
+    std::vector<const char*> enabledExtensions;
+    if (surface != VK_NULL_HANDLE) {
+        enabledExtensions = deviceExtensions;
+    }
+    enabledExtensions.insert(enabledExtensions.end(), featureChain.extensions().begin(), featureChain.extensions().end());
+
+    // Lets the profiler line GPU timestamps up with the CPU clock. Optional, it falls back to a one-off measurement.
+    if (profiler.isEnabled() && enumerations.hasDeviceExtension(physicalDevice, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+        enabledExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        capabilities.calibratedTimestamps = true;
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     if (enableValidationLayers) {
 
@@ -239,9 +512,12 @@ void Application::createLogicalDevice() {
 
     // Instantiate the logical device
     
-    if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Device);
+    VkDevice created;
+    if (vkCreateDevice(physicalDevice, &createInfo, callbacks, &created) != VK_SUCCESS) {
         throw std::runtime_error("failed to create logical device!");
     }
+    device = UniqueDevice(created, vkDestroyDevice, callbacks);
 
     // We can use the vkGetDeviceQueue function to retrieve queue handles for each queue family. The parameters are the logical device, 
     // queue family, queue index and a pointer to the variable to store the queue handle in. Because we're only creating a single queue 
@@ -249,4 +525,41 @@ void Application::createLogicalDevice() {
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 
+    // The present queue can only be fetched once the device exists
+    if (indices.presentFamily.has_value()) {
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    }
+
+    // When there's no dedicated family these are the graphics queue again, so callers never need to check.
+    // Work submitted to a dedicated family overlaps with graphics work instead of waiting behind it.
+    vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+    vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+
+    std::clog << "Queue families: graphics " << indices.graphicsFamily.value()
+        << ", compute " << indices.computeFamily.value() << (indices.hasDedicatedCompute() ? " (dedicated)" : "")
+        << ", transfer " << indices.transferFamily.value() << (indices.hasDedicatedTransfer() ? " (dedicated)" : "");
+    if (indices.presentFamily.has_value()) {
+        std::clog << ", present " << indices.presentFamily.value();
+    }
+    std::clog << "\n";
+
+    capabilities.print(std::clog);
+
+}
+
+void Application::createSwapChain() {
+
+    STARTUP_STAGE(startupTimer, "createSwapChain");
+
+    // Surfaces that let us pick the extent (headless ones) get the window size from the config. A real window
+    // reports its framebuffer size in pixels, which is what the swap chain needs on high DPI displays.
+    windowExtent = { WIDTH, HEIGHT };
+    if (window != nullptr) {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        windowExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    }
+
+    swapchain.create(physicalDevice, device, surface, queueFamilyIndices, windowExtent, swapchainSettings,
+        hostAllocator.callbacks(HostSubsystem::Swapchain));
 }
\ No newline at end of file
@@ -0,0 +1,406 @@
+// instance-culling.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include "instance-culling.h"
+#include "simd-kernels.h"
+
+Frustum Frustum::fromMatrix(const float viewProjection[16]) {
+
+    // Row i of the matrix, which for column-major storage is every fourth value starting at i
+    auto row = [&](int i, int component) { return viewProjection[component * 4 + i]; };
+
+    // Clip space is -w <= x <= w, -w <= y <= w and 0 <= z <= w, and each of those is a plane in world space
+    // (Gribb and Hartmann): the fourth row plus or minus one of the others, or the third row alone for near
+    Frustum frustum;
+    for (int component = 0; component < 4; component++) {
+        float* planes = frustum.planes;
+        planes[0 * 4 + component] = row(3, component) + row(0, component);    // Left
+        planes[1 * 4 + component] = row(3, component) - row(0, component);    // Right
+        planes[2 * 4 + component] = row(3, component) + row(1, component);    // Bottom
+        planes[3 * 4 + component] = row(3, component) - row(1, component);    // Top
+        planes[4 * 4 + component] = row(2, component);                        // Near
+        planes[5 * 4 + component] = row(3, component) - row(2, component);    // Far
+    }
+
+    // Unit normals, so the distances can be compared with radii
+    for (int plane = 0; plane < 6; plane++) {
+        float* p = frustum.planes + plane * 4;
+        float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        if (length > 0.0f) {
+            for (int component = 0; component < 4; component++) p[component] /= length;
+        }
+    }
+    return frustum;
+}
+
+uint32_t InstanceStore::addMesh(const MeshRange& mesh) {
+
+    meshRanges.push_back(mesh);
+    meshInstanceCounts.push_back(0);
+    changes++;
+    return static_cast<uint32_t>(meshRanges.size() - 1);
+}
+
+uint32_t InstanceStore::add(uint32_t mesh, float x, float y, float z, float radius) {
+
+    if (mesh >= meshRanges.size()) {
+        throw std::runtime_error("instance of a mesh that was never added!");
+    }
+
+    centerX.push_back(x);
+    centerY.push_back(y);
+    centerZ.push_back(z);
+    radii.push_back(radius);
+    instanceMeshes.push_back(mesh);
+    meshInstanceCounts[mesh]++;
+    changes++;
+    return static_cast<uint32_t>(centerX.size() - 1);
+}
+
+void InstanceStore::move(uint32_t instance, float x, float y, float z, float radius) {
+
+    centerX[instance] = x;
+    centerY[instance] = y;
+    centerZ[instance] = z;
+    radii[instance] = radius;
+    changes++;
+}
+
+void InstanceStore::clear() {
+
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radii.clear();
+    instanceMeshes.clear();
+    meshRanges.clear();
+    meshInstanceCounts.clear();
+    changes++;
+}
+
+void DrawCuller::create(VkDevice device, DeviceAllocator& allocator, ComputeContext& compute, ShaderLibrary& shaders,
+    const std::string& shaderDir, const DeviceCapabilities& capabilities, const QueueFamilyIndices& queueFamilies,
+    uint32_t framesInFlight) {
+
+    this->device = device;
+    this->allocator = &allocator;
+    this->compute = &compute;
+    this->shaders = &shaders;
+    this->capabilities = capabilities;
+    frames.resize(framesInFlight);
+
+    // The draws are written on the compute queue and read on the graphics queue
+    if (queueFamilies.hasDedicatedCompute()) {
+        sharedFamilies = { queueFamilies.computeFamily.value(), queueFamilies.graphicsFamily.value() };
+    }
+
+    // drawIndirectCount is only ever set on 1.2 devices, where the function is core
+    if (capabilities.drawIndirectCount) {
+        drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCount)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCount");
+    }
+
+    // Each mesh's draw starts at its group of visible instances, which an indirect draw can only say with firstInstance
+    if (!capabilities.drawIndirectFirstInstance) {
+        std::clog << "GPU culling unavailable (no drawIndirectFirstInstance), culling on the CPU ("
+            << simdInstructionSet() << ")" << std::endl;
+        return;
+    }
+
+    try {
+        cullShader = shaders.load(shaderDir + "/cull.spv");
+        drawsShader = shaders.load(shaderDir + "/cull-draws.spv");
+    }
+    catch (const std::runtime_error& error) {
+        // Not fatal, the CPU gives the same draws
+        std::clog << "GPU culling unavailable (" << error.what() << "), culling on the CPU ("
+            << simdInstructionSet() << ")" << std::endl;
+        return;
+    }
+
+    cullPipeline = compute.createPipeline(shaders.module(cullShader), 6, sizeof(PushConstants));
+    drawsPipeline = compute.createPipeline(shaders.module(drawsShader), 3, sizeof(PushConstants));
+    gpuCreated = true;
+}
+
+void DrawCuller::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+    if (gpuCreated) {
+        compute->destroyPipeline(cullPipeline);
+        compute->destroyPipeline(drawsPipeline);
+        gpuCreated = false;
+    }
+
+    for (FrameBuffers& frame : frames) {
+        destroyBuffer(frame.draws);
+        destroyBuffer(frame.visible);
+    }
+    frames.clear();
+
+    destroyBuffer(bounds);
+    destroyBuffer(instanceMeshes);
+    destroyBuffer(meshes);
+    destroyBuffer(frustumPlanes);
+    destroyBuffer(meshCounts);
+    uploadedStore = nullptr;
+    device = VK_NULL_HANDLE;
+}
+
+void DrawCuller::reload(const std::vector<ShaderHandle>& changed) {
+
+    if (!gpuCreated) return;
+
+    // Culls wait for themselves, so neither pipeline is in use between them and the old one can go right away
+    auto rebuild = [&](ShaderHandle shader, ComputePipeline& pipeline, uint32_t bindingCount, const char* file) {
+        if (std::find(changed.begin(), changed.end(), shader) == changed.end()) return;
+
+        ComputePipeline rebuilt;
+        try {
+            rebuilt = compute->createPipeline(shaders->module(shader), bindingCount, sizeof(PushConstants));
+        }
+        catch (const std::runtime_error& error) {
+            std::clog << "Keeping the old " << file << " pipeline: " << error.what() << std::endl;
+            return;
+        }
+        compute->destroyPipeline(pipeline);
+        pipeline = rebuilt;
+    };
+
+    rebuild(cullShader, cullPipeline, 6, "cull.spv");
+    rebuild(drawsShader, drawsPipeline, 3, "cull-draws.spv");
+}
+
+ComputeBuffer DrawCuller::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool graphics) {
+
+    // Like ComputeContext's buffers, written and read through the mapping, with the compute queue's fills on top
+    ComputeBuffer buffer;
+    buffer.size = std::max<VkDeviceSize>(size, 16);
+    buffer.buffer = allocator->createBuffer(buffer.size,
+        usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffer.allocation, graphics ? sharedFamilies : std::vector<uint32_t>());
+    return buffer;
+}
+
+void DrawCuller::destroyBuffer(ComputeBuffer& buffer) {
+
+    if (buffer.buffer == VK_NULL_HANDLE) return;
+    allocator->destroyBuffer(buffer.buffer, buffer.allocation);
+    buffer = {};
+}
+
+void DrawCuller::reserve(ComputeBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool graphics) {
+
+    if (buffer.buffer != VK_NULL_HANDLE && buffer.size >= size) return;
+
+    // Doubling, so a store that grows an instance at a time doesn't make a new buffer every cull
+    VkDeviceSize grown = std::max(size, buffer.size * 2);
+    destroyBuffer(buffer);
+    buffer = createBuffer(grown, usage, graphics);
+}
+
+void DrawCuller::reserveFrame(FrameBuffers& frame, const InstanceStore& store) {
+
+    reserve(frame.draws, drawsOffset + static_cast<VkDeviceSize>(store.meshCount()) * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, true);
+    reserve(frame.visible, static_cast<VkDeviceSize>(store.size()) * sizeof(uint32_t), 0, true);
+}
+
+void DrawCuller::upload(const InstanceStore& store) {
+
+    if (uploadedStore == &store && uploadedVersion == store.version()) return;
+
+    uint32_t count = store.size();
+    uint32_t meshCount = store.meshCount();
+    reserve(bounds, static_cast<VkDeviceSize>(count) * 4 * sizeof(float), 0, false);
+    reserve(instanceMeshes, static_cast<VkDeviceSize>(count) * sizeof(uint32_t), 0, false);
+    reserve(meshes, static_cast<VkDeviceSize>(meshCount) * 4 * sizeof(uint32_t), 0, false);
+    reserve(meshCounts, static_cast<VkDeviceSize>(meshCount) * sizeof(uint32_t), 0, false);
+
+    // The shader wants each sphere in one vec4, so this is the one place the instances are interleaved
+    float* sphere = static_cast<float*>(bounds.mapped());
+    for (uint32_t i = 0; i < count; i++) {
+        sphere[i * 4] = store.x()[i];
+        sphere[i * 4 + 1] = store.y()[i];
+        sphere[i * 4 + 2] = store.z()[i];
+        sphere[i * 4 + 3] = store.radius()[i];
+    }
+    std::memcpy(instanceMeshes.mapped(), store.meshes(), count * sizeof(uint32_t));
+
+    // Every mesh gets room for all of its instances in the visible list, so cull.comp can place them without a scan
+    uint32_t* mesh = static_cast<uint32_t*>(meshes.mapped());
+    uint32_t base = 0;
+    for (uint32_t i = 0; i < meshCount; i++) {
+        const MeshRange& range = store.mesh(i);
+        mesh[i * 4] = range.indexCount;
+        mesh[i * 4 + 1] = range.firstIndex;
+        mesh[i * 4 + 2] = static_cast<uint32_t>(range.vertexOffset);
+        mesh[i * 4 + 3] = base;
+        base += store.meshInstances(i);
+    }
+
+    uploadedStore = &store;
+    uploadedVersion = store.version();
+    uploads++;
+}
+
+uint32_t DrawCuller::cullCpu(const InstanceStore& store, const Frustum& frustum, uint32_t frameIndex) {
+
+    FrameBuffers& frame = frames[frameIndex];
+    uint32_t count = store.size();
+    uint32_t meshCount = store.meshCount();
+    reserveFrame(frame, store);
+
+    visibleScratch.resize(count);
+    uint32_t visibleCount = static_cast<uint32_t>(cpuFrustumCull(frustum.planes, store.x(), store.y(), store.z(),
+        store.radius(), count, visibleScratch.data()));
+
+    // Counting sort by mesh: how many of each, where each mesh's group starts, then every instance into its group.
+    // They stay in ascending order within a group.
+    const uint32_t* instanceMesh = store.meshes();
+    meshCountScratch.assign(meshCount, 0);
+    for (uint32_t i = 0; i < visibleCount; i++) {
+        meshCountScratch[instanceMesh[visibleScratch[i]]]++;
+    }
+    meshOffsetScratch.resize(meshCount);
+    cpuExclusiveScan(meshCountScratch.data(), meshOffsetScratch.data(), meshCount);
+
+    auto* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(static_cast<char*>(frame.draws.mapped()) + drawsOffset);
+    uint32_t drawCount = 0;
+    for (uint32_t mesh = 0; mesh < meshCount; mesh++) {
+        if (meshCountScratch[mesh] == 0) continue;
+
+        const MeshRange& range = store.mesh(mesh);
+        commands[drawCount++] = { range.indexCount, meshCountScratch[mesh], range.firstIndex, range.vertexOffset,
+            meshOffsetScratch[mesh] };
+    }
+    *static_cast<uint32_t*>(frame.draws.mapped()) = drawCount;
+
+    // Sorted in host memory and copied over in one go, since scattered writes to write-combined memory are slow
+    sortedScratch.resize(visibleCount);
+    for (uint32_t i = 0; i < visibleCount; i++) {
+        uint32_t instance = visibleScratch[i];
+        sortedScratch[meshOffsetScratch[instanceMesh[instance]]++] = instance;
+    }
+    std::memcpy(frame.visible.mapped(), sortedScratch.data(), visibleCount * sizeof(uint32_t));
+
+    frame.drawCount = drawCount;
+    frame.gpuCulled = false;
+    cpuCulls++;
+    culledInstances += count;
+    visibleInstanceCount += visibleCount;
+    batchedDraws += drawCount;
+    return visibleCount;
+}
+
+uint32_t DrawCuller::cullGpu(const InstanceStore& store, const Frustum& frustum, uint32_t frameIndex) {
+
+    if (!gpuCreated) return cullCpu(store, frustum, frameIndex);
+
+    FrameBuffers& frame = frames[frameIndex];
+    uint32_t count = store.size();
+    uint32_t meshCount = store.meshCount();
+    reserveFrame(frame, store);
+    upload(store);
+
+    reserve(frustumPlanes, sizeof(frustum.planes), 0, false);
+    std::memcpy(frustumPlanes.mapped(), frustum.planes, sizeof(frustum.planes));
+
+    PushConstants params{ count, meshCount, (count + groupSize - 1) / groupSize };
+
+    compute->begin();
+    compute->fill(meshCounts, 0);
+    compute->fill(frame.draws, 0);
+    compute->dispatch(cullPipeline, { &bounds, &instanceMeshes, &frustumPlanes, &meshes, &meshCounts, &frame.visible },
+        &params, params.blockCount);
+
+    params.blockCount = (meshCount + groupSize - 1) / groupSize;
+    compute->dispatch(drawsPipeline, { &meshes, &meshCounts, &frame.draws }, &params, params.blockCount);
+    compute->submitAndWait();
+
+    // Read back for the fallbacks that need the count on the host, and for the report
+    frame.drawCount = *static_cast<const uint32_t*>(frame.draws.mapped());
+    frame.gpuCulled = true;
+
+    uint32_t visibleCount = 0;
+    const VkDrawIndexedIndirectCommand* commands = draws(frameIndex);
+    for (uint32_t draw = 0; draw < frame.drawCount; draw++) {
+        visibleCount += commands[draw].instanceCount;
+    }
+
+    gpuCulls++;
+    culledInstances += count;
+    visibleInstanceCount += visibleCount;
+    batchedDraws += frame.drawCount;
+    return visibleCount;
+}
+
+void DrawCuller::recordDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex) const {
+
+    const FrameBuffers& frame = frames[frameIndex];
+    if (frame.draws.buffer == VK_NULL_HANDLE) return;
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    // Indirect draws ignore firstInstance without drawIndirectFirstInstance. Only the CPU's draws get here, since
+    // GPU culling is off then, and they're on the host anyway.
+    if (!capabilities.drawIndirectFirstInstance) {
+        const VkDrawIndexedIndirectCommand* commands = draws(frameIndex);
+        for (uint32_t draw = 0; draw < frame.drawCount; draw++) {
+            const VkDrawIndexedIndirectCommand& command = commands[draw];
+            vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex,
+                command.vertexOffset, command.firstInstance);
+        }
+        return;
+    }
+
+    if (drawIndexedIndirectCount != nullptr) {
+        uint32_t maxDraws = static_cast<uint32_t>((frame.draws.size - drawsOffset) / stride);
+        drawIndexedIndirectCount(commandBuffer, frame.draws.buffer, drawsOffset, frame.draws.buffer, 0, maxDraws, stride);
+    }
+    else if (capabilities.multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(commandBuffer, frame.draws.buffer, drawsOffset, frame.drawCount, stride);
+    }
+    else {
+        for (uint32_t draw = 0; draw < frame.drawCount; draw++) {
+            vkCmdDrawIndexedIndirect(commandBuffer, frame.draws.buffer, drawsOffset + draw * stride, 1, stride);
+        }
+    }
+}
+
+uint32_t DrawCuller::drawCount(uint32_t frameIndex) const {
+
+    return frames[frameIndex].drawCount;
+}
+
+const VkDrawIndexedIndirectCommand* DrawCuller::draws(uint32_t frameIndex) const {
+
+    return reinterpret_cast<const VkDrawIndexedIndirectCommand*>(
+        static_cast<const char*>(frames[frameIndex].draws.mapped()) + drawsOffset);
+}
+
+const uint32_t* DrawCuller::visibleInstanceIndices(uint32_t frameIndex) const {
+
+    return static_cast<const uint32_t*>(frames[frameIndex].visible.mapped());
+}
+
+void DrawCuller::report(std::ostream& out) const {
+
+    uint64_t culls = cpuCulls + gpuCulls;
+    if (culls == 0) return;
+
+    out << std::fixed << std::setprecision(1)
+        << "\nInstance culling: " << cpuCulls << " culls on the CPU (" << simdInstructionSet() << "), " << gpuCulls
+        << " on the GPU, " << (culledInstances > 0 ? 100.0 * visibleInstanceCount / culledInstances : 0.0)
+        << "% of instances visible, " << double(batchedDraws) / culls << " draws per cull, bounds uploaded "
+        << uploads << " times, drawn with "
+        << (!capabilities.drawIndirectFirstInstance ? "vkCmdDrawIndexed" :
+            drawIndexedIndirectCount != nullptr ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect") << "\n";
+    out.unsetf(std::ios::floatfield);
+}
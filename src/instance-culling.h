@@ -0,0 +1,194 @@
+// instance-culling.h
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "include.h"
+#include "compute.h"
+#include "device-allocator.h"
+#include "device-capabilities.h"
+#include "queue-family-indices.h"
+#include "shader-library.h"
+
+// Six planes as (a, b, c, d), normals pointing inwards and normalised, so a * x + b * y + c * z + d is how far
+// inside the plane (x, y, z) is. Left, right, bottom, top, near, far.
+struct Frustum {
+	float planes[24];
+
+	// viewProjection is column-major and maps depth to 0..1, the way Vulkan clips
+	static Frustum fromMatrix(const float viewProjection[16]);
+};
+
+// Where one mesh's indices are in the bound index and vertex buffers
+struct MeshRange {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+};
+
+// Instances as a structure of arrays: every instance's x together, then every y, and so on, so the culling tests
+// load eight instances' worth of each straight out of memory. An instance is a bounding sphere and the mesh it
+// draws, and its index is what the vertex shader gets back to find its own data.
+class InstanceStore {
+
+public:
+
+	uint32_t addMesh(const MeshRange& mesh);
+	uint32_t add(uint32_t mesh, float x, float y, float z, float radius);
+	void move(uint32_t instance, float x, float y, float z, float radius);
+	void clear();
+
+	uint32_t size() const { return static_cast<uint32_t>(centerX.size()); }
+	uint32_t meshCount() const { return static_cast<uint32_t>(meshRanges.size()); }
+
+	const float* x() const { return centerX.data(); }
+	const float* y() const { return centerY.data(); }
+	const float* z() const { return centerZ.data(); }
+	const float* radius() const { return radii.data(); }
+	const uint32_t* meshes() const { return instanceMeshes.data(); }
+
+	const MeshRange& mesh(uint32_t mesh) const { return meshRanges[mesh]; }
+	uint32_t meshInstances(uint32_t mesh) const { return meshInstanceCounts[mesh]; }
+
+	// Goes up with every change, so a copy on the GPU is only refreshed when it's out of date
+	uint64_t version() const { return changes; }
+
+private:
+
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radii;
+	std::vector<uint32_t> instanceMeshes;
+
+	std::vector<MeshRange> meshRanges;
+	std::vector<uint32_t> meshInstanceCounts;
+
+	uint64_t changes = 0;
+};
+
+// Frustum culling and draw batching: instead of a draw call per instance, one indexed indirect draw per mesh that
+// has any instances in view, drawing all of them.
+//
+// The visible instances come out grouped by mesh, and each mesh's draw starts at its group with firstInstance, so
+// the vertex shader finds its instance as visibleInstances[gl_InstanceIndex]. The draw buffer holds the draw count
+// in its first 16 bytes and VkDrawIndexedIndirectCommands after that.
+//
+// Culling runs either way, with the same results:
+//
+// - cullCpu() tests the spheres with cpuFrustumCull (AVX2, SSE2 or NEON, see simd-kernels.h), counting-sorts the
+//   survivors by mesh and writes the draws through the mapping.
+// - cullGpu() does the same in two compute shaders on the compute queue, cull.spv and cull-draws.spv. The bounds
+//   are only uploaded again when the store has changed. Without the shaders, or without drawIndirectFirstInstance,
+//   it's cullCpu() instead.
+//
+// recordDraws() records the draws into a graphics command buffer with vkCmdDrawIndexedIndirectCount, so the count
+// never has to come back to the host. Without drawIndirectCount the count is read back instead, and without
+// multiDrawIndirect (or drawIndirectFirstInstance, for the CPU's draws) the draws go out one call each.
+//
+// There's a set of draw and visible-instance buffers per frame in flight. A cull writes its frame's set, so that
+// frame's earlier draws have to be done on the GPU first. The sets are shared between the compute and graphics
+// families when those differ, so the draws need no ownership transfer.
+
+class DrawCuller {
+
+public:
+
+	void create(VkDevice device, DeviceAllocator& allocator, ComputeContext& compute, ShaderLibrary& shaders,
+		const std::string& shaderDir, const DeviceCapabilities& capabilities, const QueueFamilyIndices& queueFamilies,
+		uint32_t framesInFlight);
+	void destroy();
+
+	// changed is what ShaderLibrary::applyReloads returned
+	void reload(const std::vector<ShaderHandle>& changed);
+
+	bool gpuAvailable() const { return gpuCreated; }
+
+	// Both return how many instances are visible
+	uint32_t cullCpu(const InstanceStore& store, const Frustum& frustum, uint32_t frameIndex);
+	uint32_t cullGpu(const InstanceStore& store, const Frustum& frustum, uint32_t frameIndex);
+
+	// Whatever the last cull for frameIndex found. The pipeline, index and vertex buffers have to be bound already.
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex) const;
+
+	// For the vertex shader, a uint per visible instance: its index in the store
+	VkBuffer visibleInstances(uint32_t frameIndex) const { return frames[frameIndex].visible.buffer; }
+
+	// The last cull's results as the GPU sees them, for checking one path against the other
+	uint32_t drawCount(uint32_t frameIndex) const;
+	const VkDrawIndexedIndirectCommand* draws(uint32_t frameIndex) const;
+	const uint32_t* visibleInstanceIndices(uint32_t frameIndex) const;
+
+	void report(std::ostream& out) const;
+
+private:
+
+	// Matches Params in cull.comp and cull-draws.comp
+	struct PushConstants {
+		uint32_t count;
+		uint32_t meshCount;
+		uint32_t blockCount;
+	};
+
+	// Threads per workgroup in both shaders
+	static constexpr uint32_t groupSize = 256;
+
+	// The draw count's slot in front of the commands
+	static constexpr VkDeviceSize drawsOffset = 16;
+
+	struct FrameBuffers {
+		ComputeBuffer draws;
+		ComputeBuffer visible;
+		uint32_t drawCount = 0;
+		bool gpuCulled = false;
+	};
+
+	ComputeBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool graphics);
+	void destroyBuffer(ComputeBuffer& buffer);
+	// Grows buffer to hold at least size bytes. Whatever was in it is gone.
+	void reserve(ComputeBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool graphics);
+	void reserveFrame(FrameBuffers& frame, const InstanceStore& store);
+	void upload(const InstanceStore& store);
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceAllocator* allocator = nullptr;
+	ComputeContext* compute = nullptr;
+	DeviceCapabilities capabilities;
+	std::vector<uint32_t> sharedFamilies;   // Compute and graphics when they differ, otherwise empty
+	PFN_vkCmdDrawIndexedIndirectCount drawIndexedIndirectCount = nullptr;  // Null without drawIndirectCount
+
+	ShaderLibrary* shaders = nullptr;
+	ShaderHandle cullShader = 0;
+	ShaderHandle drawsShader = 0;
+	ComputePipeline cullPipeline;
+	ComputePipeline drawsPipeline;
+	bool gpuCreated = false;
+
+	std::vector<FrameBuffers> frames;
+
+	// The store as the GPU sees it, and which version of which store that was
+	ComputeBuffer bounds;                   // vec4 per instance, center and radius
+	ComputeBuffer instanceMeshes;
+	ComputeBuffer meshes;                   // uvec4 per mesh: index count, first index, vertex offset, base
+	ComputeBuffer frustumPlanes;
+	ComputeBuffer meshCounts;
+	const InstanceStore* uploadedStore = nullptr;
+	uint64_t uploadedVersion = 0;
+
+	// CPU scratch, kept to save reallocating it
+	std::vector<uint32_t> visibleScratch;
+	std::vector<uint32_t> meshCountScratch;
+	std::vector<uint32_t> meshOffsetScratch;
+	std::vector<uint32_t> sortedScratch;
+
+	// Bookkeeping for the report
+	uint64_t cpuCulls = 0;
+	uint64_t gpuCulls = 0;
+	uint64_t uploads = 0;
+	uint64_t culledInstances = 0;
+	uint64_t visibleInstanceCount = 0;
+	uint64_t batchedDraws = 0;
+};
@@ -1,12 +1,30 @@
 // is-device-suitable.cpp
 
+#include <set>
+#include <string>
+#include <vector>
 #include "include.h"
 #include "application.h"
+#include "swap-chain-support-details.h"
 
 // This function has it's own source file for easier editing of it's parameters. When additions to
 // the other source files have been made that include new Vulkan features, those features will have to
 // be include here.
 
+bool Application::checkDeviceExtensionSupport(VkPhysicalDevice device) {
+
+    const std::vector<VkExtensionProperties>& availableExtensions = enumerations.deviceExtensions(device);
+
+    // Tick off every required extension the device has. Whatever is left over is missing.
+    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+
+    for (const auto& extension : availableExtensions) {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    return requiredExtensions.empty();
+}
+
 bool Application::isDeviceSuitable(VkPhysicalDevice device) {
 
     // Determine if a given GPU has the required features for this program
@@ -17,6 +35,20 @@ bool Application::isDeviceSuitable(VkPhysicalDevice device) {
 
     QueueFamilyIndices indices = findQueueFamilies(device);
 
-    return indices.isComplete();
+    // Without a surface (headless, offscreen only) there's nothing to present to, so graphics alone is enough
+    if (surface == VK_NULL_HANDLE) {
+        return indices.graphicsFamily.has_value();
+    }
+
+    // Being able to present isn't enough, the device also needs the swap chain extension and at least one
+    // format and present mode for our surface. Support details can only be queried once the extension is known to exist.
+    bool extensionsSupported = checkDeviceExtensionSupport(device);
+
+    bool swapChainAdequate = false;
+    if (extensionsSupported) {
+        swapChainAdequate = querySwapChainSupport(device, surface).isAdequate();
+    }
+
+    return indices.isComplete() && extensionsSupported && swapChainAdequate;
 
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+// job-system.cpp
+
+#include <algorithm>
+#include <iomanip>
+#include "job-system.h"
+
+// Which JobSystem the current thread works for, and its index there. Any thread that isn't one of our workers
+// counts as thread 0.
+static thread_local const JobSystem* owner = nullptr;
+static thread_local uint32_t ownerIndex = 0;
+
+JobSystem::JobSystem(uint32_t threadCount) {
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+
+    // Every queue has to exist before the first worker starts looking through them for work to steal
+    for (uint32_t i = 1; i < threadCount; i++) {
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    wake.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+uint32_t JobSystem::currentThreadIndex() const {
+    return owner == this ? ownerIndex : 0;
+}
+
+void JobSystem::push(uint32_t threadIndex, Entry entry) {
+
+    // Counted before the job is visible so queued never drops below the real number of jobs. It's incremented under
+    // the sleep lock so a worker can't check queued, find nothing, and then miss the notify.
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[threadIndex]->mutex);
+        queues[threadIndex]->entries.push_back(std::move(entry));
+    }
+    wake.notify_one();
+}
+
+void JobSystem::submit(Counter& counter, Job job) {
+
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    push(currentThreadIndex(), { std::move(job), &counter });
+}
+
+bool JobSystem::runOne(uint32_t threadIndex) {
+
+    Entry entry;
+    bool found = false;
+
+    {
+        Queue& own = *queues[threadIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.entries.empty()) {
+            entry = std::move(own.entries.back());
+            own.entries.pop_back();
+            found = true;
+        }
+    }
+
+    // Look through the other queues starting with the next thread along, so thieves spread out instead of
+    // all hitting thread 0
+    for (uint32_t i = 1; !found && i < queues.size(); i++) {
+        Queue& victim = *queues[(threadIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.entries.empty()) {
+            entry = std::move(victim.entries.front());
+            victim.entries.pop_front();
+            found = true;
+            queues[threadIndex]->stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!found) return false;
+
+    queued--;
+
+    // An exception escaping a worker thread would terminate the process, so it's handed to whoever waits instead
+    try {
+        entry.job(threadIndex);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(entry.counter->errorMutex);
+        if (!entry.counter->error) {
+            entry.counter->error = std::current_exception();
+        }
+    }
+    queues[threadIndex]->executed.fetch_add(1, std::memory_order_relaxed);
+
+    // Release so whatever the job wrote is visible to the thread that sees the counter reach zero
+    entry.counter->pending.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void JobSystem::workerLoop(uint32_t threadIndex) {
+
+    owner = this;
+    ownerIndex = threadIndex;
+
+    while (true) {
+        if (runOne(threadIndex)) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return !running || queued > 0; });
+        if (!running) return;
+    }
+}
+
+void JobSystem::wait(Counter& counter) {
+
+    uint32_t threadIndex = currentThreadIndex();
+
+    // Help instead of blocking. If there's nothing left to pick up, the last jobs are running on other threads and
+    // will finish shortly.
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        if (!runOne(threadIndex)) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (counter.error) {
+        std::rethrow_exception(counter.error);
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t, uint32_t)>& function) {
+
+    Counter counter;
+    batchSize = std::max(1u, batchSize);
+
+    for (uint32_t begin = 0; begin < count; begin += batchSize) {
+        uint32_t end = std::min(count, begin + batchSize);
+        submit(counter, [&function, begin, end](uint32_t threadIndex) { function(begin, end, threadIndex); });
+    }
+
+    wait(counter);
+}
+
+void JobSystem::report(std::ostream& out) const {
+
+    out << "\nJob system: " << queues.size() << " threads\n";
+    for (size_t i = 0; i < queues.size(); i++) {
+        out << "    thread " << std::setw(2) << i << ": " << queues[i]->executed.load() << " jobs, "
+            << queues[i]->stolen.load() << " stolen\n";
+    }
+}
@@ -0,0 +1,86 @@
+// job-system.h
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// A small work-stealing job system.
+//
+// Every thread has its own deque of jobs. A thread pushes and pops at the back of its own deque, so the job it just
+// queued is usually the next one it runs while its data is still in cache. A thread that runs dry steals from the
+// front of somebody else's deque, which takes the oldest (usually biggest) piece of work and keeps thieves away
+// from the end the owner is working on.
+//
+// Thread 0 is whichever thread created the JobSystem (the main thread). It doesn't run jobs on its own, only inside
+// wait(), where it helps out instead of blocking. Threads 1..N-1 are workers that sleep when there's nothing to do.
+
+class JobSystem {
+
+public:
+
+	// Tracks a group of jobs. wait() returns once every job submitted against it has run, and rethrows the first
+	// exception any of them threw.
+	struct Counter {
+		std::atomic<uint32_t> pending{ 0 };
+		std::mutex errorMutex;
+		std::exception_ptr error;
+	};
+
+	using Job = std::function<void(uint32_t threadIndex)>;
+
+	// 0 = one thread per hardware thread
+	explicit JobSystem(uint32_t threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(queues.size()); }
+
+	void submit(Counter& counter, Job job);
+	void wait(Counter& counter);
+
+	// Splits [0, count) into batches of batchSize and runs them across all threads, including the caller.
+	// function(begin, end, threadIndex) is called once per batch.
+	void parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t, uint32_t)>& function);
+
+	void report(std::ostream& out) const;
+
+private:
+
+	struct Entry {
+		Job job;
+		Counter* counter;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Entry> entries;
+		std::atomic<uint64_t> executed{ 0 };
+		std::atomic<uint64_t> stolen{ 0 };     // Jobs this thread took from other threads' queues
+	};
+
+	uint32_t currentThreadIndex() const;
+	void push(uint32_t threadIndex, Entry entry);
+	bool runOne(uint32_t threadIndex);
+	void workerLoop(uint32_t threadIndex);
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	// Workers sleep on this when every queue is empty
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<uint32_t> queued{ 0 };
+	std::atomic<bool> running{ true };
+};
@@ -4,13 +4,24 @@
 #include <vector>
 #include "include.h"
 #include "application.h"
+#include "app-config.h"
 
 
-int main() {
-    Application app;
+int main(int argc, char** argv) {
 
     try {
-        app.run();
+        AppConfig config = parseAppConfig(argc, argv);
+
+        if (!config.benchmarkOutput.empty()) {
+            Application::runBenchmarkSuite(config);
+        }
+        else if (config.startupBenchmarkRuns > 0) {
+            Application::runStartupBenchmark(config);
+        }
+        else {
+            Application app(config);
+            app.run();
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,151 @@
+// mapped-file.cpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "mapped-file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)), length(std::exchange(other.length, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+
+    if (this != &other) {
+        close();
+        mapping = std::exchange(other.mapping, nullptr);
+        length = std::exchange(other.length, 0);
+    }
+    return *this;
+}
+
+void MappedFile::load(size_t offset, size_t size) const {
+
+    if (mapping == nullptr || offset >= length || size == 0) return;
+    size = std::min(size, length - offset);
+    const volatile char* begin = static_cast<const char*>(mapping) + offset;
+
+#ifndef _WIN32
+    // One request for the whole range, so it isn't read a page per fault. madvise wants a page-aligned start.
+    uintptr_t pageMask = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+    uintptr_t start = reinterpret_cast<uintptr_t>(begin) & ~pageMask;
+    madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(begin) + size - start, MADV_WILLNEED);
+#endif
+
+    // 4 KiB is the smallest page anywhere we run, so this touches every page whatever the size
+    for (size_t i = 0; i < size; i += 4096) {
+        (void)begin[i];
+    }
+    (void)begin[size - 1];
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, std::string* error, bool sequential) {
+
+    close();
+
+    auto fail = [&](const char* what) {
+        if (error != nullptr) *error = std::string(what) + " (error " + std::to_string(GetLastError()) + ")";
+        return false;
+    };
+
+    // Shared for writing and deleting too, so a shader compiler can replace the file while it's mapped
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return fail("can't open");
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        if (error != nullptr) *error = "empty or unreadable";
+        return false;
+    }
+
+    // The view keeps the mapping alive, and the mapping the file, so both handles can go straight away
+    HANDLE section = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (section == nullptr) return fail("can't map");
+
+    void* view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(section);
+    if (view == nullptr) return fail("can't map");
+
+    mapping = view;
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+
+    if (mapping == nullptr) return;
+    UnmapViewOfFile(mapping);
+    mapping = nullptr;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, std::string* error, bool sequential) {
+
+    close();
+
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        if (error != nullptr) *error = std::strerror(errno);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size <= 0) {
+        ::close(file);
+        if (error != nullptr) *error = "empty or unreadable";
+        return false;
+    }
+
+    // The mapping holds its own reference to the file, so the descriptor isn't needed past this
+    void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    int mapError = errno;
+    ::close(file);
+    if (view == MAP_FAILED) {
+        if (error != nullptr) *error = std::strerror(mapError);
+        return false;
+    }
+
+    // Read front to back exactly once, by whoever mapped it, so start the readahead now. These are two separate
+    // pieces of advice, not flags that can be combined. Anything else is read a page at a time as it's touched.
+    if (sequential) {
+        madvise(view, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+        madvise(view, static_cast<size_t>(status.st_size), MADV_WILLNEED);
+    }
+    else {
+        madvise(view, static_cast<size_t>(status.st_size), MADV_RANDOM);
+    }
+
+    mapping = view;
+    length = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+
+    if (mapping == nullptr) return;
+    munmap(mapping, length);
+    mapping = nullptr;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+// mapped-file.h
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A read-only memory mapping of a whole file. The OS pages it in on first touch, straight from the page cache,
+// so nothing is copied into a buffer of ours the way a stream read would. The mapping starts on a page boundary,
+// which makes it aligned for any type the file holds.
+//
+// Don't keep a mapping open on a file that may be rewritten in place: truncating a mapped file makes reading the
+// lost pages a bus error. Map, use, close.
+
+class MappedFile {
+
+public:
+
+	MappedFile() = default;
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	// False (with the reason in error, if given) if the file can't be opened or mapped. Empty files can't be mapped
+	// and are reported as errors too.
+	//
+	// A sequential file is expected to be read front to back straight away, so the OS starts reading all of it ahead.
+	// Files read piecemeal and on demand (texture mips, say) should pass false, so only what's touched is read.
+	bool open(const std::string& path, std::string* error = nullptr, bool sequential = true);
+	void close();
+
+	bool isOpen() const { return mapping != nullptr; }
+	const void* data() const { return mapping; }
+	size_t size() const { return length; }
+
+	// Reads [offset, offset + size) in from disk, if it isn't in memory already, and returns once it is: the whole
+	// range is asked for at once, then every page touched. For files that weren't opened sequential, on a thread
+	// that can afford to block.
+	void load(size_t offset, size_t size) const;
+
+private:
+
+	void* mapping = nullptr;
+	size_t length = 0;
+};
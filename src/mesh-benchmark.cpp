@@ -0,0 +1,130 @@
+// mesh-benchmark.cpp
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <system_error>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "frame-stats.h"
+#include "mesh-converter.h"
+#include "mesh-loader.h"
+
+// Loading a .vkmesh file onto the GPU, two ways: mapped and streamed from the mapping into the upload ring (what
+// MeshFile::open and MeshStreamer do), and read into memory with a stream first (MeshFile::read), the way loading
+// worked before. Each is timed from opening the file to every mesh on the GPU, and separately to the first mesh on
+// the GPU, which is when a scene switch could start drawing.
+//
+// The file is in the page cache after the first run, so these are warm loads. From cold, both ways wait on the disk
+// the same, but the mapped one starts uploading after the first pages instead of after the whole file.
+
+static constexpr VkDeviceSize streamBudget = 4ull << 20;
+
+// The generated test scene: about 47 MiB of geometry, 64 meshes and 4096 instances of them
+static constexpr uint32_t sceneMeshes = 64;
+static constexpr uint32_t sceneRings = 96;
+static constexpr uint32_t sceneSegments = 192;
+static constexpr uint32_t sceneNodes = 4096;
+static constexpr float sceneExtent = 200.0f;
+
+std::string Application::benchmarkMeshFile() {
+
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::temp_directory_path(error) / "vulkan-test-scene.vkmesh";
+    if (error) {
+        path = "vulkan-test-scene.vkmesh";
+    }
+
+    // Written once and kept, like anything else that only makes the next run faster
+    try {
+        MeshFile file;
+        file.open(path.string());
+        if (file.meshCount() == sceneMeshes && file.nodeCount() == sceneNodes) {
+            return path.string();
+        }
+    }
+    catch (const std::runtime_error&) {
+    }
+
+    std::vector<SourceMesh> meshes;
+    std::vector<MeshFileNode> nodes;
+    makeTestScene(sceneMeshes, sceneRings, sceneSegments, sceneNodes, sceneExtent, meshes, nodes);
+    writeMeshFile(path.string(), meshes, nodes);
+    return path.string();
+}
+
+std::vector<MeshLoadTiming> Application::measureMeshLoading(const std::string& path) {
+
+    MeshStreamer streamer;
+    streamer.create(allocator, uploadRing, queueFamilyIndices, deferred);
+
+    const BenchmarkRuns runs;
+    std::vector<MeshLoadTiming> timings;
+    for (bool mapped : { true, false }) {
+        MeshLoadTiming timing{ mapped ? "mapped" : "read", FrameStats("load"), FrameStats("first draw") };
+        timing.load.reserve(runs.measured);
+        timing.firstDraw.reserve(runs.measured);
+
+        // Two timings a run, so not timeRuns
+        repeatRuns(runs, [&](bool measured) {
+            MeshFile file;
+
+            // Everything
+            auto start = std::chrono::steady_clock::now();
+            mapped ? file.open(path) : file.read(path);
+            streamer.begin(file);
+            while (streamer.stream(streamBudget)) {}
+            streamer.finish();
+            double load = elapsedMilliseconds(start, std::chrono::steady_clock::now());
+            file.close();
+
+            // Only as far as the first mesh, then the rest untimed, so the next run's copies don't overlap these
+            start = std::chrono::steady_clock::now();
+            mapped ? file.open(path) : file.read(path);
+            streamer.begin(file);
+            while (!streamer.meshQueued(0) && streamer.stream(streamBudget)) {}
+            streamer.waitForMesh(0);
+            double firstDraw = elapsedMilliseconds(start, std::chrono::steady_clock::now());
+            streamer.finish();
+            file.close();
+
+            if (measured) {
+                timing.load.add(load);
+                timing.firstDraw.add(firstDraw);
+            }
+        });
+        timings.push_back(std::move(timing));
+    }
+
+    streamer.report(std::cout);
+    streamer.destroy();
+    return timings;
+}
+
+void Application::runMeshBenchmark() {
+
+    std::string path = meshBenchmarkFile == "generated" ? benchmarkMeshFile() : meshBenchmarkFile;
+
+    MeshFile file;
+    file.open(path);
+    double mebibytes = file.size() / double(1 << 20);
+    std::cout << "\nMesh loader benchmark: " << path << ", " << std::fixed << std::setprecision(1) << mebibytes << " MiB, "
+        << file.meshCount() << " meshes, " << file.header().meshletCount << " meshlets, " << file.nodeCount() << " nodes, "
+        << BenchmarkRuns{}.measured << " runs per step\n"
+        << "    method        load ms    MiB/s   first draw ms\n";
+    file.close();
+
+    for (const MeshLoadTiming& timing : measureMeshLoading(path)) {
+        double load = timing.load.mean();
+        std::cout << std::fixed << std::setprecision(3)
+            << "    " << std::left << std::setw(10) << timing.method << std::right
+            << std::setw(11) << load
+            << std::setprecision(0) << std::setw(9) << (load > 0.0 ? mebibytes / (load / 1000.0) : 0.0)
+            << std::setprecision(3) << std::setw(16) << timing.firstDraw.mean() << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    uploadRing.report(std::cout);
+}
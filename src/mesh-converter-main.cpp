@@ -0,0 +1,89 @@
+// mesh-converter-main.cpp
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mesh-converter.h"
+
+// Entry point of the vulkan-test-meshconv target in CMakeLists.txt, which turns OBJ files into a .vkmesh file (see
+// mesh-format.h), or generates a test scene as one:
+//
+//   vulkan-test-meshconv <input.obj>... -o <output.vkmesh>
+//   vulkan-test-meshconv --generate <meshes> <rings> <segments> <nodes> -o <output.vkmesh>
+//
+// Every mesh of every input goes into the one file, with a node for each at the origin. The Visual Studio project
+// doesn't build this file.
+
+static uint32_t parseCount(const std::string& option, const char* value) {
+
+    char* end;
+    unsigned long count = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || count > 0xffffffffu) {
+        throw std::runtime_error("invalid value for " + option + ": " + value);
+    }
+    return static_cast<uint32_t>(count);
+}
+
+int main(int argc, char** argv) {
+
+    try {
+        std::vector<std::string> inputs;
+        std::string output;
+        bool generate = false;
+        uint32_t meshCount = 0, rings = 0, segments = 0, nodeCount = 0;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto next = [&]() -> const char* {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "-o") { output = next(); }
+            else if (arg == "--generate") {
+                generate = true;
+                meshCount = parseCount(arg, next());
+                rings = parseCount(arg, next());
+                segments = parseCount(arg, next());
+                nodeCount = parseCount(arg, next());
+            }
+            else { inputs.push_back(arg); }
+        }
+
+        if (output.empty() || inputs.empty() == !generate) {
+            std::cerr << "usage: vulkan-test-meshconv <input.obj>... -o <output.vkmesh>\n"
+                << "       vulkan-test-meshconv --generate <meshes> <rings> <segments> <nodes> -o <output.vkmesh>" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::vector<SourceMesh> meshes;
+        std::vector<MeshFileNode> nodes;
+        if (generate) {
+            makeTestScene(meshCount, rings, segments, nodeCount, 200.0f, meshes, nodes);
+        }
+        for (const std::string& input : inputs) {
+            for (SourceMesh& mesh : loadObj(input)) {
+                meshes.push_back(std::move(mesh));
+            }
+        }
+
+        MeshFileHeader header = writeMeshFile(output, meshes, nodes);
+
+        // What the same vertices would have taken as float position, normal and uv
+        uint64_t vertices = header.vertexBytes / sizeof(PackedVertex);
+        std::cout << output << ": " << header.meshCount << " meshes, " << header.nodeCount << " nodes, " << vertices
+            << " vertices, " << header.indexBytes / sizeof(uint32_t) / 3 << " triangles in " << header.meshletCount
+            << " meshlets, " << (header.indexOffset + header.indexBytes) / 1024 << " KiB (vertices "
+            << header.vertexBytes / 1024 << " KiB, " << vertices * 32 / 1024 << " KiB as floats)" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,465 @@
+// mesh-converter.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include "mesh-converter.h"
+
+namespace fs = std::filesystem;
+
+// A face corner in an OBJ file: position, uv and normal indices, 0-based, with missing ones as ~0u
+struct ObjCorner {
+    uint32_t position, uv, normal;
+    bool operator==(const ObjCorner& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner& corner) const {
+        return (size_t(corner.position) * 0x9e3779b97f4a7c15ull) ^ (size_t(corner.uv) * 0xc2b2ae3d27d4eb4full) ^ corner.normal;
+    }
+};
+
+// One index of a face corner. OBJ counts from 1, and negative indices count back from the last one read.
+static uint32_t objIndex(const char*& text, size_t count) {
+
+    char* end;
+    long value = std::strtol(text, &end, 10);
+    if (end == text) return ~0u;
+    text = end;
+    long resolved = value < 0 ? long(count) + value : value - 1;
+    if (resolved < 0 || size_t(resolved) >= count) {
+        throw std::runtime_error("failed to load OBJ file (index out of range)!");
+    }
+    return static_cast<uint32_t>(resolved);
+}
+
+// The bounding box center and the farthest point from it. Not the smallest sphere, but close, and it's only for culling.
+static void boundingSphere(const float* positions, const uint32_t* vertices, size_t count, float center[3], float& radius) {
+
+    float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float hi[3] = { -lo[0], -lo[1], -lo[2] };
+    for (size_t i = 0; i < count; i++) {
+        const float* p = positions + 3 * size_t(vertices ? vertices[i] : i);
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+        }
+    }
+
+    radius = 0.0f;
+    if (count == 0) {
+        center[0] = center[1] = center[2] = 0.0f;
+        return;
+    }
+    for (int c = 0; c < 3; c++) center[c] = 0.5f * (lo[c] + hi[c]);
+    for (size_t i = 0; i < count; i++) {
+        const float* p = positions + 3 * size_t(vertices ? vertices[i] : i);
+        float dx = p[0] - center[0], dy = p[1] - center[1], dz = p[2] - center[2];
+        radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+    }
+    radius = std::sqrt(radius);
+}
+
+// Area-weighted vertex normals, for meshes that came without any
+static std::vector<float> generateNormals(const SourceMesh& mesh) {
+
+    std::vector<float> normals(mesh.positions.size(), 0.0f);
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const float* a = &mesh.positions[3 * size_t(mesh.indices[i])];
+        const float* b = &mesh.positions[3 * size_t(mesh.indices[i + 1])];
+        const float* c = &mesh.positions[3 * size_t(mesh.indices[i + 2])];
+        float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        for (int corner = 0; corner < 3; corner++) {
+            float* out = &normals[3 * size_t(mesh.indices[i + corner])];
+            out[0] += n[0];
+            out[1] += n[1];
+            out[2] += n[2];
+        }
+    }
+    return normals;
+}
+
+// Greedy: triangles go into the current meshlet, in order, until one more would take it past either limit. The
+// indices come out in meshlet order, which for this builder is the order they went in.
+static void buildMeshlets(const SourceMesh& mesh, uint32_t firstIndex, std::vector<MeshFileMeshlet>& meshlets) {
+
+    size_t vertexCount = mesh.positions.size() / 3;
+    std::vector<uint32_t> lastMeshlet(vertexCount, ~0u);
+    uint32_t id = 0;
+
+    MeshFileMeshlet current{ firstIndex, 0, 0, {}, 0.0f };
+    auto close = [&](uint32_t end) {
+        if (current.triangleCount == 0) return;
+        boundingSphere(mesh.positions.data(), mesh.indices.data() + (current.firstIndex - firstIndex),
+            size_t(current.triangleCount) * 3, current.center, current.radius);
+        meshlets.push_back(current);
+        current = { firstIndex + end, 0, 0, {}, 0.0f };
+        id++;
+    };
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        uint32_t added = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            if (lastMeshlet[mesh.indices[i + corner]] != id) added++;
+        }
+        if (current.triangleCount == meshletMaxTriangles || current.vertexCount + added > meshletMaxVertices) {
+            close(static_cast<uint32_t>(i));
+        }
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t& last = lastMeshlet[mesh.indices[i + corner]];
+            if (last != id) {
+                last = id;
+                current.vertexCount++;
+            }
+        }
+        current.triangleCount++;
+    }
+    close(static_cast<uint32_t>(mesh.indices.size()));
+}
+
+// unorm16 across lo..lo + extent, the way the vertex shader turns it back
+static uint16_t quantizeUnorm16(float value, float lo, float extent) {
+    if (!(extent > 0.0f)) return 0;
+    float scaled = std::round((value - lo) / extent * 65535.0f);
+    return static_cast<uint16_t>(std::clamp(scaled, 0.0f, 65535.0f));
+}
+
+static int8_t quantizeSnorm8(float value) {
+    return static_cast<int8_t>(std::clamp(std::round(value * 127.0f), -127.0f, 127.0f));
+}
+
+std::vector<SourceMesh> loadObj(const std::string& path) {
+
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("failed to open OBJ file " + path + "!");
+    }
+
+    std::vector<float> positions, uvs, normals;
+    std::vector<SourceMesh> meshes;
+    SourceMesh mesh;
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> corners;
+    bool anyUv = false, anyNormal = false;
+
+    auto finishMesh = [&] {
+        if (!mesh.indices.empty()) {
+            if (!anyUv) mesh.uvs.clear();
+            if (!anyNormal) mesh.normals.clear();
+            meshes.push_back(std::move(mesh));
+        }
+        mesh = SourceMesh();
+        corners.clear();
+        anyUv = anyNormal = false;
+    };
+
+    std::string line;
+    std::vector<uint32_t> face;
+    while (std::getline(file, line)) {
+        const char* text = line.c_str();
+        while (*text == ' ' || *text == '\t') text++;
+
+        auto readFloats = [&](std::vector<float>& out, int count) {
+            char* end;
+            for (int i = 0; i < count; i++) {
+                out.push_back(std::strtof(text, &end));
+                text = end;
+            }
+        };
+
+        if (text[0] == 'v' && text[1] == ' ') { text += 2; readFloats(positions, 3); }
+        else if (text[0] == 'v' && text[1] == 't' && text[2] == ' ') { text += 3; readFloats(uvs, 2); }
+        else if (text[0] == 'v' && text[1] == 'n' && text[2] == ' ') { text += 3; readFloats(normals, 3); }
+        else if ((text[0] == 'o' || text[0] == 'g') && (text[1] == ' ' || text[1] == '\0')) { finishMesh(); }
+        else if (text[0] == 'f' && text[1] == ' ') {
+            text += 2;
+            face.clear();
+            while (true) {
+                while (*text == ' ' || *text == '\t') text++;
+                if (*text == '\0' || *text == '\r') break;
+
+                ObjCorner corner{ objIndex(text, positions.size() / 3), ~0u, ~0u };
+                if (corner.position == ~0u) {
+                    throw std::runtime_error("failed to load OBJ file " + path + " (bad face)!");
+                }
+                if (*text == '/') {
+                    text++;
+                    if (*text != '/') corner.uv = objIndex(text, uvs.size() / 2);
+                    if (*text == '/') {
+                        text++;
+                        corner.normal = objIndex(text, normals.size() / 3);
+                    }
+                }
+
+                auto found = corners.find(corner);
+                if (found == corners.end()) {
+                    uint32_t index = static_cast<uint32_t>(mesh.positions.size() / 3);
+                    const float* p = &positions[3 * size_t(corner.position)];
+                    mesh.positions.insert(mesh.positions.end(), p, p + 3);
+
+                    // OBJ puts v = 0 at the bottom of the texture, Vulkan at the top
+                    anyUv |= corner.uv != ~0u;
+                    mesh.uvs.push_back(corner.uv != ~0u ? uvs[2 * size_t(corner.uv)] : 0.0f);
+                    mesh.uvs.push_back(corner.uv != ~0u ? 1.0f - uvs[2 * size_t(corner.uv) + 1] : 0.0f);
+
+                    anyNormal |= corner.normal != ~0u;
+                    for (int c = 0; c < 3; c++) {
+                        mesh.normals.push_back(corner.normal != ~0u ? normals[3 * size_t(corner.normal) + c] : 0.0f);
+                    }
+                    found = corners.emplace(corner, index).first;
+                }
+                face.push_back(found->second);
+            }
+
+            for (size_t i = 2; i < face.size(); i++) {
+                mesh.indices.insert(mesh.indices.end(), { face[0], face[i - 1], face[i] });
+            }
+        }
+    }
+    finishMesh();
+
+    if (meshes.empty()) {
+        throw std::runtime_error("failed to load OBJ file " + path + " (no faces)!");
+    }
+    return meshes;
+}
+
+SourceMesh makeSphereMesh(uint32_t rings, uint32_t segments, float radius) {
+
+    rings = std::max(rings, 2u);
+    segments = std::max(segments, 3u);
+    const float pi = 3.14159265358979f;
+
+    SourceMesh mesh;
+    for (uint32_t ring = 0; ring <= rings; ring++) {
+        float theta = pi * ring / rings;
+        for (uint32_t segment = 0; segment <= segments; segment++) {
+            float phi = 2.0f * pi * segment / segments;
+            float n[3] = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+            mesh.positions.insert(mesh.positions.end(), { radius * n[0], radius * n[1], radius * n[2] });
+            mesh.normals.insert(mesh.normals.end(), { n[0], n[1], n[2] });
+            mesh.uvs.insert(mesh.uvs.end(), { float(segment) / segments, float(ring) / rings });
+        }
+    }
+
+    for (uint32_t ring = 0; ring < rings; ring++) {
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            uint32_t a = ring * (segments + 1) + segment;
+            uint32_t b = a + segments + 1;
+            mesh.indices.insert(mesh.indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+    return mesh;
+}
+
+void makeTestScene(uint32_t meshCount, uint32_t rings, uint32_t segments, uint32_t nodeCount, float extent,
+    std::vector<SourceMesh>& meshes, std::vector<MeshFileNode>& nodes) {
+
+    meshes.clear();
+    for (uint32_t mesh = 0; mesh < meshCount; mesh++) {
+        meshes.push_back(makeSphereMesh(rings, segments, 1.0f + 0.5f * (mesh % 4)));
+    }
+
+    std::mt19937 random(meshCount * 7919u + nodeCount);
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+    std::normal_distribution<float> axis(0.0f, 1.0f);
+
+    nodes.clear();
+    for (uint32_t i = 0; i < nodeCount && meshCount > 0; i++) {
+        MeshFileNode node{};
+        node.mesh = i % meshCount;
+        node.translation[0] = position(random);
+        node.translation[1] = position(random);
+        node.translation[2] = position(random);
+        node.scale = scale(random);
+
+        // Four normally distributed values, normalised, are a uniformly random rotation
+        float length = 0.0f;
+        for (float& q : node.rotation) {
+            q = axis(random);
+            length += q * q;
+        }
+        length = std::sqrt(length);
+        for (float& q : node.rotation) {
+            q = length > 0.0f ? q / length : 0.0f;
+        }
+        if (length == 0.0f) node.rotation[3] = 1.0f;
+        nodes.push_back(node);
+    }
+}
+
+MeshFileHeader writeMeshFile(const std::string& path, const std::vector<SourceMesh>& meshes,
+    const std::vector<MeshFileNode>& nodes) {
+
+    auto align = [](uint64_t offset) { return (offset + meshFileAlignment - 1) & ~(meshFileAlignment - 1); };
+
+    // Everything but the vertices and indices themselves first, since the header needs the meshlet count
+    std::vector<MeshFileMesh> entries(meshes.size());
+    std::vector<MeshFileMeshlet> meshlets;
+    uint64_t vertexCount = 0, indexCount = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const SourceMesh& mesh = meshes[i];
+        size_t vertices = mesh.positions.size() / 3;
+        if (mesh.indices.size() % 3 != 0 || (!mesh.normals.empty() && mesh.normals.size() != vertices * 3) ||
+            (!mesh.uvs.empty() && mesh.uvs.size() != vertices * 2)) {
+            throw std::runtime_error("failed to write mesh file " + path + " (inconsistent mesh)!");
+        }
+        for (uint32_t index : mesh.indices) {
+            if (index >= vertices) {
+                throw std::runtime_error("failed to write mesh file " + path + " (index out of range)!");
+            }
+        }
+        if (vertexCount + vertices > std::numeric_limits<uint32_t>::max() ||
+            indexCount + mesh.indices.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("failed to write mesh file " + path + " (more than 2^32 vertices or indices)!");
+        }
+
+        MeshFileMesh& entry = entries[i];
+        entry.firstVertex = static_cast<uint32_t>(vertexCount);
+        entry.vertexCount = static_cast<uint32_t>(vertices);
+        entry.firstIndex = static_cast<uint32_t>(indexCount);
+        entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        entry.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+        buildMeshlets(mesh, entry.firstIndex, meshlets);
+        entry.meshletCount = static_cast<uint32_t>(meshlets.size() - entry.firstMeshlet);
+
+        float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+        for (size_t v = 0; v < vertices; v++) {
+            for (int c = 0; c < 3; c++) {
+                float p = mesh.positions[3 * v + c];
+                lo[c] = v == 0 ? p : std::min(lo[c], p);
+                hi[c] = v == 0 ? p : std::max(hi[c], p);
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            entry.positionMin[c] = lo[c];
+            entry.positionScale[c] = (hi[c] - lo[c]) / 65535.0f;
+        }
+
+        float uvLo[2] = { 0, 0 }, uvHi[2] = { 0, 0 };
+        for (size_t v = 0; v < vertices && !mesh.uvs.empty(); v++) {
+            for (int c = 0; c < 2; c++) {
+                float uv = mesh.uvs[2 * v + c];
+                uvLo[c] = v == 0 ? uv : std::min(uvLo[c], uv);
+                uvHi[c] = v == 0 ? uv : std::max(uvHi[c], uv);
+            }
+        }
+        for (int c = 0; c < 2; c++) {
+            entry.uvMin[c] = uvLo[c];
+            entry.uvScale[c] = (uvHi[c] - uvLo[c]) / 65535.0f;
+        }
+
+        boundingSphere(mesh.positions.data(), nullptr, vertices, entry.center, entry.radius);
+
+        vertexCount += vertices;
+        indexCount += mesh.indices.size();
+    }
+
+    std::vector<MeshFileNode> defaultNodes;
+    if (nodes.empty()) {
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            defaultNodes.push_back({ i, { 0.0f, 0.0f, 0.0f }, 1.0f, { 0.0f, 0.0f, 0.0f, 1.0f } });
+        }
+    }
+    const std::vector<MeshFileNode>& sceneNodes = nodes.empty() ? defaultNodes : nodes;
+    for (const MeshFileNode& node : sceneNodes) {
+        if (node.mesh >= meshes.size()) {
+            throw std::runtime_error("failed to write mesh file " + path + " (node of a mesh that isn't there)!");
+        }
+    }
+
+    MeshFileHeader header{};
+    header.magic = meshFileMagic;
+    header.version = meshFileVersion;
+    header.meshCount = static_cast<uint32_t>(entries.size());
+    header.meshletCount = static_cast<uint32_t>(meshlets.size());
+    header.nodeCount = static_cast<uint32_t>(sceneNodes.size());
+    header.meshesOffset = align(sizeof(MeshFileHeader));
+    header.meshletsOffset = align(header.meshesOffset + entries.size() * sizeof(MeshFileMesh));
+    header.nodesOffset = align(header.meshletsOffset + meshlets.size() * sizeof(MeshFileMeshlet));
+    header.vertexOffset = align(header.nodesOffset + sceneNodes.size() * sizeof(MeshFileNode));
+    header.vertexBytes = vertexCount * sizeof(PackedVertex);
+    header.indexOffset = align(header.vertexOffset + header.vertexBytes);
+    header.indexBytes = indexCount * sizeof(uint32_t);
+
+    // Written section by section, one mesh at a time, so the converter never holds a second copy of the scene
+    fs::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("failed to write mesh file " + path + "!");
+        }
+
+        auto write = [&](uint64_t offset, const void* data, size_t size) {
+            static const char zeros[meshFileAlignment] = {};
+            uint64_t position = static_cast<uint64_t>(file.tellp());
+            if (position < offset) file.write(zeros, static_cast<std::streamsize>(offset - position));
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        };
+
+        write(0, &header, sizeof(header));
+        write(header.meshesOffset, entries.data(), entries.size() * sizeof(MeshFileMesh));
+        write(header.meshletsOffset, meshlets.data(), meshlets.size() * sizeof(MeshFileMeshlet));
+        write(header.nodesOffset, sceneNodes.data(), sceneNodes.size() * sizeof(MeshFileNode));
+
+        std::vector<PackedVertex> packed;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const SourceMesh& mesh = meshes[i];
+            const MeshFileMesh& entry = entries[i];
+            std::vector<float> generated = mesh.normals.empty() ? generateNormals(mesh) : std::vector<float>();
+            const std::vector<float>& normals = mesh.normals.empty() ? generated : mesh.normals;
+
+            packed.resize(entry.vertexCount);
+            for (size_t v = 0; v < entry.vertexCount; v++) {
+                PackedVertex& out = packed[v];
+                for (int c = 0; c < 3; c++) {
+                    out.position[c] = quantizeUnorm16(mesh.positions[3 * v + c], entry.positionMin[c], entry.positionScale[c] * 65535.0f);
+                }
+                out.position[3] = 0;
+
+                const float* n = &normals[3 * v];
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int c = 0; c < 3; c++) {
+                    out.normal[c] = length > 0.0f ? quantizeSnorm8(n[c] / length) : 0;
+                }
+                out.normal[3] = 0;
+
+                for (int c = 0; c < 2; c++) {
+                    out.uv[c] = mesh.uvs.empty() ? 0 : quantizeUnorm16(mesh.uvs[2 * v + c], entry.uvMin[c], entry.uvScale[c] * 65535.0f);
+                }
+            }
+            write(header.vertexOffset + uint64_t(entry.firstVertex) * sizeof(PackedVertex), packed.data(), packed.size() * sizeof(PackedVertex));
+        }
+
+        // The builder keeps triangles in order, so each mesh's indices are already in meshlet order
+        for (size_t i = 0; i < meshes.size(); i++) {
+            write(header.indexOffset + uint64_t(entries[i].firstIndex) * sizeof(uint32_t), meshes[i].indices.data(),
+                meshes[i].indices.size() * sizeof(uint32_t));
+        }
+
+        if (!file.flush()) {
+            file.close();
+            std::error_code ignored;
+            fs::remove(temporary, ignored);
+            throw std::runtime_error("failed to write mesh file " + path + "!");
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        throw std::runtime_error("failed to write mesh file " + path + "!");
+    }
+    return header;
+}
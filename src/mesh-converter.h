@@ -0,0 +1,38 @@
+// mesh-converter.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mesh-format.h"
+
+// Turns meshes into .vkmesh files (see mesh-format.h), offline, so loading never has to. This is where all the
+// parsing, quantizing and meshlet building happens; the vulkan-test-meshconv tool (mesh-converter-main.cpp) runs it
+// on OBJ files, and the mesh loader benchmark on a generated scene.
+
+// Triangles with float attributes, the way an importer or generator produces them
+struct SourceMesh {
+	std::vector<float> positions;       // xyz per vertex
+	std::vector<float> normals;         // xyz per vertex, or empty to have them generated
+	std::vector<float> uvs;             // uv per vertex, or empty
+	std::vector<uint32_t> indices;
+};
+
+// Each object (o) or group (g) with faces in it becomes a mesh, and polygons are split into fans. Vertices are
+// shared wherever the same position, uv and normal come up again. Throws if the file can't be read or has no faces.
+std::vector<SourceMesh> loadObj(const std::string& path);
+
+// A UV sphere around the origin, rings from pole to pole and segments around
+SourceMesh makeSphereMesh(uint32_t rings, uint32_t segments, float radius);
+
+// meshCount spheres of different sizes and nodeCount instances of them scattered through a cube of the given half
+// extent, each with its own scale and rotation. The same arguments give the same scene.
+void makeTestScene(uint32_t meshCount, uint32_t rings, uint32_t segments, uint32_t nodeCount, float extent,
+	std::vector<SourceMesh>& meshes, std::vector<MeshFileNode>& nodes);
+
+// Quantizes the vertices, splits each mesh's triangles into meshlets in the order they come, and writes the file
+// (to a temporary file renamed over path at the end). Without nodes every mesh gets one, at the origin. Returns the
+// header that was written; throws if it can't be.
+MeshFileHeader writeMeshFile(const std::string& path, const std::vector<SourceMesh>& meshes,
+	const std::vector<MeshFileNode>& nodes);
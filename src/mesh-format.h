@@ -0,0 +1,95 @@
+// mesh-format.h
+
+#pragma once
+
+#include <cstdint>
+
+// The .vkmesh file: meshes and a scene of them, laid out the way the GPU wants them so loading is a bounds check
+// and a copy. There's nothing to parse. Written by the converter (mesh-converter.h), read by MeshFile
+// (mesh-loader.h).
+//
+//   MeshFileHeader
+//   MeshFileMesh[meshCount]
+//   MeshFileMeshlet[meshletCount]   every mesh's meshlets, mesh after mesh
+//   MeshFileNode[nodeCount]
+//   PackedVertex[...]        every mesh's vertices, mesh after mesh
+//   uint32_t[...]            every mesh's indices, mesh after mesh, each mesh's in meshlet order
+//
+// Every section starts on a meshFileAlignment boundary, and the header's offsets are from the start of the file.
+// Everything is little-endian, which is every platform this builds for.
+//
+// Vertices are quantized (16 bytes instead of 32 for float position, normal and uv). Positions are unorm16
+// across the mesh's bounding box and uvs unorm16 across the mesh's uv range, so the vertex shader gets them back as
+// min + value * scale with the mesh's positionMin/positionScale and uvMin/uvScale. Normals are snorm8. As vertex
+// attributes they're R16G16B16A16_UNORM, R8G8B8A8_SNORM and R16G16_UNORM, which every device supports.
+//
+// Indices are relative to the mesh's first vertex, so a mesh draws with vertexOffset = firstVertex (a MeshRange in
+// instance-culling.h). They're ordered meshlet by meshlet: each meshlet's triangles are contiguous and touch at most
+// meshletMaxVertices distinct vertices, ready for a mesh shader or per-meshlet culling as they are.
+
+constexpr uint32_t meshFileMagic = 0x4853454d;      // "MESH"
+constexpr uint32_t meshFileVersion = 1;
+constexpr uint64_t meshFileAlignment = 64;
+
+constexpr uint32_t meshletMaxVertices = 64;
+constexpr uint32_t meshletMaxTriangles = 124;
+
+struct MeshFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t meshCount;
+	uint32_t meshletCount;
+	uint32_t nodeCount;
+	uint32_t reserved;
+	uint64_t meshesOffset;
+	uint64_t meshletsOffset;
+	uint64_t nodesOffset;
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexBytes;
+};
+
+struct MeshFileMesh {
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+	float positionMin[3];
+	float positionScale[3];
+	float uvMin[2];
+	float uvScale[2];
+	float center[3];            // Bounding sphere, in the mesh's own space
+	float radius;
+};
+
+// firstIndex is into the whole index section, like the mesh's
+struct MeshFileMeshlet {
+	uint32_t firstIndex;
+	uint32_t triangleCount;
+	uint32_t vertexCount;
+	float center[3];
+	float radius;
+};
+
+// One instance of a mesh in the scene: position = translation + scale * rotate(rotation, meshPosition)
+struct MeshFileNode {
+	uint32_t mesh;
+	float translation[3];
+	float scale;
+	float rotation[4];          // Unit quaternion, x y z w
+};
+
+struct PackedVertex {
+	uint16_t position[4];       // w is padding
+	int8_t normal[4];           // w is padding
+	uint16_t uv[2];
+};
+
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader is read straight from the file");
+static_assert(sizeof(MeshFileMesh) == 80, "MeshFileMesh is read straight from the file");
+static_assert(sizeof(MeshFileMeshlet) == 28, "MeshFileMeshlet is read straight from the file");
+static_assert(sizeof(MeshFileNode) == 36, "MeshFileNode is read straight from the file");
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex is read straight from the file");
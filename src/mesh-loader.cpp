@@ -0,0 +1,300 @@
+// mesh-loader.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <stdexcept>
+#include "mesh-loader.h"
+
+void MeshFile::open(const std::string& path) {
+
+    close();
+
+    std::string error;
+    if (!mapping.open(path, &error)) {
+        throw std::runtime_error("failed to load mesh file " + path + " (" + error + ")!");
+    }
+    base = static_cast<const char*>(mapping.data());
+    length = mapping.size();
+    check(path);
+}
+
+void MeshFile::read(const std::string& path) {
+
+    close();
+
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    std::streamsize size = stream ? static_cast<std::streamsize>(stream.tellg()) : -1;
+    if (size <= 0) {
+        throw std::runtime_error("failed to load mesh file " + path + " (can't be read)!");
+    }
+
+    copy.resize(static_cast<size_t>(size));
+    stream.seekg(0);
+    if (!stream.read(copy.data(), size)) {
+        throw std::runtime_error("failed to load mesh file " + path + " (can't be read)!");
+    }
+    base = copy.data();
+    length = copy.size();
+    check(path);
+}
+
+void MeshFile::close() {
+
+    mapping.close();
+    copy.clear();
+    copy.shrink_to_fit();
+    base = nullptr;
+    length = 0;
+}
+
+void MeshFile::check(const std::string& path) {
+
+    auto fail = [&](const char* reason) {
+        close();
+        throw std::runtime_error("failed to load mesh file " + path + " (" + reason + ")!");
+    };
+
+    if (length < sizeof(MeshFileHeader)) fail("too short");
+    const MeshFileHeader& h = header();
+    if (h.magic != meshFileMagic) fail("not a mesh file");
+    if (h.version != meshFileVersion) fail("written by a different version of the converter");
+
+    // Sections are aligned, which also keeps the tables aligned for their types, and inside the file. Counts are at
+    // most 2^32 and entries at most 80 bytes, so none of this can overflow.
+    auto inside = [&](uint64_t offset, uint64_t bytes) {
+        return offset % meshFileAlignment == 0 && offset <= length && bytes <= length - offset;
+    };
+    if (!inside(h.meshesOffset, uint64_t(h.meshCount) * sizeof(MeshFileMesh)) ||
+        !inside(h.meshletsOffset, uint64_t(h.meshletCount) * sizeof(MeshFileMeshlet)) ||
+        !inside(h.nodesOffset, uint64_t(h.nodeCount) * sizeof(MeshFileNode)) ||
+        !inside(h.vertexOffset, h.vertexBytes) || h.vertexBytes % sizeof(PackedVertex) != 0 ||
+        !inside(h.indexOffset, h.indexBytes) || h.indexBytes % sizeof(uint32_t) != 0) {
+        fail("section out of bounds");
+    }
+
+    uint64_t vertexCount = h.vertexBytes / sizeof(PackedVertex);
+    uint64_t indexCount = h.indexBytes / sizeof(uint32_t);
+
+    // The streamer goes through the meshes in order and relies on them covering the sections in order too, all of
+    // each section, so nothing it uploads is left out of a mesh. Meshlets are in mesh order as well, which keeps the
+    // check of each one against its own mesh's indices to one pass over the table.
+    uint64_t nextVertex = 0, nextIndex = 0, nextMeshlet = 0;
+    for (uint32_t i = 0; i < h.meshCount; i++) {
+        const MeshFileMesh& mesh = meshes()[i];
+        if (mesh.firstVertex != nextVertex || mesh.firstIndex != nextIndex || mesh.firstMeshlet != nextMeshlet ||
+            uint64_t(mesh.firstVertex) + mesh.vertexCount > vertexCount ||
+            uint64_t(mesh.firstIndex) + mesh.indexCount > indexCount ||
+            uint64_t(mesh.firstMeshlet) + mesh.meshletCount > h.meshletCount) {
+            fail("mesh out of bounds");
+        }
+
+        uint64_t meshIndexEnd = uint64_t(mesh.firstIndex) + mesh.indexCount;
+        for (uint32_t m = mesh.firstMeshlet; m < mesh.firstMeshlet + mesh.meshletCount; m++) {
+            const MeshFileMeshlet& meshlet = meshlets()[m];
+            if (meshlet.firstIndex < mesh.firstIndex ||
+                uint64_t(meshlet.firstIndex) + uint64_t(meshlet.triangleCount) * 3 > meshIndexEnd) {
+                fail("meshlet outside its mesh");
+            }
+        }
+
+        nextVertex += mesh.vertexCount;
+        nextIndex += mesh.indexCount;
+        nextMeshlet += mesh.meshletCount;
+    }
+    if (nextVertex != vertexCount || nextIndex != indexCount || nextMeshlet != h.meshletCount) {
+        fail("meshes don't cover the file's geometry");
+    }
+    for (uint32_t i = 0; i < h.nodeCount; i++) {
+        if (nodes()[i].mesh >= h.meshCount) {
+            fail("node of a mesh that isn't there");
+        }
+    }
+}
+
+MeshRange MeshFile::meshRange(uint32_t mesh) const {
+
+    const MeshFileMesh& entry = meshes()[mesh];
+    return { entry.indexCount, entry.firstIndex, static_cast<int32_t>(entry.firstVertex) };
+}
+
+void MeshFile::addInstances(InstanceStore& store) const {
+
+    uint32_t firstMesh = store.meshCount();
+    for (uint32_t mesh = 0; mesh < meshCount(); mesh++) {
+        store.addMesh(meshRange(mesh));
+    }
+
+    for (uint32_t i = 0; i < nodeCount(); i++) {
+        const MeshFileNode& node = nodes()[i];
+        const MeshFileMesh& mesh = meshes()[node.mesh];
+
+        // The center rotated by the quaternion, v + 2w(q x v) + 2q x (q x v), then scaled and moved
+        const float* q = node.rotation;
+        const float* v = mesh.center;
+        float t[3] = { 2.0f * (q[1] * v[2] - q[2] * v[1]), 2.0f * (q[2] * v[0] - q[0] * v[2]), 2.0f * (q[0] * v[1] - q[1] * v[0]) };
+        float rotated[3] = {
+            v[0] + q[3] * t[0] + (q[1] * t[2] - q[2] * t[1]),
+            v[1] + q[3] * t[1] + (q[2] * t[0] - q[0] * t[2]),
+            v[2] + q[3] * t[2] + (q[0] * t[1] - q[1] * t[0]),
+        };
+
+        store.add(firstMesh + node.mesh,
+            node.translation[0] + node.scale * rotated[0],
+            node.translation[1] + node.scale * rotated[1],
+            node.translation[2] + node.scale * rotated[2],
+            std::abs(node.scale) * mesh.radius);
+    }
+}
+
+void MeshStreamer::create(DeviceAllocator& allocator, UploadRing& uploads, const QueueFamilyIndices& queueFamilies,
+    DeferredDestruction& deferred) {
+
+    this->allocator = &allocator;
+    this->uploads = &uploads;
+    this->deferred = &deferred;
+
+    // Written on the transfer queue, drawn from on the graphics queue, and read by compute for culling
+    std::set<uint32_t> families = { uploads.queueFamily(), queueFamilies.graphicsFamily.value(), queueFamilies.computeFamily.value() };
+    if (families.size() > 1) {
+        sharedFamilies.assign(families.begin(), families.end());
+    }
+}
+
+void MeshStreamer::destroy() {
+
+    if (allocator == nullptr) return;
+
+    if (vertices != VK_NULL_HANDLE) allocator->destroyBuffer(vertices, vertexMemory);
+    if (indices != VK_NULL_HANDLE) allocator->destroyBuffer(indices, indexMemory);
+    vertices = VK_NULL_HANDLE;
+    indices = VK_NULL_HANDLE;
+    vertexCapacity = 0;
+    indexCapacity = 0;
+    file = nullptr;
+    meshTickets.clear();
+    lastTicket = 0;
+}
+
+void MeshStreamer::reserve(VkBuffer& buffer, DeviceAllocation& memory, VkDeviceSize& capacity, VkDeviceSize size,
+    VkBufferUsageFlags usage) {
+
+    if (size <= capacity) return;
+
+    // The frames in flight are covered by the deferral, but the ring's batches aren't on their fences: a scene
+    // replaced mid-stream can still have copies going into the old buffer. So once the frames are done it's deferred
+    // again until the last copy's ticket, which is usually reached by then and goes at the next collect()
+    if (buffer != VK_NULL_HANDLE) {
+        deferred->defer([deferred = deferred, allocator = allocator, ticket = lastTicket, buffer, memory]() {
+            deferred->deferUntil(ticket, [allocator, buffer, memory]() mutable {
+                allocator->destroyBuffer(buffer, memory);
+            });
+        });
+    }
+
+    // Half as much again, so switching between scenes of about the same size doesn't reallocate every time
+    capacity = std::max<VkDeviceSize>(size + size / 2, 1 << 16);
+    buffer = allocator->createBuffer(capacity, usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, memory, sharedFamilies);
+}
+
+void MeshStreamer::begin(const MeshFile& file) {
+
+    const MeshFileHeader& header = file.header();
+    reserve(vertices, vertexMemory, vertexCapacity, header.vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    reserve(indices, indexMemory, indexCapacity, header.indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+    this->file = &file;
+    nextMesh = 0;
+    meshOffset = 0;
+    meshTickets.assign(header.meshCount, 0);
+    filesStreamed++;
+}
+
+bool MeshStreamer::stream(VkDeviceSize budget) {
+
+    if (file == nullptr) return false;
+
+    streamCalls++;
+
+    // A mesh is its vertices followed by its indices, and meshOffset goes through both. The file lays every mesh's
+    // vertices out in order, and every mesh's indices, so this reads the mapping as two sequential streams.
+    const MeshFileMesh* meshes = file->meshes();
+    std::vector<uint32_t> completed;
+    VkDeviceSize limit = std::max<VkDeviceSize>(budget, 1);
+    VkDeviceSize queued = 0;
+    while (nextMesh < file->meshCount() && queued < limit) {
+        const MeshFileMesh& mesh = meshes[nextMesh];
+        VkDeviceSize vertexBytes = VkDeviceSize(mesh.vertexCount) * sizeof(PackedVertex);
+        VkDeviceSize indexBytes = VkDeviceSize(mesh.indexCount) * sizeof(uint32_t);
+
+        VkDeviceSize piece = limit - queued;
+        if (meshOffset < vertexBytes) {
+            piece = std::min(piece, vertexBytes - meshOffset);
+            VkDeviceSize offset = VkDeviceSize(mesh.firstVertex) * sizeof(PackedVertex) + meshOffset;
+            uploads->uploadBuffer(vertices, offset, file->vertexData() + offset, piece);
+        }
+        else if (meshOffset < vertexBytes + indexBytes) {
+            piece = std::min(piece, vertexBytes + indexBytes - meshOffset);
+            VkDeviceSize offset = VkDeviceSize(mesh.firstIndex) * sizeof(uint32_t) + (meshOffset - vertexBytes);
+            uploads->uploadBuffer(indices, offset, file->indexData() + offset, piece);
+        }
+        else {
+            piece = 0;
+        }
+
+        queued += piece;
+        meshOffset += piece;
+        if (meshOffset == vertexBytes + indexBytes) {
+            completed.push_back(nextMesh);
+            nextMesh++;
+            meshOffset = 0;
+        }
+    }
+
+    bytesStreamed += queued;
+
+    UploadRing::Ticket ticket = uploads->flush();
+    lastTicket = std::max(lastTicket, ticket);
+    for (uint32_t mesh : completed) {
+        meshTickets[mesh] = ticket;
+    }
+
+    if (nextMesh == file->meshCount()) {
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void MeshStreamer::finish() {
+
+    while (stream(~VkDeviceSize(0))) {}
+
+    if (!meshTickets.empty()) {
+        uploads->wait(meshTickets.back());
+    }
+}
+
+bool MeshStreamer::meshReady(uint32_t mesh) {
+    return meshQueued(mesh) && uploads->isComplete(meshTickets[mesh]);
+}
+
+void MeshStreamer::waitForMesh(uint32_t mesh) {
+
+    if (meshQueued(mesh)) {
+        uploads->wait(meshTickets[mesh]);
+    }
+}
+
+void MeshStreamer::report(std::ostream& out) const {
+
+    if (filesStreamed == 0) return;
+
+    out << std::fixed << std::setprecision(1)
+        << "\nMesh streaming: " << filesStreamed << " files, " << bytesStreamed / double(1 << 20) << " MiB in "
+        << streamCalls << " pieces, " << (vertexCapacity + indexCapacity) / double(1 << 20) << " MiB of geometry buffers\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,136 @@
+// mesh-loader.h
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "include.h"
+#include "deferred-destruction.h"
+#include "device-allocator.h"
+#include "instance-culling.h"
+#include "mapped-file.h"
+#include "mesh-format.h"
+#include "queue-family-indices.h"
+#include "upload-ring.h"
+
+// A .vkmesh file (see mesh-format.h), mapped. Opening checks the header, that every section is inside the file,
+// that the meshes cover the vertex, index and meshlet sections in order, and that each meshlet's triangles are inside
+// its own mesh's indices. That's all: the tables are used where they lie in the mapping, and the vertex and index
+// sections go to the GPU from there. Index values aren't looked at; they're trusted the way the converter wrote them.
+
+class MeshFile {
+
+public:
+
+	// Throws if the file can't be mapped or fails the checks above
+	void open(const std::string& path);
+
+	// The same, but read into memory with a stream instead of mapped: what loading cost before, kept for the
+	// loader benchmark to compare against
+	void read(const std::string& path);
+
+	void close();
+
+	bool isOpen() const { return base != nullptr; }
+	size_t size() const { return length; }
+
+	const MeshFileHeader& header() const { return *reinterpret_cast<const MeshFileHeader*>(base); }
+	uint32_t meshCount() const { return header().meshCount; }
+	uint32_t nodeCount() const { return header().nodeCount; }
+
+	const MeshFileMesh* meshes() const { return reinterpret_cast<const MeshFileMesh*>(base + header().meshesOffset); }
+	const MeshFileMeshlet* meshlets() const { return reinterpret_cast<const MeshFileMeshlet*>(base + header().meshletsOffset); }
+	const MeshFileNode* nodes() const { return reinterpret_cast<const MeshFileNode*>(base + header().nodesOffset); }
+	const char* vertexData() const { return base + header().vertexOffset; }
+	const char* indexData() const { return base + header().indexOffset; }
+
+	// What a mesh's draw needs, with the geometry where MeshStreamer puts it
+	MeshRange meshRange(uint32_t mesh) const;
+
+	// Every mesh, then an instance per scene node, with the node's transform applied to its mesh's bounding sphere.
+	// Mesh n of the file is mesh (first mesh added + n) in the store.
+	void addInstances(InstanceStore& store) const;
+
+private:
+
+	void check(const std::string& path);
+
+	MappedFile mapping;
+	std::vector<char> copy;
+	const char* base = nullptr;
+	size_t length = 0;
+};
+
+// A MeshFile's geometry on the GPU: every mesh's vertices in one device-local vertex buffer and every mesh's indices
+// in one index buffer, at the same offsets as in the file.
+//
+// The data goes from the mapping straight into the upload ring, with no copy of our own in between, a chunk at a
+// time in mesh order. stream() queues up to a byte budget and flushes, so a frame loop can spread a scene over
+// several frames, and each mesh can be drawn as soon as meshReady() says its batch is done, without waiting for the
+// rest of the scene. The file has to stay open until everything is queued.
+//
+// The buffers are concurrent across the transfer, graphics and compute families when those aren't all one, as the
+// upload ring requires. They're kept and reused by the next begin() when they're big enough. When they aren't, the
+// old ones go to the deferred destruction queue, since frames still in flight may be drawing from them and the
+// ring may still be copying into them, so begin() can be called from a running frame loop.
+
+class MeshStreamer {
+
+public:
+
+	void create(DeviceAllocator& allocator, UploadRing& uploads, const QueueFamilyIndices& queueFamilies,
+		DeferredDestruction& deferred);
+	void destroy();                         // The GPU must be done with the geometry
+
+	// Starts streaming file, replacing whatever was loaded before
+	void begin(const MeshFile& file);
+
+	// Queues up to budget bytes (at least one piece, however small the budget) and flushes. Returns true while
+	// there's more to queue.
+	bool stream(VkDeviceSize budget);
+
+	// Queues whatever is left and waits for all of it
+	void finish();
+
+	bool meshQueued(uint32_t mesh) const { return mesh < meshTickets.size() && meshTickets[mesh] != 0; }
+	bool meshReady(uint32_t mesh);
+	void waitForMesh(uint32_t mesh);         // Does nothing if it isn't queued
+
+	VkBuffer vertexBuffer() const { return vertices; }
+	VkBuffer indexBuffer() const { return indices; }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	void reserve(VkBuffer& buffer, DeviceAllocation& memory, VkDeviceSize& capacity, VkDeviceSize size,
+		VkBufferUsageFlags usage);
+
+	DeviceAllocator* allocator = nullptr;
+	UploadRing* uploads = nullptr;
+	DeferredDestruction* deferred = nullptr;
+	std::vector<uint32_t> sharedFamilies;   // Transfer, graphics and compute when they aren't all one, otherwise empty
+
+	VkBuffer vertices = VK_NULL_HANDLE;
+	DeviceAllocation vertexMemory;
+	VkDeviceSize vertexCapacity = 0;
+	VkBuffer indices = VK_NULL_HANDLE;
+	DeviceAllocation indexMemory;
+	VkDeviceSize indexCapacity = 0;
+
+	// Where streaming is up to: the mesh, and how far into its vertices and then its indices
+	const MeshFile* file = nullptr;
+	uint32_t nextMesh = 0;
+	VkDeviceSize meshOffset = 0;
+
+	// The ticket of the batch that holds the last of each mesh, 0 until it's queued
+	std::vector<UploadRing::Ticket> meshTickets;
+	UploadRing::Ticket lastTicket = 0;      // Of the last batch with any of it, finished mesh or not
+
+	// Bookkeeping for the report
+	uint64_t filesStreamed = 0;
+	uint64_t bytesStreamed = 0;
+	uint64_t streamCalls = 0;
+};
@@ -0,0 +1,110 @@
+// parallel-recorder.cpp
+
+#include <stdexcept>
+#include "parallel-recorder.h"
+#include "profiler.h"
+
+void ParallelRecorder::create(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t framesInFlight,
+    const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+
+    // No RESET_COMMAND_BUFFER flag: buffers are only ever reset all at once through their pool, which lets the
+    // driver skip tracking them individually
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    frames.resize(framesInFlight);
+    for (auto& threads : frames) {
+        threads.resize(threadCount);
+        for (ThreadPool& thread : threads) {
+            if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &thread.pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create recording command pool!");
+            }
+        }
+    }
+}
+
+void ParallelRecorder::destroy() {
+
+    // Destroying a pool frees its command buffers
+    for (auto& threads : frames) {
+        for (ThreadPool& thread : threads) {
+            vkDestroyCommandPool(device, thread.pool, allocationCallbacks);
+        }
+    }
+    frames.clear();
+}
+
+void ParallelRecorder::beginFrame(uint32_t frameIndex) {
+
+    currentFrame = frameIndex;
+
+    for (ThreadPool& thread : frames[currentFrame]) {
+        if (thread.used > 0) {
+            vkResetCommandPool(device, thread.pool, 0);
+            thread.used = 0;
+        }
+    }
+}
+
+VkCommandBuffer ParallelRecorder::acquire(uint32_t threadIndex) {
+
+    // Only ever called from the thread that owns this pool, so no locking
+    ThreadPool& thread = frames[currentFrame][threadIndex];
+
+    if (thread.used == thread.buffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = thread.pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+        thread.buffers.push_back(commandBuffer);
+        allocatedCount++;
+    }
+
+    return thread.buffers[thread.used++];
+}
+
+void ParallelRecorder::record(JobSystem& jobs, VkCommandBuffer primary, uint32_t chunkCount,
+    const VkCommandBufferInheritanceInfo& inheritance, VkCommandBufferUsageFlags usage,
+    const std::function<void(VkCommandBuffer, uint32_t)>& record) {
+
+    if (chunkCount == 0) return;
+
+    // Written by index, so the order they're executed in doesn't depend on which thread got which chunk
+    std::vector<VkCommandBuffer> secondaries(chunkCount);
+
+    jobs.parallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end, uint32_t threadIndex) {
+        for (uint32_t chunk = begin; chunk < end; chunk++) {
+            PROFILE_ZONE("record secondary");
+            VkCommandBuffer commandBuffer = acquire(threadIndex);
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = usage | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = &inheritance;
+
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+
+            record(commandBuffer, chunk);
+
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            secondaries[chunk] = commandBuffer;
+        }
+    });
+
+    vkCmdExecuteCommands(primary, chunkCount, secondaries.data());
+}
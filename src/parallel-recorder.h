@@ -0,0 +1,55 @@
+// parallel-recorder.h
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "include.h"
+#include "job-system.h"
+
+// Records secondary command buffers on every thread of a JobSystem and gathers them into one primary, so a frame
+// is still a single vkQueueSubmit no matter how many threads recorded it.
+//
+// Command pools are externally synchronized, so every thread gets its own pool, and every frame in flight gets its
+// own set of those, since a pool can't be reset while the GPU may still be executing its buffers. At the start of a
+// frame its pools are reset with vkResetCommandPool, which recycles every buffer in them at once. The buffers
+// themselves are kept and re-recorded, never freed and reallocated.
+
+class ParallelRecorder {
+
+public:
+
+	void create(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t framesInFlight,
+		const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Call once the frame's fence has signalled, i.e. when the GPU is done with whatever was recorded into this
+	// frame slot last time around
+	void beginFrame(uint32_t frameIndex);
+
+	// Runs record(commandBuffer, chunk) for every chunk in [0, chunkCount) across the job system, each chunk into
+	// its own secondary command buffer, then executes them all into primary in chunk order. inheritance is passed
+	// to every secondary as is; give it a render pass and RENDER_PASS_CONTINUE usage when recording draws.
+	void record(JobSystem& jobs, VkCommandBuffer primary, uint32_t chunkCount,
+		const VkCommandBufferInheritanceInfo& inheritance, VkCommandBufferUsageFlags usage,
+		const std::function<void(VkCommandBuffer, uint32_t)>& record);
+
+	uint32_t allocatedBuffers() const { return allocatedCount; }
+
+private:
+
+	struct ThreadPool {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> buffers;
+		uint32_t used = 0;
+	};
+
+	VkCommandBuffer acquire(uint32_t threadIndex);
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	std::vector<std::vector<ThreadPool>> frames;    // [frame in flight][thread]
+	uint32_t currentFrame = 0;
+	std::atomic<uint32_t> allocatedCount{ 0 };
+};
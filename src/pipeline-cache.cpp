@@ -0,0 +1,204 @@
+// pipeline-cache.cpp
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "pipeline-cache.h"
+#include "cache-directory.h"
+#include "frame-stats.h"
+
+// FNV-1a. Not cryptographic, but it reliably catches truncated or bit-flipped files, which is all we need.
+static uint64_t checksum(const char* data, size_t size) {
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// One file per vendor/device pair, so machines with more than one GPU don't throw away each other's caches
+static std::filesystem::path cacheFilePath(const VkPhysicalDeviceProperties& properties) {
+
+    std::filesystem::path directory = cacheDirectory();
+    if (directory.empty()) return directory;
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "pipeline-cache-%04x-%04x.bin", properties.vendorID, properties.deviceID);
+    return directory / name;
+}
+
+bool PipelineCache::validate(const char* data, size_t size, const char*& driverData, size_t& driverSize, const char*& reason) const {
+
+    FileHeader header;
+    if (size < sizeof(FileHeader)) { reason = "truncated header"; return false; }
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0) { reason = "not a pipeline cache file"; return false; }
+    if (header.formatVersion != fileFormatVersion) { reason = "unknown file version"; return false; }
+    if (header.dataSize != size - sizeof(FileHeader)) { reason = "size mismatch"; return false; }
+
+    driverData = data + sizeof(FileHeader);
+    driverSize = header.dataSize;
+
+    if (checksum(driverData, driverSize) != header.checksum) { reason = "checksum mismatch"; return false; }
+
+    // The driver checks this too, but not every driver is as careful as it should be with foreign data
+    DriverHeader driverHeader;
+    if (driverSize < sizeof(DriverHeader)) { reason = "truncated driver header"; return false; }
+    std::memcpy(&driverHeader, driverData, sizeof(driverHeader));
+
+    if (driverHeader.headerSize < sizeof(DriverHeader) || driverHeader.headerSize > driverSize) { reason = "bad driver header size"; return false; }
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) { reason = "unknown driver header version"; return false; }
+    if (driverHeader.vendorID != deviceProperties.vendorID || driverHeader.deviceID != deviceProperties.deviceID) { reason = "different device"; return false; }
+    if (std::memcmp(driverHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) { reason = "different driver version"; return false; }
+
+    return true;
+}
+
+void PipelineCache::create(VkPhysicalDevice physicalDevice, VkDevice device, bool cold, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::optional<std::vector<char>> file;
+    std::filesystem::path path = cacheFilePath(deviceProperties);
+
+    if (cold) {
+        loadResult = "cold start requested";
+    }
+    else if (path.empty() || !(file = readCacheFile(path))) {
+        loadResult = "no cache file";
+    }
+
+    const char* driverData = nullptr;
+    size_t driverSize = 0;
+
+    if (file) {
+        const char* reason = nullptr;
+        if (validate(file->data(), file->size(), driverData, driverSize, reason)) {
+            loadResult = "loaded";
+            loadedBytes = driverSize;
+        }
+        else {
+            std::clog << "Ignoring pipeline cache " << path.string() << ": " << reason << "\n";
+            loadResult = reason;
+            driverData = nullptr;
+            driverSize = 0;
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = driverSize;
+    createInfo.pInitialData = driverData;
+
+    // A driver is still allowed to refuse data that passed our checks. An empty cache is always accepted.
+    if (vkCreatePipelineCache(device, &createInfo, allocationCallbacks, &cache) != VK_SUCCESS) {
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        loadResult = "rejected by driver";
+        loadedBytes = 0;
+
+        if (vkCreatePipelineCache(device, &createInfo, allocationCallbacks, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    loadMilliseconds = elapsedMilliseconds(start, std::chrono::steady_clock::now());
+}
+
+VkResult PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline) {
+
+    VkComputePipelineCreateInfo info = createInfo;
+
+    VkPipelineCreationFeedback feedback{};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+    if (creationFeedbackSupported) {
+        feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        feedbackInfo.pNext = info.pNext;
+        feedbackInfo.pPipelineCreationFeedback = &feedback;
+        info.pNext = &feedbackInfo;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    VkResult result = vkCreateComputePipelines(device, cache, 1, &info, allocationCallbacks, pipeline);
+    double milliseconds = elapsedMilliseconds(start, std::chrono::steady_clock::now());
+
+    if (result == VK_SUCCESS) {
+        recordCreation(milliseconds, creationFeedbackSupported ? &feedback : nullptr);
+    }
+    return result;
+}
+
+void PipelineCache::recordCreation(double milliseconds, const VkPipelineCreationFeedback* feedback) {
+
+    compileMilliseconds += milliseconds;
+
+    if (feedback == nullptr || !(feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+        unknown++;
+    }
+    else if (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+        hits++;
+    }
+    else {
+        misses++;
+    }
+}
+
+void PipelineCache::save() {
+
+    std::filesystem::path path = cacheFilePath(deviceProperties);
+    if (path.empty() || cache == VK_NULL_HANDLE) return;
+
+    // Standard two-call pattern. The size can grow between the calls if another thread is creating pipelines,
+    // in which case VK_INCOMPLETE comes back and the partial data is not worth keeping.
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+
+    std::vector<char> file(sizeof(FileHeader) + size);
+    if (vkGetPipelineCacheData(device, cache, &size, file.data() + sizeof(FileHeader)) != VK_SUCCESS) return;
+    file.resize(sizeof(FileHeader) + size);
+
+    FileHeader header{};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.formatVersion = fileFormatVersion;
+    header.dataSize = static_cast<uint32_t>(size);
+    header.checksum = checksum(file.data() + sizeof(FileHeader), size);
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    if (writeCacheFileAtomically(path, file.data(), file.size())) {
+        savedBytes = size;
+    }
+    else {
+        std::clog << "Failed to write pipeline cache " << path.string() << "\n";
+    }
+}
+
+void PipelineCache::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+    vkDestroyPipelineCache(device, cache, allocationCallbacks);
+    cache = VK_NULL_HANDLE;
+    device = VK_NULL_HANDLE;
+}
+
+void PipelineCache::report(std::ostream& out) const {
+
+    out << std::fixed << std::setprecision(3)
+        << "\nPipeline cache: " << loadResult << " (" << loadedBytes << " bytes in " << loadMilliseconds << " ms)\n"
+        << "    pipelines " << (hits + misses + unknown) << ": " << hits << " hits, " << misses << " misses, " << unknown << " unknown\n"
+        << "    compile time " << compileMilliseconds << " ms\n"
+        << "    saved " << savedBytes << " bytes\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,76 @@
+// pipeline-cache.h
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include "include.h"
+
+// Keeps a VkPipelineCache on disk between runs so pipelines compiled once don't get compiled again on every launch.
+//
+// The file is the driver's own cache blob behind a small header of ours with a checksum, written atomically on
+// shutdown. On load the blob is rejected (and we start empty) if the checksum fails or if the driver's header doesn't
+// match this device's vendor, device ID and pipelineCacheUUID. A driver update changes the UUID, so stale caches from
+// an older driver are thrown away instead of being handed to a driver that might not cope with them.
+
+class PipelineCache {
+
+public:
+
+	// cold = ignore whatever is on disk. The cache is still saved at shutdown, so running once cold and once warm
+	// gives a direct comparison of startup cost.
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, bool cold, const VkAllocationCallbacks* allocationCallbacks);
+	void save();
+	void destroy();
+
+	VkPipelineCache handle() const { return cache; }
+
+	// All pipeline creation should go through here so hits, misses and compile time get counted. Hits are only known
+	// when the device reports creation feedback (core in 1.3, VK_EXT_pipeline_creation_feedback before that, see
+	// DeviceCapabilities); without it pipelines are counted as "unknown".
+	void setCreationFeedbackSupported(bool supported) { creationFeedbackSupported = supported; }
+	VkResult createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline);
+
+	void report(std::ostream& out) const;
+
+private:
+
+	// Ours, in front of the driver's data
+	struct FileHeader {
+		char magic[8];
+		uint32_t formatVersion;
+		uint32_t dataSize;
+		uint64_t checksum;
+	};
+
+	// The layout every driver's blob starts with (VkPipelineCacheHeaderVersionOne in newer headers)
+	struct DriverHeader {
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+	static constexpr char fileMagic[8] = { 'V', 'K', 'T', 'P', 'C', 'A', 'C', 'H' };
+	static constexpr uint32_t fileFormatVersion = 1;
+
+	bool validate(const char* data, size_t size, const char*& driverData, size_t& driverSize, const char*& reason) const;
+	void recordCreation(double milliseconds, const VkPipelineCreationFeedback* feedback);
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties deviceProperties{};
+	bool creationFeedbackSupported = false;
+
+	// Bookkeeping for the report
+	const char* loadResult = "not loaded";
+	size_t loadedBytes = 0;
+	double loadMilliseconds = 0.0;
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t unknown = 0;
+	double compileMilliseconds = 0.0;
+	size_t savedBytes = 0;
+};
@@ -0,0 +1,520 @@
+// profiler.cpp
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include "profiler.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+Profiler profiler;
+
+// Two timestamps per zone. Zones past this in one frame are dropped and counted.
+static constexpr uint32_t maxGpuZonesPerFrame = 64;
+static constexpr uint32_t queriesPerFrame = maxGpuZonesPerFrame * 2;
+
+// Caps memory use when a long run is left profiling. Roughly 24 MiB per thread.
+static constexpr size_t maxEventsPerThread = 1 << 20;
+
+// Frames between re-calibrations with VK_EXT_calibrated_timestamps. The call is cheap, but GPU and CPU clocks
+// only drift apart by a few microseconds per second, so there's no point doing it every frame.
+static constexpr uint64_t recalibrationInterval = 120;
+
+void Profiler::enable(std::string tracePath) {
+
+    this->tracePath = std::move(tracePath);
+    startTime = Clock::now();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+Profiler::ThreadEvents& Profiler::localEvents() {
+
+    // Registered on the thread's first zone. The buffer is owned by the profiler, so it outlives the thread and
+    // job threads that have already exited still end up in the trace.
+    static thread_local ThreadEvents* local = nullptr;
+
+    if (local == nullptr) {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        threads.push_back(std::make_unique<ThreadEvents>());
+        local = threads.back().get();
+        local->thread = static_cast<uint32_t>(threads.size() - 1);
+        local->events.reserve(4096);
+    }
+    return *local;
+}
+
+int64_t Profiler::sinceStart(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - startTime).count();
+}
+
+int64_t Profiler::hostNanoseconds(Clock::time_point time) const {
+
+    // steady_clock is CLOCK_MONOTONIC on Linux and QueryPerformanceCounter on Windows, the same clocks the
+    // calibrated host domains sample
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+void Profiler::addCpuZone(const char* name, Clock::time_point start, Clock::time_point end) {
+
+    ThreadEvents& local = localEvents();
+    if (local.events.size() >= maxEventsPerThread) {
+        droppedCpuZones.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    local.events.push_back({ name, sinceStart(start), sinceStart(end) });
+}
+
+void Profiler::createGpu(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue,
+    uint32_t queueFamily, uint32_t framesInFlight, bool calibratedTimestamps, bool hostQueryReset,
+    const VkAllocationCallbacks* allocationCallbacks) {
+
+    if (!isEnabled()) return;
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // Zero valid bits means the queue can't write timestamps at all
+    uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+    if (validBits == 0) {
+        std::clog << "Queue family " << queueFamily << " has no timestamp support, GPU zones are off\n";
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = framesInFlight * queriesPerFrame;
+
+    if (vkCreateQueryPool(device, &poolInfo, allocationCallbacks, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+
+    // Queries start out undefined and must be reset before their first write
+    resetFromHost = hostQueryReset;
+    if (resetFromHost) {
+        vkResetQueryPool(device, queryPool, 0, poolInfo.queryCount);
+    }
+
+    gpuFrames.assign(framesInFlight, GpuFrame{});
+    for (GpuFrame& frame : gpuFrames) {
+        frame.names.reserve(maxGpuZonesPerFrame);
+    }
+    queryResults.resize(queriesPerFrame);
+    gpuProfiled = true;
+
+    // The device and our host clock both have to be calibrateable. The host domain is whichever one steady_clock
+    // reads, see hostNanoseconds.
+#ifdef _WIN32
+    hostDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+    hostDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+    if (calibratedTimestamps) {
+        auto getTimeDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(instance,
+            "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+
+        uint32_t domainCount = 0;
+        std::vector<VkTimeDomainEXT> domains;
+        if (getTimeDomains != nullptr && getTimeDomains(physicalDevice, &domainCount, nullptr) == VK_SUCCESS) {
+            domains.resize(domainCount);
+            getTimeDomains(physicalDevice, &domainCount, domains.data());
+        }
+
+        bool hasDevice = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+        bool hasHost = std::find(domains.begin(), domains.end(), hostDomain) != domains.end();
+
+        if (hasDevice && hasHost) {
+            getCalibratedTimestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+        }
+    }
+
+    if (getCalibratedTimestamps != nullptr) {
+        calibrate();
+    }
+
+    // Either the extension isn't there or every attempt to use it failed
+    if (calibrations == 0) {
+        getCalibratedTimestamps = nullptr;
+        calibrateWithSubmit(queue, queueFamily);
+    }
+}
+
+void Profiler::calibrate() {
+
+    VkCalibratedTimestampInfoEXT infos[2]{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = hostDomain;
+
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+#endif
+
+    // The driver reads the two clocks one after the other and reports how far apart that was. Getting preempted
+    // in between makes for a bad sample, so take the best of a few.
+    uint64_t bestDeviation = UINT64_MAX;
+
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint64_t timestamps[2];
+        uint64_t deviation = 0;
+
+        if (getCalibratedTimestamps(device, 2, infos, timestamps, &deviation) != VK_SUCCESS) continue;
+        if (deviation >= bestDeviation) continue;
+
+        bestDeviation = deviation;
+        calibrationTicks = timestamps[0] & timestampMask;
+#ifdef _WIN32
+        calibrationHost = static_cast<int64_t>(static_cast<double>(timestamps[1]) * 1e9 / static_cast<double>(frequency.QuadPart));
+#else
+        calibrationHost = static_cast<int64_t>(timestamps[1]);
+#endif
+    }
+
+    if (bestDeviation == UINT64_MAX) return;
+
+    calibrationError = static_cast<double>(bestDeviation) / 2.0;
+    calibrations++;
+}
+
+void Profiler::calibrateWithSubmit(VkQueue queue, uint32_t queueFamily) {
+
+    // Submit nothing but one timestamp and note the time either side of it. The GPU wrote it somewhere in between,
+    // so the midpoint is off by at most half the round trip.
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create calibration command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate calibration command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(device, &fenceInfo, allocationCallbacks, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create calibration fence!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording calibration command buffer!");
+    }
+
+    // Borrows the first query, which frame slot 0 resets again before using it
+    if (!resetFromHost) {
+        vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record calibration command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    Clock::time_point before = Clock::now();
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit calibration timestamp!");
+    }
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    Clock::time_point after = Clock::now();
+
+    uint64_t ticks = 0;
+    if (vkGetQueryPoolResults(device, queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+        throw std::runtime_error("failed to read calibration timestamp!");
+    }
+
+    int64_t roundTrip = hostNanoseconds(after) - hostNanoseconds(before);
+    calibrationTicks = ticks & timestampMask;
+    calibrationHost = hostNanoseconds(before) + roundTrip / 2;
+    calibrationError = static_cast<double>(roundTrip) / 2.0;
+
+    vkDestroyFence(device, fence, allocationCallbacks);
+    vkDestroyCommandPool(device, commandPool, allocationCallbacks);
+}
+
+int64_t Profiler::gpuToHost(uint64_t ticks) const {
+
+    // Counters narrower than 64 bits wrap, so the distance to the calibration point is taken modulo the counter
+    // width and read as signed, which keeps timestamps from just before a calibration correct too
+    uint64_t delta = (ticks - calibrationTicks) & timestampMask;
+    int64_t signedDelta = delta > timestampMask / 2 ? -static_cast<int64_t>((timestampMask - delta) + 1) : static_cast<int64_t>(delta);
+
+    return calibrationHost + static_cast<int64_t>(static_cast<double>(signedDelta) * timestampPeriod) - hostNanoseconds(startTime);
+}
+
+void Profiler::collectGpuFrame(uint32_t frameIndex) {
+
+    GpuFrame& frame = gpuFrames[frameIndex];
+    if (!frame.pending) return;
+    frame.pending = false;
+
+    uint32_t queryCount = static_cast<uint32_t>(frame.names.size() * 2);
+
+    // No WAIT flag. The frame's fence has signalled by the time its slot comes around again, so everything should
+    // be there, and if it isn't (a zone that was never ended) the frame is dropped rather than stalling on it.
+    VkResult result = vkGetQueryPoolResults(device, queryPool, frameIndex * queriesPerFrame, queryCount,
+        queryCount * sizeof(uint64_t), queryResults.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_NOT_READY) {
+        notReadyFrames++;
+        return;
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to read back timestamp queries!");
+    }
+
+    for (size_t zone = 0; zone < frame.names.size(); zone++) {
+        gpuEvents.push_back({ frame.names[zone], gpuToHost(queryResults[zone * 2]), gpuToHost(queryResults[zone * 2 + 1]) });
+    }
+}
+
+void Profiler::beginGpuFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+
+    if (queryPool == VK_NULL_HANDLE) return;
+
+    collectGpuFrame(frameIndex);
+
+    if (getCalibratedTimestamps != nullptr && ++gpuFramesSinceCalibration >= recalibrationInterval) {
+        calibrate();
+        gpuFramesSinceCalibration = 0;
+    }
+
+    // Queries have to be reset before they're written again. The frame's fence has signalled, so nothing on the GPU
+    // uses this range any more and the host can reset it right away, which keeps the reset out of the GPU's work.
+    // Without hostQueryReset it goes in the frame's own command buffer, ordered with the writes that follow.
+    if (resetFromHost) {
+        vkResetQueryPool(device, queryPool, frameIndex * queriesPerFrame, queriesPerFrame);
+    }
+    else {
+        vkCmdResetQueryPool(commandBuffer, queryPool, frameIndex * queriesPerFrame, queriesPerFrame);
+    }
+
+    gpuFrames[frameIndex].names.clear();
+    currentGpuFrame = frameIndex;
+    gpuFrameOpen = true;
+}
+
+uint32_t Profiler::beginGpuZone(VkCommandBuffer commandBuffer, const char* name) {
+
+    if (!gpuFrameOpen) return noZone;
+
+    GpuFrame& frame = gpuFrames[currentGpuFrame];
+    if (frame.names.size() == maxGpuZonesPerFrame) {
+        droppedGpuZones++;
+        return noZone;
+    }
+
+    uint32_t zone = static_cast<uint32_t>(frame.names.size());
+    frame.names.push_back(name);
+    frame.pending = true;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, currentGpuFrame * queriesPerFrame + zone * 2);
+    return zone;
+}
+
+void Profiler::endGpuZone(VkCommandBuffer commandBuffer, uint32_t zone) {
+
+    if (zone == noZone) return;
+
+    // BOTTOM_OF_PIPE: written once everything recorded before it has finished
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, currentGpuFrame * queriesPerFrame + zone * 2 + 1);
+}
+
+void Profiler::destroyGpu() {
+
+    if (queryPool == VK_NULL_HANDLE) return;
+
+    for (uint32_t frameIndex = 0; frameIndex < gpuFrames.size(); frameIndex++) {
+        collectGpuFrame(frameIndex);
+    }
+
+    vkDestroyQueryPool(device, queryPool, allocationCallbacks);
+    queryPool = VK_NULL_HANDLE;
+    gpuFrameOpen = false;
+}
+
+// Zone names are ours, but escape them anyway so a stray quote can't break the whole file
+static void writeJsonString(std::ostream& out, const char* text) {
+
+    out << '"';
+    for (const char* c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') out << '\\' << *c;
+        else if (static_cast<unsigned char>(*c) < 0x20) out << ' ';
+        else out << *c;
+    }
+    out << '"';
+}
+
+void Profiler::writeChromeTrace() const {
+
+    if (!isEnabled() || tracePath.empty()) return;
+
+    std::ofstream file(tracePath, std::ios::trunc);
+    if (!file) {
+        std::clog << "Failed to write profile trace " << tracePath << "\n";
+        return;
+    }
+
+    // The GPU gets a track of its own after all the CPU threads
+    uint32_t gpuTrack = static_cast<uint32_t>(threads.size());
+
+    // Complete ("X") events in microseconds. Fractions are kept, since plenty of zones are shorter than one.
+    auto writeEvent = [&](const Event& event, uint32_t track, const char* category) {
+        file << ",\n{\"name\":";
+        writeJsonString(file, event.name);
+        file << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track
+            << ",\"ts\":" << static_cast<double>(event.start) / 1000.0
+            << ",\"dur\":" << static_cast<double>(event.end - event.start) / 1000.0 << "}";
+    };
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Vulkan Test\"}}";
+
+    std::lock_guard<std::mutex> lock(threadsMutex);
+
+    for (const auto& thread : threads) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->thread
+            << ",\"args\":{\"name\":\"" << (thread->thread == 0 ? std::string("main") : "thread " + std::to_string(thread->thread)) << "\"}}";
+        for (const Event& event : thread->events) {
+            writeEvent(event, thread->thread, "cpu");
+        }
+    }
+
+    if (!gpuEvents.empty()) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpuTrack
+            << ",\"args\":{\"name\":\"GPU (graphics queue)\"}}";
+        for (const Event& event : gpuEvents) {
+            writeEvent(event, gpuTrack, "gpu");
+        }
+    }
+
+    file << "\n]}\n";
+
+    if (!file.flush()) {
+        std::clog << "Failed to write profile trace " << tracePath << "\n";
+    }
+}
+
+void Profiler::report(std::ostream& out) const {
+
+    if (!isEnabled()) return;
+
+    struct Totals {
+        uint64_t count = 0;
+        double total = 0.0;     // Milliseconds
+        double max = 0.0;
+    };
+
+    auto summarize = [](const std::vector<Event>& events, std::map<std::string, Totals>& totals) {
+        for (const Event& event : events) {
+            Totals& zone = totals[event.name];
+            double milliseconds = static_cast<double>(event.end - event.start) / 1e6;
+            zone.count++;
+            zone.total += milliseconds;
+            zone.max = std::max(zone.max, milliseconds);
+        }
+    };
+
+    // Busiest zones first
+    auto print = [&](const char* title, const std::map<std::string, Totals>& totals) {
+        std::vector<std::pair<std::string, Totals>> sorted(totals.begin(), totals.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+
+        out << "    " << std::left << std::setw(32) << title << std::right << std::setw(8) << "count" << std::setw(12) << "total ms"
+            << std::setw(11) << "mean ms" << std::setw(11) << "max ms" << "\n";
+        for (const auto& [name, zone] : sorted) {
+            out << "      " << std::left << std::setw(30) << name << std::right << std::setw(8) << zone.count
+                << std::setw(12) << zone.total << std::setw(11) << zone.total / static_cast<double>(zone.count)
+                << std::setw(11) << zone.max << "\n";
+        }
+    };
+
+    std::map<std::string, Totals> cpuTotals, gpuTotals;
+    size_t cpuZones = 0, threadCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        threadCount = threads.size();
+        for (const auto& thread : threads) {
+            summarize(thread->events, cpuTotals);
+            cpuZones += thread->events.size();
+        }
+    }
+    summarize(gpuEvents, gpuTotals);
+
+    out << std::fixed << std::setprecision(3)
+        << "\nProfiler: " << cpuZones << " CPU zones on " << threadCount << " threads, " << gpuEvents.size() << " GPU zones";
+    if (!tracePath.empty()) {
+        out << ", trace in " << tracePath;
+    }
+    out << "\n";
+
+    if (!gpuProfiled) {
+        out << "    GPU clock: not profiled\n";
+    }
+    else if (calibrations > 0) {
+        out << "    GPU clock: VK_EXT_calibrated_timestamps, " << calibrations << " calibrations, +-"
+            << calibrationError / 1000.0 << " us\n";
+    }
+    else {
+        out << "    GPU clock: matched once by submit, +-" << calibrationError / 1000.0 << " us\n";
+    }
+    if (gpuProfiled) {
+        out << "    queries reset " << (resetFromHost ? "from the host" : "in each frame's command buffer") << "\n";
+    }
+
+    if (droppedCpuZones > 0 || droppedGpuZones > 0 || notReadyFrames > 0) {
+        out << "    dropped " << droppedCpuZones.load() << " CPU zones, " << droppedGpuZones << " GPU zones, "
+            << notReadyFrames << " GPU frames not ready\n";
+    }
+
+    print("CPU", cpuTotals);
+    if (!gpuTotals.empty()) {
+        print("GPU", gpuTotals);
+    }
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,178 @@
+// profiler.h
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "include.h"
+
+// CPU and GPU zone profiler with Chrome trace export (load the file in chrome://tracing or ui.perfetto.dev).
+//
+// CPU zones are scoped: PROFILE_ZONE("name") times the rest of the enclosing block on whatever thread runs it.
+// When profiling is off, a zone costs one relaxed atomic load. Defining VKTEST_NO_PROFILER removes them completely.
+// Each thread appends to its own event buffer, so zones on job threads never contend with each other.
+//
+// GPU zones are a pair of vkCmdWriteTimestamp queries. Every frame in flight has its own range of the query pool,
+// and a range is only read back when its frame slot comes around again. By then the frame's fence has signalled,
+// so vkGetQueryPoolResults never waits.
+//
+// GPU timestamps count in device ticks, on a clock that has nothing to do with the CPU's. With
+// VK_EXT_calibrated_timestamps the two are sampled together and re-sampled every so often, which keeps drift out
+// of long traces. Without it (lavapipe, some mobile drivers) the GPU clock is matched once at startup against a
+// one-timestamp submit, accurate to half the submit round trip, which the report prints.
+//
+// Names must be string literals or otherwise outlive the profiler. They're stored as pointers.
+
+class Profiler {
+
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	// Turns on recording. Zones opened before this aren't recorded.
+	void enable(std::string tracePath);
+	bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	void addCpuZone(const char* name, Clock::time_point start, Clock::time_point end);
+
+	// GPU zones need a device, so they're set up separately once there is one. Timestamps are written on
+	// queue, from command buffers of queueFamily. calibratedTimestamps and hostQueryReset say whether
+	// VK_EXT_calibrated_timestamps and Vulkan 1.2's hostQueryReset were enabled on the device.
+	void createGpu(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue,
+		uint32_t queueFamily, uint32_t framesInFlight, bool calibratedTimestamps, bool hostQueryReset,
+		const VkAllocationCallbacks* allocationCallbacks);
+
+	// Reads back whatever is still pending, so call it once the device is idle
+	void destroyGpu();
+
+	// Call right after beginning a frame slot's command buffer, once its fence has signalled. Collects what that
+	// slot recorded last time and resets its queries.
+	void beginGpuFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	// Returns a handle for endGpuZone. Does nothing (and returns noZone) when GPU profiling is off or the frame
+	// ran out of queries.
+	uint32_t beginGpuZone(VkCommandBuffer commandBuffer, const char* name);
+	void endGpuZone(VkCommandBuffer commandBuffer, uint32_t zone);
+
+	static constexpr uint32_t noZone = UINT32_MAX;
+
+	// Writes the trace to the path given to enable(). Every thread that recorded zones must be done by then.
+	void writeChromeTrace() const;
+	void report(std::ostream& out) const;
+
+private:
+
+	struct Event {
+		const char* name;
+		int64_t start;          // Nanoseconds since enable()
+		int64_t end;
+	};
+
+	struct ThreadEvents {
+		uint32_t thread = 0;
+		std::vector<Event> events;
+	};
+
+	struct GpuFrame {
+		std::vector<const char*> names;     // Zone i uses queries 2i and 2i + 1 of the frame's range
+		bool pending = false;
+	};
+
+	ThreadEvents& localEvents();
+	int64_t sinceStart(Clock::time_point time) const;
+	int64_t hostNanoseconds(Clock::time_point time) const;
+	int64_t gpuToHost(uint64_t ticks) const;
+	void calibrate();
+	void calibrateWithSubmit(VkQueue queue, uint32_t queueFamily);
+	void collectGpuFrame(uint32_t frameIndex);
+
+	std::atomic<bool> enabled{ false };
+	std::string tracePath;
+	Clock::time_point startTime;
+
+	mutable std::mutex threadsMutex;
+	std::vector<std::unique_ptr<ThreadEvents>> threads;
+	std::atomic<uint64_t> droppedCpuZones{ 0 };
+
+	// GPU side. Only touched from the thread that records frames.
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	std::vector<GpuFrame> gpuFrames;
+	uint32_t currentGpuFrame = 0;
+	bool gpuFrameOpen = false;
+	std::vector<uint64_t> queryResults;
+	std::vector<Event> gpuEvents;
+	bool gpuProfiled = false;
+	bool resetFromHost = false;         // vkResetQueryPool instead of recording vkCmdResetQueryPool
+	uint64_t droppedGpuZones = 0;
+	uint64_t notReadyFrames = 0;
+	uint64_t gpuFramesSinceCalibration = 0;
+
+	double timestampPeriod = 1.0;       // Nanoseconds per tick
+	uint64_t timestampMask = ~0ull;
+	PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+	VkTimeDomainEXT hostDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+	uint64_t calibrationTicks = 0;      // A GPU timestamp and the host time it was taken at
+	int64_t calibrationHost = 0;
+	double calibrationError = 0.0;      // Nanoseconds, either way
+	uint32_t calibrations = 0;
+};
+
+extern Profiler profiler;
+
+// Times the enclosing scope. Use through PROFILE_ZONE.
+class ProfileZone {
+
+public:
+
+	explicit ProfileZone(const char* name) : name(profiler.isEnabled() ? name : nullptr) {
+		if (this->name != nullptr) start = Profiler::Clock::now();
+	}
+	~ProfileZone() {
+		if (name != nullptr) profiler.addCpuZone(name, start, Profiler::Clock::now());
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+
+	const char* name;
+	Profiler::Clock::time_point start;
+};
+
+// Brackets everything recorded into commandBuffer for the rest of the enclosing scope with two timestamps
+class GpuProfileZone {
+
+public:
+
+	GpuProfileZone(VkCommandBuffer commandBuffer, const char* name)
+		: commandBuffer(commandBuffer), zone(profiler.beginGpuZone(commandBuffer, name)) {}
+	~GpuProfileZone() { profiler.endGpuZone(commandBuffer, zone); }
+
+	GpuProfileZone(const GpuProfileZone&) = delete;
+	GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+private:
+
+	VkCommandBuffer commandBuffer;
+	uint32_t zone;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef VKTEST_NO_PROFILER
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(commandBuffer, name)
+#else
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(commandBuffer, name) GpuProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__)(commandBuffer, name)
+#endif
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <optional>
 
 struct QueueFamilyIndices {
@@ -9,8 +10,21 @@ struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily; // Queue families that support Vulkan graphics
     std::optional<uint32_t> presentFamily; // Queue families that support presentation to a surface
 
+    // Compute and transfer prefer families that can't do graphics, so their work overlaps with rendering.
+    // If the device has no such family these fall back to a shared one (at worst the graphics family).
+    std::optional<uint32_t> computeFamily;
+    std::optional<uint32_t> transferFamily;
+
     bool isComplete() {
         // Use has_value() to determine if an optional-type variable has a value
         return graphicsFamily.has_value() && presentFamily.has_value();
     }
-};
\ No newline at end of file
+
+    bool hasDedicatedCompute() const {
+        return computeFamily.has_value() && computeFamily != graphicsFamily;
+    }
+
+    bool hasDedicatedTransfer() const {
+        return transferFamily.has_value() && transferFamily != graphicsFamily && transferFamily != computeFamily;
+    }
+};
@@ -0,0 +1,186 @@
+// record-benchmark.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "frame-stats.h"
+#include "job-system.h"
+#include "parallel-recorder.h"
+
+// How command recording scales with thread count. A synthetic scene of recordBenchmarkDraws draws is split into
+// secondary command buffers, recorded across 1, 2, 4, ... threads, and executed from one primary in one submit.
+//
+// There's no graphics pipeline yet, so a "draw" is the per-draw state a real one would set (viewport, scissor,
+// stencil reference, blend constants). That's still driver work per command, which is what's being measured.
+// Only recording is timed; submission and the GPU wait are not.
+
+static constexpr uint32_t drawsPerSecondary = 256;
+static constexpr uint32_t warmupFrames = 5;
+static constexpr uint32_t measuredFrames = 50;
+
+static void recordSyntheticDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount, VkExtent2D extent) {
+
+    for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; draw++) {
+
+        // Vary everything a little so no driver can collapse repeated identical state
+        float shift = static_cast<float>(draw % 16);
+
+        VkViewport viewport{};
+        viewport.x = shift;
+        viewport.y = shift;
+        viewport.width = static_cast<float>(extent.width) - shift;
+        viewport.height = static_cast<float>(extent.height) - shift;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = { static_cast<int32_t>(draw % 16), 0 };
+        scissor.extent = extent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        vkCmdSetStencilReference(commandBuffer, VK_STENCIL_FACE_FRONT_AND_BACK, draw & 0xff);
+
+        const float blendConstants[4] = { shift / 16.0f, 0.0f, 0.0f, 1.0f };
+        vkCmdSetBlendConstants(commandBuffer, blendConstants);
+    }
+}
+
+FrameStats Application::measureRecording(uint32_t threads, uint32_t drawCount) {
+
+    const VkAllocationCallbacks* callbacks = hostAllocator.callbacks(HostSubsystem::Device);
+    const uint32_t secondaryCount = (drawCount + drawsPerSecondary - 1) / drawsPerSecondary;
+    const VkExtent2D extent = { WIDTH, HEIGHT };
+
+    // The primary and its fence. The pool is reset as a whole every frame, like the recorder's.
+    VkCommandPool primaryPool;
+    VkCommandBuffer primary;
+    VkFence fence;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+    if (vkCreateCommandPool(device, &poolInfo, callbacks, &primaryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create benchmark command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = primaryPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &primary) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate benchmark command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(device, &fenceInfo, callbacks, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create benchmark fence!");
+    }
+
+    // Secondaries outside a render pass still need inheritance info, it's just empty
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+
+    JobSystem jobs(threads);
+    ParallelRecorder recorder;
+    recorder.create(device, queueFamilyIndices.graphicsFamily.value(), threads, 1, callbacks);
+
+    FrameStats recordTime("record");
+    recordTime.reserve(measuredFrames);
+
+    for (uint32_t frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+
+        recorder.beginFrame(0);
+        vkResetCommandPool(device, primaryPool, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(primary, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording benchmark command buffer!");
+        }
+
+        recorder.record(jobs, primary, secondaryCount, inheritance, 0, [&](VkCommandBuffer commandBuffer, uint32_t secondary) {
+            uint32_t firstDraw = secondary * drawsPerSecondary;
+            recordSyntheticDraws(commandBuffer, firstDraw, std::min(drawsPerSecondary, drawCount - firstDraw), extent);
+        });
+
+        if (vkEndCommandBuffer(primary) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record benchmark command buffer!");
+        }
+
+        if (frame >= warmupFrames) {
+            recordTime.add(elapsedMilliseconds(start, std::chrono::steady_clock::now()));
+        }
+
+        // Every thread's work goes out in this one submit
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &primary;
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit benchmark frame!");
+        }
+        vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(device, 1, &fence);
+    }
+
+    recorder.destroy();
+    vkDestroyFence(device, fence, callbacks);
+    vkDestroyCommandPool(device, primaryPool, callbacks);
+
+    return recordTime;
+}
+
+uint32_t Application::recordingThreads() const {
+    return workerThreads > 0 ? workerThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void Application::runRecordBenchmark() {
+
+    const uint32_t drawCount = recordBenchmarkDraws;
+    const uint32_t secondaryCount = (drawCount + drawsPerSecondary - 1) / drawsPerSecondary;
+
+    std::vector<uint32_t> threadCounts;
+    uint32_t maxThreads = recordingThreads();
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "\nRecord benchmark: " << drawCount << " draws in " << secondaryCount << " secondary command buffers, "
+        << measuredFrames << " frames per thread count\n"
+        << "    threads    mean ms     p95 ms   draws/ms   speedup\n";
+
+    double singleThreaded = 0.0;
+
+    for (uint32_t threads : threadCounts) {
+        FrameStats recordTime = measureRecording(threads, drawCount);
+
+        double mean = recordTime.mean();
+        if (threads == 1) {
+            singleThreaded = mean;
+        }
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "    " << std::setw(7) << threads << std::setw(11) << mean << std::setw(11) << recordTime.percentile(95.0)
+            << std::setw(11) << std::setprecision(0) << (mean > 0.0 ? drawCount / mean : 0.0)
+            << std::setw(9) << std::setprecision(2) << (mean > 0.0 ? singleThreaded / mean : 0.0) << "x\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
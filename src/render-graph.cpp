@@ -0,0 +1,575 @@
+// render-graph.cpp
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include "render-graph.h"
+#include "profiler.h"
+
+// Every stage and access used here has the same value in the synchronization2 flags as in the original ones, so
+// without synchronization2 a batch's masks can simply be narrowed to VkPipelineStageFlags and VkAccessFlags.
+
+RenderGraph::Pass& RenderGraph::Pass::read(GraphImage image, GraphAccess access) {
+
+    uses.push_back({ image, access });
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::write(GraphImage image, GraphAccess access) {
+
+    uses.push_back({ image, access });
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::sideEffects() {
+
+    keep = true;
+    return *this;
+}
+
+bool RenderGraph::TransientShape::operator==(const TransientShape& other) const {
+
+    return format == other.format && extent.width == other.extent.width && extent.height == other.extent.height &&
+        usage == other.usage && aspect == other.aspect && firstPass == other.firstPass && lastPass == other.lastPass;
+}
+
+RenderGraph::AccessInfo RenderGraph::accessInfo(GraphAccess access) {
+
+    switch (access) {
+    case GraphAccess::ColorAttachmentWrite:
+        return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true };
+    case GraphAccess::DepthAttachmentWrite:
+        return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true };
+    case GraphAccess::DepthAttachmentRead:
+        return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, false };
+    case GraphAccess::SampledRead:
+        return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false };
+    case GraphAccess::StorageRead:
+        return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_USAGE_STORAGE_BIT, false };
+    case GraphAccess::StorageWrite:
+        return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_USAGE_STORAGE_BIT, true };
+    case GraphAccess::TransferRead:
+        return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false };
+    case GraphAccess::TransferWrite:
+        return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT, true };
+    }
+    throw std::invalid_argument("unknown render graph access!");
+}
+
+void RenderGraph::create(VkDevice device, DeviceAllocator& allocator, const DeviceCapabilities& capabilities,
+    DeferredDestruction& deferred, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocator = &allocator;
+    this->deferred = &deferred;
+    this->allocationCallbacks = allocationCallbacks;
+
+    // Core in 1.3, the KHR entry point on older devices that have the extension
+    if (capabilities.synchronization2) {
+        pipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2");
+        if (pipelineBarrier2 == nullptr) {
+            pipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR");
+        }
+    }
+}
+
+void RenderGraph::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+    // The device is idle by now, so nothing has to wait for its frame
+    retirePhysicalImages(true);
+    images.clear();
+    passes.clear();
+    device = VK_NULL_HANDLE;
+}
+
+void RenderGraph::begin() {
+
+    images.clear();
+    passes.clear();
+}
+
+GraphImage RenderGraph::importImage(VkImage image, VkImageView view, VkImageAspectFlags aspect,
+    VkImageLayout initialLayout, VkPipelineStageFlags2 readyStage, VkImageLayout finalLayout) {
+
+    Image imported;
+    imported.imported = true;
+    imported.image = image;
+    imported.view = view;
+    imported.aspect = aspect;
+    imported.finalLayout = finalLayout;
+    imported.initial.layout = initialLayout;
+    imported.initial.writeStages = readyStage;
+    images.push_back(imported);
+    return static_cast<GraphImage>(images.size() - 1);
+}
+
+GraphImage RenderGraph::createImage(VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect) {
+
+    Image transient;
+    transient.format = format;
+    transient.extent = extent;
+    transient.aspect = aspect;
+    images.push_back(transient);
+    return static_cast<GraphImage>(images.size() - 1);
+}
+
+RenderGraph::Pass& RenderGraph::addPass(const char* name, Execute execute) {
+
+    // Only good until the next addPass, which may move the passes
+    passes.emplace_back();
+    Pass& pass = passes.back();
+    pass.name = name;
+    pass.execute = std::move(execute);
+    return pass;
+}
+
+void RenderGraph::cull() {
+
+    // Backwards, so by the time a pass is looked at everything that could read what it writes has been decided
+    std::vector<char> kept(passes.size(), 0);
+    neededImages.assign(images.size(), 0);
+
+    for (size_t index = passes.size(); index-- > 0;) {
+        const Pass& pass = passes[index];
+        bool keep = pass.keep;
+        for (const Pass::Use& use : pass.uses) {
+            if (accessInfo(use.access).writes && (images[use.image].imported || neededImages[use.image])) {
+                keep = true;
+            }
+        }
+        if (!keep) continue;
+
+        kept[index] = 1;
+        for (const Pass::Use& use : pass.uses) {
+            if (!accessInfo(use.access).writes) {
+                neededImages[use.image] = 1;
+            }
+        }
+    }
+
+    keptPasses.clear();
+    for (uint32_t index = 0; index < passes.size(); index++) {
+        if (kept[index]) keptPasses.push_back(index);
+    }
+}
+
+void RenderGraph::placeTransients() {
+
+    // Lifetimes and usage, from the kept passes only
+    for (uint32_t position = 0; position < keptPasses.size(); position++) {
+        for (const Pass::Use& use : passes[keptPasses[position]].uses) {
+            Image& image = images[use.image];
+            if (image.imported) continue;
+            image.firstPass = std::min(image.firstPass, position);
+            image.lastPass = std::max(image.lastPass, position);
+            image.usage |= accessInfo(use.access).usage;
+        }
+    }
+
+    shapes.clear();
+    for (Image& image : images) {
+        if (image.imported || image.firstPass == UINT32_MAX) continue;
+        image.physical = static_cast<uint32_t>(shapes.size());
+        shapes.push_back({ image.format, image.extent, image.usage, image.aspect, image.firstPass, image.lastPass });
+    }
+
+    bool sameShape = shapes.size() == physicalImages.size();
+    for (size_t index = 0; sameShape && index < shapes.size(); index++) {
+        sameShape = shapes[index] == physicalImages[index].shape;
+    }
+    if (!sameShape) {
+        retirePhysicalImages(false);
+        buildPhysicalImages();
+        rebuilds++;
+    }
+
+    for (Image& image : images) {
+        if (image.imported || image.physical == UINT32_MAX) continue;
+        image.image = physicalImages[image.physical].image;
+        image.view = physicalImages[image.physical].view;
+    }
+}
+
+void RenderGraph::buildPhysicalImages() {
+
+    physicalImages.resize(shapes.size());
+    for (size_t index = 0; index < shapes.size(); index++) {
+        PhysicalImage& physical = physicalImages[index];
+        physical.shape = shapes[index];
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = physical.shape.format;
+        imageInfo.extent = { physical.shape.extent.width, physical.shape.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = physical.shape.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(device, &imageInfo, allocationCallbacks, &physical.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transient image!");
+        }
+        vkGetImageMemoryRequirements(device, physical.image, &physical.requirements);
+    }
+
+    // Largest first, so each slot is sized by the first image placed in it and the smaller ones fit in after
+    std::vector<uint32_t> order(shapes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return physicalImages[a].requirements.size > physicalImages[b].requirements.size;
+    });
+
+    for (uint32_t index : order) {
+        PhysicalImage& physical = physicalImages[index];
+        const VkMemoryRequirements& requirements = physical.requirements;
+
+        auto fits = [&](const MemorySlot& slot) {
+            if (requirements.size > slot.allocation.size) return false;
+            if ((requirements.memoryTypeBits & (1u << slot.allocation.memoryType)) == 0) return false;
+            if (slot.allocation.offset % requirements.alignment != 0) return false;
+            for (uint32_t other : slot.images) {
+                const TransientShape& shape = physicalImages[other].shape;
+                if (shape.firstPass <= physical.shape.lastPass && physical.shape.firstPass <= shape.lastPass) return false;
+            }
+            return true;
+        };
+
+        auto slot = std::find_if(slots.begin(), slots.end(), fits);
+        if (slot == slots.end()) {
+            MemorySlot created;
+            created.allocation = allocator->allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                ResourceKind::Optimal);
+            slots.push_back(std::move(created));
+            slot = slots.end() - 1;
+        }
+        slot->images.push_back(index);
+        physical.slot = static_cast<uint32_t>(slot - slots.begin());
+
+        if (vkBindImageMemory(device, physical.image, slot->allocation.memory, slot->allocation.offset) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind transient image memory!");
+        }
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = physical.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = physical.shape.format;
+        viewInfo.subresourceRange.aspectMask = physical.shape.aspect;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, allocationCallbacks, &physical.view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transient image view!");
+        }
+    }
+
+    // In lifetime order, which is the order the memory changes hands in
+    for (MemorySlot& slot : slots) {
+        std::sort(slot.images.begin(), slot.images.end(), [this](uint32_t a, uint32_t b) {
+            return physicalImages[a].shape.firstPass < physicalImages[b].shape.firstPass;
+        });
+    }
+}
+
+void RenderGraph::retirePhysicalImages(bool now) {
+
+    if (physicalImages.empty() && slots.empty()) return;
+
+    // Frames recorded before this one may still be on the GPU with them
+    auto destroy = [device = device, allocator = allocator, callbacks = allocationCallbacks,
+        images = std::move(physicalImages), slots = std::move(slots)]() mutable {
+        for (PhysicalImage& physical : images) {
+            vkDestroyImageView(device, physical.view, callbacks);
+            vkDestroyImage(device, physical.image, callbacks);
+        }
+        for (MemorySlot& slot : slots) {
+            allocator->free(slot.allocation);
+        }
+    };
+    physicalImages.clear();
+    slots.clear();
+
+    if (now) {
+        destroy();
+    }
+    else {
+        deferred->defer(std::move(destroy));
+    }
+}
+
+void RenderGraph::addBarriers(BarrierBatch* batch, GraphImage index, ImageState& state, const AccessInfo& info) {
+
+    const Image& image = images[index];
+
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.dstStageMask = info.stages;
+    barrier.dstAccessMask = info.access;
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = info.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.image;
+    barrier.subresourceRange.aspectMask = image.aspect;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    if (state.layout != info.layout || info.writes) {
+
+        // Writes and layout transitions wait for everything since the last write: read after write, write after
+        // read and write after write all at once
+        barrier.srcStageMask = state.writeStages | state.readStages;
+        barrier.srcAccessMask = state.writeAccess;
+        if (batch != nullptr && (state.layout != info.layout || barrier.srcStageMask != 0)) {
+            batch->images.push_back(barrier);
+        }
+
+        // A layout transition counts as a write, and is already visible to this access
+        state.layout = info.layout;
+        state.writeStages = info.stages;
+        state.writeAccess = info.writes ? info.access : 0;
+        state.readStages = info.writes ? 0 : info.stages;
+        state.visibleStages = info.writes ? 0 : info.stages;
+        state.visibleAccess = info.writes ? 0 : info.access;
+        return;
+    }
+
+    // A read in the layout the image already has only needs the last write made visible to it, once per stage
+    bool visible = (info.stages & ~state.visibleStages) == 0 && (info.access & ~state.visibleAccess) == 0;
+    if (state.writeStages != 0 && !visible) {
+        barrier.srcStageMask = state.writeStages;
+        barrier.srcAccessMask = state.writeAccess;
+        if (batch != nullptr) {
+            batch->images.push_back(barrier);
+        }
+        state.visibleStages |= info.stages;
+        state.visibleAccess |= info.access;
+    }
+    state.readStages |= info.stages;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) {
+
+    bool aliasing = batch.memory.srcStageMask != 0;
+    if (batch.images.empty() && !aliasing) return;
+
+    barrierCalls++;
+    imageBarriers += batch.images.size();
+    memoryBarriers += aliasing ? 1 : 0;
+
+    if (pipelineBarrier2 != nullptr) {
+        VkDependencyInfo dependency{};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.memoryBarrierCount = aliasing ? 1 : 0;
+        dependency.pMemoryBarriers = &batch.memory;
+        dependency.imageMemoryBarrierCount = static_cast<uint32_t>(batch.images.size());
+        dependency.pImageMemoryBarriers = batch.images.data();
+        pipelineBarrier2(commandBuffer, &dependency);
+        return;
+    }
+
+    // One pair of stage masks for the whole call, so every barrier in it waits on all of the batch's sources
+    VkPipelineStageFlags srcStages = static_cast<VkPipelineStageFlags>(batch.memory.srcStageMask);
+    VkPipelineStageFlags dstStages = static_cast<VkPipelineStageFlags>(batch.memory.dstStageMask);
+
+    legacyBarriers.clear();
+    for (const VkImageMemoryBarrier2& image : batch.images) {
+        srcStages |= static_cast<VkPipelineStageFlags>(image.srcStageMask);
+        dstStages |= static_cast<VkPipelineStageFlags>(image.dstStageMask);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = static_cast<VkAccessFlags>(image.srcAccessMask);
+        barrier.dstAccessMask = static_cast<VkAccessFlags>(image.dstAccessMask);
+        barrier.oldLayout = image.oldLayout;
+        barrier.newLayout = image.newLayout;
+        barrier.srcQueueFamilyIndex = image.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = image.dstQueueFamilyIndex;
+        barrier.image = image.image;
+        barrier.subresourceRange = image.subresourceRange;
+        legacyBarriers.push_back(barrier);
+    }
+
+    VkMemoryBarrier memory{};
+    memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory.srcAccessMask = static_cast<VkAccessFlags>(batch.memory.srcAccessMask);
+    memory.dstAccessMask = static_cast<VkAccessFlags>(batch.memory.dstAccessMask);
+
+    // Stage 0 means "none" to synchronization2, which the original barrier spells as these two
+    vkCmdPipelineBarrier(commandBuffer,
+        srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        aliasing ? 1 : 0, &memory, 0, nullptr, static_cast<uint32_t>(legacyBarriers.size()), legacyBarriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+
+    cull();
+    placeTransients();
+
+    // A pass that uses an image more than one way gets one barrier for all of them. Conflicting layouts fall back
+    // to GENERAL.
+    auto mergedUses = [this](const Pass& pass) -> const std::vector<std::pair<GraphImage, AccessInfo>>& {
+        mergedScratch.clear();
+        for (const Pass::Use& use : pass.uses) {
+            AccessInfo info = accessInfo(use.access);
+            auto merged = std::find_if(mergedScratch.begin(), mergedScratch.end(),
+                [&](const std::pair<GraphImage, AccessInfo>& entry) { return entry.first == use.image; });
+            if (merged == mergedScratch.end()) {
+                mergedScratch.push_back({ use.image, info });
+                continue;
+            }
+            AccessInfo& combined = merged->second;
+            combined.stages |= info.stages;
+            combined.access |= info.access;
+            combined.usage |= info.usage;
+            combined.writes = combined.writes || info.writes;
+            if (combined.layout != info.layout) {
+                combined.layout = VK_IMAGE_LAYOUT_GENERAL;
+            }
+        }
+        return mergedScratch;
+    };
+
+    // First a dry run for where each image ends the frame. A transient's memory is handed over from the image that
+    // used it last, earlier in this frame or (for the first in its slot) at the end of the previous one.
+    states.resize(images.size());
+    for (size_t index = 0; index < images.size(); index++) {
+        states[index] = images[index].initial;
+    }
+    for (uint32_t passIndex : keptPasses) {
+        for (const std::pair<GraphImage, AccessInfo>& use : mergedUses(passes[passIndex])) {
+            addBarriers(nullptr, use.first, states[use.first], use.second);
+        }
+    }
+
+    finalStates.assign(physicalImages.size(), ImageState{});
+    for (size_t index = 0; index < images.size(); index++) {
+        if (!images[index].imported && images[index].physical != UINT32_MAX) {
+            finalStates[images[index].physical] = states[index];
+        }
+    }
+
+    handovers.assign(physicalImages.size(), Handover{});
+    for (const MemorySlot& slot : slots) {
+        for (size_t position = 0; position < slot.images.size(); position++) {
+            uint32_t previous = slot.images[position > 0 ? position - 1 : slot.images.size() - 1];
+            const ImageState& last = finalStates[previous];
+            Handover& handover = handovers[slot.images[position]];
+            handover.stages = last.writeStages | last.readStages;
+            handover.access = last.writeAccess;
+            handover.aliased = previous != slot.images[position];
+        }
+    }
+
+    for (size_t index = 0; index < images.size(); index++) {
+        states[index] = images[index].initial;
+        if (!images[index].imported && images[index].physical != UINT32_MAX) {
+            states[index].writeStages = handovers[images[index].physical].stages;
+            states[index].writeAccess = handovers[images[index].physical].access;
+        }
+    }
+
+    // The real run, one barrier batch ahead of each pass
+    BarrierBatch batch;
+    for (uint32_t passIndex : keptPasses) {
+        const Pass& pass = passes[passIndex];
+
+        batch.images.clear();
+        batch.memory = {};
+        batch.memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+
+        for (const std::pair<GraphImage, AccessInfo>& use : mergedUses(pass)) {
+            const Image& image = images[use.first];
+            ImageState& state = states[use.first];
+
+            // An image barrier only covers accesses through that image, so the image that had the memory before
+            // needs a memory barrier as well
+            if (!image.imported && state.layout == VK_IMAGE_LAYOUT_UNDEFINED && handovers[image.physical].aliased) {
+                const Handover& handover = handovers[image.physical];
+                batch.memory.srcStageMask |= handover.stages;
+                batch.memory.srcAccessMask |= handover.access;
+                batch.memory.dstStageMask |= use.second.stages;
+                batch.memory.dstAccessMask |= use.second.access;
+            }
+            addBarriers(&batch, use.first, state, use.second);
+        }
+        recordBarriers(commandBuffer, batch);
+
+        PROFILE_GPU_ZONE(commandBuffer, pass.name);
+        pass.execute(commandBuffer, *this);
+    }
+
+    // Imported images go back to whatever their next user expects, e.g. PRESENT_SRC
+    batch.images.clear();
+    batch.memory = {};
+    for (size_t index = 0; index < images.size(); index++) {
+        const Image& image = images[index];
+        if (!image.imported || states[index].layout == image.finalLayout) continue;
+
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = states[index].writeStages | states[index].readStages;
+        barrier.srcAccessMask = states[index].writeAccess;
+        barrier.oldLayout = states[index].layout;
+        barrier.newLayout = image.finalLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image.image;
+        barrier.subresourceRange.aspectMask = image.aspect;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        batch.images.push_back(barrier);
+    }
+    recordBarriers(commandBuffer, batch);
+
+    frames++;
+    totalPasses += passes.size();
+    culledPasses += passes.size() - keptPasses.size();
+
+    VkDeviceSize frameAliasedBytes = 0;
+    for (const PhysicalImage& physical : physicalImages) {
+        transientBytes += physical.requirements.size;
+    }
+    for (const MemorySlot& slot : slots) {
+        frameAliasedBytes += slot.allocation.size;
+    }
+    aliasedBytes += frameAliasedBytes;
+    peakAliasedBytes = std::max(peakAliasedBytes, frameAliasedBytes);
+}
+
+void RenderGraph::report(std::ostream& out) const {
+
+    if (frames == 0) return;
+
+    const double mebibyte = 1024.0 * 1024.0;
+    const double perFrame = 1.0 / frames;
+
+    out << std::fixed << std::setprecision(1)
+        << "\nRender graph: " << totalPasses * perFrame << " passes per frame (" << culledPasses * perFrame
+        << " culled), " << (imageBarriers + memoryBarriers) * perFrame << " barriers in " << barrierCalls * perFrame
+        << " calls per frame (" << memoryBarriers << " aliasing hand-overs in total), "
+        << (pipelineBarrier2 != nullptr ? "synchronization2" : "vkCmdPipelineBarrier") << "\n"
+        << "    Transients: " << transientBytes * perFrame / mebibyte << " MiB in " << aliasedBytes * perFrame / mebibyte
+        << " MiB of memory per frame, " << (transientBytes - aliasedBytes) * perFrame / mebibyte
+        << " MiB saved by aliasing (peak " << peakAliasedBytes / mebibyte << " MiB), rebuilt " << rebuilds << " times\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,233 @@
+// render-graph.h
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "include.h"
+#include "deferred-destruction.h"
+#include "device-allocator.h"
+#include "device-capabilities.h"
+
+// How a pass uses an image. Each one stands for a pipeline stage, an access and the layout the image has to be in.
+enum class GraphAccess {
+	ColorAttachmentWrite,
+	DepthAttachmentWrite,
+	DepthAttachmentRead,
+	SampledRead,                // Fragment or compute shader
+	StorageRead,                // Compute shader
+	StorageWrite,               // Compute shader
+	TransferRead,
+	TransferWrite
+};
+
+// Images in the graph are referred to by index, valid until the next begin()
+using GraphImage = uint32_t;
+
+// The frame as a list of passes, each declaring which images it reads and writes, rather than hand-placed barriers.
+//
+// A frame is built between begin() and execute(). Images are either imported (the swap chain image, anything
+// else that outlives the frame) or transient: created by the graph, only valid inside the frame, and described by
+// format and size alone. execute() then:
+//
+// - Culls passes nothing depends on. A pass is kept when it writes an imported image, is marked with
+//   sideEffects(), or writes something a kept pass after it reads. Transients only culled passes use are never
+//   created.
+// - Works out every pass's barriers from the declared accesses: layout transitions, read after write, write after
+//   read and write after write. Reads in the same layout after a barrier don't get another one. All of a pass's
+//   barriers go out in one vkCmdPipelineBarrier2 (vkCmdPipelineBarrier without synchronization2, with the stages
+//   of the whole batch combined), and imported images are moved to their final layouts in one more at the end.
+// - Places transients whose lifetimes (first to last kept pass that uses them) don't overlap in the same memory.
+//   The memory and the images are kept and reused for as long as the frames keep the same shape, so a steady
+//   frame creates nothing. When the shape changes, the old ones go to the deferred destruction queue, which
+//   destroys them once every frame in flight that could still use them is done.
+//
+// One set of transient memory serves every frame in flight. A transient's first barrier waits for whatever last
+// used its memory, in this frame or the one before it on the queue, so frames never overwrite each other's.
+//
+// Pass names must be string literals, since each pass is also a GPU profiler zone (see profiler.h).
+
+class RenderGraph {
+
+public:
+
+	using Execute = std::function<void(VkCommandBuffer commandBuffer, const RenderGraph& graph)>;
+
+	class Pass {
+
+	public:
+
+		Pass& read(GraphImage image, GraphAccess access);
+		Pass& write(GraphImage image, GraphAccess access);
+
+		// Keep the pass even if nothing reads what it writes
+		Pass& sideEffects();
+
+	private:
+
+		friend class RenderGraph;
+
+		struct Use {
+			GraphImage image;
+			GraphAccess access;
+		};
+
+		const char* name = nullptr;
+		Execute execute;
+		std::vector<Use> uses;
+		bool keep = false;
+	};
+
+	void create(VkDevice device, DeviceAllocator& allocator, const DeviceCapabilities& capabilities,
+		DeferredDestruction& deferred, const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Starts a new frame's graph. Every GraphImage and Pass from the last one is gone.
+	void begin();
+
+	// readyStage is where the image's first use has to wait, e.g. the stage the acquire semaphore is waited on,
+	// 0 when it's ready already. The image is left in finalLayout at the end of the frame.
+	GraphImage importImage(VkImage image, VkImageView view, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+		VkPipelineStageFlags2 readyStage, VkImageLayout finalLayout);
+	GraphImage createImage(VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+
+	// Passes run in the order they're added
+	Pass& addPass(const char* name, Execute execute);
+
+	// Culls, places the transients and records every kept pass with its barriers
+	void execute(VkCommandBuffer commandBuffer);
+
+	// For the passes, while they're recorded
+	VkImage image(GraphImage image) const { return images[image].image; }
+	VkImageView imageView(GraphImage image) const { return images[image].view; }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	struct AccessInfo {
+		VkPipelineStageFlags2 stages;
+		VkAccessFlags2 access;
+		VkImageLayout layout;
+		VkImageUsageFlags usage;
+		bool writes;
+	};
+
+	static AccessInfo accessInfo(GraphAccess access);
+
+	// Where an image's memory stands after the accesses so far. Everything since the last write (or layout
+	// transition) is in reads, and visible says what's already been made to see that write.
+	struct ImageState {
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2 writeStages = 0;
+		VkAccessFlags2 writeAccess = 0;
+		VkPipelineStageFlags2 readStages = 0;
+		VkPipelineStageFlags2 visibleStages = 0;
+		VkAccessFlags2 visibleAccess = 0;
+	};
+
+	struct Image {
+		bool imported = false;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkImageAspectFlags aspect = 0;
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		ImageState initial;
+
+		// Transients only
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{};
+		VkImageUsageFlags usage = 0;
+		uint32_t firstPass = UINT32_MAX;        // Kept passes only, in execution order
+		uint32_t lastPass = 0;
+		uint32_t physical = UINT32_MAX;         // Index into physicalImages
+	};
+
+	// What a transient looked like when its physical image was made. The same list two frames in a row means the
+	// same images and memory work for both.
+	struct TransientShape {
+		VkFormat format;
+		VkExtent2D extent;
+		VkImageUsageFlags usage;
+		VkImageAspectFlags aspect;
+		uint32_t firstPass;
+		uint32_t lastPass;
+
+		bool operator==(const TransientShape& other) const;
+	};
+
+	struct PhysicalImage {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkMemoryRequirements requirements{};
+		uint32_t slot = 0;
+		TransientShape shape{};
+	};
+
+	// A piece of memory and the physical images placed in it, which never overlap in lifetime
+	struct MemorySlot {
+		DeviceAllocation allocation;
+		std::vector<uint32_t> images;
+	};
+
+	// Whatever last used a transient's memory, which its first barrier has to wait for
+	struct Handover {
+		VkPipelineStageFlags2 stages = 0;
+		VkAccessFlags2 access = 0;
+		bool aliased = false;                   // It was another image in the same slot
+	};
+
+	// One vkCmdPipelineBarrier2's worth
+	struct BarrierBatch {
+		std::vector<VkImageMemoryBarrier2> images;
+		VkMemoryBarrier2 memory{};              // Aliasing hand-overs, all merged. Unused when srcStageMask is 0.
+	};
+
+	void cull();
+	void placeTransients();
+	void buildPhysicalImages();
+	void retirePhysicalImages(bool now);
+
+	// batch may be null, to only follow the image's state
+	void addBarriers(BarrierBatch* batch, GraphImage index, ImageState& state, const AccessInfo& info);
+	void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch);
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceAllocator* allocator = nullptr;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	DeferredDestruction* deferred = nullptr;
+	PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2 = nullptr;    // Null without synchronization2
+
+	// This frame's graph
+	std::vector<Image> images;
+	std::vector<Pass> passes;
+	std::vector<uint32_t> keptPasses;
+
+	// Kept across frames
+	std::vector<PhysicalImage> physicalImages;
+	std::vector<MemorySlot> slots;
+
+	// Per frame scratch, kept to save reallocating it
+	std::vector<char> neededImages;
+	std::vector<TransientShape> shapes;
+	std::vector<ImageState> states;
+	std::vector<ImageState> finalStates;    // Per physical image
+	std::vector<Handover> handovers;        // Per physical image
+	std::vector<std::pair<GraphImage, AccessInfo>> mergedScratch;
+	std::vector<VkImageMemoryBarrier> legacyBarriers;
+
+	// Bookkeeping for the report
+	uint64_t frames = 0;
+	uint64_t totalPasses = 0;
+	uint64_t culledPasses = 0;
+	uint64_t barrierCalls = 0;
+	uint64_t imageBarriers = 0;
+	uint64_t memoryBarriers = 0;
+	uint64_t rebuilds = 0;
+	uint64_t transientBytes = 0;            // What the transients would have taken on their own, over every frame
+	uint64_t aliasedBytes = 0;              // What they took in their slots
+	VkDeviceSize peakAliasedBytes = 0;
+};
@@ -0,0 +1,85 @@
+// resize.cpp
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include "include.h"
+#include "application.h"
+#include "profiler.h"
+
+// Window resizes. GLFW reports every size a window goes through while it's dragged, often several between two frames,
+// and rebuilding the swap chain for each of them would be wasted work. The callback only records the latest size;
+// applyResize() acts on it once, at the start of the next frame, and not at all if it came back to what's there.
+//
+// The rebuild itself doesn't wait for anything: the new swap chain is created from the old one, and the old one goes
+// to the deferred destruction queue until the frames still using it are done (see Swapchain::recreate). The swap
+// chain's report has how long each rebuild took and the frame time around it.
+//
+// Headless runs have no window, so simulateResize() feeds sizes through the same path every resizeEvery frames.
+
+static uint32_t lerp(uint32_t from, uint32_t to, uint32_t step, uint32_t steps) {
+
+    return static_cast<uint32_t>(int64_t(from) + (int64_t(to) - int64_t(from)) * step / steps);
+}
+
+void Application::framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+
+    auto app = static_cast<Application*>(glfwGetWindowUserPointer(window));
+    app->onResize(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+}
+
+void Application::onResize(uint32_t width, uint32_t height) {
+
+    windowExtent = { width, height };
+    resizePending = true;
+    resizeEvents++;
+}
+
+void Application::simulateResize(uint32_t frame) {
+
+    if (resizeEvery == 0 || frame == 0 || frame % resizeEvery != 0) return;
+
+    // A drag to the next size in the cycle, reported in a few steps the way a window system would. Only the last of
+    // them should lead to a rebuild.
+    static constexpr float scales[] = { 1.25f, 1.5f, 0.75f, 1.0f };
+    static constexpr uint32_t steps = 4;
+
+    float scale = scales[(frame / resizeEvery - 1) % std::size(scales)];
+    VkExtent2D from = windowExtent;
+    VkExtent2D to = { std::max(1u, static_cast<uint32_t>(WIDTH * scale)), std::max(1u, static_cast<uint32_t>(HEIGHT * scale)) };
+    for (uint32_t step = 1; step <= steps; step++) {
+        onResize(lerp(from.width, to.width, step, steps), lerp(from.height, to.height, step, steps));
+    }
+}
+
+bool Application::applyResize() {
+
+    bool outOfDate = surface != VK_NULL_HANDLE && swapchain.outOfDate();
+    if (!resizePending && !outOfDate) return true;
+
+    // Minimized. The swap chain stays as it is until the window has a size again.
+    if (windowExtent.width == 0 || windowExtent.height == 0) return false;
+    resizePending = false;
+
+    PROFILE_ZONE("applyResize");
+
+    // Unless the surface itself said so, a size that ended up where it started needs nothing
+    VkExtent2D current = surface != VK_NULL_HANDLE ? swapchain.getExtent() : offscreenExtent;
+    if (!outOfDate && current.width == windowExtent.width && current.height == windowExtent.height) return true;
+
+    if (surface != VK_NULL_HANDLE) {
+        swapchain.recreate(windowExtent, deferred);
+    }
+    else {
+        resizeOffscreenTarget(windowExtent);
+    }
+    resizesApplied++;
+    return true;
+}
+
+void Application::reportResizes(std::ostream& out) const {
+
+    if (resizeEvents == 0) return;
+
+    out << "\nResizes: " << resizeEvents << " size events, " << resizesApplied << " rebuilds\n";
+}
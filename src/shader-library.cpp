@@ -0,0 +1,371 @@
+// shader-library.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include "shader-library.h"
+#include "frame-stats.h"
+#include "mapped-file.h"
+#include "shader-module.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Eight bytes at a time, each folded in with a multiply so every bit reaches the high half, then the splitmix64
+// finalizer to spread the last few words. Not cryptographic, just fast and well mixed, which is all dedup needs.
+static uint64_t hashCode(const void* data, size_t size) {
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, size - i);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+// The key the watcher looks files up by: a path it can rebuild from a directory and an event's file name
+static std::string watchKey(const fs::path& directory, const fs::path& name) {
+    return (directory / name).lexically_normal().string();
+}
+
+static fs::path directoryOf(const std::string& path) {
+
+    fs::path directory = fs::path(path).parent_path();
+    return directory.empty() ? fs::path(".") : directory;
+}
+
+void ShaderLibrary::create(VkDevice device, bool hotReload, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+
+    if (!hotReload) return;
+
+#ifdef __linux__
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd < 0 || pipe(stopPipe) != 0) {
+        std::clog << "Shader hot reload unavailable: " << std::strerror(errno) << std::endl;
+        if (notifyFd >= 0) close(notifyFd);
+        notifyFd = -1;
+        return;
+    }
+    watcher = std::thread(&ShaderLibrary::watchLoop, this);
+#else
+    std::clog << "Shader hot reload is only supported on Linux" << std::endl;
+#endif
+}
+
+void ShaderLibrary::destroy() {
+
+    if (device == VK_NULL_HANDLE) return;
+
+#ifdef __linux__
+    if (watcher.joinable()) {
+        char stop = 0;
+        if (write(stopPipe[1], &stop, 1) != 1) {
+            std::clog << "Failed to stop the shader watcher" << std::endl;
+        }
+        watcher.join();
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+        close(notifyFd);
+        notifyFd = -1;
+    }
+#endif
+
+    // Reloads nobody picked up
+    for (Reload& reload : pending) {
+        vkDestroyShaderModule(device, reload.module, allocationCallbacks);
+    }
+    pending.clear();
+
+    for (auto& [hash, entry] : modules) {
+        vkDestroyShaderModule(device, entry.module, allocationCallbacks);
+    }
+    modules.clear();
+    shaders.clear();
+    byPath.clear();
+    watchedDirectories.clear();
+    watchedFiles.clear();
+    device = VK_NULL_HANDLE;
+}
+
+bool ShaderLibrary::build(const std::string& path, const std::unordered_map<uint64_t, Module>* existing, VkShaderModule& module,
+    uint64_t& hash, size_t& size, std::string& error) {
+
+    MappedFile file;
+    if (!file.open(path, &error)) {
+        return false;
+    }
+
+    if (const char* problem = checkSpirv(file.data(), file.size())) {
+        error = problem;
+        return false;
+    }
+
+    hash = hashCode(file.data(), file.size());
+    size = file.size();
+    module = VK_NULL_HANDLE;
+
+    // Same code as a module we have already: the driver never needs to see it
+    if (existing != nullptr && existing->count(hash) != 0) {
+        return true;
+    }
+
+    // Straight out of the mapping. The driver copies (or compiles) it before this returns, so it can be unmapped.
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = file.size();
+    createInfo.pCode = static_cast<const uint32_t*>(file.data());
+
+    if (vkCreateShaderModule(device, &createInfo, allocationCallbacks, &module) != VK_SUCCESS) {
+        error = "vkCreateShaderModule failed";
+        return false;
+    }
+    return true;
+}
+
+ShaderHandle ShaderLibrary::load(const std::string& path) {
+
+    auto found = byPath.find(path);
+    if (found != byPath.end()) {
+        pathHits++;
+        return found->second;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    VkShaderModule module;
+    uint64_t hash;
+    size_t size;
+    std::string error;
+    if (!build(path, &modules, module, hash, size, error)) {
+        throw std::runtime_error("failed to load shader " + path + " (" + error + ")!");
+    }
+
+    if (module == VK_NULL_HANDLE) {
+        modules[hash].references++;
+        contentHits++;
+    }
+    else {
+        modules.emplace(hash, Module{ module, 1 });
+    }
+
+    ShaderHandle shader = static_cast<ShaderHandle>(shaders.size());
+    shaders.push_back({ path, hash });
+    byPath.emplace(path, shader);
+
+    if (hotReloading()) {
+        watch(shader);
+    }
+
+    filesMapped++;
+    bytesMapped += size;
+    loadMilliseconds += elapsedMilliseconds(start, std::chrono::steady_clock::now());
+    return shader;
+}
+
+uint32_t ShaderLibrary::loadDirectory(const std::string& directory) {
+
+    std::error_code error;
+    std::vector<fs::path> files;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".spv") {
+            files.push_back(entry.path());
+        }
+    }
+    if (error) {
+        std::clog << "Can't read shader directory " << directory << ": " << error.message() << std::endl;
+        return 0;
+    }
+    std::sort(files.begin(), files.end());
+
+    uint32_t loaded = 0;
+    for (const fs::path& file : files) {
+        try {
+            load(file.string());
+            loaded++;
+        }
+        catch (const std::runtime_error& failure) {
+            std::clog << failure.what() << std::endl;
+        }
+    }
+    return loaded;
+}
+
+VkShaderModule ShaderLibrary::module(ShaderHandle shader) const {
+    return modules.at(shaders[shader].hash).module;
+}
+
+void ShaderLibrary::release(uint64_t hash) {
+
+    auto found = modules.find(hash);
+    if (--found->second.references == 0) {
+        vkDestroyShaderModule(device, found->second.module, allocationCallbacks);
+        modules.erase(found);
+    }
+}
+
+std::vector<ShaderHandle> ShaderLibrary::applyReloads() {
+
+    std::vector<ShaderHandle> changed;
+    if (!hotReloading()) return changed;
+
+    std::vector<Reload> ready;
+    {
+        // The watcher only holds this for a moment, but a frame shouldn't wait even that long
+        std::unique_lock<std::mutex> lock(watchMutex, std::try_to_lock);
+        if (!lock.owns_lock() || pending.empty()) return changed;
+        ready.swap(pending);
+    }
+
+    for (Reload& reload : ready) {
+        Shader& shader = shaders[reload.shader];
+
+        // Saved again without changes, or rebuilt to the same code
+        if (reload.hash == shader.hash) {
+            vkDestroyShaderModule(device, reload.module, allocationCallbacks);
+            unchangedReloads++;
+            continue;
+        }
+
+        auto existing = modules.find(reload.hash);
+        if (existing != modules.end()) {
+            vkDestroyShaderModule(device, reload.module, allocationCallbacks);
+            existing->second.references++;
+        }
+        else {
+            modules.emplace(reload.hash, Module{ reload.module, 1 });
+        }
+
+        release(shader.hash);
+        shader.hash = reload.hash;
+        shader.generation++;
+        reloads++;
+        changed.push_back(reload.shader);
+
+        std::clog << "Reloaded " << shader.path << " (generation " << shader.generation << ")" << std::endl;
+    }
+    return changed;
+}
+
+void ShaderLibrary::watch(ShaderHandle shader) {
+
+#ifdef __linux__
+    // Watching the directory rather than the file, because compilers and editors tend to write a new file and
+    // rename it over the old one, which a watch on the old file never hears about
+    fs::path directory = directoryOf(shaders[shader].path);
+    int watchDescriptor = inotify_add_watch(notifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watchDescriptor < 0) {
+        std::clog << "Can't watch " << directory.string() << " for shader changes: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(watchMutex);
+    watchedDirectories[watchDescriptor] = directory.string();
+    watchedFiles[watchKey(directory, fs::path(shaders[shader].path).filename())] = shader;
+#endif
+}
+
+void ShaderLibrary::watchLoop() {
+
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+
+    while (true) {
+        pollfd descriptors[2] = { { notifyFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        if (poll(descriptors, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            std::clog << "Shader watcher stopped: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        if (descriptors[1].revents != 0) return;
+
+        // One write can raise several events (a close and a rename, or a burst of saves), so everything that's
+        // queued is collected first and every file built once
+        std::vector<std::pair<ShaderHandle, std::string>> changed;
+        ssize_t length;
+        while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0) {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            for (char* at = buffer; at < buffer + length; ) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(at);
+                at += sizeof(inotify_event) + event->len;
+                if (event->len == 0) continue;
+
+                auto directory = watchedDirectories.find(event->wd);
+                if (directory == watchedDirectories.end()) continue;
+
+                auto file = watchedFiles.find(watchKey(directory->second, event->name));
+                if (file == watchedFiles.end()) continue;
+
+                auto same = [&](const std::pair<ShaderHandle, std::string>& entry) { return entry.first == file->second; };
+                if (std::none_of(changed.begin(), changed.end(), same)) {
+                    changed.emplace_back(file->second, file->first);
+                }
+            }
+        }
+
+        for (const auto& [shader, path] : changed) {
+            VkShaderModule module;
+            uint64_t hash;
+            size_t size;
+            std::string error;
+            if (!build(path, nullptr, module, hash, size, error)) {
+                std::clog << "Reloading " << path << " failed (" << error << "), keeping the old version" << std::endl;
+                failedReloads++;
+                continue;
+            }
+
+            // A newer build replaces one the frame loop hasn't picked up yet
+            std::lock_guard<std::mutex> lock(watchMutex);
+            auto older = std::find_if(pending.begin(), pending.end(), [&](const Reload& reload) { return reload.shader == shader; });
+            if (older != pending.end()) {
+                vkDestroyShaderModule(device, older->module, allocationCallbacks);
+                *older = { shader, module, hash };
+            }
+            else {
+                pending.push_back({ shader, module, hash });
+            }
+        }
+    }
+#endif
+}
+
+void ShaderLibrary::report(std::ostream& out) const {
+
+    if (shaders.empty()) return;
+
+    out << std::fixed << std::setprecision(2)
+        << "Shaders: " << shaders.size() << " loaded as " << modules.size() << " modules (" << contentHits
+        << " shared by content, " << pathHits << " repeat loads), " << filesMapped << " files / "
+        << bytesMapped / 1024.0 << " KiB mapped in " << loadMilliseconds << " ms\n";
+    if (hotReloading()) {
+        out << "    hot reload: " << reloads << " reloaded, " << unchangedReloads << " unchanged, "
+            << failedReloads.load() << " failed\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,120 @@
+// shader-library.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "include.h"
+
+// Loads compiled shaders and hands out their VkShaderModules.
+//
+// Files are memory mapped (see mapped-file.h) and go from the page cache straight to vkCreateShaderModule, with no
+// copy into a buffer of ours, and are unmapped again right after. Every file is checked for alignment and the SPIR-V
+// magic before the driver sees it. Modules are shared by content: two files with the same code (the same shader
+// copied under two names, or a library that ships one variant several times) get one VkShaderModule. Content is
+// identified by a 64-bit hash of the code, which for a few thousand shaders makes a collision far less likely
+// than a bad read from disk.
+//
+// With hot reload on (Linux only, it's built on inotify) a background thread watches the directory of every loaded
+// shader. When one is rewritten it maps, checks and builds the new module right there, off the frame loop. The
+// frame loop picks the result up with applyReloads(), which only swaps handles and never waits for the watcher. A
+// file that fails to load (half written, or just broken) is reported and the old module stays.
+//
+// Everything but the watcher runs on the thread that owns the library. Handles are stable for its whole life.
+
+using ShaderHandle = uint32_t;
+
+class ShaderLibrary {
+
+public:
+
+	void create(VkDevice device, bool hotReload, const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Throws if the file can't be mapped or isn't SPIR-V. Loading a path that's already loaded returns its handle
+	// without touching the file again.
+	ShaderHandle load(const std::string& path);
+
+	// Every .spv file in directory, in name order. Files that fail to load are reported and skipped.
+	// Returns how many loaded.
+	uint32_t loadDirectory(const std::string& directory);
+
+	// Only valid until the next applyReloads() that includes this shader. Anything built from it (pipelines) stays
+	// valid, since those don't need the module once they're created.
+	VkShaderModule module(ShaderHandle shader) const;
+
+	// Starts at 0 and goes up by one every time the shader is reloaded
+	uint32_t generation(ShaderHandle shader) const { return shaders[shader].generation; }
+	const std::string& path(ShaderHandle shader) const { return shaders[shader].path; }
+
+	// Once per frame. Swaps in whatever the watcher finished since the last call and returns the shaders whose module
+	// changed, so their pipelines can be rebuilt. Skips a frame rather than wait if the watcher is mid-update.
+	std::vector<ShaderHandle> applyReloads();
+
+	bool hotReloading() const { return watcher.joinable(); }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	struct Shader {
+		std::string path;
+		uint64_t hash;                      // Key into modules
+		uint32_t generation = 0;
+	};
+
+	struct Module {
+		VkShaderModule module;
+		uint32_t references;                // Shaders currently using it
+	};
+
+	// Built by the watcher, waiting for applyReloads
+	struct Reload {
+		ShaderHandle shader;
+		VkShaderModule module;
+		uint64_t hash;
+	};
+
+	// Maps, checks and hashes path, and builds a module from it unless one with that content exists already (the
+	// watcher passes nullptr, since it mustn't touch modules). Returns false with the reason in error.
+	bool build(const std::string& path, const std::unordered_map<uint64_t, Module>* existing, VkShaderModule& module,
+		uint64_t& hash, size_t& size, std::string& error);
+	void release(uint64_t hash);
+
+	void watch(ShaderHandle shader);
+	void watchLoop();
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+
+	std::vector<Shader> shaders;
+	std::unordered_map<std::string, ShaderHandle> byPath;
+	std::unordered_map<uint64_t, Module> modules;
+
+	// inotify descriptor, watch per directory, and a pipe that wakes the watcher up to stop
+	int notifyFd = -1;
+	int stopPipe[2] = { -1, -1 };
+	std::thread watcher;
+
+	// Guards watches and pending, shared with the watcher
+	std::mutex watchMutex;
+	std::unordered_map<int, std::string> watchedDirectories;                            // Watch descriptor -> directory
+	std::unordered_map<std::string, ShaderHandle> watchedFiles;                         // Full path -> shader
+	std::vector<Reload> pending;
+
+	// Bookkeeping for the report. The watcher's counter is atomic since it updates it on its own thread.
+	uint32_t filesMapped = 0;
+	uint64_t bytesMapped = 0;
+	uint32_t pathHits = 0;                  // load() of an already loaded path
+	uint32_t contentHits = 0;               // A new path whose code was already loaded under another name
+	double loadMilliseconds = 0.0;
+	uint32_t reloads = 0;
+	uint32_t unchangedReloads = 0;          // Rewritten with the same code
+	std::atomic<uint32_t> failedReloads{ 0 };
+};
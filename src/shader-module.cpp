@@ -0,0 +1,27 @@
+// shader-module.cpp
+
+#include <cstdlib>
+#include "shader-module.h"
+
+const char* checkSpirv(const void* code, size_t size) {
+
+    // vkCreateShaderModule takes uint32_t words, so it wants the code 4-byte aligned
+    if (reinterpret_cast<uintptr_t>(code) % alignof(uint32_t) != 0) return "not 4-byte aligned";
+    if (size % sizeof(uint32_t) != 0) return "not a whole number of words";
+
+    // Magic, version, generator, bound, schema
+    if (size < 5 * sizeof(uint32_t)) return "too short for a SPIR-V header";
+
+    uint32_t magic = static_cast<const uint32_t*>(code)[0];
+    if (magic == spirvMagic) return nullptr;
+
+    // Valid SPIR-V, just written on a machine of the other endianness. Vulkan only takes it in host order.
+    if (magic == 0x03022307) return "SPIR-V in the wrong byte order";
+    return "bad SPIR-V magic number";
+}
+
+std::string shaderDirectory() {
+
+    const char* directory = std::getenv("VKTEST_SHADER_DIR");
+    return directory != nullptr && directory[0] != '\0' ? directory : "shaders";
+}
@@ -0,0 +1,20 @@
+// shader-module.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The SPIR-V magic number, as the first word of every module in the host's (little-endian) byte order
+constexpr uint32_t spirvMagic = 0x07230203;
+
+// Checks that size bytes at code could be a SPIR-V module: 4-byte aligned, a whole number of words, at least the
+// five-word header, and the magic number in our byte order. Returns nullptr if so, otherwise what's wrong with it.
+// Cheap enough to run on every load; the driver (and the validation layer) still check the rest. See shader-library.h
+// for the loading itself.
+const char* checkSpirv(const void* code, size_t size);
+
+// Where the compiled shaders are: VKTEST_SHADER_DIR if set, otherwise "shaders" relative to the working directory,
+// which is where both the CMake build and shaders/compile.bat put them
+std::string shaderDirectory();
@@ -0,0 +1,416 @@
+// simd-kernels.cpp
+
+#include <algorithm>
+#include <cstring>
+#include "simd-kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+// Only these functions are compiled for AVX2, the rest of the program still runs on any x86-64
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// One sphere against the six planes. The SIMD versions and cull.comp add the terms up in this same order, so they
+// all agree on spheres that only just touch a plane.
+inline bool sphereVisible(const float* planes, float x, float y, float z, float radius) {
+
+    for (int plane = 0; plane < 24; plane += 4) {
+        float distance = planes[plane] * x + planes[plane + 1] * y + planes[plane + 2] * z + planes[plane + 3];
+        if (!(distance >= -radius)) return false;
+    }
+    return true;
+}
+
+size_t frustumCullScalar(const float* planes, const float* x, const float* y, const float* z, const float* radius,
+    size_t begin, size_t count, uint32_t* visible, size_t visibleCount) {
+
+    for (size_t i = begin; i < count; i++) {
+        if (sphereVisible(planes, x[i], y[i], z[i], radius[i])) visible[visibleCount++] = static_cast<uint32_t>(i);
+    }
+    return visibleCount;
+}
+
+#if SIMD_X86 || SIMD_NEON
+
+// For every mask of up to eight lanes, which lanes are set, packed to the front, and how many there are. Turns a
+// vector compare into a run of indices without a branch per lane.
+struct LanePacking {
+    uint8_t lanes[256][8];
+    uint8_t counts[256];
+
+    LanePacking() {
+        for (uint32_t mask = 0; mask < 256; mask++) {
+            uint8_t count = 0;
+            for (uint8_t lane = 0; lane < 8; lane++) {
+                lanes[mask][lane] = 0;
+                if (mask & (1u << lane)) lanes[mask][count++] = lane;
+            }
+            counts[mask] = count;
+        }
+    }
+};
+
+const LanePacking lanePacking;
+
+#endif
+
+#if SIMD_X86
+
+bool detectAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // AVX2 itself, plus OSXSAVE and the OS actually saving the YMM registers
+    __cpuidex(info, 1, 0);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+const bool hasAvx2 = detectAvx2();
+
+AVX2_TARGET uint32_t reduceAvx2(const uint32_t* values, size_t count) {
+
+    // Two accumulators so consecutive adds don't wait on each other
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_add_epi32(sum0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+        sum1 = _mm256_add_epi32(sum1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 8)));
+    }
+    __m256i sum = _mm256_add_epi32(sum0, sum1);
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    uint32_t total = static_cast<uint32_t>(_mm_cvtsi128_si32(half));
+    for (; i < count; i++) total += values[i];
+    return total;
+}
+
+uint32_t reduceSse2(const uint32_t* values, size_t count) {
+
+    __m128i sum0 = _mm_setzero_si128();
+    __m128i sum1 = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm_add_epi32(sum0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+        sum1 = _mm_add_epi32(sum1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 4)));
+    }
+    __m128i sum = _mm_add_epi32(sum0, sum1);
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    uint32_t total = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+    for (; i < count; i++) total += values[i];
+    return total;
+}
+
+AVX2_TARGET size_t frustumCullAvx2(const float* planes, const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible) {
+
+    __m256 a[6], b[6], c[6], d[6];
+    for (int plane = 0; plane < 6; plane++) {
+        a[plane] = _mm256_set1_ps(planes[plane * 4]);
+        b[plane] = _mm256_set1_ps(planes[plane * 4 + 1]);
+        c[plane] = _mm256_set1_ps(planes[plane * 4 + 2]);
+        d[plane] = _mm256_set1_ps(planes[plane * 4 + 3]);
+    }
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        __m256 minusRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int plane = 0; plane < 6; plane++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[plane], px),
+                _mm256_mul_ps(b[plane], py)), _mm256_mul_ps(c[plane], pz)), d[plane]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, minusRadius, _CMP_GE_OQ));
+        }
+
+        // All eight indices are stored whatever the mask, and only the survivors counted. The stores never get
+        // past i + 7, so they stay inside visible.
+        int mask = _mm256_movemask_ps(inside);
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lanePacking.lanes[mask])));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(visible + visibleCount),
+            _mm256_add_epi32(lanes, _mm256_set1_epi32(static_cast<int>(i))));
+        visibleCount += lanePacking.counts[mask];
+    }
+    return frustumCullScalar(planes, x, y, z, radius, i, count, visible, visibleCount);
+}
+
+size_t frustumCullSse2(const float* planes, const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible) {
+
+    __m128 a[6], b[6], c[6], d[6];
+    for (int plane = 0; plane < 6; plane++) {
+        a[plane] = _mm_set1_ps(planes[plane * 4]);
+        b[plane] = _mm_set1_ps(planes[plane * 4 + 1]);
+        c[plane] = _mm_set1_ps(planes[plane * 4 + 2]);
+        d[plane] = _mm_set1_ps(planes[plane * 4 + 3]);
+    }
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 minusRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int plane = 0; plane < 6; plane++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[plane], px),
+                _mm_mul_ps(b[plane], py)), _mm_mul_ps(c[plane], pz)), d[plane]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, minusRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (uint8_t lane = 0; lane < lanePacking.counts[mask]; lane++) {
+            visible[visibleCount++] = static_cast<uint32_t>(i) + lanePacking.lanes[mask][lane];
+        }
+    }
+    return frustumCullScalar(planes, x, y, z, radius, i, count, visible, visibleCount);
+}
+
+uint32_t scanSse2(const uint32_t* values, uint32_t* output, size_t count) {
+
+    // Inclusive scan of four values in two shift-and-adds, then the running total of everything before
+    __m128i carry = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        __m128i x = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_sub_epi32(x, v));
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    uint32_t running = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+    for (; i < count; i++) {
+        uint32_t value = values[i];
+        output[i] = running;
+        running += value;
+    }
+    return running;
+}
+
+#elif SIMD_NEON
+
+uint32_t reduceNeon(const uint32_t* values, size_t count) {
+
+    uint32x4_t sum0 = vdupq_n_u32(0);
+    uint32x4_t sum1 = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sum0 = vaddq_u32(sum0, vld1q_u32(values + i));
+        sum1 = vaddq_u32(sum1, vld1q_u32(values + i + 4));
+    }
+
+    uint32_t total = vaddvq_u32(vaddq_u32(sum0, sum1));
+    for (; i < count; i++) total += values[i];
+    return total;
+}
+
+uint32_t scanNeon(const uint32_t* values, uint32_t* output, size_t count) {
+
+    const uint32x4_t zero = vdupq_n_u32(0);
+    uint32x4_t carry = zero;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t v = vld1q_u32(values + i);
+        uint32x4_t x = vaddq_u32(v, vextq_u32(zero, v, 3));
+        x = vaddq_u32(x, vextq_u32(zero, x, 2));
+        x = vaddq_u32(x, carry);
+        vst1q_u32(output + i, vsubq_u32(x, v));
+        carry = vdupq_n_u32(vgetq_lane_u32(x, 3));
+    }
+
+    uint32_t running = vgetq_lane_u32(carry, 0);
+    for (; i < count; i++) {
+        uint32_t value = values[i];
+        output[i] = running;
+        running += value;
+    }
+    return running;
+}
+
+size_t frustumCullNeon(const float* planes, const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible) {
+
+    float32x4_t a[6], b[6], c[6], d[6];
+    for (int plane = 0; plane < 6; plane++) {
+        a[plane] = vdupq_n_f32(planes[plane * 4]);
+        b[plane] = vdupq_n_f32(planes[plane * 4 + 1]);
+        c[plane] = vdupq_n_f32(planes[plane * 4 + 2]);
+        d[plane] = vdupq_n_f32(planes[plane * 4 + 3]);
+    }
+
+    // NEON has no movemask, so each lane's result picks out its own bit and the four are added up
+    const uint32_t laneBitValues[4] = { 1, 2, 4, 8 };
+    const uint32x4_t laneBits = vld1q_u32(laneBitValues);
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t px = vld1q_f32(x + i);
+        float32x4_t py = vld1q_f32(y + i);
+        float32x4_t pz = vld1q_f32(z + i);
+        float32x4_t minusRadius = vnegq_f32(vld1q_f32(radius + i));
+
+        uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+        for (int plane = 0; plane < 6; plane++) {
+            float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(a[plane], px),
+                vmulq_f32(b[plane], py)), vmulq_f32(c[plane], pz)), d[plane]);
+            inside = vandq_u32(inside, vcgeq_f32(distance, minusRadius));
+        }
+
+        uint32_t mask = vaddvq_u32(vandq_u32(inside, laneBits));
+        for (uint8_t lane = 0; lane < lanePacking.counts[mask]; lane++) {
+            visible[visibleCount++] = static_cast<uint32_t>(i) + lanePacking.lanes[mask][lane];
+        }
+    }
+    return frustumCullScalar(planes, x, y, z, radius, i, count, visible, visibleCount);
+}
+
+#endif
+
+}
+
+uint32_t cpuReduce(const uint32_t* values, size_t count) {
+
+#if SIMD_X86
+    return hasAvx2 ? reduceAvx2(values, count) : reduceSse2(values, count);
+#elif SIMD_NEON
+    return reduceNeon(values, count);
+#else
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++) total += values[i];
+    return total;
+#endif
+}
+
+void cpuExclusiveScan(const uint32_t* values, uint32_t* output, size_t count) {
+
+    // A scan is one long dependency chain, so AVX2's extra width buys next to nothing over SSE2 here
+#if SIMD_X86
+    scanSse2(values, output, count);
+#elif SIMD_NEON
+    scanNeon(values, output, count);
+#else
+    uint32_t running = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = values[i];
+        output[i] = running;
+        running += value;
+    }
+#endif
+}
+
+void cpuHistogram(const uint32_t* values, size_t count, uint32_t shift, uint32_t* bins) {
+
+    // Runs of equal values would otherwise increment one counter back to back, each increment waiting for the
+    // store before it. Four interleaved tables break that chain.
+    uint32_t tables[4][256] = {};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        tables[0][(values[i] >> shift) & 255]++;
+        tables[1][(values[i + 1] >> shift) & 255]++;
+        tables[2][(values[i + 2] >> shift) & 255]++;
+        tables[3][(values[i + 3] >> shift) & 255]++;
+    }
+    for (; i < count; i++) tables[0][(values[i] >> shift) & 255]++;
+
+    for (uint32_t bin = 0; bin < 256; bin++) {
+        bins[bin] = tables[0][bin] + tables[1][bin] + tables[2][bin] + tables[3][bin];
+    }
+}
+
+void cpuRadixSort(std::vector<uint32_t>& keys) {
+
+    size_t count = keys.size();
+    if (count < 2) return;
+
+    // All four histograms in one read of the keys
+    uint32_t counts[4][256] = {};
+    for (uint32_t key : keys) {
+        counts[0][key & 255]++;
+        counts[1][(key >> 8) & 255]++;
+        counts[2][(key >> 16) & 255]++;
+        counts[3][key >> 24]++;
+    }
+
+    std::vector<uint32_t> buffer(count);
+    uint32_t* source = keys.data();
+    uint32_t* destination = buffer.data();
+
+    for (uint32_t pass = 0; pass < 4; pass++) {
+        uint32_t shift = pass * 8;
+
+        // Every key has the same digit: the pass wouldn't move anything
+        if (counts[pass][(source[0] >> shift) & 255] == count) continue;
+
+        uint32_t offsets[256];
+        cpuExclusiveScan(counts[pass], offsets, 256);
+
+        for (size_t i = 0; i < count; i++) {
+            uint32_t key = source[i];
+            destination[offsets[(key >> shift) & 255]++] = key;
+        }
+        std::swap(source, destination);
+    }
+
+    // An odd number of passes leaves the result in the scratch buffer
+    if (source != keys.data()) {
+        std::memcpy(keys.data(), source, count * sizeof(uint32_t));
+    }
+}
+
+size_t cpuFrustumCull(const float planes[24], const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible) {
+
+#if SIMD_X86
+    return hasAvx2 ? frustumCullAvx2(planes, x, y, z, radius, count, visible)
+        : frustumCullSse2(planes, x, y, z, radius, count, visible);
+#elif SIMD_NEON
+    return frustumCullNeon(planes, x, y, z, radius, count, visible);
+#else
+    return frustumCullScalar(planes, x, y, z, radius, 0, count, visible, 0);
+#endif
+}
+
+const char* simdInstructionSet() {
+
+#if SIMD_X86
+    return hasAvx2 ? "avx2" : "sse2";
+#elif SIMD_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
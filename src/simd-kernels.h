@@ -0,0 +1,37 @@
+// simd-kernels.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU versions of the compute kernels (see compute-kernels.h), used when there are no shaders to load, and as the
+// baseline the GPU is measured and checked against. All of them wrap at 2^32 exactly like the shaders do, so the
+// results can be compared bit for bit.
+//
+// Reduce, scan and frustum culling are vectorised: AVX2 when the CPU has it (checked at runtime, so the build doesn't have to
+// target it), otherwise SSE2 on x86-64 and NEON on ARM64, both of which are always there. Histograms and radix sort
+// are bound by scattered memory accesses rather than arithmetic, so they stay scalar and instead avoid the
+// store-to-load stalls that come from incrementing the same counter over and over.
+
+uint32_t cpuReduce(const uint32_t* values, size_t count);
+
+// output[i] = sum of values[0 .. i-1]. output may be values.
+void cpuExclusiveScan(const uint32_t* values, uint32_t* output, size_t count);
+
+// 256 bins of (value >> shift) & 255
+void cpuHistogram(const uint32_t* values, size_t count, uint32_t shift, uint32_t* bins);
+
+// LSD radix sort, 8 bits per pass. Passes where every key has the same digit are skipped.
+void cpuRadixSort(std::vector<uint32_t>& keys);
+
+// Bounding spheres against six planes, from structure-of-arrays bounds. planes holds (a, b, c, d) per plane, the
+// normal pointing inwards, and a sphere survives when a * x + b * y + c * z + d >= -radius for every one of them.
+// The indices of the survivors go into visible in ascending order (room for count of them), and the return value
+// is how many there were. Vectorised like reduce, eight spheres at a time with AVX2.
+size_t cpuFrustumCull(const float planes[24], const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible);
+
+// "avx2", "sse2", "neon" or "scalar": what cpuReduce, cpuExclusiveScan and cpuFrustumCull use on this machine
+const char* simdInstructionSet();
@@ -0,0 +1,74 @@
+// startup-benchmark.cpp
+
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "frame-stats.h"
+#include "startup-timer.h"
+
+// Time to first frame, cold and warm. Our render jobs are short-lived, so their launch cost matters about as much
+// as their frame rate.
+//
+// The Application is started config.startupBenchmarkRuns times in this process, each time up to its first frame
+// and then cleaned up again. The first run ignores the pipeline cache on disk, the way a fresh install or a new
+// driver would. The runs after it start from what the previous one wrote, which is the common case. Process
+// startup itself (loading the executable and the Vulkan loader) isn't part of any run; it happens once for all of
+// them.
+//
+// The device choice cache is left alone, so set VKTEST_DEVICE_CACHE=0 to include the full ranking pass in every run.
+// Profiling is off for these runs, since it would only add to what's being measured.
+
+void Application::runStartupBenchmark(const AppConfig& config) {
+
+    const uint32_t runs = config.startupBenchmarkRuns;
+
+    FrameStats warm("warm");
+    warm.reserve(runs);
+    double cold = 0.0;
+
+    // Stage names in the order the cold run went through them, and their totals over every run
+    std::vector<StartupTimer::Stage> coldStages;
+    std::vector<double> warmStageTotals;
+
+    for (uint32_t run = 0; run < runs; run++) {
+
+        AppConfig runConfig = config;
+        runConfig.frameCount = 1;
+        runConfig.profilePath.clear();
+        runConfig.coldPipelineCache = config.coldPipelineCache || run == 0;
+
+        Application app(runConfig);
+        app.run();
+
+        const StartupTimer& timer = app.startup();
+        if (run == 0) {
+            cold = timer.timeToFirstFrame();
+            coldStages = timer.stages();
+            warmStageTotals.assign(coldStages.size(), 0.0);
+        }
+        else {
+            warm.add(timer.timeToFirstFrame());
+            for (size_t i = 0; i < coldStages.size(); i++) {
+                warmStageTotals[i] += timer.stageMilliseconds(coldStages[i].name);
+            }
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "\nStartup benchmark (" << runs << (runs == 1 ? " run, " : " runs, ") << (config.headless ? "headless" : "windowed") << "):\n"
+        << "    cold           " << cold << " ms to first frame\n";
+    std::cout.unsetf(std::ios::floatfield);
+
+    if (warm.count() == 0) return;
+    warm.printLine(std::cout);
+
+    std::cout << std::fixed << std::setprecision(2) << "    " << std::left << std::setw(24) << "stage" << std::right
+        << std::setw(10) << "cold" << std::setw(12) << "warm mean" << "\n";
+    for (size_t i = 0; i < coldStages.size(); i++) {
+        std::cout << "    " << std::left << std::setw(24) << coldStages[i].name << std::right
+            << std::setw(7) << coldStages[i].duration << " ms" << std::setw(9) << warmStageTotals[i] / warm.count() << " ms\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+}
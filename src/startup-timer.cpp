@@ -0,0 +1,90 @@
+// startup-timer.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include "startup-timer.h"
+#include "frame-stats.h"
+
+void StartupTimer::begin() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    beginTime = Clock::now();
+    lastStageEnd = beginTime;
+    mainThread = std::this_thread::get_id();
+    recorded.clear();
+    firstFrame = -1.0;
+}
+
+void StartupTimer::addStage(const char* name, Clock::time_point start, Clock::time_point end) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (firstFrame >= 0.0) return;
+
+    recorded.push_back({ name, elapsedMilliseconds(beginTime, start), elapsedMilliseconds(start, end),
+        std::this_thread::get_id() == mainThread });
+    lastStageEnd = std::max(lastStageEnd, end);
+}
+
+void StartupTimer::markFirstFrame() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (firstFrame >= 0.0) return;
+
+    Clock::time_point now = Clock::now();
+    recorded.push_back({ "first frame", elapsedMilliseconds(beginTime, lastStageEnd), elapsedMilliseconds(lastStageEnd, now), true });
+    firstFrame = elapsedMilliseconds(beginTime, now);
+}
+
+bool StartupTimer::hasFirstFrame() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return firstFrame >= 0.0;
+}
+
+double StartupTimer::timeToFirstFrame() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::max(firstFrame, 0.0);
+}
+
+double StartupTimer::stageMilliseconds(const char* name) const {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    double total = 0.0;
+    for (const Stage& stage : recorded) {
+        if (std::strcmp(stage.name, name) == 0) total += stage.duration;
+    }
+    return total;
+}
+
+std::vector<StartupTimer::Stage> StartupTimer::stages() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return recorded;
+}
+
+void StartupTimer::report(std::ostream& out) const {
+
+    std::vector<Stage> sorted = stages();
+    std::sort(sorted.begin(), sorted.end(), [](const Stage& a, const Stage& b) { return a.start < b.start; });
+
+    // Stage time that ran alongside other stages: the sum of all of them minus the time covered by at least one
+    double busy = 0.0, covered = 0.0, coveredUntil = 0.0;
+    for (const Stage& stage : sorted) {
+        busy += stage.duration;
+        double end = stage.start + stage.duration;
+        if (end > coveredUntil) {
+            covered += end - std::max(stage.start, coveredUntil);
+            coveredUntil = end;
+        }
+    }
+
+    out << std::fixed << std::setprecision(2) << "\nStartup: " << timeToFirstFrame() << " ms to first frame\n";
+    for (const Stage& stage : sorted) {
+        out << "    " << std::left << std::setw(24) << stage.name << std::right
+            << " at " << std::setw(8) << stage.start << " ms  " << std::setw(8) << stage.duration << " ms"
+            << (stage.mainThread ? "" : "  (worker thread)") << "\n";
+    }
+    if (busy > covered) {
+        out << "    " << busy - covered << " ms overlapped across threads\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,83 @@
+// startup-timer.h
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "profiler.h"
+
+// Where the time between run() and the first finished frame goes.
+//
+// Every init stage is timed with STARTUP_STAGE, which also opens a profiler zone of the same name, so stages show
+// up in the Chrome trace too when profiling is on. Stages can run on any thread; the report marks the ones that ran
+// off the main thread and how much time was saved by overlapping them.
+//
+// The first frame closes the timeline. Stages that come after it (setupDebugMessenger runs again whenever the
+// validation schedule comes back around) aren't startup any more and are ignored.
+
+class StartupTimer {
+
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Stage {
+		const char* name;
+		double start;               // Milliseconds since begin()
+		double duration;
+		bool mainThread;
+	};
+
+	// Starts the timeline. Must be called from the main thread.
+	void begin();
+
+	void addStage(const char* name, Clock::time_point start, Clock::time_point end);
+
+	// Adds a "first frame" stage from the end of the last stage until now. Only the first call counts.
+	void markFirstFrame();
+	bool hasFirstFrame() const;
+
+	// Milliseconds from begin() to markFirstFrame()
+	double timeToFirstFrame() const;
+
+	// Total of every stage with this name, 0 if there's none
+	double stageMilliseconds(const char* name) const;
+
+	std::vector<Stage> stages() const;
+
+	void report(std::ostream& out) const;
+
+private:
+
+	mutable std::mutex mutex;
+	Clock::time_point beginTime;
+	Clock::time_point lastStageEnd;
+	std::thread::id mainThread;
+	std::vector<Stage> recorded;
+	double firstFrame = -1.0;
+};
+
+// Times the enclosing scope as a startup stage. Use through STARTUP_STAGE.
+class StartupStage {
+
+public:
+
+	StartupStage(StartupTimer& timer, const char* name)
+		: timer(timer), name(name), zone(name), start(StartupTimer::Clock::now()) {}
+	~StartupStage() { timer.addStage(name, start, StartupTimer::Clock::now()); }
+
+	StartupStage(const StartupStage&) = delete;
+	StartupStage& operator=(const StartupStage&) = delete;
+
+private:
+
+	StartupTimer& timer;
+	const char* name;
+	ProfileZone zone;
+	StartupTimer::Clock::time_point start;
+};
+
+#define STARTUP_STAGE(timer, name) StartupStage PROFILE_CONCAT(startupStage, __LINE__)(timer, name)
@@ -0,0 +1,22 @@
+// swap-chain-support-details.h
+
+#pragma once
+
+#include <vector>
+#include "include.h"
+
+// Everything a surface can tell us about the swap chains it supports for a given physical device.
+// https://vulkan-tutorial.com/Drawing_a_triangle/Presentation/Swap_chain
+
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;      // Min/max number of images, min/max image extent
+    std::vector<VkSurfaceFormatKHR> formats;    // Pixel format and color space pairs
+    std::vector<VkPresentModeKHR> presentModes; // Available presentation modes
+
+    bool isAdequate() const {
+        // At least one format and one present mode is enough to build a swap chain from
+        return !formats.empty() && !presentModes.empty();
+    }
+};
+
+SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
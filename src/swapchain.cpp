@@ -0,0 +1,448 @@
+// swapchain.cpp
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include "swapchain.h"
+
+const char* presentPreferenceName(PresentPreference preference) {
+
+    switch (preference) {
+    case PresentPreference::Mailbox:     return "mailbox";
+    case PresentPreference::Immediate:   return "immediate";
+    case PresentPreference::FifoRelaxed: return "relaxed";
+    case PresentPreference::Fifo:        return "fifo";
+    }
+    return "unknown";
+}
+
+static const char* presentModeName(VkPresentModeKHR mode) {
+
+    switch (mode) {
+    case VK_PRESENT_MODE_MAILBOX_KHR:      return "MAILBOX";
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "IMMEDIATE";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+    case VK_PRESENT_MODE_FIFO_KHR:         return "FIFO";
+    default:                               return "other";
+    }
+}
+
+SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) {
+
+    SwapChainSupportDetails details;
+
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+    uint32_t formatCount;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+    details.formats.resize(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+
+    uint32_t presentModeCount;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+    details.presentModes.resize(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+
+    return details;
+}
+
+VkSurfaceFormatKHR Swapchain::chooseSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
+
+    // SRGB gives more accurate perceived colors, and is the standard color space for images such as textures
+    for (const auto& availableFormat : availableFormats) {
+        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            return availableFormat;
+        }
+    }
+    return availableFormats[0];
+}
+
+VkPresentModeKHR Swapchain::choosePresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, PresentPreference preference) {
+
+    // The preferred mode goes first, then the rest in rough order of latency. FIFO is always there to land on.
+    std::vector<VkPresentModeKHR> order;
+    switch (preference) {
+    case PresentPreference::Mailbox:
+        order = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+        break;
+    case PresentPreference::Immediate:
+        order = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+        break;
+    case PresentPreference::FifoRelaxed:
+        order = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+        break;
+    case PresentPreference::Fifo:
+        break;
+    }
+
+    for (VkPresentModeKHR mode : order) {
+        if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end()) {
+            return mode;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkExtent2D Swapchain::chooseExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D windowExtent) {
+
+    // Most surfaces tell us exactly how big the images have to be. A currentExtent of UINT32_MAX means the surface
+    // leaves it up to us (headless surfaces do this), in which case the window size is used, clamped to the limits.
+
+    if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+        return capabilities.currentExtent;
+    }
+
+    VkExtent2D actualExtent = windowExtent;
+    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    return actualExtent;
+}
+
+void Swapchain::create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface,
+    const QueueFamilyIndices& indices, VkExtent2D windowExtent, const SwapchainSettings& settings,
+    const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    this->surface = surface;
+    this->queueFamilies = indices;
+    this->settings = settings;
+    this->allocationCallbacks = allocationCallbacks;
+
+    createSwapchain(windowExtent, VK_NULL_HANDLE);
+    createImageSemaphores();
+    createFramesInFlight(indices.graphicsFamily.value(), std::max(settings.framesInFlight, 1u));
+}
+
+void Swapchain::recreate(VkExtent2D windowExtent, DeferredDestruction& deferred) {
+
+    Clock::time_point start = Clock::now();
+    VkExtent2D oldExtent = extent;
+
+    // Frames in flight may still be rendering to the old images or waiting to present them, so everything tied to
+    // them is kept until those frames are done. The presentation engine doesn't say when it's finished with a
+    // render finished semaphore, but it has by the time the frame that presented with it has been waited on again
+    // framesInFlight frames later, which is what the deferred queue waits for. They're handed over before anything
+    // new is created, so a failed create can't destroy them under those frames.
+    for (UniqueImageView& view : imageViews) {
+        deferred.defer(std::move(view));
+    }
+    for (UniqueSemaphore& semaphore : renderFinished) {
+        deferred.defer(std::move(semaphore));
+    }
+    imageViews.clear();
+    renderFinished.clear();
+
+    // Handing over the old swap chain lets the implementation reuse its resources, and any image of it that's still
+    // queued for presentation gets presented. It's retired either way, even if the create fails.
+    VkSwapchainKHR oldSwapchain = swapChain;
+    deferred.defer(std::move(swapChain));
+    createSwapchain(windowExtent, oldSwapchain);
+    createImageSemaphores();
+
+    // The frame slots' fences carry over; only which of them last wrote each image starts over with the new images
+    imagesInFlight.assign(images.size(), VK_NULL_HANDLE);
+    stale = false;
+
+    recreations.push_back({ oldExtent, extent, elapsedMilliseconds(start, Clock::now()) });
+    recreatedSinceLastFrame = true;
+}
+
+void Swapchain::createSwapchain(VkExtent2D windowExtent, VkSwapchainKHR oldSwapchain) {
+
+    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice, surface);
+
+    VkSurfaceFormatKHR surfaceFormat = chooseSurfaceFormat(swapChainSupport.formats);
+    presentMode = choosePresentMode(swapChainSupport.presentModes, settings.presentMode);
+    extent = chooseExtent(swapChainSupport.capabilities, windowExtent);
+    imageFormat = surfaceFormat.format;
+
+    // A maxImageCount of 0 means there's no maximum
+    uint32_t imageCount = std::max(settings.imageCount, swapChainSupport.capabilities.minImageCount);
+    if (swapChainSupport.capabilities.maxImageCount > 0) {
+        imageCount = std::min(imageCount, swapChainSupport.capabilities.maxImageCount);
+    }
+
+    VkSwapchainCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = surface;
+    createInfo.minImageCount = imageCount;
+    createInfo.imageFormat = surfaceFormat.format;
+    createInfo.imageColorSpace = surfaceFormat.colorSpace;
+    createInfo.imageExtent = extent;
+    createInfo.imageArrayLayers = 1;
+
+    // Frames are cleared with a transfer until there's a pipeline to draw with
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    // If graphics and presentation happen on different queue families, the images have to be shared between them.
+    // Concurrent mode is slower than handing ownership over explicitly, but it's rare enough not to matter yet.
+    uint32_t queueFamilyIndices[] = { queueFamilies.graphicsFamily.value(), queueFamilies.presentFamily.value() };
+    if (queueFamilies.graphicsFamily != queueFamilies.presentFamily) {
+        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = queueFamilyIndices;
+    }
+    else {
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = oldSwapchain;
+
+    VkSwapchainKHR created;
+    if (vkCreateSwapchainKHR(device, &createInfo, allocationCallbacks, &created) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create swap chain!");
+    }
+    swapChain = UniqueSwapchain(device, created, vkDestroySwapchainKHR, allocationCallbacks);
+
+    // The implementation may create more images than we asked for, so ask how many there really are
+    vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+    images.resize(imageCount);
+    vkGetSwapchainImagesKHR(device, swapChain, &imageCount, images.data());
+
+    createImageViews();
+}
+
+void Swapchain::createImageViews() {
+
+    imageViews.clear();
+    imageViews.reserve(images.size());
+
+    for (size_t i = 0; i < images.size(); i++) {
+        VkImageViewCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = images[i];
+        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        createInfo.format = imageFormat;
+        createInfo.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
+        createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        createInfo.subresourceRange.baseMipLevel = 0;
+        createInfo.subresourceRange.levelCount = 1;
+        createInfo.subresourceRange.baseArrayLayer = 0;
+        createInfo.subresourceRange.layerCount = 1;
+
+        VkImageView view;
+        if (vkCreateImageView(device, &createInfo, allocationCallbacks, &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image views!");
+        }
+        imageViews.emplace_back(device, view, vkDestroyImageView, allocationCallbacks);
+    }
+}
+
+void Swapchain::createFramesInFlight(uint32_t queueFamily, uint32_t count) {
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    // Fences start signaled so the very first wait on each frame slot returns straight away
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    // Each frame gets its own pool so it can be reset in one go once that frame's fence has signaled, rather than
+    // resetting command buffers one at a time
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    frames.resize(count);
+    for (FrameInFlight& frame : frames) {
+        VkCommandPool pool;
+        if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create frame command pool!");
+        }
+        frame.commandPool = UniqueCommandPool(device, pool, vkDestroyCommandPool, allocationCallbacks);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkSemaphore imageAvailable = VK_NULL_HANDLE;
+        VkFence inFlight = VK_NULL_HANDLE;
+        bool created = vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) == VK_SUCCESS &&
+            vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &imageAvailable) == VK_SUCCESS &&
+            vkCreateFence(device, &fenceInfo, allocationCallbacks, &inFlight) == VK_SUCCESS;
+        frame.imageAvailable = UniqueSemaphore(device, imageAvailable, vkDestroySemaphore, allocationCallbacks);
+        frame.inFlight = UniqueFence(device, inFlight, vkDestroyFence, allocationCallbacks);
+        if (!created) {
+            throw std::runtime_error("failed to create synchronization objects for a frame!");
+        }
+    }
+
+    currentFrame = 0;
+}
+
+void Swapchain::createImageSemaphores() {
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    renderFinished.clear();
+    renderFinished.reserve(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        VkSemaphore semaphore;
+        if (vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create synchronization objects for a frame!");
+        }
+        renderFinished.emplace_back(device, semaphore, vkDestroySemaphore, allocationCallbacks);
+    }
+
+    imagesInFlight.assign(images.size(), VK_NULL_HANDLE);
+}
+
+VkCommandBuffer Swapchain::beginFrame() {
+
+    FrameInFlight& frame = frames[currentFrame];
+
+    // The only point where the CPU waits on the GPU: this slot was last used framesInFlight frames ago
+    Clock::time_point waitStart = Clock::now();
+    if (lastFrameStart != Clock::time_point()) {
+        double interval = elapsedMilliseconds(lastFrameStart, waitStart);
+        if (recreatedSinceLastFrame) {
+            recreations.back().frameMs = interval;
+        }
+        else {
+            frameInterval.add(interval);
+        }
+    }
+    lastFrameStart = waitStart;
+    recreatedSinceLastFrame = false;
+
+    VkFence inFlight = frame.inFlight;
+    vkWaitForFences(device, 1, &inFlight, VK_TRUE, UINT64_MAX);
+    acquireStart = Clock::now();
+    fenceWait.add(elapsedMilliseconds(waitStart, acquireStart));
+
+    // Out of date means there's no image and the semaphore won't be signaled, so there's nothing to render to until
+    // the swap chain is recreated. Suboptimal still hands out an image, so this frame goes ahead and the next one
+    // gets a new swap chain.
+    VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        stale = true;
+        return VK_NULL_HANDLE;
+    }
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        throw std::runtime_error("failed to acquire swap chain image!");
+    }
+    if (result == VK_SUBOPTIMAL_KHR) {
+        stale = true;
+    }
+
+    // With more images than frames in flight, the image we got back may still be in use by an older frame slot
+    if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+        vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+    }
+    imagesInFlight[imageIndex] = inFlight;
+
+    // Only reset the fence once we know work will be submitted with it, otherwise an early return would deadlock
+    vkResetFences(device, 1, &inFlight);
+    vkResetCommandPool(device, frame.commandPool, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(frame.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    return frame.commandBuffer;
+}
+
+void Swapchain::endFrame(VkQueue graphicsQueue, VkQueue presentQueue) {
+
+    FrameInFlight& frame = frames[currentFrame];
+
+    if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+
+    // Nothing may write the image before the presentation engine has handed it over
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSemaphore imageAvailable = frame.imageAvailable;
+    VkSemaphore finished = renderFinished[imageIndex];
+    VkSwapchainKHR presented = swapChain;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &imageAvailable;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &frame.commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &finished;
+
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlight) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &finished;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &presented;
+    presentInfo.pImageIndices = &imageIndex;
+
+    // The submit above has happened either way, so the frame slot moves on even when presenting didn't
+    VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        stale = true;
+    }
+    else if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to present swap chain image!");
+    }
+
+    acquireToPresent.add(elapsedMilliseconds(acquireStart, Clock::now()));
+
+    currentFrame = (currentFrame + 1) % frames.size();
+}
+
+void Swapchain::report(std::ostream& out) const {
+
+    out << "\nSwap chain: " << images.size() << " images, " << frames.size() << " frames in flight, "
+        << presentModeName(presentMode) << ", " << extent.width << "x" << extent.height << "\n";
+    fenceWait.printLine(out);
+    acquireToPresent.printLine(out);
+
+    if (recreations.empty()) return;
+
+    // Each recreation's frame against the median frame without one. Long runs of resizes only list the first few.
+    static constexpr size_t listed = 16;
+    double median = frameInterval.count() > 0 ? frameInterval.percentile(50.0) : 0.0;
+    out << "    " << recreations.size() << " recreations, frames without one " << std::fixed << std::setprecision(2)
+        << median << " ms median\n";
+    for (size_t i = 0; i < recreations.size() && i < listed; i++) {
+        const Recreation& r = recreations[i];
+        out << "    " << r.from.width << "x" << r.from.height << " -> " << r.to.width << "x" << r.to.height << ": "
+            << r.recreateMs << " ms to recreate";
+        if (r.frameMs >= 0.0) {
+            out << ", frame " << r.frameMs << " ms (" << std::showpos << r.frameMs - median << std::noshowpos << " ms)";
+        }
+        out << "\n";
+    }
+    if (recreations.size() > listed) {
+        out << "    ... " << recreations.size() - listed << " more\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
+
+void Swapchain::destroy() {
+
+    // Each handle destroys itself; this only puts the views before the swap chain their images belong to, which is
+    // also the order the members go in when the Swapchain goes out of scope
+    frames.clear();
+    renderFinished.clear();
+    imagesInFlight.clear();
+    imageViews.clear();
+    images.clear();
+    swapChain.reset();
+}
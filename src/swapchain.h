@@ -0,0 +1,139 @@
+// swapchain.h
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include "include.h"
+#include "deferred-destruction.h"
+#include "queue-family-indices.h"
+#include "swap-chain-support-details.h"
+#include "frame-stats.h"
+#include "vulkan-handle.h"
+
+// Which present mode to ask for. The surface may not support it, in which case we fall back through the
+// others in the order below and end up at FIFO, the only mode every implementation has to offer.
+//
+// Mailbox       Lowest latency without tearing. New frames replace the queued one instead of waiting behind it.
+// Immediate     No waiting at all, may tear. Best raw throughput.
+// FifoRelaxed   VSync, but a late frame is shown immediately instead of waiting a whole extra refresh.
+// Fifo          Plain VSync.
+
+enum class PresentPreference {
+	Mailbox,
+	Immediate,
+	FifoRelaxed,
+	Fifo
+};
+
+const char* presentPreferenceName(PresentPreference preference);
+
+struct SwapchainSettings {
+	PresentPreference presentMode = PresentPreference::Mailbox;
+
+	// Requested swap chain images: 2 for double buffering, 3 for triple. Clamped to what the surface allows.
+	uint32_t imageCount = 3;
+
+	// How many frames the CPU may record ahead of the GPU. Each one has its own command buffer, fence and
+	// acquire semaphore, so recording frame N only waits on the GPU finishing frame N - framesInFlight.
+	uint32_t framesInFlight = 2;
+};
+
+class Swapchain {
+
+public:
+
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface,
+		const QueueFamilyIndices& indices, VkExtent2D windowExtent, const SwapchainSettings& settings,
+		const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Builds a swap chain for the new size from the current one (oldSwapchain), between frames. The frame slots stay
+	// as they are, so frames in flight finish on their own: the old swap chain, its views and its semaphores go to
+	// the deferred destruction queue rather than waiting for the device to go idle.
+	void recreate(VkExtent2D windowExtent, DeferredDestruction& deferred);
+
+	// Set once acquire or present reports that the swap chain no longer matches the surface, until recreate()
+	bool outOfDate() const { return stale; }
+
+	// Waits for this frame slot to come free, acquires an image and returns the slot's command buffer, already
+	// begun. The caller records into it and then calls endFrame, which submits and presents. Returns VK_NULL_HANDLE
+	// without touching the slot when the swap chain is out of date, in which case the frame is skipped.
+	VkCommandBuffer beginFrame();
+	void endFrame(VkQueue graphicsQueue, VkQueue presentQueue);
+
+	VkImage currentImage() const { return images[imageIndex]; }
+
+	// The frame slot between beginFrame and endFrame, in [0, framesInFlight())
+	uint32_t frameIndex() const { return currentFrame; }
+	uint32_t framesInFlight() const { return static_cast<uint32_t>(frames.size()); }
+	VkExtent2D getExtent() const { return extent; }
+	VkFormat getImageFormat() const { return imageFormat; }
+	VkPresentModeKHR getPresentMode() const { return presentMode; }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	using Clock = std::chrono::steady_clock;
+
+	struct FrameInFlight {
+		UniqueCommandPool commandPool;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;   // Freed with the pool
+		UniqueSemaphore imageAvailable;
+		UniqueFence inFlight;
+	};
+
+	VkSurfaceFormatKHR chooseSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
+	VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, PresentPreference preference);
+	VkExtent2D chooseExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D windowExtent);
+
+	void createSwapchain(VkExtent2D windowExtent, VkSwapchainKHR oldSwapchain);
+	void createImageViews();
+	void createImageSemaphores();
+	void createFramesInFlight(uint32_t queueFamily, uint32_t count);
+
+	struct Recreation {
+		VkExtent2D from;
+		VkExtent2D to;
+		double recreateMs;                  // The recreate() call itself
+		double frameMs = -1.0;              // beginFrame to beginFrame across it, -1 until the next frame starts
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	QueueFamilyIndices queueFamilies;
+	SwapchainSettings settings;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	UniqueSwapchain swapChain;
+	bool stale = false;
+	VkFormat imageFormat = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{};
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+	std::vector<VkImage> images;            // Owned by the swap chain
+	std::vector<UniqueImageView> imageViews;
+
+	// The render finished semaphore is waited on by the presentation engine, which gives no signal of when it's
+	// done with it. It's only safe to reuse once that same image has been acquired again, hence one per image.
+	std::vector<UniqueSemaphore> renderFinished;
+
+	// Fence of the frame that last rendered to each image, so an image is never written by two frames at once
+	std::vector<VkFence> imagesInFlight;
+
+	std::vector<FrameInFlight> frames;
+	uint32_t currentFrame = 0;
+	uint32_t imageIndex = 0;
+
+	Clock::time_point acquireStart;
+	FrameStats fenceWait{ "fence wait" };
+	FrameStats acquireToPresent{ "acquire->present" };
+
+	// The hitch a recreation causes is the frame it lands in, against the frames without one
+	Clock::time_point lastFrameStart;
+	bool recreatedSinceLastFrame = false;
+	FrameStats frameInterval{ "frame interval" };
+	std::vector<Recreation> recreations;
+};
@@ -0,0 +1,30 @@
+// test-harness.h
+
+#pragma once
+
+#include <cstdint>
+#include "include.h"
+#include "device-capabilities.h"
+#include "vulkan-handle.h"
+
+// What the tests in vulkan-test-tests share. ctest runs them one at a time by name, see test-main.cpp.
+//
+// The tests need a Vulkan device but no window, and CMakeLists.txt points them at lavapipe when it can find it. A
+// failed CHECK prints where it was and the test carries on, so a run shows every failure at once. A test that can't
+// run at all, because there's no device, throws TestSkipped and ctest reports it as skipped rather than failed.
+
+#define CHECK(condition) checkThat((condition), #condition, __FILE__, __LINE__)
+
+void checkThat(bool passed, const char* condition, const char* file, int line);
+
+struct TestSkipped {
+	const char* reason;
+};
+
+// An instance at apiVersion, without layers or extensions, and its first physical device. Returns false when the
+// loader doesn't go up to apiVersion, and throws TestSkipped when there's no device at all.
+bool createTestInstance(uint32_t apiVersion, UniqueInstance& instance, VkPhysicalDevice& physicalDevice);
+
+// A device created with a negotiated feature chain and its extensions, with one queue from family 0. Every device
+// has a family 0, and lavapipe's does graphics, compute and transfer.
+UniqueDevice createTestDevice(VkPhysicalDevice physicalDevice, const DeviceFeatureChain& features, VkQueue& queue);
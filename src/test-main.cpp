@@ -0,0 +1,144 @@
+// test-main.cpp
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include "include.h"
+#include "test-harness.h"
+
+// Entry point of the vulkan-test-tests target in CMakeLists.txt. ctest runs it once per test, with the test's name
+// as the only argument; without one it runs them all. The Visual Studio project doesn't build the tests.
+
+void testBuddyAllocator();
+void testDeferredDestruction();
+void testDeviceAllocator();
+void testDeviceCapabilities();
+void testHeadlessResize();
+void testUploadRing();
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const TestCase tests[] = {
+    { "buddy-allocator", testBuddyAllocator },
+    { "deferred-destruction", testDeferredDestruction },
+    { "device-allocator", testDeviceAllocator },
+    { "device-capabilities", testDeviceCapabilities },
+    { "headless-resize", testHeadlessResize },
+    { "upload-ring", testUploadRing },
+};
+
+// What ctest takes as "skipped", see SKIP_RETURN_CODE in CMakeLists.txt
+static constexpr int skippedExitCode = 77;
+
+static uint32_t failedChecks = 0;
+
+void checkThat(bool passed, const char* condition, const char* file, int line) {
+
+    if (passed) return;
+
+    std::cerr << file << ":" << line << ": CHECK(" << condition << ") failed\n";
+    failedChecks++;
+}
+
+bool createTestInstance(uint32_t apiVersion, UniqueInstance& instance, VkPhysicalDevice& physicalDevice) {
+
+    // A 1.0 loader has no vkEnumerateInstanceVersion, and refuses any other version
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+    if (enumerateInstanceVersion != nullptr) {
+        enumerateInstanceVersion(&loaderVersion);
+    }
+    if (loaderVersion < apiVersion) return false;
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Vulkan Test tests";
+    appInfo.apiVersion = apiVersion;
+
+    VkInstanceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+
+    VkInstance rawInstance;
+    VkResult result = vkCreateInstance(&createInfo, nullptr, &rawInstance);
+    if (result == VK_ERROR_INCOMPATIBLE_DRIVER) {
+        throw TestSkipped{ "no Vulkan driver" };
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create instance!");
+    }
+    instance = UniqueInstance(rawInstance, vkDestroyInstance, nullptr);
+
+    uint32_t deviceCount = 1;
+    result = vkEnumeratePhysicalDevices(instance, &deviceCount, &physicalDevice);
+    if (deviceCount == 0 || (result != VK_SUCCESS && result != VK_INCOMPLETE)) {
+        throw TestSkipped{ "no Vulkan device" };
+    }
+    return true;
+}
+
+UniqueDevice createTestDevice(VkPhysicalDevice physicalDevice, const DeviceFeatureChain& features, VkQueue& queue) {
+
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo{};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = 0;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &priority;
+
+    VkDeviceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = features.next();
+    createInfo.queueCreateInfoCount = 1;
+    createInfo.pQueueCreateInfos = &queueInfo;
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(features.extensions().size());
+    createInfo.ppEnabledExtensionNames = features.extensions().data();
+
+    VkDevice device;
+    if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create logical device!");
+    }
+    vkGetDeviceQueue(device, 0, 0, &queue);
+    return UniqueDevice(device, vkDestroyDevice, nullptr);
+}
+
+int main(int argc, char** argv) {
+
+    const char* only = argc > 1 ? argv[1] : nullptr;
+    uint32_t ran = 0, skipped = 0, failed = 0;
+
+    for (const TestCase& test : tests) {
+        if (only != nullptr && std::strcmp(only, test.name) != 0) continue;
+        ran++;
+
+        uint32_t failedBefore = failedChecks;
+        try {
+            test.run();
+        }
+        catch (const TestSkipped& skip) {
+            std::cout << test.name << ": skipped, " << skip.reason << "\n";
+            skipped++;
+            continue;
+        }
+        catch (const std::exception& e) {
+            std::cerr << test.name << ": " << e.what() << "\n";
+            failedChecks++;
+        }
+
+        bool passed = failedChecks == failedBefore;
+        std::cout << test.name << ": " << (passed ? "passed" : "FAILED") << "\n";
+        failed += passed ? 0 : 1;
+    }
+
+    if (ran == 0) {
+        std::cerr << "no test named " << only << "\n";
+        return EXIT_FAILURE;
+    }
+    if (failed > 0) return EXIT_FAILURE;
+    return skipped == ran ? skippedExitCode : EXIT_SUCCESS;
+}
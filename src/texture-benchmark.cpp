@@ -0,0 +1,136 @@
+// texture-benchmark.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "include.h"
+#include "application.h"
+#include "frame-stats.h"
+#include "texture-file.h"
+
+// Texture streaming without a renderer: each "frame" is a TextureStreamer::update() and an upload ring flush, with
+// requests standing in for what a renderer would ask for. Frames are paced at frameRate, about what a fast renderer
+// manages, so the loader threads and the transfer queue get the time between updates they'd have in a real run.
+// Three steps:
+//
+// - Every texture added at once, until every one has its tail. That's how soon a new scene can draw at all.
+// - Every texture requested at full size, until nothing more fits the budget.
+// - A window over a quarter of the textures requested at full size, moving by one texture every sweepStep frames,
+//   twice around, like a camera panning across a scene. Textures falling out of the window get evicted for the ones
+//   coming in.
+//
+// The report at exit (TextureStreamer::report) has the misses and stalls.
+
+static constexpr uint32_t textureSize = 1024;
+static constexpr uint32_t maxUpdates = 100000;
+static constexpr uint32_t sweepStep = 8;
+static constexpr double frameRate = 240.0;
+
+std::vector<std::string> Application::benchmarkTextureFiles(uint32_t count) {
+
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+    if (error) {
+        directory = ".";
+    }
+
+    // Written once and kept, like the mesh benchmark's scene
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < count; i++) {
+        std::filesystem::path path = directory / ("vulkan-test-texture-" + std::to_string(i) + ".vktex");
+        try {
+            TextureFile file;
+            file.open(path.string());
+            if (file.header().width != textureSize || file.header().height != textureSize) {
+                throw std::runtime_error("wrong size");
+            }
+        }
+        catch (const std::runtime_error&) {
+            std::vector<uint8_t> texels = makeTestTexture(textureSize, textureSize, i);
+            writeTextureFile(path.string(), textureSize, textureSize, texels.data(), true);
+        }
+        paths.push_back(path.string());
+    }
+    return paths;
+}
+
+void Application::runTextureBenchmark() {
+
+    std::vector<std::string> paths = benchmarkTextureFiles(textureBenchmarkTextures);
+    std::cout << "\nTexture streaming benchmark: " << paths.size() << " textures of " << textureSize << "x" << textureSize
+        << ", " << std::fixed << std::setprecision(1) << textures.budget() / double(1 << 20) << " MiB budget\n";
+    std::cout.unsetf(std::ios::floatfield);
+
+    std::vector<TextureStreamer::Handle> handles;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& path : paths) {
+        handles.push_back(textures.add(path));
+    }
+
+    auto nextFrame = std::chrono::steady_clock::now();
+    // No frame fence here, so each frame counts as one finished for the images the streamer replaces
+    auto frame = [&]() {
+        deferred.beginFrame();
+        deferred.collect(uploadRing.completed());
+        textures.update();
+        uploadRing.flush();
+        nextFrame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / frameRate));
+        std::this_thread::sleep_until(nextFrame);
+    };
+
+    uint32_t updates = 0;
+    auto allResident = [&]() {
+        return std::all_of(handles.begin(), handles.end(), [&](TextureStreamer::Handle h) { return textures.resident(h); });
+    };
+    while (!allResident() && updates++ < maxUpdates) {
+        frame();
+    }
+    std::cout << std::fixed << std::setprecision(3)
+        << "    every tail resident     " << std::setw(10) << elapsedMilliseconds(start, std::chrono::steady_clock::now())
+        << " ms, " << updates << " updates\n";
+
+    // Settled once nothing has been pending for a few updates in a row
+    auto settle = [&](auto&& requestAll) {
+        uint32_t idle = 0;
+        updates = 0;
+        while (idle < 3 && updates++ < maxUpdates) {
+            requestAll();
+            frame();
+            idle = textures.pendingRequests() == 0 ? idle + 1 : 0;
+        }
+    };
+
+    start = std::chrono::steady_clock::now();
+    settle([&]() { for (TextureStreamer::Handle h : handles) textures.request(h, 0); });
+    uint32_t full = static_cast<uint32_t>(std::count_if(handles.begin(), handles.end(),
+        [&](TextureStreamer::Handle h) { return textures.residentLevel(h) == 0; }));
+    std::cout << "    everything requested    " << std::setw(10) << elapsedMilliseconds(start, std::chrono::steady_clock::now())
+        << " ms, " << updates << " updates, " << full << " at full size, " << std::setprecision(1)
+        << textures.residentBytes() / double(1 << 20) << " MiB resident\n";
+
+    uint32_t window = std::max(1u, static_cast<uint32_t>(handles.size()) / 4);
+    uint32_t sweepFrames = 2 * static_cast<uint32_t>(handles.size()) * sweepStep;
+    uint32_t missed = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t f = 0; f < sweepFrames; f++) {
+        for (uint32_t i = 0; i < window; i++) {
+            TextureStreamer::Handle h = handles[(f / sweepStep + i) % handles.size()];
+            textures.request(h, 0);
+            if (textures.residentLevel(h) != 0) missed++;
+        }
+        frame();
+    }
+    std::cout << std::setprecision(3)
+        << "    sweep                   " << std::setw(10) << elapsedMilliseconds(start, std::chrono::steady_clock::now())
+        << " ms, " << sweepFrames << " frames, " << std::setprecision(1) << 100.0 * missed / (sweepFrames * window)
+        << "% of requests drawn coarser, " << textures.pendingRequests() << " pending at the end\n";
+    std::cout.unsetf(std::ios::floatfield);
+
+    uploadRing.report(std::cout);
+}
@@ -0,0 +1,146 @@
+// texture-file.cpp
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include "include.h"
+#include "texture-file.h"
+
+namespace fs = std::filesystem;
+
+void TextureFile::open(const std::string& path) {
+
+    std::string error;
+    if (!mapping.open(path, &error, false)) {
+        throw std::runtime_error("failed to load texture " + path + " (" + error + ")!");
+    }
+
+    auto fail = [&](const char* reason) {
+        mapping.close();
+        throw std::runtime_error("failed to load texture " + path + " (" + reason + ")!");
+    };
+
+    size_t length = mapping.size();
+    if (length < sizeof(TextureFileHeader)) fail("too short");
+    const TextureFileHeader& h = header();
+    if (h.magic != textureFileMagic) fail("not a texture file");
+    if (h.version != textureFileVersion) fail("written by a different version");
+    if (h.format != VK_FORMAT_R8G8B8A8_UNORM && h.format != VK_FORMAT_R8G8B8A8_SRGB) fail("unsupported format");
+    if (h.mipCount == 0 || h.mipCount > textureFileMaxMips ||
+        sizeof(TextureFileHeader) + uint64_t(h.mipCount) * sizeof(TextureFileMip) > length) {
+        fail("bad mip table");
+    }
+
+    for (uint32_t level = 0; level < h.mipCount; level++) {
+        const TextureFileMip& m = mip(level);
+        uint32_t width = std::max(h.width >> level, 1u);
+        uint32_t height = std::max(h.height >> level, 1u);
+        if (m.width != width || m.height != height || m.size != uint64_t(width) * height * 4 ||
+            m.offset % textureFileAlignment != 0 || m.offset > length || m.size > length - m.offset) {
+            fail("mip out of bounds");
+        }
+    }
+    if (std::max(h.width, h.height) >> (h.mipCount - 1) != 1) fail("incomplete mip chain");
+}
+
+void writeTextureFile(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba, bool srgb) {
+
+    if (width == 0 || height == 0 || std::max(width, height) >= (1u << textureFileMaxMips)) {
+        throw std::runtime_error("failed to write texture " + path + " (bad size)!");
+    }
+
+    // Every level, each from the one before. Linear averaging even for sRGB, which is slightly too dark but fine here.
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(rgba, rgba + size_t(width) * height * 4);
+    uint32_t w = width, h = height;
+    while (w > 1 || h > 1) {
+        uint32_t nw = std::max(w / 2, 1u), nh = std::max(h / 2, 1u);
+        const std::vector<uint8_t>& source = levels.back();
+        std::vector<uint8_t> next(size_t(nw) * nh * 4);
+        for (uint32_t y = 0; y < nh; y++) {
+            for (uint32_t x = 0; x < nw; x++) {
+                uint32_t x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                uint32_t y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                for (int c = 0; c < 4; c++) {
+                    uint32_t sum = source[(size_t(y0) * w + x0) * 4 + c] + source[(size_t(y0) * w + x1) * 4 + c] +
+                        source[(size_t(y1) * w + x0) * 4 + c] + source[(size_t(y1) * w + x1) * 4 + c];
+                    next[(size_t(y) * nw + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(std::move(next));
+        w = nw;
+        h = nh;
+    }
+
+    TextureFileHeader header{};
+    header.magic = textureFileMagic;
+    header.version = textureFileVersion;
+    header.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    header.width = width;
+    header.height = height;
+    header.mipCount = static_cast<uint32_t>(levels.size());
+
+    auto align = [](uint64_t offset) { return (offset + textureFileAlignment - 1) & ~(textureFileAlignment - 1); };
+
+    // Coarsest level first in the file
+    std::vector<TextureFileMip> mips(levels.size());
+    uint64_t offset = align(sizeof(TextureFileHeader) + mips.size() * sizeof(TextureFileMip));
+    for (size_t level = levels.size(); level-- > 0;) {
+        mips[level] = { offset, levels[level].size(), std::max(width >> level, 1u), std::max(height >> level, 1u) };
+        offset = align(offset + levels[level].size());
+    }
+
+    fs::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("failed to write texture " + path + "!");
+        }
+
+        auto write = [&](uint64_t at, const void* data, size_t size) {
+            static const char zeros[textureFileAlignment] = {};
+            uint64_t position = static_cast<uint64_t>(file.tellp());
+            if (position < at) file.write(zeros, static_cast<std::streamsize>(at - position));
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        };
+
+        write(0, &header, sizeof(header));
+        write(sizeof(header), mips.data(), mips.size() * sizeof(TextureFileMip));
+        for (size_t level = levels.size(); level-- > 0;) {
+            write(mips[level].offset, levels[level].data(), levels[level].size());
+        }
+
+        if (!file.flush()) {
+            file.close();
+            std::error_code ignored;
+            fs::remove(temporary, ignored);
+            throw std::runtime_error("failed to write texture " + path + "!");
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        throw std::runtime_error("failed to write texture " + path + "!");
+    }
+}
+
+std::vector<uint8_t> makeTestTexture(uint32_t width, uint32_t height, uint32_t seed) {
+
+    uint8_t tint[3] = { uint8_t(64 + seed * 97 % 192), uint8_t(64 + seed * 57 % 192), uint8_t(64 + seed * 31 % 192) };
+    std::vector<uint8_t> texels(size_t(width) * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            bool light = ((x / 32) + (y / 32)) % 2 == 0;
+            uint8_t* texel = &texels[(size_t(y) * width + x) * 4];
+            for (int c = 0; c < 3; c++) texel[c] = light ? tint[c] : uint8_t(tint[c] / 4);
+            texel[3] = 255;
+        }
+    }
+    return texels;
+}
@@ -0,0 +1,83 @@
+// texture-file.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mapped-file.h"
+
+// The .vktex file: one 2D texture and its whole mip chain, each level exactly as vkCmdCopyBufferToImage takes it,
+// so streaming a level in is a copy out of the mapping. Written by writeTextureFile, read by TextureFile and
+// streamed by TextureStreamer (texture-streamer.h).
+//
+//   TextureFileHeader
+//   TextureFileMip[mipCount]     level 0 (the full size) first
+//   level data                   coarsest level first, each on a textureFileAlignment boundary
+//
+// The data runs from the coarsest level to the finest, so the small levels that are always resident are one short
+// read at the start, and each finer level follows the ones before it in the order they're streamed.
+//
+// Only VK_FORMAT_R8G8B8A8_UNORM and _SRGB for now, 4 bytes per texel with rows tightly packed.
+
+constexpr uint32_t textureFileMagic = 0x58455456;      // "VTEX"
+constexpr uint32_t textureFileVersion = 1;
+constexpr uint64_t textureFileAlignment = 64;
+constexpr uint32_t textureFileMaxMips = 16;
+
+struct TextureFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;            // VkFormat
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	uint32_t reserved[2];
+};
+
+struct TextureFileMip {
+	uint64_t offset;            // From the start of the file
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+static_assert(sizeof(TextureFileHeader) == 32, "TextureFileHeader is read straight from the file");
+static_assert(sizeof(TextureFileMip) == 24, "TextureFileMip is read straight from the file");
+
+// A mapped .vktex file. Opening checks the header, that the mip chain halves down to 1x1 and that every level is
+// inside the file; the levels themselves are used where they are.
+class TextureFile {
+
+public:
+
+	// Throws if the file can't be mapped or fails the checks above
+	void open(const std::string& path);
+	void close() { mapping.close(); }
+
+	bool isOpen() const { return mapping.isOpen(); }
+
+	const TextureFileHeader& header() const { return *static_cast<const TextureFileHeader*>(mapping.data()); }
+	uint32_t mipCount() const { return header().mipCount; }
+	const TextureFileMip& mip(uint32_t level) const {
+		return reinterpret_cast<const TextureFileMip*>(static_cast<const char*>(mapping.data()) + sizeof(TextureFileHeader))[level];
+	}
+	const char* mipData(uint32_t level) const { return static_cast<const char*>(mapping.data()) + mip(level).offset; }
+
+	// Reads levels finest to coarsest in from disk, one contiguous range of the file, and returns once they're in
+	// memory. Blocks on the disk, so for loader threads.
+	void load(uint32_t finest, uint32_t coarsest) const {
+		mapping.load(mip(coarsest).offset, mip(finest).offset + mip(finest).size - mip(coarsest).offset);
+	}
+
+private:
+
+	MappedFile mapping;
+};
+
+// Builds the mip chain from rgba (width * height texels, 4 bytes each) with a 2x2 box filter and writes the file,
+// through a temporary file renamed over path. Throws if it can't be written.
+void writeTextureFile(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba, bool srgb);
+
+// A checkerboard with a different tint per seed, for tests and benchmarks
+std::vector<uint8_t> makeTestTexture(uint32_t width, uint32_t height, uint32_t seed);
@@ -0,0 +1,417 @@
+// texture-streamer.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <set>
+#include <stdexcept>
+#include "texture-streamer.h"
+
+void TextureStreamer::create(VkDevice device, DeviceAllocator& allocator, UploadRing& uploads, BindlessTable& bindless,
+    const QueueFamilyIndices& queueFamilies, DeferredDestruction& deferred, const TextureStreamingSettings& settings,
+    const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocator = &allocator;
+    this->uploads = &uploads;
+    this->bindless = &bindless;
+    this->deferred = &deferred;
+    this->settings = settings;
+    this->allocationCallbacks = allocationCallbacks;
+
+    // Written on the transfer queue, sampled on the graphics queue
+    std::set<uint32_t> families = { uploads.queueFamily(), queueFamilies.graphicsFamily.value() };
+    if (families.size() > 1) {
+        sharedFamilies.assign(families.begin(), families.end());
+    }
+
+    // The same heaps device selection looks at. A quarter of the biggest leaves the rest to render targets and
+    // geometry, and on integrated GPUs, where the one heap is system memory, to everything else.
+    budgetBytes = settings.budget;
+    if (budgetBytes == 0) {
+        const VkPhysicalDeviceMemoryProperties& memory = allocator.memoryProperties();
+        for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+            if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                budgetBytes = std::max(budgetBytes, memory.memoryHeaps[i].size / 4);
+            }
+        }
+    }
+
+    stopping = false;
+    for (uint32_t i = 0; i < std::max(settings.loaderThreads, 1u); i++) {
+        loaders.emplace_back(&TextureStreamer::loaderLoop, this);
+    }
+}
+
+void TextureStreamer::destroy() {
+
+    if (allocator == nullptr) return;
+
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        stopping = true;
+    }
+    loaderWake.notify_all();
+    for (std::thread& thread : loaders) {
+        thread.join();
+    }
+    loaders.clear();
+    requests = {};
+    completed.clear();
+
+    // The device is idle by now, apart from uploads still in the ring's batches
+    for (std::unique_ptr<Texture>& texture : textures) {
+        if (texture->state == State::Uploading) {
+            uploads->wait(texture->ticket);
+        }
+        destroyImage(texture->current);
+        destroyImage(texture->incoming);
+        texture->file.close();
+    }
+    textures.clear();
+    currentBytes = 0;
+    committedBytes = 0;
+
+    allocator = nullptr;
+}
+
+TextureStreamer::Handle TextureStreamer::add(const std::string& path) {
+
+    auto texture = std::make_unique<Texture>();
+    texture->file.open(path);
+
+    uint32_t mipCount = texture->file.mipCount();
+    texture->tailLevel = mipCount - 1;
+    while (texture->tailLevel > 0) {
+        const TextureFileMip& mip = texture->file.mip(texture->tailLevel - 1);
+        if (std::max(mip.width, mip.height) > settings.tailSize) break;
+        texture->tailLevel--;
+    }
+
+    // Half the ring, so a level going through doesn't have to wait for the whole ring to drain first
+    texture->finestLevel = texture->tailLevel;
+    while (texture->finestLevel > 0 && texture->file.mip(texture->finestLevel - 1).size <= uploads->ringSize() / 2) {
+        texture->finestLevel--;
+    }
+    texture->wanted = texture->tailLevel;
+    texture->lastRequested = updates;
+
+    Handle handle = static_cast<Handle>(textures.size());
+    textures.push_back(std::move(texture));
+
+    // The tail goes in whatever the budget says: without it there's nothing to draw with
+    Texture& added = *textures.back();
+    added.incoming.firstLevel = added.tailLevel;
+    added.incoming.bytes = levelBytes(added, added.tailLevel);
+    committedBytes += added.incoming.bytes;
+    queueRead(handle, added.tailLevel, mipCount - 1);
+
+    return handle;
+}
+
+void TextureStreamer::request(Handle texture, uint32_t level) {
+
+    Texture& t = *textures[texture];
+    t.requested = std::min(t.requested, level);
+}
+
+uint32_t TextureStreamer::pendingRequests() const {
+
+    uint32_t pending = 0;
+    for (const std::unique_ptr<Texture>& texture : textures) {
+        if (texture->state != State::Idle) pending++;
+    }
+    return pending;
+}
+
+VkDeviceSize TextureStreamer::levelBytes(const Texture& texture, uint32_t firstLevel) const {
+
+    VkDeviceSize bytes = 0;
+    for (uint32_t level = firstLevel; level < texture.file.mipCount(); level++) {
+        bytes += texture.file.mip(level).size;
+    }
+    return bytes;
+}
+
+void TextureStreamer::update() {
+
+    updates++;
+
+    // Finished uploads replace what was drawn with
+    for (std::unique_ptr<Texture>& texture : textures) {
+        if (texture->state == State::Uploading && uploads->isComplete(texture->ticket)) {
+            finishUpload(*texture);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        for (Handle handle : completed) {
+            textures[handle]->state = State::Read;
+        }
+        completed.clear();
+    }
+
+    // This frame's feedback
+    for (std::unique_ptr<Texture>& texture : textures) {
+        Texture& t = *texture;
+        if (t.requested != UINT32_MAX) {
+            t.wanted = std::clamp(t.requested, t.finestLevel, t.tailLevel);
+            t.lastRequested = updates;
+            totalRequests++;
+            if (t.current.image == VK_NULL_HANDLE || t.current.firstLevel > t.wanted) missedRequests++;
+            t.requested = UINT32_MAX;
+        }
+    }
+
+    // Upload bytes handed to the ring this update, by evictions and then by finished reads
+    VkDeviceSize spent = 0;
+
+    // One level finer at a time for what was requested finer than it is. The bytes are committed now, so reads
+    // queued in the same update can't overshoot the budget between them.
+    for (Handle handle = 0; handle < textures.size(); handle++) {
+        Texture& t = *textures[handle];
+        if (t.state != State::Idle || t.lastRequested != updates || t.current.firstLevel <= t.wanted) continue;
+
+        uint32_t target = t.current.firstLevel - 1;
+        VkDeviceSize bytes = levelBytes(t, target);
+        if (committedBytes + bytes - t.current.bytes > budgetBytes) {
+            makeRoom(committedBytes + bytes - t.current.bytes - budgetBytes, spent);
+            budgetStalls++;
+            continue;
+        }
+
+        t.incoming.firstLevel = target;
+        t.incoming.bytes = bytes;
+        committedBytes += bytes - t.current.bytes;
+        queueRead(handle, target, target);
+    }
+
+    // Coarsest first, so what's barely drawable gets drawable before what's merely blurry gets sharp
+    std::vector<Texture*> ready;
+    for (std::unique_ptr<Texture>& texture : textures) {
+        if (texture->state == State::Read) ready.push_back(texture.get());
+    }
+    std::stable_sort(ready.begin(), ready.end(), [](const Texture* a, const Texture* b) {
+        return a->incoming.firstLevel > b->incoming.firstLevel;
+    });
+
+    for (Texture* texture : ready) {
+        VkDeviceSize bytes = levelBytes(*texture, texture->incoming.firstLevel);
+        if (spent > 0 && spent + bytes > settings.uploadBytesPerUpdate) {
+            uploadStalls++;
+            break;
+        }
+        startUpload(*texture, texture->incoming.firstLevel);
+        spent += bytes;
+    }
+
+    // Submitted here rather than by the frame's flush, which then has nothing to do, to get the ticket to wait for
+    bool started = false;
+    for (std::unique_ptr<Texture>& texture : textures) {
+        started |= texture->state == State::Uploading && texture->ticket == 0;
+    }
+    if (started) {
+        UploadRing::Ticket ticket = uploads->flush();
+        for (std::unique_ptr<Texture>& texture : textures) {
+            if (texture->state == State::Uploading && texture->ticket == 0) texture->ticket = ticket;
+        }
+    }
+}
+
+void TextureStreamer::makeRoom(VkDeviceSize needed, VkDeviceSize& spent) {
+
+    // Shrinks already under way count toward it
+    for (const std::unique_ptr<Texture>& texture : textures) {
+        if (texture->state == State::Uploading && texture->incoming.bytes < texture->current.bytes) {
+            VkDeviceSize freeing = texture->current.bytes - texture->incoming.bytes;
+            if (freeing >= needed) return;
+            needed -= freeing;
+        }
+    }
+
+    // Anything finer than its tail that either wasn't requested this update or has more than it was, least recently
+    // requested first
+    std::vector<Texture*> candidates;
+    for (std::unique_ptr<Texture>& texture : textures) {
+        const Texture& t = *texture;
+        if (t.state == State::Idle && t.current.image != VK_NULL_HANDLE && t.current.firstLevel < t.tailLevel &&
+            (t.lastRequested != updates || t.current.firstLevel < t.wanted)) {
+            candidates.push_back(texture.get());
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Texture* a, const Texture* b) {
+        return a->lastRequested < b->lastRequested;
+    });
+
+    // The unrequested lose one level at a time, since they may well be back next frame. The over-served go straight
+    // down to what they asked for: the same upload whether it drops one level or several. The smaller image is
+    // an upload like any other and comes out of the same per-update bytes; what doesn't fit is made room for by a
+    // later update, since the texture that needed it stalls until then.
+    for (Texture* texture : candidates) {
+        if (needed == 0) break;
+        uint32_t level = texture->lastRequested != updates ? texture->current.firstLevel + 1 : texture->wanted;
+        VkDeviceSize bytes = levelBytes(*texture, level);
+        if (spent > 0 && spent + bytes > settings.uploadBytesPerUpdate) {
+            uploadStalls++;
+            break;
+        }
+        spent += bytes;
+        texture->incoming.firstLevel = level;
+        texture->incoming.bytes = bytes;
+        startUpload(*texture, level);
+        evictions++;
+        needed -= std::min(needed, texture->current.bytes - bytes);
+    }
+}
+
+void TextureStreamer::queueRead(Handle handle, uint32_t level, uint32_t coarsest) {
+
+    Texture& texture = *textures[handle];
+    texture.state = State::Reading;
+    readsQueued++;
+
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        requests.push({ handle, &texture.file, level, coarsest, nextSequence++ });
+    }
+    loaderWake.notify_one();
+}
+
+void TextureStreamer::startUpload(Texture& texture, uint32_t level) {
+
+    const TextureFile& file = texture.file;
+    const TextureFileMip& top = file.mip(level);
+    uint32_t levels = file.mipCount() - level;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = static_cast<VkFormat>(file.header().format);
+    imageInfo.extent = { top.width, top.height, 1 };
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = sharedFamilies.empty() ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT;
+    imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharedFamilies.size());
+    imageInfo.pQueueFamilyIndices = sharedFamilies.data();
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    Image& image = texture.incoming;
+    image.image = allocator->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image.memory);
+    image.firstLevel = level;
+    image.bytes = levelBytes(texture, level);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+
+    if (vkCreateImageView(device, &viewInfo, allocationCallbacks, &image.view) != VK_SUCCESS) {
+        allocator->destroyImage(image.image, image.memory);
+        image.image = VK_NULL_HANDLE;
+        throw std::runtime_error("failed to create streamed texture view!");
+    }
+
+    // Written now, but nothing reads the slot until the image replaces the current one
+    if (bindless->available()) {
+        image.slot = bindless->allocate(BindlessKind::SampledImage);
+        if (image.slot != BindlessTable::invalidSlot) {
+            bindless->writeSampledImage(image.slot, image.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+
+    // Every level straight from the mapping. The coarser ones were read in before, and are most likely still in memory.
+    for (uint32_t i = 0; i < levels; i++) {
+        const TextureFileMip& mip = file.mip(level + i);
+        uploads->uploadImage(image.image, { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 }, { mip.width, mip.height, 1 },
+            file.mipData(level + i), mip.size, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    texture.state = State::Uploading;
+    texture.ticket = 0;
+    uploadsStarted++;
+    bytesUploaded += image.bytes;
+}
+
+void TextureStreamer::finishUpload(Texture& texture) {
+
+    VkDeviceSize before = footprint(texture);
+    currentBytes -= texture.current.bytes;
+    retire(texture.current);
+
+    texture.current = texture.incoming;
+    texture.incoming = Image{};
+    texture.state = State::Idle;
+    currentBytes += texture.current.bytes;
+    committedBytes -= before - footprint(texture);
+    peakBytes = std::max(peakBytes, currentBytes);
+}
+
+void TextureStreamer::retire(Image& image) {
+
+    if (image.image != VK_NULL_HANDLE) {
+        deferred->defer([this, old = image]() mutable { destroyImage(old); });
+    }
+    image = Image{};
+}
+
+void TextureStreamer::destroyImage(Image& image) {
+
+    if (image.slot != BindlessTable::invalidSlot) {
+        bindless->free(BindlessKind::SampledImage, image.slot);
+    }
+    if (image.view != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, image.view, allocationCallbacks);
+    }
+    if (image.image != VK_NULL_HANDLE) {
+        allocator->destroyImage(image.image, image.memory);
+    }
+    image = Image{};
+}
+
+void TextureStreamer::loaderLoop() {
+
+    for (;;) {
+        LoadRequest request;
+        {
+            std::unique_lock<std::mutex> lock(loaderMutex);
+            loaderWake.wait(lock, [&] { return stopping || !requests.empty(); });
+            if (stopping) return;
+            request = requests.top();
+            requests.pop();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        request.file->load(request.level, request.coarsest);
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t bytes = request.file->mip(request.level).offset + request.file->mip(request.level).size -
+            request.file->mip(request.coarsest).offset;
+        bytesRead += bytes;
+        readNanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        completed.push_back(request.texture);
+    }
+}
+
+void TextureStreamer::report(std::ostream& out) const {
+
+    if (textures.empty()) return;
+
+    out << std::fixed << std::setprecision(1)
+        << "\nTexture streaming: " << textures.size() << " textures, " << currentBytes / double(1 << 20) << " MiB resident (peak "
+        << peakBytes / double(1 << 20) << ") of a " << budgetBytes / double(1 << 20) << " MiB budget, "
+        << pendingRequests() << " pending\n"
+        << "    " << readsQueued << " reads, " << bytesRead.load() / double(1 << 20) << " MiB in "
+        << readNanoseconds.load() / 1e6 << " ms on " << loaders.size() << " loader threads; " << uploadsStarted << " uploads, "
+        << bytesUploaded / double(1 << 20) << " MiB\n"
+        << "    " << missedRequests << " of " << totalRequests << " requests drawn coarser than asked, "
+        << budgetStalls << " budget stalls, " << uploadStalls << " upload stalls, " << evictions << " evictions\n";
+    out.unsetf(std::ios::floatfield);
+}
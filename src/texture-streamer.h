@@ -0,0 +1,190 @@
+// texture-streamer.h
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "include.h"
+#include "bindless-table.h"
+#include "deferred-destruction.h"
+#include "device-allocator.h"
+#include "queue-family-indices.h"
+#include "texture-file.h"
+#include "upload-ring.h"
+
+struct TextureStreamingSettings {
+	// Device memory textures may take. 0 = a quarter of the largest device-local heap.
+	VkDeviceSize budget = 0;
+
+	uint32_t loaderThreads = 2;
+
+	// Most bytes update() hands to the upload ring per call, evictions included, so streaming can't make a frame late.
+	// One texture always goes.
+	VkDeviceSize uploadBytesPerUpdate = 8ull << 20;
+
+	// Levels this size or smaller are loaded as soon as a texture is added and are never evicted
+	uint32_t tailSize = 64;
+};
+
+// Texture streaming: every texture always has its small levels resident, and its finer levels come and go with
+// what's being drawn, under a memory budget.
+//
+// What's wanted comes from the renderer as a feedback signal: request() says how fine a level of a texture was
+// needed this frame (from the screen size of what it's on, or from a GPU feedback buffer read back a frame later).
+// update() then, once per frame:
+//
+// - Queues a read of the next finer level for each texture requested at finer than it has. Loader threads read the
+//   level from the texture's mapping (see texture-file.h), coarsest requests first across all textures, so nothing
+//   waits on disk on the main thread.
+// - Uploads the reads that have finished through the upload ring: a new image with one more level, all of its
+//   levels copied straight from the mapping. When its batch is done the new image replaces the old one.
+// - Under the budget, makes room least recently requested first: textures not requested this update lose their
+//   finest level, and textures with more than they were asked for drop to what was. Dropping levels is the same
+//   replace with a smaller image, without the read. A texture that's wanted but can't fit yet is a budget stall.
+//
+// Nothing is dropped without pressure, so textures out of view keep their levels for when they're back.
+//
+// Images are replaced rather than resized, since a Vulkan image can't change size. The old one goes to the deferred
+// destruction queue, to stay until the frames that may still be drawing with it are done. With the bindless table,
+// each image gets a slot of its own, because a slot can't be rewritten while frames in flight use it: read
+// bindlessSlot() each frame rather than keeping it.
+//
+// The budget defaults to a share of the device-local heaps that device selection ranks devices by. A level has to
+// fit in the upload ring in one piece (see UploadRing::uploadImage), so textures stop at the finest level that takes
+// half the ring or less.
+//
+// Everything but the loader threads is main thread only.
+
+class TextureStreamer {
+
+public:
+
+	using Handle = uint32_t;
+
+	void create(VkDevice device, DeviceAllocator& allocator, UploadRing& uploads, BindlessTable& bindless,
+		const QueueFamilyIndices& queueFamilies, DeferredDestruction& deferred, const TextureStreamingSettings& settings,
+		const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Maps the file and queues its small levels. Throws if it isn't a texture file.
+	Handle add(const std::string& path);
+
+	// The finest level (0 = full size) texture was needed at this frame. The finest since the last update() counts.
+	void request(Handle texture, uint32_t level);
+
+	// Once per frame, before the upload ring is flushed
+	void update();
+
+	// Whether it has an image yet, and how fine it is
+	bool resident(Handle texture) const { return textures[texture]->current.image != VK_NULL_HANDLE; }
+	uint32_t residentLevel(Handle texture) const { return textures[texture]->current.firstLevel; }
+	VkImageView view(Handle texture) const { return textures[texture]->current.view; }
+	uint32_t bindlessSlot(Handle texture) const { return textures[texture]->current.slot; }
+
+	VkDeviceSize budget() const { return budgetBytes; }
+	VkDeviceSize residentBytes() const { return currentBytes; }
+	uint32_t pendingRequests() const;
+
+	void report(std::ostream& out) const;
+
+private:
+
+	struct Image {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		DeviceAllocation memory;
+		uint32_t slot = BindlessTable::invalidSlot;
+		uint32_t firstLevel = 0;            // The file's level that's this image's level 0
+		VkDeviceSize bytes = 0;
+	};
+
+	enum class State {
+		Idle,
+		Reading,                            // On the loader queue or a loader thread
+		Read,                               // Waiting for upload bytes in some update()
+		Uploading                           // incoming is being filled, ticket says when it's done
+	};
+
+	struct Texture {
+		TextureFile file;
+		uint32_t tailLevel = 0;             // Coarsest level that's always resident, tailSize or smaller
+		uint32_t finestLevel = 0;           // Finest level that fits through the upload ring
+		Image current;                      // What's drawn with
+		Image incoming;                     // Replacing current: firstLevel and bytes from when it's queued, the image once uploading
+		UploadRing::Ticket ticket = 0;
+		State state = State::Idle;
+		uint32_t requested = UINT32_MAX;    // Finest level requested since the last update()
+		uint32_t wanted = 0;                // The last request, clamped to [finestLevel, tailLevel]
+		uint64_t lastRequested = 0;         // Update count of the last request
+	};
+
+	// A read for a loader thread: levels level to coarsest of a texture's file. Ordered coarsest level first, then
+	// oldest first. Holds the file rather than the handle's Texture, since textures may grow while it's read.
+	struct LoadRequest {
+		Handle texture;
+		const TextureFile* file;
+		uint32_t level;
+		uint32_t coarsest;
+		uint64_t sequence;
+
+		bool operator<(const LoadRequest& other) const {
+			return level != other.level ? level < other.level : sequence > other.sequence;
+		}
+	};
+
+	VkDeviceSize levelBytes(const Texture& texture, uint32_t firstLevel) const;
+	void queueRead(Handle handle, uint32_t level, uint32_t coarsest);
+	void startUpload(Texture& texture, uint32_t level);
+	void finishUpload(Texture& texture);
+	void retire(Image& image);
+	void destroyImage(Image& image);
+	VkDeviceSize footprint(const Texture& texture) const { return std::max(texture.current.bytes, texture.incoming.bytes); }
+	void makeRoom(VkDeviceSize needed, VkDeviceSize& spent);   // Adds its uploads to spent
+	void loaderLoop();
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	DeviceAllocator* allocator = nullptr;
+	UploadRing* uploads = nullptr;
+	BindlessTable* bindless = nullptr;
+	std::vector<uint32_t> sharedFamilies;   // Transfer and graphics when they differ, otherwise empty
+	DeferredDestruction* deferred = nullptr;
+	TextureStreamingSettings settings;
+	VkDeviceSize budgetBytes = 0;
+
+	std::vector<std::unique_ptr<Texture>> textures;
+	uint64_t updates = 0;
+	VkDeviceSize currentBytes = 0;          // Every texture's current image
+	VkDeviceSize committedBytes = 0;        // Every texture's current image, or the one replacing it where that's bigger
+
+	// Loader threads take from requests and put finished reads in completed
+	std::mutex loaderMutex;
+	std::condition_variable loaderWake;
+	std::priority_queue<LoadRequest> requests;
+	std::vector<Handle> completed;
+	std::vector<std::thread> loaders;
+	bool stopping = false;
+	uint64_t nextSequence = 0;
+
+	// Bookkeeping for the report
+	std::atomic<uint64_t> bytesRead{ 0 };
+	std::atomic<uint64_t> readNanoseconds{ 0 };
+	uint64_t readsQueued = 0;
+	uint64_t uploadsStarted = 0;
+	uint64_t bytesUploaded = 0;
+	uint64_t evictions = 0;
+	uint64_t budgetStalls = 0;              // A texture wanted a finer level and there was no room for it
+	uint64_t uploadStalls = 0;              // An update ran out of upload bytes with reads or evictions still waiting
+	uint64_t missedRequests = 0;            // Requests for a level finer than what was resident
+	uint64_t totalRequests = 0;
+	VkDeviceSize peakBytes = 0;
+};
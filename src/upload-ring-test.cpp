@@ -0,0 +1,105 @@
+// upload-ring-test.cpp
+
+#include <cstring>
+#include <vector>
+#include "include.h"
+#include "device-allocator.h"
+#include "device-capabilities.h"
+#include "enumeration-cache.h"
+#include "test-harness.h"
+#include "upload-ring.h"
+
+// Uploads through the ring with fences and, when the device has them, with a timeline semaphore, and reads the
+// data back. Eight times the ring's size goes through in pieces, so batches are retired and their ring space reused
+// while later ones are still in flight. Then the same range is written twice in a row, which splits the writes across two
+// batches that have to land in order.
+//
+// The destination is host-visible so it can be compared directly. Lavapipe's memory is all host memory, which is
+// what lets this skip the barrier to the host domain a discrete GPU would need before the read.
+
+static constexpr VkDeviceSize ringSize = 1 << 20;
+static constexpr VkDeviceSize pieceSize = 256 << 10;
+static constexpr VkDeviceSize totalSize = 8 * ringSize;
+
+static void checkUploads(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, bool timelineSemaphores) {
+
+    DeviceAllocator allocator;
+    allocator.create(physicalDevice, device, nullptr);
+
+    UploadRing uploads;
+    uploads.create(physicalDevice, device, allocator, queue, 0, ringSize, timelineSemaphores, nullptr);
+
+    DeviceAllocation destinationMemory;
+    VkBuffer destination = allocator.createBuffer(totalSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, destinationMemory);
+    std::memset(destinationMemory.mapped, 0, totalSize);
+
+    std::vector<uint32_t> data(totalSize / sizeof(uint32_t));
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint32_t>(i * 2654435761u);
+    }
+
+    // Every piece is flushed as its own batch, so more batches are submitted than there are slots
+    UploadRing::Ticket first = 0, last = 0;
+    for (VkDeviceSize offset = 0; offset < totalSize; offset += pieceSize) {
+        uploads.uploadBuffer(destination, offset, reinterpret_cast<const char*>(data.data()) + offset, pieceSize);
+        last = uploads.flush();
+        if (first == 0) first = last;
+    }
+    CHECK(last - first + 1 == totalSize / pieceSize);
+
+    uploads.wait(last);
+    CHECK(uploads.isComplete(first));
+    CHECK(uploads.isComplete(last));
+    CHECK(std::memcmp(destinationMemory.mapped, data.data(), totalSize) == 0);
+
+    // Nothing pending, so flushing hands back the last ticket again
+    CHECK(uploads.flush() == last);
+
+    // The same range written again, overlapping a write still pending. The first goes off in a batch of its own,
+    // and the second batch has to land after it, or the read back is a mix of the two.
+    std::vector<uint32_t> second(pieceSize / sizeof(uint32_t));
+    for (uint32_t round = 0; round < 16; round++) {
+        for (size_t i = 0; i < second.size(); i++) {
+            second[i] = static_cast<uint32_t>(~(i * 2246822519u) + round);
+        }
+        uploads.uploadBuffer(destination, 0, data.data(), pieceSize);
+        uploads.uploadBuffer(destination, pieceSize / 2, second.data(), pieceSize);
+        UploadRing::Ticket ticket = uploads.flush();
+        CHECK(ticket == last + 2);
+        last = ticket;
+        uploads.wait(last);
+
+        const char* written = static_cast<const char*>(destinationMemory.mapped);
+        CHECK(std::memcmp(written, data.data(), pieceSize / 2) == 0);
+        CHECK(std::memcmp(written + pieceSize / 2, second.data(), pieceSize) == 0);
+    }
+
+    allocator.destroyBuffer(destination, destinationMemory);
+    uploads.destroy();
+    allocator.destroy();
+}
+
+void testUploadRing() {
+
+    // A 1.0 loader can still test the fence path
+    UniqueInstance instance;
+    VkPhysicalDevice physicalDevice;
+    uint32_t apiVersion = VK_API_VERSION_1_3;
+    if (!createTestInstance(apiVersion, instance, physicalDevice)) {
+        apiVersion = VK_API_VERSION_1_0;
+        createTestInstance(apiVersion, instance, physicalDevice);
+    }
+
+    EnumerationCache enumeration;
+    DeviceFeatureChain chain;
+    DeviceCapabilities capabilities = chain.negotiate(physicalDevice, apiVersion, enumeration.deviceExtensions(physicalDevice));
+
+    VkQueue queue;
+    UniqueDevice device = createTestDevice(physicalDevice, chain, queue);
+
+    checkUploads(physicalDevice, device, queue, false);
+    if (capabilities.timelineSemaphores) {
+        checkUploads(physicalDevice, device, queue, true);
+    }
+}
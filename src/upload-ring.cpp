@@ -0,0 +1,495 @@
+// upload-ring.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#include "upload-ring.h"
+#include "frame-stats.h"
+
+static constexpr uint32_t batchSlots = 4;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void UploadRing::create(VkPhysicalDevice physicalDevice, VkDevice device, DeviceAllocator& allocator, VkQueue queue,
+    uint32_t queueFamily, VkDeviceSize capacity, bool timelineSemaphores, const VkAllocationCallbacks* allocationCallbacks) {
+
+    this->device = device;
+    this->allocationCallbacks = allocationCallbacks;
+    this->allocator = &allocator;
+    this->queue = queue;
+    this->family = queueFamily;
+    this->capacity = capacity;
+
+    // 16 covers the texel size of every format we'd upload, and copies from well aligned offsets are faster on
+    // some hardware. Coherent memory means there's no nonCoherentAtomSize to round to.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    while (alignment < properties.limits.optimalBufferCopyOffsetAlignment) {
+        alignment *= 2;
+    }
+
+    ringBuffer = allocator.createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, ringMemory);
+    mapped = static_cast<char*>(ringMemory.mapped);
+
+    // Each batch's command buffer is re-recorded every time the slot is reused
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload command pool!");
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(batchSlots);
+
+    VkCommandBufferAllocateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    bufferInfo.commandPool = commandPool;
+    bufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    bufferInfo.commandBufferCount = batchSlots;
+
+    if (vkAllocateCommandBuffers(device, &bufferInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffers!");
+    }
+
+    // Tickets start at 1, so the semaphore's initial 0 means nothing has completed yet
+    if (timelineSemaphores) {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload timeline semaphore!");
+        }
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (VkCommandBuffer commandBuffer : commandBuffers) {
+        Batch batch;
+        batch.commandBuffer = commandBuffer;
+        if (timeline == VK_NULL_HANDLE && vkCreateFence(device, &fenceInfo, allocationCallbacks, &batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload fence!");
+        }
+        batchPool.push_back(batch);
+    }
+}
+
+void UploadRing::destroy() {
+
+    if (allocator == nullptr) return;
+
+    // Nothing can be destroyed while a copy might still be reading from the ring
+    submit();
+    while (!inFlight.empty()) {
+        reclaim(true);
+    }
+
+    for (Batch& batch : batchPool) {
+        vkDestroyFence(device, batch.fence, allocationCallbacks);
+    }
+    batchPool.clear();
+    vkDestroySemaphore(device, timeline, allocationCallbacks);
+    timeline = VK_NULL_HANDLE;
+
+    // Freeing the pool frees the command buffers allocated from it
+    vkDestroyCommandPool(device, commandPool, allocationCallbacks);
+    commandPool = VK_NULL_HANDLE;
+    allocator->destroyBuffer(ringBuffer, ringMemory);
+    ringBuffer = VK_NULL_HANDLE;
+    mapped = nullptr;
+    allocator = nullptr;
+}
+
+bool UploadRing::tryReserve(VkDeviceSize size, VkDeviceSize& offset) {
+
+    // An empty ring starts over at the beginning, which gives the largest possible contiguous range
+    if (used == 0) {
+        head = 0;
+        tail = 0;
+    }
+    else if (head == tail) {
+        return false;
+    }
+
+    VkDeviceSize start = alignUp(head, alignment);
+    VkDeviceSize consumed;
+
+    if (head >= tail) {
+        // Free space is [head, capacity) followed by [0, tail). Data can't straddle the end, so if it doesn't fit
+        // before the end, the rest of the ring is skipped and it goes at the start instead.
+        if (start + size <= capacity) {
+            consumed = start + size - head;
+        }
+        else if (size <= tail) {
+            start = 0;
+            consumed = capacity - head + size;
+        }
+        else {
+            return false;
+        }
+    }
+    else {
+        // Free space is [head, tail)
+        if (start + size > tail) return false;
+        consumed = start + size - head;
+    }
+
+    head = (start + size) % capacity;
+    used += consumed;
+    pendingBytes += consumed;
+    offset = start;
+    return true;
+}
+
+VkDeviceSize UploadRing::reserve(VkDeviceSize size) {
+
+    if (size > capacity) {
+        throw std::runtime_error("upload is larger than the staging ring!");
+    }
+
+    reclaim(false);
+
+    VkDeviceSize offset;
+    bool stalled = false;
+
+    while (!tryReserve(size, offset)) {
+
+        // If uploads that haven't been submitted yet are what's filling the ring, sending them off is the only way
+        // to ever get that space back
+        if (!pendingBuffers.empty() || !pendingImages.empty()) {
+            submit();
+            continue;
+        }
+
+        if (!stalled) {
+            ringFullStalls++;
+            stalled = true;
+        }
+        auto start = Clock::now();
+        reclaim(true);
+        stallMilliseconds += elapsedMilliseconds(start, Clock::now());
+    }
+
+    return offset;
+}
+
+void UploadRing::reclaim(bool block) {
+
+    // The semaphore's value is the newest completed ticket, so one read covers every batch in flight
+    uint64_t signalled = 0;
+    if (timeline != VK_NULL_HANDLE && !inFlight.empty()) {
+        if (block) {
+            VkSemaphoreWaitInfo waitInfo{};
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &timeline;
+            waitInfo.pValues = &inFlight.front().ticket;
+            vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+            block = false;
+        }
+        vkGetSemaphoreCounterValue(device, timeline, &signalled);
+    }
+
+    // Batches complete in submission order on a single queue, so it's enough to look at the oldest
+    while (!inFlight.empty()) {
+        Batch& batch = inFlight.front();
+
+        if (timeline != VK_NULL_HANDLE) {
+            if (batch.ticket > signalled) break;
+        }
+        else if (block) {
+            vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            block = false;
+        }
+        else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS) {
+            break;
+        }
+
+        gpuMilliseconds += elapsedMilliseconds(batch.submitted, Clock::now());
+
+        tail = (tail + batch.ringBytes) % capacity;
+        used -= batch.ringBytes;
+        completedTicket = batch.ticket;
+
+        if (batch.fence != VK_NULL_HANDLE) {
+            vkResetFences(device, 1, &batch.fence);
+        }
+        batchPool.push_back(batch);
+        inFlight.pop_front();
+    }
+}
+
+void UploadRing::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+
+    auto start = Clock::now();
+
+    uploadedBytes += size;
+    uploadCount++;
+
+    const char* bytes = static_cast<const char*>(data);
+
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, capacity / 2);
+
+        auto range = pendingRanges.find(buffer);
+        if (range != pendingRanges.end() && offset < range->second.second && offset + chunk > range->second.first) {
+            submit();
+        }
+
+        VkDeviceSize source = reserve(chunk);
+        std::memcpy(mapped + source, bytes, chunk);
+
+        // Streaming a buffer in pieces is the common case, and contiguous pieces can be a single region
+        PendingBufferCopy* last = pendingBuffers.empty() ? nullptr : &pendingBuffers.back();
+        if (last != nullptr && last->buffer == buffer &&
+            last->region.srcOffset + last->region.size == source &&
+            last->region.dstOffset + last->region.size == offset) {
+            last->region.size += chunk;
+        }
+        else {
+            pendingBuffers.push_back({ buffer, { source, offset, chunk } });
+        }
+
+        auto& covered = pendingRanges.emplace(buffer, std::make_pair(offset, offset + chunk)).first->second;
+        covered.first = std::min(covered.first, offset);
+        covered.second = std::max(covered.second, offset + chunk);
+
+        bytes += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+
+    cpuMilliseconds += elapsedMilliseconds(start, Clock::now());
+}
+
+void UploadRing::uploadImage(VkImage image, const VkImageSubresourceLayers& subresource, VkExtent3D extent,
+    const void* data, VkDeviceSize size, VkImageLayout finalLayout) {
+
+    auto start = Clock::now();
+
+    // Each pending copy transitions its subresource from UNDEFINED, which would throw away an earlier copy to the
+    // same subresource in the same batch
+    for (const PendingImageCopy& pending : pendingImages) {
+        if (pending.image == image && pending.region.imageSubresource.mipLevel == subresource.mipLevel &&
+            pending.region.imageSubresource.baseArrayLayer < subresource.baseArrayLayer + subresource.layerCount &&
+            subresource.baseArrayLayer < pending.region.imageSubresource.baseArrayLayer + pending.region.imageSubresource.layerCount) {
+            submit();
+            break;
+        }
+    }
+
+    VkDeviceSize source = reserve(size);
+    std::memcpy(mapped + source, data, size);
+
+    // Tightly packed rows, which is what zero bufferRowLength and bufferImageHeight mean
+    VkBufferImageCopy region{};
+    region.bufferOffset = source;
+    region.imageSubresource = subresource;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = extent;
+
+    pendingImages.push_back({ image, region, finalLayout });
+
+    uploadedBytes += size;
+    uploadCount++;
+    cpuMilliseconds += elapsedMilliseconds(start, Clock::now());
+}
+
+void UploadRing::record(Batch& batch) {
+
+    vkResetCommandBuffer(batch.commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording upload command buffer!");
+    }
+
+    // An upload that overlaps a pending one submits the pending batch first, so this batch may write what an earlier
+    // one on the queue is still writing. Submission order alone doesn't order the copies; this barrier makes every
+    // earlier transfer write finish, and be made available, before any copy here starts.
+    //
+    // Images: their transitions into TRANSFER_DST go in the same barrier, so an UNDEFINED transition can't discard
+    // the subresource under an earlier batch's copy either. Every transition out happens in one barrier after the
+    // copies.
+    std::vector<VkImageMemoryBarrier> toTransfer, toFinal;
+
+    for (const PendingImageCopy& pending : pendingImages) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = pending.image;
+        barrier.subresourceRange.aspectMask = pending.region.imageSubresource.aspectMask;
+        barrier.subresourceRange.baseMipLevel = pending.region.imageSubresource.mipLevel;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = pending.region.imageSubresource.baseArrayLayer;
+        barrier.subresourceRange.layerCount = pending.region.imageSubresource.layerCount;
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        toTransfer.push_back(barrier);
+
+        // Whoever reads the image waits for the batch's ticket first, so no later stage needs to be named here
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = pending.finalLayout;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        toFinal.push_back(barrier);
+    }
+
+    VkMemoryBarrier earlierWrites{};
+    earlierWrites.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    earlierWrites.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    earlierWrites.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        1, &earlierWrites, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+
+    // One vkCmdCopyBuffer per destination buffer with all of its regions. No two pending regions overlap (see
+    // pendingRanges), so grouping them doesn't change the result.
+    std::stable_sort(pendingBuffers.begin(), pendingBuffers.end(), [](const PendingBufferCopy& a, const PendingBufferCopy& b) {
+        return std::less<VkBuffer>()(a.buffer, b.buffer);
+    });
+
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < pendingBuffers.size();) {
+        VkBuffer buffer = pendingBuffers[i].buffer;
+
+        regions.clear();
+        for (; i < pendingBuffers.size() && pendingBuffers[i].buffer == buffer; i++) {
+            regions.push_back(pendingBuffers[i].region);
+        }
+
+        vkCmdCopyBuffer(batch.commandBuffer, ringBuffer, buffer, static_cast<uint32_t>(regions.size()), regions.data());
+        copyCommands++;
+        copyRegions += regions.size();
+    }
+
+    if (!pendingImages.empty()) {
+        for (const PendingImageCopy& pending : pendingImages) {
+            vkCmdCopyBufferToImage(batch.commandBuffer, ringBuffer, pending.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &pending.region);
+            copyCommands++;
+            copyRegions++;
+        }
+
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, 0, nullptr, static_cast<uint32_t>(toFinal.size()), toFinal.data());
+    }
+
+    if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record upload command buffer!");
+    }
+
+    pendingBuffers.clear();
+    pendingImages.clear();
+    pendingRanges.clear();
+}
+
+UploadRing::Ticket UploadRing::submit() {
+
+    if (pendingBuffers.empty() && pendingImages.empty()) {
+        return nextTicket - 1;
+    }
+
+    if (batchPool.empty()) {
+        batchSlotStalls++;
+        auto start = Clock::now();
+        reclaim(true);
+        stallMilliseconds += elapsedMilliseconds(start, Clock::now());
+    }
+
+    Batch batch = batchPool.back();
+    batchPool.pop_back();
+
+    record(batch);
+    batch.ticket = nextTicket++;
+    batch.ringBytes = pendingBytes;
+    pendingBytes = 0;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    if (timeline != VK_NULL_HANDLE) {
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &batch.ticket;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timeline;
+    }
+
+    if (vkQueueSubmit(queue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit uploads!");
+    }
+
+    batch.submitted = Clock::now();
+    inFlight.push_back(batch);
+    batchCount++;
+    return batch.ticket;
+}
+
+UploadRing::Ticket UploadRing::flush() {
+
+    auto start = Clock::now();
+    Ticket ticket = submit();
+    reclaim(false);
+    cpuMilliseconds += elapsedMilliseconds(start, Clock::now());
+    return ticket;
+}
+
+bool UploadRing::isComplete(Ticket ticket) {
+
+    reclaim(false);
+    return completedTicket >= ticket;
+}
+
+UploadRing::Ticket UploadRing::completed() {
+
+    reclaim(false);
+    return completedTicket;
+}
+
+void UploadRing::wait(Ticket ticket) {
+
+    while (completedTicket < ticket && !inFlight.empty()) {
+        reclaim(true);
+    }
+}
+
+void UploadRing::report(std::ostream& out) const {
+
+    // Bytes per millisecond / 1000 = MB/s
+    auto megabytesPerSecond = [&](double milliseconds) {
+        return milliseconds > 0.0 ? static_cast<double>(uploadedBytes) / milliseconds / 1000.0 : 0.0;
+    };
+
+    out << std::fixed << std::setprecision(2)
+        << "\nUpload ring: " << static_cast<double>(uploadedBytes) / (1024.0 * 1024.0) << " MiB in " << uploadCount << " uploads, "
+        << batchCount << " batches (" << copyCommands << " copy commands, " << copyRegions << " regions), "
+        << capacity / (1024 * 1024) << " MiB ring, " << (timeline != VK_NULL_HANDLE ? "timeline semaphore" : "fences") << "\n"
+        << "    throughput " << megabytesPerSecond(cpuMilliseconds) << " MB/s CPU (copy + record), "
+        << megabytesPerSecond(gpuMilliseconds) << " MB/s submit->complete\n"
+        << "    ring full " << ringFullStalls << " times, out of batches " << batchSlotStalls << " times, "
+        << stallMilliseconds << " ms stalled\n";
+    out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,140 @@
+// upload-ring.h
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "include.h"
+#include "device-allocator.h"
+
+// Gets data from the CPU into device-local buffers and images.
+//
+// Uploads are memcpy'd into one persistently mapped, host-visible ring buffer, and the copies out of it are
+// collected into a batch. flush() records the whole batch into one command buffer and submits it to the transfer
+// queue, which is a dedicated copy engine when the device has one. Copies into the same buffer are merged into a
+// single vkCmdCopyBuffer, and copies into contiguous ranges become a single region. Each batch starts with a
+// transfer-to-transfer barrier, so a batch's copies are ordered after every earlier batch's writes.
+//
+// Every submitted batch owns the slice of the ring it wrote and a fence. Slices are handed back as fences signal,
+// checked without blocking on every upload. The CPU only waits when the ring or all batch slots are full, and
+// those stalls are counted. With timeline semaphores a ticket is the value the batch signals on one semaphore
+// instead, so a single counter read retires every finished batch at once rather than a status call per fence.
+//
+// Queue ownership: when the transfer family differs from the family that will read the data, destination
+// resources must be created VK_SHARING_MODE_CONCURRENT across both (see queueFamily()). Otherwise their contents
+// are undefined on the other queue without an explicit ownership transfer.
+
+class UploadRing {
+
+public:
+
+	using Ticket = uint64_t;    // Identifies a batch. Ticket N is complete once every batch up to N has finished.
+
+	// timelineSemaphores says whether the device was created with them, see device-capabilities.h
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, DeviceAllocator& allocator, VkQueue queue,
+		uint32_t queueFamily, VkDeviceSize capacity, bool timelineSemaphores, const VkAllocationCallbacks* allocationCallbacks);
+	void destroy();
+
+	// Both copy data out immediately, so the caller's memory can be reused as soon as they return. Buffer
+	// uploads larger than half the ring are split up; an image upload has to fit in the ring on its own.
+	void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+	// Whole mip level or layer range given by subresource. The image goes from UNDEFINED to finalLayout, so
+	// anything already in that subresource is discarded.
+	void uploadImage(VkImage image, const VkImageSubresourceLayers& subresource, VkExtent3D extent,
+		const void* data, VkDeviceSize size, VkImageLayout finalLayout);
+
+	// Submits everything uploaded since the last flush. Returns the batch's ticket, or the last one if there was
+	// nothing to submit. Cheap when idle, so it's fine to call once per frame unconditionally.
+	Ticket flush();
+
+	bool isComplete(Ticket ticket);
+	void wait(Ticket ticket);
+
+	// The newest complete ticket, checked without blocking. What DeferredDestruction::collect() is given each frame.
+	Ticket completed();
+
+	uint32_t queueFamily() const { return family; }
+
+	// The largest image upload there can be
+	VkDeviceSize ringSize() const { return capacity; }
+
+	void report(std::ostream& out) const;
+
+private:
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Batch {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;  // Null with a timeline semaphore
+		Ticket ticket = 0;
+		VkDeviceSize ringBytes = 0;     // Including alignment padding and any space skipped to wrap around
+		Clock::time_point submitted;
+	};
+
+	struct PendingBufferCopy {
+		VkBuffer buffer;
+		VkBufferCopy region;
+	};
+
+	struct PendingImageCopy {
+		VkImage image;
+		VkBufferImageCopy region;
+		VkImageLayout finalLayout;
+	};
+
+	VkDeviceSize reserve(VkDeviceSize size);
+	bool tryReserve(VkDeviceSize size, VkDeviceSize& offset);
+	void reclaim(bool block);
+	Ticket submit();
+	void record(Batch& batch);
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	DeviceAllocator* allocator = nullptr;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t family = 0;
+
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	DeviceAllocation ringMemory;
+	char* mapped = nullptr;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize alignment = 16;
+	VkDeviceSize head = 0;              // Next byte to write
+	VkDeviceSize tail = 0;              // First byte still in use by the GPU
+	VkDeviceSize used = 0;              // Bytes between tail and head, so a full ring can be told apart from an empty one
+	VkDeviceSize pendingBytes = 0;      // Ring bytes taken by uploads that aren't submitted yet
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkSemaphore timeline = VK_NULL_HANDLE;  // Counts completed tickets, when the device has timeline semaphores
+	std::vector<Batch> batchPool;       // Free batch slots
+	std::deque<Batch> inFlight;         // Submitted, oldest first
+
+	std::vector<PendingBufferCopy> pendingBuffers;
+	std::vector<PendingImageCopy> pendingImages;
+
+	// Smallest range covering every pending copy into each buffer. Copies within one batch may run in any order,
+	// so an upload that overlaps one still pending forces a flush first.
+	std::unordered_map<VkBuffer, std::pair<VkDeviceSize, VkDeviceSize>> pendingRanges;
+
+	Ticket nextTicket = 1;
+	Ticket completedTicket = 0;
+
+	// Bookkeeping for the report
+	uint64_t uploadedBytes = 0;
+	uint64_t uploadCount = 0;
+	uint64_t copyCommands = 0;
+	uint64_t copyRegions = 0;
+	uint64_t batchCount = 0;
+	uint64_t ringFullStalls = 0;
+	uint64_t batchSlotStalls = 0;
+	double stallMilliseconds = 0.0;
+	double cpuMilliseconds = 0.0;       // Spent in upload*/flush: memcpy, bookkeeping and recording
+	double gpuMilliseconds = 0.0;       // Sum of submit -> observed completion per batch
+};
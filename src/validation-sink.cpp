@@ -0,0 +1,330 @@
+// validation-sink.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "validation-sink.h"
+
+VkDebugUtilsMessageSeverityFlagsEXT parseValidationSeverity(const char* name) {
+
+    // Each level includes everything above it, the same way log levels usually work
+    VkDebugUtilsMessageSeverityFlagsEXT severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    if (std::strcmp(name, "error") == 0) return severities;
+
+    severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+    if (std::strcmp(name, "warning") == 0) return severities;
+
+    severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+    if (std::strcmp(name, "info") == 0) return severities;
+
+    severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+    if (std::strcmp(name, "verbose") == 0) return severities;
+
+    return 0;
+}
+
+VkDebugUtilsMessageTypeFlagsEXT parseValidationTypes(const char* list) {
+
+    VkDebugUtilsMessageTypeFlagsEXT types = 0;
+    std::string remaining = list;
+
+    while (!remaining.empty()) {
+        size_t comma = remaining.find(',');
+        std::string name = remaining.substr(0, comma);
+        remaining = comma == std::string::npos ? "" : remaining.substr(comma + 1);
+
+        if (name == "general") types |= VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT;
+        else if (name == "validation") types |= VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+        else if (name == "performance") types |= VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        else return 0;
+    }
+    return types;
+}
+
+static const char* severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+
+    switch (severity) {
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "error";
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "warning";
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "info";
+    default: return "verbose";
+    }
+}
+
+static void copyTruncated(char* destination, size_t capacity, const char* source) {
+
+    if (source == nullptr) source = "";
+    size_t length = std::min(std::strlen(source), capacity - 1);
+    std::memcpy(destination, source, length);
+    destination[length] = '\0';
+}
+
+// Everything only the background thread touches
+struct ValidationSink::Consumer {
+    std::unordered_map<uint64_t, std::string> seen;     // Key -> id name (or text), for the report
+    std::map<std::string, uint32_t> framePerformance;   // Performance warnings raised during the open frame
+    uint64_t framesWithPerformanceWarnings = 0;
+};
+
+ValidationSink::ValidationSink()
+    : slots(new Slot[ringCapacity]),
+      dedupKeys(new std::atomic<uint64_t>[dedupCapacity]),
+      dedupCounts(new std::atomic<uint64_t>[dedupCapacity]),
+      consumer(std::make_unique<Consumer>()) {
+
+    for (uint32_t i = 0; i < ringCapacity; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < dedupCapacity; i++) {
+        dedupKeys[i].store(0, std::memory_order_relaxed);
+        dedupCounts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+ValidationSink::~ValidationSink() {
+    stop();
+}
+
+void ValidationSink::start(const ValidationFilter& filter) {
+
+    setFilter(filter);
+    running = true;
+    thread = std::thread(&ValidationSink::consumerLoop, this);
+}
+
+void ValidationSink::stop() {
+
+    if (!running.exchange(false)) return;
+    thread.join();
+}
+
+void ValidationSink::setFilter(const ValidationFilter& filter) {
+
+    severities.store(filter.severities, std::memory_order_relaxed);
+    types.store(filter.types, std::memory_order_relaxed);
+}
+
+ValidationFilter ValidationSink::filter() const {
+
+    ValidationFilter filter;
+    filter.severities = severities.load(std::memory_order_relaxed);
+    filter.types = types.load(std::memory_order_relaxed);
+    return filter;
+}
+
+uint64_t ValidationSink::countOccurrence(uint64_t key) {
+
+    // Linear probing. Keys are only ever inserted, never removed, so once a slot holds a key it holds it for good
+    // and a reader that finds it can just bump the count.
+    for (uint32_t probe = 0; probe < dedupCapacity; probe++) {
+        uint32_t index = static_cast<uint32_t>((key + probe) & (dedupCapacity - 1));
+        uint64_t existing = dedupKeys[index].load(std::memory_order_acquire);
+
+        if (existing == 0) {
+            if (dedupKeys[index].compare_exchange_strong(existing, key, std::memory_order_acq_rel)) {
+                return dedupCounts[index].fetch_add(1, std::memory_order_relaxed);
+            }
+            // Somebody else took the slot first. Maybe with this very key, which the check below picks up.
+        }
+        if (existing == key) {
+            return dedupCounts[index].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Thousands of distinct messages means something is badly wrong anyway. Print them all rather than lose any.
+    dedupOverflow.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+bool ValidationSink::push(EntryKind kind, VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types, uint64_t key, const char* name, const char* text) {
+
+    uint64_t position = head.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    while (true) {
+        slot = &slots[position & (ringCapacity - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+
+        if (difference == 0) {
+            if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        }
+        else if (difference < 0) {
+            // The consumer hasn't freed this slot from the last lap yet, so the ring is full
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    Entry& entry = slot->entry;
+    entry.kind = kind;
+    entry.severity = severity;
+    entry.types = types;
+    entry.key = key;
+    entry.frame = frame.load(std::memory_order_relaxed);
+    copyTruncated(entry.name, sizeof(entry.name), name);
+    copyTruncated(entry.text, sizeof(entry.text), text);
+
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool ValidationSink::pop(Entry& entry) {
+
+    Slot& slot = slots[tail & (ringCapacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1) return false;
+
+    entry = slot.entry;
+    slot.sequence.store(tail + ringCapacity, std::memory_order_release);
+    tail++;
+    return true;
+}
+
+void ValidationSink::capture(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT messageTypes,
+    const VkDebugUtilsMessengerCallbackDataEXT* data) {
+
+    captured.fetch_add(1, std::memory_order_relaxed);
+
+    if (!(severity & severities.load(std::memory_order_relaxed)) || !(messageTypes & types.load(std::memory_order_relaxed))) {
+        filtered.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Before start() or after stop() there's no thread to hand it to. Only the instance's own create and destroy
+    // can get here, so doing it the slow way is fine.
+    if (!running.load(std::memory_order_acquire)) {
+        std::cerr << "validation layer: " << data->pMessage << "\n";
+        return;
+    }
+
+    // The layers give most messages a stable id. The few without one (0) are told apart by their text instead.
+    // The top bits keep the two kinds of key apart and make sure neither is ever 0.
+    uint64_t key;
+    if (data->messageIdNumber != 0) {
+        key = (1ull << 32) | static_cast<uint32_t>(data->messageIdNumber);
+    }
+    else {
+        key = 14695981039346656037ull;      // FNV-1a
+        for (const char* c = data->pMessage; c != nullptr && *c != '\0'; c++) {
+            key = (key ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+        }
+        key |= 1ull << 63;
+    }
+
+    bool firstTime = countOccurrence(key) == 0;
+    bool performance = messageTypes & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+
+    if (firstTime) {
+        push(EntryKind::Message, severity, messageTypes, key, data->pMessageIdName, data->pMessage);
+    }
+    else if (performance) {
+        // Repeats still count towards the frame summary, but the text isn't copied again
+        push(EntryKind::Repeat, severity, messageTypes, key, data->pMessageIdName, nullptr);
+    }
+}
+
+void ValidationSink::endFrame() {
+
+    if (!running.load(std::memory_order_relaxed)) return;
+
+    push(EntryKind::FrameEnd, VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, 0, 0, nullptr, nullptr);
+    frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ValidationSink::drain() {
+
+    Entry entry;
+    bool wroteAnything = false;
+
+    while (pop(entry)) {
+        if (entry.kind == EntryKind::FrameEnd) {
+            if (consumer->framePerformance.empty()) continue;
+
+            // Messages raised on other threads can land after the marker of the frame they belong to, in which case
+            // they're counted towards the next one
+            std::cerr << "validation layer: frame " << entry.frame << " performance warnings:";
+            for (const auto& [name, count] : consumer->framePerformance) {
+                std::cerr << " " << name << " x" << count;
+            }
+            std::cerr << "\n";
+
+            consumer->framePerformance.clear();
+            consumer->framesWithPerformanceWarnings++;
+            wroteAnything = true;
+            continue;
+        }
+
+        if (entry.types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) {
+            consumer->framePerformance[entry.name[0] != '\0' ? entry.name : "(unnamed)"]++;
+        }
+
+        if (entry.kind == EntryKind::Message) {
+            consumer->seen[entry.key] = entry.name[0] != '\0' ? entry.name : entry.text;
+            std::cerr << "validation layer (" << severityName(entry.severity) << "): " << entry.text << "\n";
+            wroteAnything = true;
+        }
+    }
+
+    if (wroteAnything) {
+        std::cerr.flush();
+    }
+}
+
+void ValidationSink::consumerLoop() {
+
+    // Polls rather than waiting on a condition variable, which would put a mutex back into the callback. A couple
+    // of milliseconds of latency on a log line doesn't matter.
+    while (running.load(std::memory_order_acquire)) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    // Whatever was pushed before stop() flipped the flag
+    drain();
+}
+
+void ValidationSink::report(std::ostream& out) const {
+
+    uint64_t unique = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> repeated;   // Key, count
+
+    for (uint32_t i = 0; i < dedupCapacity; i++) {
+        uint64_t key = dedupKeys[i].load(std::memory_order_relaxed);
+        if (key == 0) continue;
+
+        unique++;
+        uint64_t count = dedupCounts[i].load(std::memory_order_relaxed);
+        if (count > 1) {
+            repeated.push_back({ key, count });
+        }
+    }
+
+    out << "\nValidation: " << captured.load() << " messages (" << filtered.load() << " filtered out), " << unique
+        << " unique, " << dropped.load() << " dropped with the ring full";
+    if (dedupOverflow > 0) {
+        out << ", " << dedupOverflow.load() << " past the dedup table";
+    }
+    out << "\n    frames with performance warnings: " << consumer->framesWithPerformanceWarnings << "\n";
+
+    if (repeated.empty()) return;
+
+    // Most frequent first, which is usually where the cost is
+    std::sort(repeated.begin(), repeated.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    repeated.resize(std::min<size_t>(repeated.size(), 20));
+
+    out << "    repeated:\n";
+    for (const auto& [key, count] : repeated) {
+        auto seen = consumer->seen.find(key);
+        std::string name = seen != consumer->seen.end() ? seen->second.substr(0, 80) : "(not printed)";
+        out << "      " << count << "x " << name << "\n";
+    }
+}
@@ -0,0 +1,127 @@
+// validation-sink.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include "include.h"
+
+// Which validation messages get through. The debug messenger is registered with these, so the layer doesn't even
+// generate anything outside them, and the sink applies them again at runtime through setFilter.
+struct ValidationFilter {
+	VkDebugUtilsMessageSeverityFlagsEXT severities =
+		VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	VkDebugUtilsMessageTypeFlagsEXT types = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+};
+
+// "verbose", "info", "warning" or "error", meaning that severity and everything worse. Returns 0 if unknown.
+VkDebugUtilsMessageSeverityFlagsEXT parseValidationSeverity(const char* name);
+
+// Comma separated list of "general", "validation" and "performance". Returns 0 if any of them is unknown.
+VkDebugUtilsMessageTypeFlagsEXT parseValidationTypes(const char* list);
+
+// Takes validation layer messages off the thread that raised them.
+//
+// The debug callback runs inside whatever Vulkan call triggered the message, so anything slow in it (like writing
+// to a console) makes that call slow. Here the callback only filters, deduplicates and copies the message into a
+// fixed-size lock-free ring; a background thread does the printing.
+//
+// Deduplication is by messageIdNumber (or a hash of the text for messages without one). Only the first occurrence
+// of each is printed, and the rest are counted in a table the callback updates with a single atomic increment, so a
+// message that fires every draw costs almost nothing after the first time. The counts are in the exit report.
+//
+// PERFORMANCE messages are additionally gathered per frame: after each endFrame() the background thread prints one
+// line listing the performance warnings raised during that frame and how often.
+//
+// If the ring fills up the message is dropped (and counted) rather than blocking the driver.
+
+class ValidationSink {
+
+public:
+
+	ValidationSink();
+	~ValidationSink();
+
+	ValidationSink(const ValidationSink&) = delete;
+	ValidationSink& operator=(const ValidationSink&) = delete;
+
+	void start(const ValidationFilter& filter);
+
+	// Prints whatever is still queued, then stops the background thread
+	void stop();
+
+	void setFilter(const ValidationFilter& filter);
+	ValidationFilter filter() const;
+
+	// Called from the debug callback, on any thread
+	void capture(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT types,
+		const VkDebugUtilsMessengerCallbackDataEXT* data);
+
+	// Closes the current frame's performance summary
+	void endFrame();
+
+	void report(std::ostream& out) const;
+
+private:
+
+	enum class EntryKind : uint8_t {
+		Message,        // First occurrence, with its text
+		Repeat,         // A PERFORMANCE message seen before, only counted towards the frame summary
+		FrameEnd
+	};
+
+	struct Entry {
+		EntryKind kind;
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+		VkDebugUtilsMessageTypeFlagsEXT types;
+		uint64_t key;
+		uint64_t frame;
+		char name[96];
+		char text[1024];
+	};
+
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		Entry entry;
+	};
+
+	struct Consumer;
+
+	bool push(EntryKind kind, VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT types,
+		uint64_t key, const char* name, const char* text);
+	bool pop(Entry& entry);
+	uint64_t countOccurrence(uint64_t key);
+	void consumerLoop();
+	void drain();
+
+	static constexpr uint32_t ringCapacity = 1024;     // Power of two
+	static constexpr uint32_t dedupCapacity = 4096;    // Power of two
+
+	// Bounded multi-producer queue after Dmitry Vyukov's. A slot whose sequence equals the write position is free
+	// for that position; the producer that claims it publishes by bumping the sequence by one, and the consumer
+	// frees it again by moving it a whole lap ahead.
+	std::unique_ptr<Slot[]> slots;
+	alignas(64) std::atomic<uint64_t> head{ 0 };
+	alignas(64) uint64_t tail = 0;                      // Consumer only
+
+	// Open-addressed, insert-only table of message keys and how often each was seen. Key 0 marks an empty entry.
+	std::unique_ptr<std::atomic<uint64_t>[]> dedupKeys;
+	std::unique_ptr<std::atomic<uint64_t>[]> dedupCounts;
+
+	std::atomic<VkDebugUtilsMessageSeverityFlagsEXT> severities{ 0 };
+	std::atomic<VkDebugUtilsMessageTypeFlagsEXT> types{ 0 };
+	std::atomic<uint64_t> frame{ 0 };
+
+	std::atomic<bool> running{ false };
+	std::thread thread;
+	std::unique_ptr<Consumer> consumer;
+
+	std::atomic<uint64_t> captured{ 0 };
+	std::atomic<uint64_t> filtered{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+	std::atomic<uint64_t> dedupOverflow{ 0 };
+};
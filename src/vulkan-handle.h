@@ -0,0 +1,133 @@
+// vulkan-handle.h
+
+#pragma once
+
+#include <utility>
+#include "include.h"
+
+// A Vulkan handle that destroys itself: move-only, null when default constructed or moved from, destroyed by reset()
+// or going out of scope. Members declared in creation order are then torn down in the right order by construction,
+// and a throw halfway through startup destroys whatever was created so far.
+//
+// It converts to the raw handle, so it can be passed to Vulkan calls as it is. Create into a raw handle first and
+// hand it over, since a create call can't write through the wrapper.
+//
+// The destroy function is given rather than looked up from the handle's type: non-dispatchable handles are all the
+// same uint64_t on 32-bit builds, and extension functions like vkDestroyDebugUtilsMessengerEXT have to be loaded.
+
+template <typename Handle, typename Parent = void>
+class UniqueHandle {
+
+public:
+
+	using Destroy = void (VKAPI_PTR*)(Parent parent, Handle handle, const VkAllocationCallbacks* allocationCallbacks);
+
+	UniqueHandle() = default;
+	UniqueHandle(Parent parent, Handle handle, Destroy destroy, const VkAllocationCallbacks* allocationCallbacks)
+		: owner(parent), handle(handle), destroyFunction(destroy), callbacks(allocationCallbacks) {}
+	~UniqueHandle() { reset(); }
+
+	UniqueHandle(const UniqueHandle&) = delete;
+	UniqueHandle& operator=(const UniqueHandle&) = delete;
+
+	UniqueHandle(UniqueHandle&& other) noexcept
+		: owner(other.owner), handle(std::exchange(other.handle, VK_NULL_HANDLE)), destroyFunction(other.destroyFunction),
+		callbacks(other.callbacks) {}
+
+	UniqueHandle& operator=(UniqueHandle&& other) noexcept {
+		if (this != &other) {
+			reset();
+			owner = other.owner;
+			handle = std::exchange(other.handle, VK_NULL_HANDLE);
+			destroyFunction = other.destroyFunction;
+			callbacks = other.callbacks;
+		}
+		return *this;
+	}
+
+	void reset() {
+		if (handle != VK_NULL_HANDLE && destroyFunction != nullptr) {
+			destroyFunction(owner, handle, callbacks);
+		}
+		handle = VK_NULL_HANDLE;
+	}
+
+	// Gives up ownership without destroying it
+	Handle release() { return std::exchange(handle, VK_NULL_HANDLE); }
+
+	Handle get() const { return handle; }
+	operator Handle() const { return handle; }
+
+	Parent parent() const { return owner; }
+	Destroy destroyer() const { return destroyFunction; }
+	const VkAllocationCallbacks* allocationCallbacks() const { return callbacks; }
+
+private:
+
+	Parent owner = VK_NULL_HANDLE;
+	Handle handle = VK_NULL_HANDLE;
+	Destroy destroyFunction = nullptr;
+	const VkAllocationCallbacks* callbacks = nullptr;
+};
+
+// The instance and the device, which have no parent to be destroyed through
+template <typename Handle>
+class UniqueHandle<Handle, void> {
+
+public:
+
+	using Destroy = void (VKAPI_PTR*)(Handle handle, const VkAllocationCallbacks* allocationCallbacks);
+
+	UniqueHandle() = default;
+	UniqueHandle(Handle handle, Destroy destroy, const VkAllocationCallbacks* allocationCallbacks)
+		: handle(handle), destroyFunction(destroy), callbacks(allocationCallbacks) {}
+	~UniqueHandle() { reset(); }
+
+	UniqueHandle(const UniqueHandle&) = delete;
+	UniqueHandle& operator=(const UniqueHandle&) = delete;
+
+	UniqueHandle(UniqueHandle&& other) noexcept
+		: handle(std::exchange(other.handle, VK_NULL_HANDLE)), destroyFunction(other.destroyFunction), callbacks(other.callbacks) {}
+
+	UniqueHandle& operator=(UniqueHandle&& other) noexcept {
+		if (this != &other) {
+			reset();
+			handle = std::exchange(other.handle, VK_NULL_HANDLE);
+			destroyFunction = other.destroyFunction;
+			callbacks = other.callbacks;
+		}
+		return *this;
+	}
+
+	void reset() {
+		if (handle != VK_NULL_HANDLE && destroyFunction != nullptr) {
+			destroyFunction(handle, callbacks);
+		}
+		handle = VK_NULL_HANDLE;
+	}
+
+	Handle release() { return std::exchange(handle, VK_NULL_HANDLE); }
+
+	Handle get() const { return handle; }
+	operator Handle() const { return handle; }
+
+private:
+
+	Handle handle = VK_NULL_HANDLE;
+	Destroy destroyFunction = nullptr;
+	const VkAllocationCallbacks* callbacks = nullptr;
+};
+
+using UniqueInstance = UniqueHandle<VkInstance>;
+using UniqueDevice = UniqueHandle<VkDevice>;
+
+using UniqueSurface = UniqueHandle<VkSurfaceKHR, VkInstance>;
+using UniqueDebugMessenger = UniqueHandle<VkDebugUtilsMessengerEXT, VkInstance>;
+
+// The ones held somewhere. Buffers and images come from the device allocator, which frees their memory with them
+using UniqueImageView = UniqueHandle<VkImageView, VkDevice>;
+using UniqueFence = UniqueHandle<VkFence, VkDevice>;
+using UniqueSemaphore = UniqueHandle<VkSemaphore, VkDevice>;
+using UniqueCommandPool = UniqueHandle<VkCommandPool, VkDevice>;
+using UniqueDescriptorSetLayout = UniqueHandle<VkDescriptorSetLayout, VkDevice>;
+using UniqueSwapchain = UniqueHandle<VkSwapchainKHR, VkDevice>;